@@ -1,7 +1,22 @@
-/* aho_corasick.c - Memory-optimized implementation of Aho-Corasick algorithm
+/* aho_corasick.c - Compact, cache-friendly implementation of Aho-Corasick algorithm
  *
- * This implementation uses a more memory-efficient representation for trie nodes
- * to reduce the 2KB overhead per node (256 pointers x 8 bytes on 64-bit systems).
+ * Patterns are first inserted into a small build-time trie (first-child / next-sibling
+ * lists, no 256-pointer arrays), then compiled into a flat automaton:
+ *
+ *  - Bytes are mapped to equivalence classes. Every byte that never occurs in a pattern
+ *    shares class 0, so transition rows are only as wide as the pattern alphabet.
+ *  - States are numbered in BFS order and stored in parallel contiguous arrays.
+ *  - The shallow states (all of them for small pattern sets) get a full transition row
+ *    with failure links already resolved, so scanning them is one table lookup per byte.
+ *  - Deeper states keep only their goto edges, sorted by class, plus a failure link.
+ *  - Outputs are stored flat per state, with a dictionary link to the next state on the
+ *    failure chain that has outputs, so reporting never walks output-less states.
+ *
+ * While the automaton sits in the root state only a byte that starts some pattern can
+ * move it anywhere, so the scan jumps straight to the next such byte with a vectorized
+ * byte-set search (memchr / packed compares for 1-3 bytes, nibble-mask "shufti" lookups
+ * on AVX2, SSSE3 or NEON otherwise) and only runs the automaton from there. The x86
+ * variant is chosen when the trie is built, from the features of the running CPU.
  */
 
 #include <stdio.h>
@@ -14,100 +29,157 @@
 #include "krep.h"         // Include main header FIRST for search_params_t definition
 #include "aho_corasick.h" // Include the header defining ac_trie_t forward decl
 
-typedef struct ac_node
-{
-    struct ac_node *children[256]; // Child nodes for each character
-    struct ac_node *fail_link;     // Failure link for state transitions
-    size_t *output_indices;        // Array of pattern indices ending at this node
-    int num_outputs;               // Number of pattern indices ending exactly here
-    int capacity_outputs;          // Capacity of the output_indices array
-} ac_node_t;
+// SIMD intrinsics for the start-byte prefilter (flags come from the Makefile)
+#if KREP_USE_AVX2
+#include <immintrin.h>
+#endif
+#if KREP_USE_NEON && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define AC_NO_STATE UINT32_MAX
+
+// Layout selection: pattern sets up to AC_DENSE_ALL_MAX_PATTERNS get a full DFA (every
+// state has a row) when it fits AC_DENSE_MAX_BYTES; larger sets only get rows for states
+// up to AC_DENSE_DEPTH, still capped by the same budget.
+#define AC_DENSE_ALL_MAX_PATTERNS 256
+#define AC_DENSE_MAX_BYTES (16 * 1024 * 1024)
+#define AC_DENSE_DEPTH 3
+
+// The prefilter is switched off for the rest of a scan once it keeps landing on start
+// bytes almost immediately (dense start-byte sets), where it only adds overhead.
+#define AC_PREFILTER_MIN_GAP 16
+#define AC_PREFILTER_MAX_MISSES 64
+
+// Vector start-byte scan. Returns true with *pos at a candidate (possibly a false
+// positive from shared shufti buckets), or false with *pos at the start of the tail
+// too short for a full vector, which the caller scans byte by byte.
+typedef bool (*ac_scan_func_t)(const ac_trie_t *trie, const unsigned char *text, size_t *pos, size_t text_len);
+static ac_scan_func_t ac_select_scan(const ac_trie_t *trie);
 
 struct ac_trie
 {
-    ac_node_t *root;     // Root node of the trie
     size_t num_patterns; // Number of patterns in the trie
     bool case_sensitive; // Whether search is case-sensitive
-};
 
-// Create a new AC node
-static ac_node_t *ac_node_create()
-{
-    ac_node_t *node = calloc(1, sizeof(ac_node_t));
-    if (!node)
-    {
-        perror("Failed to allocate memory for Aho-Corasick node");
-        return NULL;
-    }
-    // Initialize children array to NULL
-    memset(node->children, 0, sizeof(node->children));
+    uint32_t num_states;   // Total states; state 0 is the root
+    uint32_t num_classes;  // Byte equivalence classes (class 0 = bytes in no pattern)
+    uint32_t dense_states; // States [0, dense_states) have a full transition row
+    uint16_t byte_class[256]; // Byte -> class, with case folding applied
+
+    uint32_t *delta;       // dense_states * num_classes resolved transitions
+    uint32_t *fail;        // Failure link per state
+    uint32_t *edge_start;  // num_states + 1 offsets into edge_class / edge_target
+    uint16_t *edge_class;  // Goto edge classes, sorted per state
+    uint32_t *edge_target; // Goto edge targets
+    uint32_t *out_start;   // num_states + 1 offsets into outputs
+    uint32_t *outputs;     // Pattern indices ending exactly at each state
+    uint32_t *dict_link;   // Nearest non-root failure ancestor with outputs
+    uint8_t *has_output;   // Non-zero if a match is reported on entering the state
+
+    // Start-byte prefilter: bytes that leave the root state
+    uint32_t num_start_bytes;
+    unsigned char start_list[3];  // The start bytes when there are at most 3
+    uint8_t shufti_lo[16];        // Bucket bits per low nibble
+    uint8_t shufti_hi[16];        // Bucket bit per high nibble
+    ac_scan_func_t scan;          // Vector scan for this CPU, NULL for scalar only
+};
 
-    // Initialize output_indices as NULL (allocated later if needed)
-    node->output_indices = NULL;
-    node->num_outputs = 0;
-    node->capacity_outputs = 0;
-    node->fail_link = NULL;
+// --- Build-time trie ---
 
-    return node;
-}
+typedef struct
+{
+    uint32_t first_child;  // Build index of first child, AC_NO_STATE if none
+    uint32_t next_sibling; // Build index of next sibling, AC_NO_STATE if none
+    uint16_t cls;          // Class of the edge leading to this node
+} ac_build_node_t;
 
-// Add pattern index to node outputs
-static bool ac_node_add_output(ac_node_t *node, size_t pattern_index)
+typedef struct
 {
-    if (!node)
-        return false;
+    ac_build_node_t *nodes;
+    uint32_t count;
+    uint32_t capacity;
+} ac_builder_t;
 
-    // Check if we need to allocate or resize
-    if (node->num_outputs >= node->capacity_outputs)
+static uint32_t ac_builder_add(ac_builder_t *b, uint16_t cls)
+{
+    if (b->count == b->capacity)
     {
-        int new_capacity = node->capacity_outputs == 0 ? 4 : node->capacity_outputs * 2;
-        // Check for potential integer overflow before multiplication
-        if (new_capacity < node->capacity_outputs)
-        {
-            perror("Integer overflow calculating new capacity for Aho-Corasick node outputs");
-            return false;
-        }
-        size_t *new_outputs = realloc(node->output_indices, new_capacity * sizeof(size_t));
-        if (!new_outputs)
+        uint32_t new_capacity = b->capacity ? b->capacity * 2 : 256;
+        if (new_capacity <= b->capacity)
+            return AC_NO_STATE; // Overflow
+        ac_build_node_t *nodes = realloc(b->nodes, (size_t)new_capacity * sizeof(ac_build_node_t));
+        if (!nodes)
         {
-            perror("Failed to resize Aho-Corasick node outputs");
-            return false;
+            perror("Failed to allocate memory for Aho-Corasick node");
+            return AC_NO_STATE;
         }
-        node->output_indices = new_outputs;
-        node->capacity_outputs = new_capacity;
+        b->nodes = nodes;
+        b->capacity = new_capacity;
     }
-
-    // Add the pattern index
-    node->output_indices[node->num_outputs++] = pattern_index;
-    return true;
+    b->nodes[b->count].first_child = AC_NO_STATE;
+    b->nodes[b->count].next_sibling = AC_NO_STATE;
+    b->nodes[b->count].cls = cls;
+    return b->count++;
 }
 
-// Free an AC node and all its children recursively
-static void ac_node_free(ac_node_t *node)
+// Find or create the child of parent for cls. Children are kept sorted by class.
+static uint32_t ac_builder_child(ac_builder_t *b, uint32_t parent, uint16_t cls)
 {
-    if (!node)
-        return;
-
-    // Recursively free children
-    for (int i = 0; i < 256; i++)
+    uint32_t prev = AC_NO_STATE;
+    uint32_t cur = b->nodes[parent].first_child;
+    while (cur != AC_NO_STATE && b->nodes[cur].cls < cls)
     {
-        if (node->children[i])
-        {
-            ac_node_free(node->children[i]);
-        }
+        prev = cur;
+        cur = b->nodes[cur].next_sibling;
     }
+    if (cur != AC_NO_STATE && b->nodes[cur].cls == cls)
+        return cur;
+
+    uint32_t node = ac_builder_add(b, cls);
+    if (node == AC_NO_STATE)
+        return AC_NO_STATE;
+    b->nodes[node].next_sibling = cur;
+    if (prev == AC_NO_STATE)
+        b->nodes[parent].first_child = node;
+    else
+        b->nodes[prev].next_sibling = node;
+    return node;
+}
 
-    // Free outputs array if allocated
-    if (node->output_indices)
+// Goto transition of a compiled state via its sorted sparse edges
+static inline uint32_t ac_goto(const ac_trie_t *trie, uint32_t state, uint16_t cls)
+{
+    uint32_t lo = trie->edge_start[state];
+    uint32_t hi = trie->edge_start[state + 1];
+    while (lo < hi)
     {
-        free(node->output_indices);
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint16_t mc = trie->edge_class[mid];
+        if (mc == cls)
+            return trie->edge_target[mid];
+        if (mc < cls)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return AC_NO_STATE;
+}
 
-    // Free the node itself
-    free(node);
+// Full transition (goto + failure links) from any state
+static inline uint32_t ac_next_state(const ac_trie_t *trie, uint32_t state, uint16_t cls)
+{
+    while (state >= trie->dense_states)
+    {
+        uint32_t next = ac_goto(trie, state, cls);
+        if (next != AC_NO_STATE)
+            return next;
+        state = trie->fail[state];
+    }
+    return trie->delta[(size_t)state * trie->num_classes + cls];
 }
 
-// Build the Aho-Corasick Trie
+// Build the Aho-Corasick automaton
 ac_trie_t *ac_trie_build(const search_params_t *params)
 {
     if (!params || params->num_patterns == 0)
@@ -115,159 +187,216 @@ ac_trie_t *ac_trie_build(const search_params_t *params)
         return NULL;
     }
 
-    // Allocate the trie structure
-    ac_trie_t *trie = malloc(sizeof(ac_trie_t));
+    ac_trie_t *trie = calloc(1, sizeof(ac_trie_t));
     if (!trie)
     {
         perror("Failed to allocate Aho-Corasick trie");
         return NULL;
     }
-
-    // Create the root node
-    trie->root = ac_node_create();
-    if (!trie->root)
-    {
-        free(trie);
-        return NULL;
-    }
-    trie->root->fail_link = trie->root; // Root's failure link points to itself
-
     trie->num_patterns = params->num_patterns;
     trie->case_sensitive = params->case_sensitive;
 
-    // Build the trie - Insert all patterns
+    // --- Byte equivalence classes ---
+    // Each (folded) byte used by a pattern gets its own class; all others share class 0.
+    uint16_t folded_class[256] = {0};
+    uint32_t num_classes = 1;
     for (size_t p = 0; p < params->num_patterns; p++)
     {
         const unsigned char *pattern = (const unsigned char *)params->patterns[p];
-        size_t pattern_len = params->pattern_lens[p];
-
-        // Handle empty pattern: Add index 0 to root's output if an empty pattern exists
-        if (pattern_len == 0)
+        for (size_t i = 0; i < params->pattern_lens[p]; i++)
         {
-            if (!ac_node_add_output(trie->root, p))
-            {
-                ac_trie_free(trie);
-                return NULL;
-            }
-            continue;
+            unsigned char c = params->case_sensitive ? pattern[i] : lower_table[pattern[i]];
+            if (folded_class[c] == 0)
+                folded_class[c] = (uint16_t)num_classes++;
         }
+    }
+    for (int b = 0; b < 256; b++)
+    {
+        unsigned char c = params->case_sensitive ? (unsigned char)b : lower_table[b];
+        trie->byte_class[b] = folded_class[c];
+    }
+    trie->num_classes = num_classes;
 
-        ac_node_t *current = trie->root;
-
-        // Insert each character of the pattern
-        for (size_t i = 0; i < pattern_len; i++)
-        {
-            unsigned char c_orig = pattern[i];
-            unsigned char c = params->case_sensitive ? c_orig : lower_table[c_orig];
-
-            // Create child node if it doesn't exist
-            if (!current->children[c])
-            {
-                current->children[c] = ac_node_create();
-                if (!current->children[c])
-                {
-                    // Handle allocation failure
-                    ac_trie_free(trie);
-                    return NULL;
-                }
-            }
-
-            // Advance to the child
-            current = current->children[c];
-        }
+    // --- Insert all patterns into the build trie ---
+    ac_builder_t builder = {0};
+    uint32_t *terminal = malloc(params->num_patterns * sizeof(uint32_t)); // Node where each pattern ends
+    uint32_t *order = NULL;
+    uint32_t *new_id = NULL;
+    uint32_t *depth = NULL;
+    if (!terminal || ac_builder_add(&builder, 0) == AC_NO_STATE)
+        goto build_failed;
 
-        // Mark this node with the pattern index (used later for output)
-        if (!ac_node_add_output(current, p))
+    for (size_t p = 0; p < params->num_patterns; p++)
+    {
+        const unsigned char *pattern = (const unsigned char *)params->patterns[p];
+        uint32_t current = 0;
+        for (size_t i = 0; i < params->pattern_lens[p]; i++)
         {
-            ac_trie_free(trie);
-            return NULL;
+            unsigned char c = params->case_sensitive ? pattern[i] : lower_table[pattern[i]];
+            current = ac_builder_child(&builder, current, folded_class[c]);
+            if (current == AC_NO_STATE)
+                goto build_failed;
         }
+        terminal[p] = current; // Empty patterns end at the root
     }
 
-    // --- Build failure links using BFS with dynamic queue ---
-    size_t queue_capacity = 64; // Initial capacity
-    ac_node_t **queue = malloc(queue_capacity * sizeof(ac_node_t *));
-    if (!queue)
+    // --- Number states in BFS order (children in class order) ---
+    uint32_t n = builder.count;
+    order = malloc((size_t)n * sizeof(uint32_t));
+    new_id = malloc((size_t)n * sizeof(uint32_t));
+    depth = malloc((size_t)n * sizeof(uint32_t));
+    trie->fail = malloc((size_t)n * sizeof(uint32_t));
+    trie->edge_start = malloc(((size_t)n + 1) * sizeof(uint32_t));
+    trie->edge_class = malloc((size_t)n * sizeof(uint16_t)); // n - 1 edges, at least one slot
+    trie->edge_target = malloc((size_t)n * sizeof(uint32_t));
+    trie->out_start = calloc((size_t)n + 1, sizeof(uint32_t));
+    trie->outputs = malloc((params->num_patterns ? params->num_patterns : 1) * sizeof(uint32_t));
+    trie->dict_link = malloc((size_t)n * sizeof(uint32_t));
+    trie->has_output = calloc(n, sizeof(uint8_t));
+    if (!order || !new_id || !depth || !trie->fail || !trie->edge_start || !trie->edge_class ||
+        !trie->edge_target || !trie->out_start || !trie->outputs || !trie->dict_link || !trie->has_output)
     {
-        perror("Failed to allocate initial queue for Aho-Corasick BFS");
-        ac_trie_free(trie);
-        return NULL;
+        perror("Failed to allocate Aho-Corasick automaton");
+        goto build_failed;
     }
-
-    size_t queue_front = 0;
-    size_t queue_rear = 0;
-
-    // Add root's immediate children to the queue and set their failure links to root
-    for (int c_val = 0; c_val < 256; c_val++) // Use c_val to avoid shadowing
+    trie->num_states = n;
+
+    uint32_t head = 0, tail = 0;
+    order[tail++] = 0;
+    new_id[0] = 0;
+    depth[0] = 0;
+    uint32_t edge_count = 0;
+    while (head < tail)
     {
-        unsigned char c = (unsigned char)c_val; // Cast for indexing
-        if (trie->root->children[c])
+        uint32_t old = order[head];
+        uint32_t id = head++;
+        trie->edge_start[id] = edge_count;
+        for (uint32_t child = builder.nodes[old].first_child; child != AC_NO_STATE; child = builder.nodes[child].next_sibling)
         {
-            ac_node_t *child = trie->root->children[c];
-            child->fail_link = trie->root; // Direct children fail to root
-
-            // Enqueue
-            if (queue_rear >= queue_capacity)
-            {
-                queue_capacity *= 2;
-                ac_node_t **new_queue = realloc(queue, queue_capacity * sizeof(ac_node_t *));
-                if (!new_queue)
-                {
-                    perror("Failed to resize queue for Aho-Corasick BFS");
-                    free(queue);
-                    ac_trie_free(trie);
-                    return NULL;
-                }
-                queue = new_queue;
-            }
-            queue[queue_rear++] = child;
+            new_id[child] = tail;
+            depth[tail] = depth[id] + 1;
+            order[tail++] = child;
+            trie->edge_class[edge_count] = builder.nodes[child].cls;
+            trie->edge_target[edge_count] = new_id[child];
+            edge_count++;
         }
     }
+    trie->edge_start[n] = edge_count;
 
-    // BFS to build failure links
-    while (queue_front < queue_rear)
+    // --- Failure links (BFS order guarantees parents are resolved first) ---
+    trie->fail[0] = 0;
+    for (uint32_t s = 0; s < n; s++)
     {
-        ac_node_t *current = queue[queue_front++]; // Dequeue
-
-        // Process each child of current node
-        for (int c_val = 0; c_val < 256; c_val++) // Use c_val to avoid shadowing
+        for (uint32_t e = trie->edge_start[s]; e < trie->edge_start[s + 1]; e++)
         {
-            unsigned char c = (unsigned char)c_val; // Cast to unsigned char for indexing
-            if (current->children[c])
+            uint32_t child = trie->edge_target[e];
+            uint16_t cls = trie->edge_class[e];
+            if (s == 0)
             {
-                ac_node_t *child = current->children[c];
+                trie->fail[child] = 0;
+                continue;
+            }
+            uint32_t f = trie->fail[s];
+            uint32_t next;
+            while ((next = ac_goto(trie, f, cls)) == AC_NO_STATE && f != 0)
+                f = trie->fail[f];
+            trie->fail[child] = (next != AC_NO_STATE) ? next : 0;
+        }
+    }
 
-                // Enqueue child
-                if (queue_rear >= queue_capacity)
-                {
-                    queue_capacity *= 2;
-                    ac_node_t **new_queue = realloc(queue, queue_capacity * sizeof(ac_node_t *));
-                    if (!new_queue)
-                    {
-                        perror("Failed to resize queue during Aho-Corasick BFS");
-                        free(queue);
-                        ac_trie_free(trie);
-                        return NULL;
-                    }
-                    queue = new_queue;
-                }
-                queue[queue_rear++] = child;
+    // --- Flat outputs, in pattern insertion order per state ---
+    for (size_t p = 0; p < params->num_patterns; p++)
+        trie->out_start[new_id[terminal[p]] + 1]++;
+    for (uint32_t s = 0; s < n; s++)
+        trie->out_start[s + 1] += trie->out_start[s];
+    uint32_t *fill = order; // Reuse as per-state write cursor; BFS order is no longer needed
+    memcpy(fill, trie->out_start, (size_t)n * sizeof(uint32_t));
+    for (size_t p = 0; p < params->num_patterns; p++)
+        trie->outputs[fill[new_id[terminal[p]]]++] = (uint32_t)p;
 
-                // Find failure link for this child
-                ac_node_t *failure = current->fail_link;
-                while (failure != trie->root && !failure->children[c])
-                {
-                    failure = failure->fail_link;
-                }
+    // Dictionary links skip failure ancestors without outputs. The root is excluded so
+    // that an empty pattern is never reported at every position.
+    trie->dict_link[0] = AC_NO_STATE;
+    for (uint32_t s = 1; s < n; s++)
+    {
+        uint32_t f = trie->fail[s];
+        if (f != 0 && trie->out_start[f + 1] > trie->out_start[f])
+            trie->dict_link[s] = f;
+        else
+            trie->dict_link[s] = trie->dict_link[f];
+        trie->has_output[s] = (trie->out_start[s + 1] > trie->out_start[s]) || trie->dict_link[s] != AC_NO_STATE;
+    }
 
-                // Set the failure link
-                child->fail_link = failure->children[c] ? failure->children[c] : trie->root;
-            }
-        }
+    // --- Dense rows for the hot states ---
+    size_t row_bytes = (size_t)num_classes * sizeof(uint32_t);
+    size_t budget_rows = AC_DENSE_MAX_BYTES / row_bytes;
+    uint32_t dense = n;
+    if (params->num_patterns > AC_DENSE_ALL_MAX_PATTERNS || n > budget_rows)
+    {
+        // BFS order makes the shallow states a prefix
+        dense = 0;
+        while (dense < n && depth[dense] <= AC_DENSE_DEPTH)
+            dense++;
+        if (dense > budget_rows)
+            dense = (uint32_t)budget_rows;
+        if (dense == 0)
+            dense = 1; // The root always has a row
+    }
+    trie->dense_states = dense;
+    trie->delta = malloc((size_t)dense * row_bytes);
+    if (!trie->delta)
+    {
+        perror("Failed to allocate Aho-Corasick transition table");
+        goto build_failed;
+    }
+    for (uint32_t s = 0; s < dense; s++)
+    {
+        uint32_t *row = trie->delta + (size_t)s * num_classes;
+        if (s == 0)
+            memset(row, 0, row_bytes);
+        else // fail[s] has smaller depth, hence a smaller BFS index and a ready row
+            memcpy(row, trie->delta + (size_t)trie->fail[s] * num_classes, row_bytes);
+        for (uint32_t e = trie->edge_start[s]; e < trie->edge_start[s + 1]; e++)
+            row[trie->edge_class[e]] = trie->edge_target[e];
     }
 
-    free(queue);
+    // --- Start-byte set for the prefilter ---
+    // Each high nibble gets its own bucket bit; with more than 8 distinct high nibbles
+    // buckets are shared, which only adds false candidates (the automaton decides).
+    uint8_t hi_bucket[16];
+    uint32_t num_buckets = 0;
+    memset(hi_bucket, 0xff, sizeof(hi_bucket));
+    for (int b = 0; b < 256; b++)
+    {
+        if (trie->delta[trie->byte_class[b]] == 0)
+            continue;
+        if (trie->num_start_bytes < 3)
+            trie->start_list[trie->num_start_bytes] = (unsigned char)b;
+        trie->num_start_bytes++;
+
+        int hi = b >> 4;
+        if (hi_bucket[hi] == 0xff)
+            hi_bucket[hi] = (uint8_t)(num_buckets++ % 8);
+        trie->shufti_hi[hi] = (uint8_t)(1u << hi_bucket[hi]);
+        trie->shufti_lo[b & 0x0f] |= (uint8_t)(1u << hi_bucket[hi]);
+    }
+    trie->scan = ac_select_scan(trie);
+
+    free(builder.nodes);
+    free(terminal);
+    free(order);
+    free(new_id);
+    free(depth);
     return trie;
+
+build_failed:
+    free(builder.nodes);
+    free(terminal);
+    free(order);
+    free(new_id);
+    free(depth);
+    ac_trie_free(trie);
+    return NULL;
 }
 
 // Free the Aho-Corasick Trie
@@ -276,17 +405,37 @@ void ac_trie_free(ac_trie_t *trie)
     if (!trie)
         return;
 
-    // Free the root node and all its children
-    ac_node_free(trie->root);
-
-    // Free the trie structure
+    free(trie->delta);
+    free(trie->fail);
+    free(trie->edge_start);
+    free(trie->edge_class);
+    free(trie->edge_target);
+    free(trie->out_start);
+    free(trie->outputs);
+    free(trie->dict_link);
+    free(trie->has_output);
     free(trie);
 }
 
 // Check if the root node has outputs (used for empty pattern matching in empty files)
 bool ac_trie_root_has_outputs(const ac_trie_t *trie)
 {
-    return (trie != NULL && trie->root != NULL && trie->root->num_outputs > 0);
+    return (trie != NULL && trie->out_start != NULL && trie->out_start[1] > trie->out_start[0]);
+}
+
+// Approximate heap footprint of the compiled automaton
+size_t ac_trie_memory_usage(const ac_trie_t *trie)
+{
+    if (!trie)
+        return 0;
+    size_t n = trie->num_states;
+    size_t edges = trie->edge_start ? trie->edge_start[n] : 0;
+    return sizeof(ac_trie_t) +
+           (size_t)trie->dense_states * trie->num_classes * sizeof(uint32_t) + // delta
+           n * (sizeof(uint32_t) * 3 + sizeof(uint8_t)) +                     // fail, dict_link, out_start, has_output
+           (n + 1) * sizeof(uint32_t) +                                       // edge_start
+           edges * (sizeof(uint16_t) + sizeof(uint32_t)) +                    // edges
+           trie->num_patterns * sizeof(uint32_t);                             // outputs
 }
 
 // Forward declarations for helper functions (assuming they exist in krep.c or elsewhere)
@@ -295,160 +444,311 @@ extern bool is_whole_word_match(const char *text, size_t text_len, size_t start,
 // Match the declaration in krep.h (remove const)
 extern unsigned char lower_table[256];
 
-// Corrected Aho-Corasick search function
+static inline bool ac_is_start_byte(const ac_trie_t *trie, unsigned char c)
+{
+    return trie->delta[trie->byte_class[c]] != 0;
+}
+
+#if KREP_USE_AVX2
+KREP_TARGET("avx2")
+static bool ac_scan_avx2(const ac_trie_t *trie, const unsigned char *text, size_t *pos_io, size_t text_len)
+{
+    size_t pos = *pos_io;
+    const uint32_t n = trie->num_start_bytes;
+    if (n <= 3)
+    {
+        __m256i c0 = _mm256_set1_epi8((char)trie->start_list[0]);
+        __m256i c1 = _mm256_set1_epi8((char)trie->start_list[1]);
+        __m256i c2 = _mm256_set1_epi8((char)trie->start_list[n == 3 ? 2 : 1]);
+        for (; pos + 32 <= text_len; pos += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(text + pos));
+            __m256i eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, c0), _mm256_cmpeq_epi8(v, c1)),
+                                         _mm256_cmpeq_epi8(v, c2));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(eq);
+            if (mask)
+            {
+                *pos_io = pos + __builtin_ctz(mask);
+                return true;
+            }
+        }
+    }
+    else
+    {
+        const __m256i lo_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)trie->shufti_lo));
+        const __m256i hi_tbl = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)trie->shufti_hi));
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        const __m256i zero = _mm256_setzero_si256();
+        for (; pos + 32 <= text_len; pos += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(text + pos));
+            __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+            __m256i hi = _mm256_shuffle_epi8(hi_tbl, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            __m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero);
+            uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(hit);
+            if (mask)
+            {
+                *pos_io = pos + __builtin_ctz(mask);
+                return true;
+            }
+        }
+    }
+    *pos_io = pos;
+    return false;
+}
+
+// Packed compares for 1-3 start bytes; SSE2 is part of every x86_64 CPU
+KREP_TARGET("sse2")
+static bool ac_scan_sse2(const ac_trie_t *trie, const unsigned char *text, size_t *pos_io, size_t text_len)
+{
+    size_t pos = *pos_io;
+    const uint32_t n = trie->num_start_bytes;
+    __m128i c0 = _mm_set1_epi8((char)trie->start_list[0]);
+    __m128i c1 = _mm_set1_epi8((char)trie->start_list[1]);
+    __m128i c2 = _mm_set1_epi8((char)trie->start_list[n == 3 ? 2 : 1]);
+    for (; pos + 16 <= text_len; pos += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+                                  _mm_cmpeq_epi8(v, c2));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(eq);
+        if (mask)
+        {
+            *pos_io = pos + __builtin_ctz(mask);
+            return true;
+        }
+    }
+    *pos_io = pos;
+    return false;
+}
+
+KREP_TARGET("ssse3")
+static bool ac_scan_ssse3(const ac_trie_t *trie, const unsigned char *text, size_t *pos_io, size_t text_len)
+{
+    size_t pos = *pos_io;
+    const __m128i lo_tbl = _mm_loadu_si128((const __m128i *)trie->shufti_lo);
+    const __m128i hi_tbl = _mm_loadu_si128((const __m128i *)trie->shufti_hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; pos + 16 <= text_len; pos += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i lo = _mm_shuffle_epi8(lo_tbl, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(hi_tbl, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i hit = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero);
+        uint32_t mask = ~(uint32_t)_mm_movemask_epi8(hit) & 0xffffu;
+        if (mask)
+        {
+            *pos_io = pos + __builtin_ctz(mask);
+            return true;
+        }
+    }
+    *pos_io = pos;
+    return false;
+}
+#endif
+
+#if KREP_USE_NEON && defined(__aarch64__)
+static bool ac_scan_neon(const ac_trie_t *trie, const unsigned char *text, size_t *pos_io, size_t text_len)
+{
+    size_t pos = *pos_io;
+    const uint8x16_t lo_tbl = vld1q_u8(trie->shufti_lo);
+    const uint8x16_t hi_tbl = vld1q_u8(trie->shufti_hi);
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    for (; pos + 16 <= text_len; pos += 16)
+    {
+        uint8x16_t v = vld1q_u8(text + pos);
+        uint8x16_t lo = vqtbl1q_u8(lo_tbl, vandq_u8(v, nibble));
+        uint8x16_t hi = vqtbl1q_u8(hi_tbl, vshrq_n_u8(v, 4));
+        if (vmaxvq_u8(vandq_u8(lo, hi)) != 0)
+        {
+            // Candidate in this block; pinpoint it byte by byte
+            for (size_t end = pos + 16; pos < end; pos++)
+            {
+                if (ac_is_start_byte(trie, text[pos]))
+                    break;
+            }
+            *pos_io = pos;
+            return true;
+        }
+    }
+    *pos_io = pos;
+    return false;
+}
+#endif
+
+// Pick the start-byte scan for this CPU once the start-byte set is known
+static ac_scan_func_t ac_select_scan(const ac_trie_t *trie)
+{
+    if (trie->num_start_bytes <= 1)
+        return NULL; // memchr or nothing to find
+#if KREP_USE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ac_scan_avx2;
+    if (trie->num_start_bytes > 3)
+        return __builtin_cpu_supports("ssse3") ? ac_scan_ssse3 : NULL;
+    return __builtin_cpu_supports("sse2") ? ac_scan_sse2 : NULL;
+#elif KREP_USE_NEON && defined(__aarch64__)
+    return ac_scan_neon;
+#else
+    return NULL;
+#endif
+}
+
+// Position of the first byte at or after pos that can leave the root state (text_len if none)
+static size_t ac_skip_to_start(const ac_trie_t *trie, const unsigned char *text, size_t pos, size_t text_len)
+{
+    const uint32_t n = trie->num_start_bytes;
+    if (n == 0)
+        return text_len;
+    if (n == 1)
+    {
+        const unsigned char *hit = memchr(text + pos, trie->start_list[0], text_len - pos);
+        return hit ? (size_t)(hit - text) : text_len;
+    }
+
+    if (trie->scan)
+    {
+        while (trie->scan(trie, text, &pos, text_len))
+        {
+            if (ac_is_start_byte(trie, text[pos]))
+                return pos;
+            pos++; // Shared-bucket false positive
+        }
+    }
+
+    // Scalar tail (and full scan without SIMD)
+    for (; pos < text_len; pos++)
+    {
+        if (ac_is_start_byte(trie, text[pos]))
+            return pos;
+    }
+    return text_len;
+}
+
+// Aho-Corasick search over the compiled automaton
 uint64_t aho_corasick_search(const search_params_t *params,
                              const char *text_start,
                              size_t text_len,
                              match_result_t *result)
 {
     // --- 1. Validations ---
-    // Check for NULL pointers for essential structures
     if (!params || !params->ac_trie || !text_start)
         return 0;
-    // Add check for root node existence
-    if (!params->ac_trie->root)
+    if (!params->ac_trie->delta)
     {
-        // Trie structure exists but root is NULL, indicates build failure
-        fprintf(stderr, "Warning: Aho-Corasick trie root is NULL during search.\n");
+        // Trie structure exists but was never compiled, indicates build failure
+        fprintf(stderr, "Warning: Aho-Corasick automaton is empty during search.\n");
         return 0;
     }
     // If max_count is 0, no matches should be found.
     if (params->max_count == 0)
         return 0;
 
-    ac_trie_t *trie = params->ac_trie;
-    ac_node_t *current_node = trie->root;
+    const ac_trie_t *trie = params->ac_trie;
+    const uint16_t *byte_class = trie->byte_class;
+    const uint32_t *delta = trie->delta;
+    const uint32_t num_classes = trie->num_classes;
+    const uint32_t dense_states = trie->dense_states;
+    uint32_t state = 0;
     uint64_t matches_found = 0;
-    const size_t max_count = params->max_count; // Use const for clarity
+    const size_t max_count = params->max_count;
     const bool count_lines_mode = params->count_lines_mode;
     const bool track_positions = params->track_positions;
-    size_t last_counted_line_start = SIZE_MAX; // Used only if count_lines_mode is true
+
+    const unsigned char *text = (const unsigned char *)text_start;
+    bool use_prefilter = true;
+    uint32_t prefilter_misses = 0;
 
     // --- 2. Iterate through the text ---
     for (size_t i = 0; i < text_len; i++)
     {
-        // --- 3. Get character and handle case-insensitivity ---
-        unsigned char c_orig = (unsigned char)text_start[i];
-        // Use lower_table for case-insensitive matching during search
-        unsigned char c = params->case_sensitive ? c_orig : lower_table[c_orig];
-
-        // --- 4. Follow failure links ---
-        // Traverse failure links until a node with a transition for 'c' is found,
-        // or until the root node is reached.
-        while (current_node != trie->root && !current_node->children[c])
+        // --- 3. In the root state, jump to the next byte that can start a match ---
+        if (state == 0 && use_prefilter)
         {
-            current_node = current_node->fail_link;
+            size_t next = ac_skip_to_start(trie, text, i, text_len);
+            if (next - i < AC_PREFILTER_MIN_GAP)
+            {
+                if (++prefilter_misses > AC_PREFILTER_MAX_MISSES)
+                    use_prefilter = false;
+            }
+            else if (prefilter_misses > 0)
+            {
+                prefilter_misses--;
+            }
+            i = next;
+            if (i >= text_len)
+                break;
         }
 
-        // --- 5. Make state transition ---
-        // If a transition for 'c' exists from the current node (or a node reached via failure links),
-        // move to that child node. Otherwise, stay at the root.
-        if (current_node->children[c])
-        {
-            current_node = current_node->children[c];
-        }
-        // If no transition exists even from the root, current_node remains root for the next character.
+        // --- 4. Transition; case folding is part of the byte class table ---
+        uint16_t cls = byte_class[text[i]];
+        if (state < dense_states)
+            state = delta[(size_t)state * num_classes + cls];
+        else
+            state = ac_next_state(trie, state, cls);
 
-        // --- 6. Collect matches by following failure links from the current state ---
-        ac_node_t *output_node = current_node;
-        // Check the current node and all nodes reachable via failure links for outputs.
-        // This ensures we find all patterns ending at the current position 'i'.
-        while (output_node != trie->root)
+        if (!trie->has_output[state])
+            continue;
+
+        // --- 5. Report patterns ending here: own outputs, then dictionary links ---
+        for (uint32_t s = state; s != AC_NO_STATE; s = trie->dict_link[s])
         {
-            if (output_node->num_outputs > 0)
+            for (uint32_t o = trie->out_start[s]; o < trie->out_start[s + 1]; o++)
             {
-                // --- 7. Process patterns ending at this output_node ---
-                for (int j = 0; j < output_node->num_outputs; j++)
-                {
-                    // Check max_count *before* processing this specific match.
-                    // If we've already reached the limit, return immediately.
-                    if (matches_found >= max_count)
-                    {
-                        return matches_found;
-                    }
-
-                    size_t pattern_idx = output_node->output_indices[j];
-                    size_t pattern_len = params->pattern_lens[pattern_idx];
+                if (matches_found >= max_count)
+                    return matches_found;
 
-                    // Skip empty patterns (should not happen if build logic is correct, but safe check)
-                    if (pattern_len == 0)
-                        continue;
+                size_t pattern_idx = trie->outputs[o];
+                size_t pattern_len = params->pattern_lens[pattern_idx];
+                if (pattern_len == 0)
+                    continue;
 
-                    // --- 8. Calculate match position ---
-                    // Match ends *at* index i (inclusive).
-                    // Start index is i - pattern_len + 1.
-                    size_t match_start = i + 1 - pattern_len;
-                    size_t match_end = i + 1; // Exclusive end position
+                // Match ends at index i (inclusive)
+                size_t match_start = i + 1 - pattern_len;
+                size_t match_end = i + 1; // Exclusive end position
 
-                    // --- 9. Apply whole word check ---
-                    if (params->whole_word && !is_whole_word_match(text_start, text_len, match_start, match_end))
-                    {
-                        continue; // Skip if not a whole word match
-                    }
+                if (params->whole_word && !is_whole_word_match(text_start, text_len, match_start, match_end))
+                    continue;
 
-                    // --- 10. Process match based on mode ---
-                    if (count_lines_mode)
-                    {
-                        size_t line_start = find_line_start(text_start, text_len, match_start);
-                        // Only count if this line hasn't been counted yet for this search
-                        if (line_start != last_counted_line_start)
-                        {
-                            // We already checked max_count at the start of the inner loop
-                            matches_found++;
-                            last_counted_line_start = line_start;
-                            // Check again immediately after incrementing in case this was the last one needed
-                            if (matches_found >= max_count)
-                                return matches_found;
-                        }
-                    }
-                    else // Count matches or track positions
+                if (count_lines_mode)
+                {
+                    // Count the line once and resume at the start of the next line from the root
+                    matches_found++;
+                    if (matches_found >= max_count)
+                        return matches_found;
+                    const unsigned char *newline = memchr(text + i, '\n', text_len - i);
+                    if (!newline)
+                        return matches_found;
+                    i = (size_t)(newline - text); // The loop steps past the newline
+                    state = 0;
+                    goto next_byte;
+                }
+                else // Count matches or track positions
+                {
+                    matches_found++;
+                    if (track_positions && result)
                     {
-                        // We already checked max_count at the start of the inner loop
-                        matches_found++;
-
-                        // Add position if tracking is enabled and result struct is provided
-                        if (track_positions && result)
-                        {
-                            match_result_add(result, match_start, match_end);
-                        }
-                        // Check again immediately after incrementing
-                        if (matches_found >= max_count)
-                            return matches_found;
+                        match_result_add(result, match_start, match_end);
                     }
-                } // End loop through outputs at this node
+                    if (matches_found >= max_count)
+                        return matches_found;
+                }
             }
-
-            // --- 11. Follow failure link ---
-            // Move to the failure link node to find shorter patterns ending at the same position 'i'.
-            output_node = output_node->fail_link;
-
-            // Optimization: Check max_count again before continuing the inner while loop.
-            // If the limit was reached while processing outputs of the current output_node,
-            // we can stop checking further failure links for this text position 'i'.
-            if (matches_found >= max_count)
-                return matches_found;
-
-        } // End while(output_node != trie->root)
-
-        // Check max_count one last time after processing all outputs for position `i`
-        if (matches_found >= max_count)
-            return matches_found;
-
-    } // End loop through text (for size_t i = 0; ...)
+        }
+    next_byte:;
+    }
 
     // --- Handle potential empty pattern match in empty text ---
-    // This case is only relevant if the input text itself was empty.
     // An empty pattern ("") should match an empty text exactly once if present.
-    if (text_len == 0 && trie->root->num_outputs > 0)
+    if (text_len == 0)
     {
-        for (int j = 0; j < trie->root->num_outputs; ++j)
+        for (uint32_t o = trie->out_start[0]; o < trie->out_start[1]; o++)
         {
-            size_t pattern_idx = trie->root->output_indices[j];
-            // Check if this output corresponds to the empty pattern
-            if (params->pattern_lens[pattern_idx] == 0)
+            if (params->pattern_lens[trie->outputs[o]] == 0)
             {
-                // Found the empty pattern match at the root
-                if (matches_found < max_count) // Should always be true if text_len is 0 unless max_count was 0
+                if (matches_found < max_count)
                 {
                     matches_found++;
                     if (track_positions && result)
@@ -456,7 +756,6 @@ uint64_t aho_corasick_search(const search_params_t *params,
                         match_result_add(result, 0, 0); // Empty match at position 0
                     }
                 }
-                // Only count one match for the empty pattern in empty text
                 break;
             }
         }
@@ -19,9 +19,6 @@ typedef struct search_params search_params_t;
 struct match_result_t;
 typedef struct match_result_t match_result_t;
 
-// Forward declaration for internal node structure
-struct ac_node;
-
 // Forward declaration for Aho-Corasick trie structure
 struct ac_trie;
 typedef struct ac_trie ac_trie_t;
@@ -35,6 +32,9 @@ void ac_trie_free(ac_trie_t *trie);
 // Check if the root node of the trie has any outputs (for empty pattern matching)
 bool ac_trie_root_has_outputs(const ac_trie_t *trie);
 
+// Approximate heap footprint of the compiled automaton in bytes
+size_t ac_trie_memory_usage(const ac_trie_t *trie);
+
 // Aho-Corasick search function declaration
 uint64_t aho_corasick_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
 
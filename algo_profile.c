@@ -0,0 +1,433 @@
+/* algo_profile.c - Calibrated algorithm selection for single literal patterns
+ *
+ * select_search_algorithm() picks the kernel for a single literal from fixed length
+ * thresholds that were tuned on one machine. --calibrate instead times every kernel
+ * able to handle the pattern on a sample of the actual input and records the fastest
+ * one for the pattern's class and the CPU model in a profile file. Later runs on the
+ * same CPU model use the recorded kernel for every pattern of that class, as long as
+ * the kernel can handle the pattern's length on this CPU; otherwise the heuristic
+ * applies as before.
+ *
+ * A class is a length bucket (1, 2-3, 4-7, 8-15, 16-31, 32-63, 64+), case handling and
+ * whether lines are counted (-c) or matches found. The profile is a text file with one
+ * tab-separated entry per line:
+ *
+ *   CPU model \t class \t kernel name \t GB/s
+ *
+ * Lines starting with '#' are comments. Entries for other CPU models are kept when the
+ * profile is rewritten, so one file can be shared by different hosts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "algo_profile.h"
+
+#define AP_CPU_MAX 128
+#define AP_KERNEL_MAX 48
+#define AP_MIN_SECONDS 0.02 // Timing budget per kernel
+#define AP_MAX_RUNS 50
+
+typedef struct
+{
+    char cpu[AP_CPU_MAX];
+    char cls[ALGO_PROFILE_CLASS_MAX];
+    char kernel[AP_KERNEL_MAX];
+    double gbps;
+    search_func_t func; // Resolved kernel when cpu is this CPU model, else NULL
+} ap_entry_t;
+
+static ap_entry_t *ap_entries = NULL;
+static size_t ap_count = 0;
+static size_t ap_capacity = 0;
+
+/* --- Kernels --- */
+
+// Every kernel a profile may name; a kernel is a candidate for a pattern only if
+// ap_kernel_handles() accepts it
+static const search_func_t ap_kernels[] = {
+    memchr_search,
+    memchr_count_lines,
+    memchr_short_search,
+    boyer_moore_search,
+    boyer_moore_count_lines,
+    kmp_search,
+#if KREP_USE_AVX512
+    simd_avx512_search,
+#endif
+#if KREP_USE_AVX2
+    simd_avx2_search,
+#endif
+#if KREP_USE_SSE42
+    simd_sse42_search,
+#endif
+#if KREP_USE_NEON
+    neon_search,
+#endif
+#if KREP_USE_AVX2 || KREP_USE_NEON
+    simd_anchor_search,
+#endif
+};
+#define AP_NUM_KERNELS (sizeof(ap_kernels) / sizeof(ap_kernels[0]))
+
+// True when func can search for the single literal of params on this CPU
+static bool ap_kernel_handles(search_func_t func, const search_params_t *params)
+{
+    size_t len = params->pattern_len;
+    if (func == memchr_search)
+        return len == 1;
+    if (func == memchr_count_lines)
+        return len == 1 && params->count_lines_mode;
+    if (func == memchr_short_search)
+        return len >= 2 && len <= 3;
+    if (func == boyer_moore_count_lines)
+        return params->count_lines_mode;
+    if (func == boyer_moore_search || func == kmp_search)
+        return true;
+    return simd_kernel_max_pattern_len(func) >= len;
+}
+
+static search_func_t ap_kernel_by_name(const char *name)
+{
+    for (size_t i = 0; i < AP_NUM_KERNELS; i++)
+    {
+        if (strcmp(get_algorithm_name(ap_kernels[i]), name) == 0)
+            return ap_kernels[i];
+    }
+    return NULL;
+}
+
+/* --- Classes and CPU model --- */
+
+bool algo_profile_class(const search_params_t *params, char *buf, size_t size)
+{
+    if (params->use_regex || params->num_patterns != 1 || params->pattern_len == 0)
+        return false;
+
+    static const struct
+    {
+        size_t max_len;
+        const char *name;
+    } buckets[] = {{1, "1"}, {3, "2-3"}, {7, "4-7"}, {15, "8-15"}, {31, "16-31"}, {63, "32-63"}, {SIZE_MAX, "64+"}};
+    size_t b = 0;
+    while (params->pattern_len > buckets[b].max_len)
+        b++;
+    snprintf(buf, size, "literal:%s:%s:%s", buckets[b].name, params->case_sensitive ? "case" : "icase",
+             params->count_lines_mode ? "lines" : "matches");
+    return true;
+}
+
+// Copy the value after the first ':' of a /proc/cpuinfo line, trimmed
+static void ap_cpuinfo_value(const char *line, char *out, size_t size)
+{
+    const char *value = strchr(line, ':');
+    value = value ? value + 1 : line;
+    while (*value == ' ' || *value == '\t')
+        value++;
+    snprintf(out, size, "%s", value);
+    size_t n = strlen(out);
+    while (n > 0 && (out[n - 1] == '\n' || out[n - 1] == ' '))
+        out[--n] = '\0';
+}
+
+const char *algo_profile_cpu_model(void)
+{
+    static char model[AP_CPU_MAX];
+    if (model[0])
+        return model;
+
+    char implementer[32] = "", part[32] = "";
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f)
+    {
+        char line[512];
+        while (fgets(line, sizeof(line), f))
+        {
+            if (!model[0] && strncmp(line, "model name", 10) == 0)
+                ap_cpuinfo_value(line, model, sizeof(model));
+            else if (!implementer[0] && strncmp(line, "CPU implementer", 15) == 0)
+                ap_cpuinfo_value(line, implementer, sizeof(implementer));
+            else if (!part[0] && strncmp(line, "CPU part", 8) == 0)
+                ap_cpuinfo_value(line, part, sizeof(part));
+        }
+        fclose(f);
+    }
+
+    struct utsname uts;
+    const char *machine = uname(&uts) == 0 ? uts.machine : "unknown";
+    if (!model[0] && implementer[0])
+        snprintf(model, sizeof(model), "%s implementer %s part %s", machine, implementer, part);
+    if (!model[0])
+        snprintf(model, sizeof(model), "%s", machine);
+
+    // Tabs would break the profile format
+    for (char *p = model; *p; p++)
+        if (*p == '\t')
+            *p = ' ';
+    return model;
+}
+
+const char *algo_profile_default_path(char *buf, size_t size)
+{
+    const char *env = getenv("KREP_PROFILE");
+    if (env && *env)
+    {
+        snprintf(buf, size, "%s", env);
+        return buf;
+    }
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache)
+    {
+        snprintf(buf, size, "%s/krep/algorithms", cache);
+        return buf;
+    }
+    const char *home = getenv("HOME");
+    if (home && *home)
+    {
+        snprintf(buf, size, "%s/.cache/krep/algorithms", home);
+        return buf;
+    }
+    return NULL;
+}
+
+/* --- Entries --- */
+
+void algo_profile_reset(void)
+{
+    free(ap_entries);
+    ap_entries = NULL;
+    ap_count = 0;
+    ap_capacity = 0;
+}
+
+// Add or replace the entry for (cpu, cls)
+static bool ap_set(const char *cpu, const char *cls, const char *kernel, double gbps)
+{
+    ap_entry_t *e = NULL;
+    for (size_t i = 0; i < ap_count && !e; i++)
+    {
+        if (strcmp(ap_entries[i].cpu, cpu) == 0 && strcmp(ap_entries[i].cls, cls) == 0)
+            e = &ap_entries[i];
+    }
+    if (!e)
+    {
+        if (ap_count == ap_capacity)
+        {
+            size_t new_capacity = ap_capacity ? ap_capacity * 2 : 16;
+            ap_entry_t *grown = realloc(ap_entries, new_capacity * sizeof(*grown));
+            if (!grown)
+                return false;
+            ap_entries = grown;
+            ap_capacity = new_capacity;
+        }
+        e = &ap_entries[ap_count++];
+    }
+    snprintf(e->cpu, sizeof(e->cpu), "%s", cpu);
+    snprintf(e->cls, sizeof(e->cls), "%s", cls);
+    snprintf(e->kernel, sizeof(e->kernel), "%s", kernel);
+    e->gbps = gbps;
+    e->func = strcmp(cpu, algo_profile_cpu_model()) == 0 ? ap_kernel_by_name(kernel) : NULL;
+    return true;
+}
+
+bool algo_profile_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return errno == ENOENT;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+        char *fields[4] = {line, NULL, NULL, NULL};
+        size_t n = 1;
+        for (char *p = line; *p && n < 4; p++)
+        {
+            if (*p == '\t')
+            {
+                *p = '\0';
+                fields[n++] = p + 1;
+            }
+        }
+        if (n < 3)
+            continue; // Malformed line
+        if (!ap_set(fields[0], fields[1], fields[2], n == 4 ? strtod(fields[3], NULL) : 0))
+        {
+            fclose(f);
+            return false;
+        }
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// mkdir -p for the directory part of path
+static void ap_make_parent_dirs(const char *path)
+{
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; *p; p++)
+    {
+        if (*p == '/')
+        {
+            *p = '\0';
+            mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+}
+
+bool algo_profile_save(const char *path)
+{
+    ap_make_parent_dirs(path);
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "# krep algorithm profile, written by --calibrate\n");
+    fprintf(f, "# cpu model\tclass\tkernel\tGB/s\n");
+    for (size_t i = 0; i < ap_count; i++)
+        fprintf(f, "%s\t%s\t%s\t%.3f\n", ap_entries[i].cpu, ap_entries[i].cls, ap_entries[i].kernel,
+                ap_entries[i].gbps);
+
+    bool ok = fflush(f) == 0 && !ferror(f);
+    ok = fclose(f) == 0 && ok;
+    // Readers only ever see a complete profile
+    if (ok && rename(tmp, path) != 0)
+        ok = false;
+    if (!ok)
+        unlink(tmp);
+    return ok;
+}
+
+search_func_t algo_profile_lookup(const search_params_t *params)
+{
+    if (ap_count == 0)
+        return NULL;
+    char cls[ALGO_PROFILE_CLASS_MAX];
+    if (!algo_profile_class(params, cls, sizeof(cls)))
+        return NULL;
+    for (size_t i = 0; i < ap_count; i++)
+    {
+        const ap_entry_t *e = &ap_entries[i];
+        if (e->func && strcmp(e->cls, cls) == 0)
+            return ap_kernel_handles(e->func, params) ? e->func : NULL;
+    }
+    return NULL;
+}
+
+/* --- Calibration --- */
+
+static double ap_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fastest of several runs of func over the sample, in seconds; count and positions
+// (for position-tracking params) go to *count and result
+static double ap_time_kernel(const search_params_t *params, search_func_t func, const char *sample, size_t len,
+                             uint64_t *count, match_result_t *result)
+{
+    double best = 0;
+    double budget_start = ap_now();
+    for (int run = 0; run < AP_MAX_RUNS; run++)
+    {
+        if (result)
+            result->count = 0;
+        double start = ap_now();
+        *count = func(params, sample, len, result);
+        double elapsed = ap_now() - start;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+        if (run >= 2 && ap_now() - budget_start > AP_MIN_SECONDS)
+            break;
+    }
+    return best > 0 ? best : 1e-9;
+}
+
+static bool ap_same_positions(const match_result_t *a, const match_result_t *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (a->count != b->count)
+        return false;
+    for (uint64_t i = 0; i < a->count; i++)
+    {
+        if (a->positions[i].start_offset != b->positions[i].start_offset ||
+            a->positions[i].end_offset != b->positions[i].end_offset)
+            return false;
+    }
+    return true;
+}
+
+search_func_t algo_profile_calibrate(const search_params_t *params, search_func_t heuristic, const char *sample,
+                                     size_t len, double *gbps, double *heuristic_gbps)
+{
+    char cls[ALGO_PROFILE_CLASS_MAX];
+    if (!heuristic || !sample || len == 0 || !algo_profile_class(params, cls, sizeof(cls)))
+        return NULL;
+
+    search_params_t timed = *params;
+    timed.max_count = SIZE_MAX;
+
+    match_result_t *expected = NULL, *got = NULL;
+    if (timed.track_positions)
+    {
+        expected = match_result_init(1024);
+        got = match_result_init(1024);
+        if (!expected || !got)
+        {
+            match_result_free(expected);
+            match_result_free(got);
+            return NULL;
+        }
+    }
+
+    // The heuristic's choice is the reference every other kernel must agree with
+    uint64_t expected_count = 0;
+    double best_seconds = ap_time_kernel(&timed, heuristic, sample, len, &expected_count, expected);
+    search_func_t best = heuristic;
+    if (heuristic_gbps)
+        *heuristic_gbps = len / best_seconds / 1e9;
+
+    for (size_t i = 0; i < AP_NUM_KERNELS; i++)
+    {
+        search_func_t func = ap_kernels[i];
+        if (func == heuristic || !ap_kernel_handles(func, &timed))
+            continue;
+        uint64_t count = 0;
+        double seconds = ap_time_kernel(&timed, func, sample, len, &count, got);
+        if (count != expected_count || !ap_same_positions(expected, got))
+            continue; // Disagrees on this input; never choose it
+        if (seconds < best_seconds)
+        {
+            best_seconds = seconds;
+            best = func;
+        }
+    }
+    match_result_free(expected);
+    match_result_free(got);
+
+    double best_gbps = len / best_seconds / 1e9;
+    if (gbps)
+        *gbps = best_gbps;
+    if (!ap_set(algo_profile_cpu_model(), cls, get_algorithm_name(best), best_gbps))
+        return NULL;
+    return best;
+}
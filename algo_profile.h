@@ -0,0 +1,54 @@
+/**
+ * Calibrated algorithm selection for single literal patterns.
+ * This header declares the profile of measured kernel choices and the calibration that fills it.
+ */
+
+#ifndef ALGO_PROFILE_H
+#define ALGO_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+#include "krep.h" // For search_params_t and search_func_t
+
+// Bytes of input --calibrate times the kernels on (cut back to a line boundary)
+#define ALGO_PROFILE_SAMPLE_SIZE (1024 * 1024)
+
+// Longest profile class name, e.g. "literal:16-31:icase:lines"
+#define ALGO_PROFILE_CLASS_MAX 48
+
+// Path used when --profile is not given: $KREP_PROFILE, else
+// $XDG_CACHE_HOME/krep/algorithms, else $HOME/.cache/krep/algorithms. NULL if none.
+const char *algo_profile_default_path(char *buf, size_t size);
+
+// CPU model the profile entries are keyed on ("model name" from /proc/cpuinfo, the
+// implementer/part pair on ARM, or the machine name)
+const char *algo_profile_cpu_model(void);
+
+// Profile class of params (pattern length bucket, case handling, -c or not) into buf.
+// Returns false for searches the profile does not cover (regex, several patterns).
+bool algo_profile_class(const search_params_t *params, char *buf, size_t size);
+
+// Read the profile at path, replacing entries already loaded. A missing file is not an
+// error. Returns false only if the file exists but cannot be read.
+bool algo_profile_load(const char *path);
+
+// Write every loaded entry (for all CPU models) to path, creating its directory
+bool algo_profile_save(const char *path);
+
+// Kernel recorded for the class of params on this CPU model, or NULL when there is
+// none or it cannot handle this pattern (then the built-in heuristic applies)
+search_func_t algo_profile_lookup(const search_params_t *params);
+
+// Time every kernel able to handle params on sample and record the fastest for the
+// class of params on this CPU model. Kernels whose results differ from those of
+// heuristic (the built-in choice) are skipped. *gbps receives the winner's speed and
+// *heuristic_gbps the heuristic's (either may be NULL). Returns the winner, or NULL if
+// the class is not covered or the sample is empty.
+search_func_t algo_profile_calibrate(const search_params_t *params, search_func_t heuristic, const char *sample,
+                                     size_t len, double *gbps, double *heuristic_gbps);
+
+// Forget all loaded and calibrated entries
+void algo_profile_reset(void);
+
+#endif // ALGO_PROFILE_H
@@ -0,0 +1,208 @@
+/* arena.c - Bump allocator for per-search memory
+ *
+ * A search allocates its match positions and formatted output from arenas instead of
+ * malloc. Allocation bumps a pointer inside the current block; the position arrays,
+ * which grow by doubling, are extended in place while the block has room, and blocks
+ * double in size so a growing array is copied a logarithmic number of times. Nothing
+ * is freed one allocation at a time: when the search of a file ends, its arenas are
+ * reset and go back to a small per-thread cache, keeping their largest block, so a
+ * recursive search over many files reuses the same memory instead of churning the
+ * allocator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_block
+{
+    arena_block_t *next; // Older, smaller block
+    size_t size;         // Usable bytes after the header
+    size_t used;         // Bytes handed out
+    size_t pad;          // Keeps the data that follows ARENA_ALIGN-aligned
+};
+
+static inline size_t arena_round(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline char *block_data(arena_block_t *block)
+{
+    return (char *)(block + 1);
+}
+
+arena_t *arena_create(void)
+{
+    return calloc(1, sizeof(arena_t));
+}
+
+static void free_blocks(arena_block_t *block)
+{
+    while (block)
+    {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void arena_destroy(arena_t *arena)
+{
+    if (!arena)
+        return;
+    free_blocks(arena->blocks);
+    free(arena);
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size_t rounded = arena_round(size ? size : 1);
+    if (rounded < size)
+        return NULL; // Overflow
+
+    arena_block_t *block = arena->blocks;
+    if (!block || block->size - block->used < rounded)
+    {
+        size_t block_size = block ? block->size * 2 : ARENA_MIN_BLOCK_SIZE;
+        if (block_size < rounded)
+            block_size = rounded;
+        if (block_size > SIZE_MAX - sizeof(arena_block_t))
+            return NULL;
+        arena_block_t *fresh = malloc(sizeof(arena_block_t) + block_size);
+        if (!fresh)
+            return NULL;
+        fresh->size = block_size;
+        fresh->used = 0;
+        fresh->next = block;
+        arena->blocks = block = fresh;
+    }
+
+    char *ptr = block_data(block) + block->used;
+    block->used += rounded;
+    arena->last = ptr;
+    arena->last_size = rounded;
+    return ptr;
+}
+
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr)
+        return arena_alloc(arena, new_size);
+
+    size_t rounded = arena_round(new_size);
+    if (rounded < new_size)
+        return NULL;
+    arena_block_t *block = arena->blocks;
+    if (ptr == arena->last && block)
+    {
+        // Last allocation of the current block: move the bump pointer
+        size_t start = (size_t)(arena->last - block_data(block));
+        if (rounded <= block->size - start)
+        {
+            block->used = start + rounded;
+            arena->last_size = rounded;
+            return ptr;
+        }
+    }
+
+    void *moved = arena_alloc(arena, new_size);
+    if (moved)
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    return moved;
+}
+
+void arena_reset(arena_t *arena)
+{
+    // Blocks grow toward the head, so the first one that fits the limit is the largest
+    arena_block_t *keep = arena->blocks;
+    arena_block_t *dropped = NULL;
+    while (keep && keep->size > ARENA_RETAIN_MAX)
+    {
+        arena_block_t *next = keep->next;
+        keep->next = dropped;
+        dropped = keep;
+        keep = next;
+    }
+    free_blocks(dropped);
+    if (keep)
+    {
+        free_blocks(keep->next);
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->blocks = keep;
+    arena->last = NULL;
+    arena->last_size = 0;
+}
+
+size_t arena_capacity(const arena_t *arena)
+{
+    size_t total = 0;
+    for (const arena_block_t *b = arena->blocks; b; b = b->next)
+        total += b->size;
+    return total;
+}
+
+// --- Per-thread cache of released arenas ---
+
+typedef struct
+{
+    arena_t *arenas[ARENA_CACHE_MAX];
+    int count;
+} arena_cache_t;
+
+static pthread_key_t arena_cache_key;
+static pthread_once_t arena_cache_once = PTHREAD_ONCE_INIT;
+
+static void free_arena_cache(void *ptr)
+{
+    arena_cache_t *cache = (arena_cache_t *)ptr;
+    for (int i = 0; i < cache->count; i++)
+        arena_destroy(cache->arenas[i]);
+    free(cache);
+}
+
+static void create_arena_cache_key(void)
+{
+    pthread_key_create(&arena_cache_key, free_arena_cache);
+}
+
+// The calling thread's cache, allocated on first use (NULL when out of memory)
+static arena_cache_t *get_arena_cache(void)
+{
+    pthread_once(&arena_cache_once, create_arena_cache_key);
+    arena_cache_t *cache = pthread_getspecific(arena_cache_key);
+    if (!cache)
+    {
+        cache = calloc(1, sizeof(arena_cache_t));
+        if (cache)
+            pthread_setspecific(arena_cache_key, cache);
+    }
+    return cache;
+}
+
+arena_t *arena_acquire(void)
+{
+    arena_cache_t *cache = get_arena_cache();
+    if (cache && cache->count > 0)
+        return cache->arenas[--cache->count];
+    return arena_create();
+}
+
+void arena_release(arena_t *arena)
+{
+    if (!arena)
+        return;
+    arena_reset(arena);
+    arena_cache_t *cache = get_arena_cache();
+    if (cache && cache->count < ARENA_CACHE_MAX)
+        cache->arenas[cache->count++] = arena;
+    else
+        arena_destroy(arena);
+}
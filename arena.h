@@ -0,0 +1,52 @@
+/**
+ * Bump allocator for per-search memory (match positions, formatted output).
+ * This header declares the arena and the per-thread cache that reuses arenas across files.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h> // For size_t
+
+// Smallest block an arena allocates; later blocks double in size
+#define ARENA_MIN_BLOCK_SIZE (64 * 1024)
+
+// Largest block a released arena keeps for the next search; bigger ones are freed
+#define ARENA_RETAIN_MAX (4 * 1024 * 1024)
+
+// Released arenas each thread keeps for reuse
+#define ARENA_CACHE_MAX 16
+
+typedef struct arena_block arena_block_t;
+
+typedef struct arena
+{
+   arena_block_t *blocks; // Blocks in use, the current (largest) one first
+   char *last;            // Most recent allocation, which arena_grow extends in place
+   size_t last_size;      // Its size, rounded up to the alignment
+} arena_t;
+
+arena_t *arena_create(void);
+void arena_destroy(arena_t *arena);
+
+// size bytes aligned for any match_position_t or pointer, or NULL when out of memory.
+// The memory lives until the arena is reset; there is no per-allocation free.
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Resize an allocation like realloc. The most recent allocation grows in place while
+// its block has room; anything else is copied to a new allocation. ptr may be NULL.
+void *arena_grow(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+
+// Drop every allocation. The largest block up to ARENA_RETAIN_MAX is kept for reuse.
+void arena_reset(arena_t *arena);
+
+// Bytes held by the arena's blocks
+size_t arena_capacity(const arena_t *arena);
+
+// A reset arena from the calling thread's cache (or a new one), NULL when out of memory
+arena_t *arena_acquire(void);
+
+// Reset arena and return it to the calling thread's cache. NULL is ignored.
+void arena_release(arena_t *arena);
+
+#endif // ARENA_H
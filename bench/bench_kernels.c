@@ -0,0 +1,562 @@
+/**
+ * Search kernel benchmark: runs every search_func_t over synthetic corpora (random
+ * text and ASCII logs, with dense and sparse match rates) and any files given on the
+ * command line, and prints a JSON baseline with GB/s, matches/s and cycles/byte.
+ *
+ * Literal kernels are run with patterns of 1, 3, 8, 16, 32 and 64 bytes (each kernel
+ * only at the lengths it supports), Aho-Corasick with 10, 1k and 10k patterns, and the
+ * regex engines with a few patterns. For real corpora the patterns are taken from the
+ * file itself. Every kernel of a row must report the same match count; rows where one
+ * does not are flagged with "mismatch": true.
+ *
+ * Cycles come from the CPU cycle counter (perf_event_open) when it can be opened and
+ * from the time-stamp counter otherwise ("cycles_source" says which).
+ *
+ * Build and run with: make bench
+ * Usage: bench/bench_kernels [--quick] [--size MB] [FILE...] > baseline.json
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../aho_corasick.h"
+#include "../regex_dfa.h"
+
+// Bytes between planted matches
+#define DENSE_MATCH_SPACING 256
+#define SPARSE_MATCH_SPACING (64 * 1024)
+
+static const size_t literal_lengths[] = {1, 3, 8, 16, 32, 64};
+static const size_t ac_pattern_counts[] = {10, 1000, 10000};
+
+static double min_seconds = 0.25; // Per measurement
+static bool first_result = true;
+
+/* --- Timing --- */
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cycles_fd = -1;
+static const char *cycles_source = "none";
+
+static void open_cycle_counter(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycles_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (cycles_fd >= 0)
+    {
+        cycles_source = "perf";
+        return;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    cycles_source = "tsc";
+#endif
+}
+
+static uint64_t read_cycles(void)
+{
+#ifdef __linux__
+    if (cycles_fd >= 0)
+    {
+        uint64_t value = 0;
+        if (read(cycles_fd, &value, sizeof(value)) == (ssize_t)sizeof(value))
+            return value;
+        return 0;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* --- Corpora --- */
+
+typedef struct
+{
+    const char *name;    // "random", "logs" or the file name
+    const char *density; // "dense", "sparse" or "file"
+    char *text;
+    size_t len;
+} corpus_t;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// Lowercase words, digits and spaces in lines of 40-120 bytes
+static void fill_random(char *text, size_t len)
+{
+    size_t line_left = 40 + rng_next() % 80;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (--line_left == 0)
+        {
+            text[i] = '\n';
+            line_left = 40 + rng_next() % 80;
+            continue;
+        }
+        unsigned r = rng_next() % 32;
+        text[i] = r < 26 ? (char)('a' + r) : r < 30 ? ' ' : (char)('0' + r % 10);
+    }
+}
+
+// Timestamped log lines with a handful of levels, services and messages
+static void fill_logs(char *text, size_t len)
+{
+    static const char *levels[] = {"INFO", "DEBUG", "WARN", "ERROR"};
+    static const char *services[] = {"api", "db", "auth", "cache", "worker"};
+    static const char *messages[] = {"request completed", "connection reset by peer", "cache miss for key",
+                                     "retrying after timeout", "user session refreshed", "slow query detected"};
+    size_t pos = 0;
+    unsigned long line = 0;
+    while (pos < len)
+    {
+        char buf[160];
+        int n = snprintf(buf, sizeof(buf), "2024-03-%02lu 12:%02lu:%02lu.%03lu %-5s [%s] %s id=%lu\n", line % 28 + 1,
+                         line / 60 % 60, line % 60, rng_next() % 1000, levels[rng_next() % 4],
+                         services[rng_next() % 5], messages[rng_next() % 6], (unsigned long)(rng_next() % 100000));
+        size_t take = (size_t)n < len - pos ? (size_t)n : len - pos;
+        memcpy(text + pos, buf, take);
+        pos += take;
+        line++;
+    }
+}
+
+// A pattern of len bytes that does not occur in the synthetic corpora by chance:
+// it starts with '~' and no line of either corpus contains that byte
+static void make_pattern(char *out, size_t len, unsigned seed)
+{
+    static const char alphabet[] = "ABCDEFGHJKLMNPQRSTUVWXYZ0123456789-_";
+    out[0] = '~';
+    for (size_t i = 1; i < len; i++)
+        out[i] = alphabet[(seed * 31 + i * 17 + (seed >> 3) * i) % (sizeof(alphabet) - 1)];
+    out[len] = '\0';
+}
+
+// Copy the patterns into the corpus every spacing bytes (cycling through them),
+// never across a newline
+static void plant(corpus_t *c, char **patterns, size_t num_patterns, size_t spacing)
+{
+    size_t k = 0;
+    for (size_t pos = spacing / 2; pos + 65 < c->len; pos += spacing)
+    {
+        size_t plen = strlen(patterns[k % num_patterns]);
+        if (memchr(c->text + pos, '\n', plen))
+            continue;
+        memcpy(c->text + pos, patterns[k % num_patterns], plen);
+        k++;
+    }
+}
+
+static bool synth_corpus(corpus_t *c, const char *name, const char *density, size_t len)
+{
+    c->name = name;
+    c->density = density;
+    c->len = len;
+    c->text = malloc(len);
+    if (!c->text)
+        return false;
+    if (strcmp(name, "random") == 0)
+        fill_random(c->text, len);
+    else
+        fill_logs(c->text, len);
+    return true;
+}
+
+static bool map_corpus(corpus_t *c, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        fprintf(stderr, "bench_kernels: cannot read %s\n", path);
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+    c->text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (c->text == MAP_FAILED)
+        return false;
+    c->name = path;
+    c->density = "file";
+    c->len = st.st_size;
+    return true;
+}
+
+// A pattern of len bytes copied from the file (the first run without a newline
+// after a pseudo-random offset); false if the file has none
+static bool sample_pattern(const corpus_t *c, char *out, size_t len, unsigned seed)
+{
+    if (c->len <= len)
+        return false;
+    for (unsigned attempt = 0; attempt < 64; attempt++)
+    {
+        size_t pos = (size_t)((seed + attempt) * 2654435761u % (c->len - len));
+        if (!memchr(c->text + pos, '\n', len) && !memchr(c->text + pos, '\0', len))
+        {
+            memcpy(out, c->text + pos, len);
+            out[len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+/* --- Measurement --- */
+
+typedef struct
+{
+    const char *kernel;
+    search_func_t func;
+} kernel_t;
+
+static void print_result(const corpus_t *c, const char *kernel, const char *mode, size_t num_patterns,
+                         size_t pattern_len, const char *pattern_kind, uint64_t matches, double seconds,
+                         uint64_t cycles, uint64_t runs, bool mismatch)
+{
+    double bytes = (double)c->len * runs;
+    printf("%s\n    {\"kernel\": \"%s\", \"corpus\": \"%s\", \"density\": \"%s\", \"bytes\": %zu, "
+           "\"mode\": \"%s\", \"patterns\": %zu, \"pattern_len\": %zu, \"pattern_kind\": \"%s\", "
+           "\"matches\": %llu, \"runs\": %llu, \"gb_per_s\": %.3f, \"matches_per_s\": %.0f, ",
+           first_result ? "" : ",", kernel, c->name, c->density, c->len, mode, num_patterns, pattern_len,
+           pattern_kind, (unsigned long long)matches, (unsigned long long)runs, bytes / seconds / 1e9,
+           (double)matches * runs / seconds);
+    if (cycles)
+        printf("\"cycles_per_byte\": %.3f", (double)cycles / bytes);
+    else
+        printf("\"cycles_per_byte\": null");
+    printf("%s}", mismatch ? ", \"mismatch\": true" : "");
+    first_result = false;
+
+    fprintf(stderr, "  %-26s %-10s %-6s %-7s n=%-5zu len=%-3zu %8.3f GB/s %12.0f matches/s%s\n", kernel,
+            c->name, c->density, mode, num_patterns, pattern_len, bytes / seconds / 1e9,
+            (double)matches * runs / seconds, mismatch ? "  MISMATCH" : "");
+}
+
+// Run func over the corpus until min_seconds have passed; returns the match count
+static uint64_t measure(const search_params_t *params, search_func_t func, const corpus_t *c, double *seconds,
+                        uint64_t *cycles, uint64_t *runs)
+{
+    uint64_t matches = func(params, c->text, c->len, NULL); // Warm-up, and the count
+    uint64_t n = 0;
+    uint64_t cycles_start = read_cycles();
+    double start = now_seconds(), elapsed = 0;
+    do
+    {
+        func(params, c->text, c->len, NULL);
+        n++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+    uint64_t cycles_end = read_cycles();
+    *seconds = elapsed;
+    *cycles = strcmp(cycles_source, "none") == 0 ? 0 : cycles_end - cycles_start;
+    *runs = n;
+    return matches;
+}
+
+// Measure each kernel with the same params and report one row per kernel
+static void bench_kernels(const corpus_t *c, search_params_t *params, const kernel_t *kernels, size_t num_kernels,
+                          const char *mode, const char *pattern_kind)
+{
+    uint64_t reference = 0;
+    for (size_t i = 0; i < num_kernels; i++)
+    {
+        double seconds;
+        uint64_t cycles, runs;
+        uint64_t matches = measure(params, kernels[i].func, c, &seconds, &cycles, &runs);
+        if (i == 0)
+            reference = matches;
+        size_t pattern_len = params->num_patterns > 1 ? 0 : params->pattern_len; // 0 for sets
+        print_result(c, kernels[i].kernel, mode, params->num_patterns, pattern_len, pattern_kind, matches,
+                     seconds, cycles, runs, matches != reference);
+    }
+}
+
+static void set_single(search_params_t *params, const char **pattern, size_t *len)
+{
+    memset(params, 0, sizeof(*params));
+    params->patterns = pattern;
+    params->pattern_lens = len;
+    params->num_patterns = 1;
+    params->pattern = pattern[0];
+    params->pattern_len = len[0];
+    params->case_sensitive = true;
+    params->max_count = SIZE_MAX;
+}
+
+static void bench_literals(const corpus_t *c, char patterns[][65], size_t num_lengths)
+{
+    for (size_t li = 0; li < num_lengths; li++)
+    {
+        const char *pattern[] = {patterns[li]};
+        size_t len[] = {strlen(patterns[li])};
+        if (len[0] == 0)
+            continue;
+        search_params_t params;
+        set_single(&params, pattern, len);
+
+        kernel_t kernels[16];
+        size_t n = 0;
+        if (len[0] == 1)
+            kernels[n++] = (kernel_t){"memchr", memchr_search};
+        if (len[0] >= 2 && len[0] <= 3)
+            kernels[n++] = (kernel_t){"memchr-short", memchr_short_search};
+        kernels[n++] = (kernel_t){"Boyer-Moore-Horspool", boyer_moore_search};
+        kernels[n++] = (kernel_t){"KMP", kmp_search};
+#if KREP_USE_AVX512
+        if (simd_kernel_max_pattern_len(simd_avx512_search) >= len[0])
+            kernels[n++] = (kernel_t){"AVX-512BW", simd_avx512_search};
+#endif
+#if KREP_USE_AVX2
+        if (simd_kernel_max_pattern_len(simd_avx2_search) >= len[0])
+            kernels[n++] = (kernel_t){"AVX2", simd_avx2_search};
+#endif
+#if KREP_USE_SSE42
+        if (simd_kernel_max_pattern_len(simd_sse42_search) >= len[0])
+            kernels[n++] = (kernel_t){"SSE4.2", simd_sse42_search};
+#endif
+#if KREP_USE_NEON
+        if (simd_kernel_max_pattern_len(neon_search) >= len[0])
+            kernels[n++] = (kernel_t){"NEON", neon_search};
+#endif
+#if KREP_USE_AVX2 || KREP_USE_NEON
+        if (simd_kernel_max_pattern_len(simd_anchor_search) >= len[0])
+            kernels[n++] = (kernel_t){"SIMD rare-byte anchor", simd_anchor_search};
+#endif
+        bench_kernels(c, &params, kernels, n, "matches", "literal");
+
+        // -c kernels, against the matching-line count of the selected algorithm
+        params.count_lines_mode = true;
+        kernel_t count_kernels[3];
+        size_t nc = 0;
+        count_kernels[nc++] = (kernel_t){"selected (count lines)", select_search_algorithm(&params)};
+        if (len[0] == 1)
+            count_kernels[nc++] = (kernel_t){"memchr (count lines)", memchr_count_lines};
+        else
+            count_kernels[nc++] = (kernel_t){"Boyer-Moore-Horspool (count lines)", boyer_moore_count_lines};
+        bench_kernels(c, &params, count_kernels, nc, "lines", "literal");
+    }
+}
+
+static void bench_aho_corasick(const corpus_t *c, char **patterns, size_t max_patterns)
+{
+    size_t *lens = malloc(max_patterns * sizeof(size_t));
+    if (!lens)
+        return;
+    for (size_t i = 0; i < max_patterns; i++)
+        lens[i] = strlen(patterns[i]);
+
+    for (size_t ci = 0; ci < sizeof(ac_pattern_counts) / sizeof(ac_pattern_counts[0]); ci++)
+    {
+        size_t count = ac_pattern_counts[ci] < max_patterns ? ac_pattern_counts[ci] : max_patterns;
+        search_params_t params = {0};
+        params.patterns = (const char **)patterns;
+        params.pattern_lens = lens;
+        params.num_patterns = count;
+        params.pattern = patterns[0];
+        params.pattern_len = lens[0];
+        params.case_sensitive = true;
+        params.max_count = SIZE_MAX;
+        params.ac_trie = ac_trie_build(&params);
+        if (!params.ac_trie)
+            continue;
+        kernel_t kernels[] = {{"Aho-Corasick", aho_corasick_search}};
+        bench_kernels(c, &params, kernels, 1, "matches", "literal set");
+        ac_trie_free(params.ac_trie);
+        if (count < ac_pattern_counts[ci])
+            break;
+    }
+    free(lens);
+}
+
+static void bench_regex(const corpus_t *c, const char *regex)
+{
+    const char *pattern[] = {regex};
+    size_t len[] = {strlen(regex)};
+    search_params_t params;
+    set_single(&params, pattern, len);
+    params.use_regex = true;
+    regex_t compiled;
+    if (regcomp(&compiled, regex, REG_EXTENDED | REG_NEWLINE) != 0)
+        return;
+    params.compiled_regex = &compiled;
+
+    // regex_search runs on the lazy DFA when it can; without it, on regexec
+    params.regex_dfa = regex_dfa_compile(regex, true);
+    kernel_t kernels[] = {{"regex", regex_search}};
+    if (params.regex_dfa)
+    {
+        bench_kernels(c, &params, kernels, 1, "matches", "regex (dfa)");
+        regex_dfa_free(params.regex_dfa);
+        params.regex_dfa = NULL;
+    }
+    // POSIX regexec is orders of magnitude slower; keep it to one pass
+    double saved = min_seconds;
+    min_seconds = 0;
+    bench_kernels(c, &params, kernels, 1, "matches", "regex (regexec)");
+    min_seconds = saved;
+    regfree(&compiled);
+}
+
+static void bench_corpus(corpus_t *c, char literals[][65], size_t num_lengths, char **ac_patterns, size_t num_ac)
+{
+    bench_literals(c, literals, num_lengths);
+    bench_aho_corasick(c, ac_patterns, num_ac);
+
+    char regex[96];
+    snprintf(regex, sizeof(regex), "%.8s[0-9A-Z]*", literals[2]);
+    bench_regex(c, regex);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t corpus_mb = 16;
+    int first_file = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            corpus_mb = 2;
+            min_seconds = 0.05;
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            corpus_mb = strtoul(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Usage: %s [--quick] [--size MB] [FILE...]\n", argv[0]);
+            return 2;
+        }
+        else
+        {
+            first_file = i;
+            break;
+        }
+    }
+    if (corpus_mb == 0)
+        corpus_mb = 1;
+    open_cycle_counter();
+
+    // Synthetic patterns: one per literal length, and a pool for the Aho-Corasick sets
+    const size_t num_lengths = sizeof(literal_lengths) / sizeof(literal_lengths[0]);
+    char literals[sizeof(literal_lengths) / sizeof(literal_lengths[0])][65];
+    for (size_t i = 0; i < num_lengths; i++)
+        make_pattern(literals[i], literal_lengths[i], (unsigned)i + 1);
+    const size_t max_ac = ac_pattern_counts[sizeof(ac_pattern_counts) / sizeof(ac_pattern_counts[0]) - 1];
+    char **ac_patterns = malloc(max_ac * sizeof(char *));
+    char *ac_storage = malloc(max_ac * 17);
+    if (!ac_patterns || !ac_storage)
+        return 2;
+    for (size_t i = 0; i < max_ac; i++)
+    {
+        ac_patterns[i] = ac_storage + i * 17;
+        make_pattern(ac_patterns[i], 8 + i % 9, (unsigned)(i + 100));
+    }
+
+    printf("{\n  \"benchmark\": \"krep search kernels\",\n  \"compiler\": \"%s\",\n  \"corpus_mb\": %zu,\n"
+           "  \"min_seconds\": %.3f,\n  \"cycles_source\": \"%s\",\n  \"results\": [",
+           __VERSION__, corpus_mb, min_seconds, cycles_source);
+    fprintf(stderr, "Kernel benchmark: %zu MB corpora, cycles from %s\n", corpus_mb, cycles_source);
+
+    static const char *synthetic[] = {"random", "logs"};
+    for (size_t s = 0; s < 2; s++)
+    {
+        for (int dense = 0; dense <= 1; dense++)
+        {
+            corpus_t c;
+            if (!synth_corpus(&c, synthetic[s], dense ? "dense" : "sparse", corpus_mb << 20))
+                return 2;
+            size_t spacing = dense ? DENSE_MATCH_SPACING : SPARSE_MATCH_SPACING;
+            // Every literal length and some of every set size occur in the corpus
+            char *planted[sizeof(literal_lengths) / sizeof(literal_lengths[0]) + 3];
+            size_t np = 0;
+            for (size_t i = 0; i < num_lengths; i++)
+                planted[np++] = literals[i];
+            planted[np++] = ac_patterns[3];
+            planted[np++] = ac_patterns[500];
+            planted[np++] = ac_patterns[5000];
+            plant(&c, planted, np, spacing);
+            bench_corpus(&c, literals, num_lengths, ac_patterns, max_ac);
+            free(c.text);
+        }
+    }
+
+    // Real corpora: patterns sampled from each file
+    for (int i = first_file; i < argc; i++)
+    {
+        corpus_t c;
+        if (!map_corpus(&c, argv[i]))
+            continue;
+        char file_literals[sizeof(literal_lengths) / sizeof(literal_lengths[0])][65];
+        for (size_t l = 0; l < num_lengths; l++)
+            if (!sample_pattern(&c, file_literals[l], literal_lengths[l], (unsigned)l * 7919 + 1))
+                file_literals[l][0] = '\0';
+        char **file_ac = malloc(max_ac * sizeof(char *));
+        char *file_storage = malloc(max_ac * 17);
+        size_t num_file_ac = 0;
+        for (size_t k = 0; file_ac && file_storage && k < max_ac; k++)
+        {
+            file_ac[num_file_ac] = file_storage + num_file_ac * 17;
+            if (sample_pattern(&c, file_ac[num_file_ac], 8 + k % 9, (unsigned)k * 104729 + 3))
+                num_file_ac++;
+        }
+        bench_literals(&c, file_literals, num_lengths);
+        if (num_file_ac > 1)
+            bench_aho_corasick(&c, file_ac, num_file_ac);
+        free(file_ac);
+        free(file_storage);
+        munmap(c.text, c.len);
+    }
+
+    printf("\n  ]\n}\n");
+    free(ac_patterns);
+    free(ac_storage);
+    if (cycles_fd >= 0)
+        close(cycles_fd);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * Thread pool microbenchmark: tasks per second of the work-stealing pool
+ * against the previous single-queue pool (one mutex-protected linked list,
+ * one malloc per task), kept here as the reference.
+ *
+ * Build and run with: make bench
+ * Usage: bench/bench_pool [threads] [tasks]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+
+/* --- Reference: the previous mutex/condvar pool --- */
+
+typedef struct legacy_task
+{
+    void *(*func)(void *);
+    void *arg;
+    struct legacy_task *next;
+} legacy_task_t;
+
+typedef struct
+{
+    pthread_t *threads;
+    int num_threads;
+    legacy_task_t *head, *tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t queue_cond;
+    pthread_cond_t complete_cond;
+    size_t working;
+    bool shutdown;
+} legacy_pool_t;
+
+static void *legacy_worker(void *arg)
+{
+    legacy_pool_t *pool = arg;
+    while (true)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->head && !pool->shutdown)
+            pthread_cond_wait(&pool->queue_cond, &pool->mutex);
+        if (pool->shutdown && !pool->head)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        legacy_task_t *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pool->working++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task->func(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->working == 0 && !pool->head)
+            pthread_cond_signal(&pool->complete_cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+static legacy_pool_t *legacy_init(int n)
+{
+    legacy_pool_t *pool = calloc(1, sizeof(*pool));
+    pool->threads = calloc(n, sizeof(pthread_t));
+    pool->num_threads = n;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->queue_cond, NULL);
+    pthread_cond_init(&pool->complete_cond, NULL);
+    for (int i = 0; i < n; i++)
+        pthread_create(&pool->threads[i], NULL, legacy_worker, pool);
+    return pool;
+}
+
+static bool legacy_submit(legacy_pool_t *pool, void *(*func)(void *), void *arg)
+{
+    legacy_task_t *task = malloc(sizeof(*task));
+    if (!task)
+        return false;
+    task->func = func;
+    task->arg = arg;
+    task->next = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pthread_cond_signal(&pool->queue_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+static void legacy_wait_all(legacy_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->head || pool->working > 0)
+        pthread_cond_wait(&pool->complete_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void legacy_destroy(legacy_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->queue_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->complete_cond);
+    pthread_cond_destroy(&pool->queue_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+    free(pool);
+}
+
+/* --- Workloads --- */
+
+#define FANOUT 16 // Children submitted by each parent task in the nested workload
+
+static atomic_uint_fast64_t tasks_run;
+static legacy_pool_t *legacy_pool;
+static thread_pool_t *steal_pool;
+
+static void *tiny_task(void *arg)
+{
+    (void)arg;
+    atomic_fetch_add_explicit(&tasks_run, 1, memory_order_relaxed);
+    return NULL;
+}
+
+static void *legacy_parent_task(void *arg)
+{
+    for (int i = 0; i < FANOUT; i++)
+        legacy_submit(legacy_pool, tiny_task, arg);
+    return tiny_task(arg);
+}
+
+static void *steal_parent_task(void *arg)
+{
+    for (int i = 0; i < FANOUT; i++)
+        thread_pool_submit(steal_pool, tiny_task, arg);
+    return tiny_task(arg);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double seconds)
+{
+    uint64_t n = atomic_load(&tasks_run);
+    printf("  %-28s %10.0f tasks/s  (%llu tasks, %.3f s)\n", name, n / seconds, (unsigned long long)n, seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    long tasks = argc > 2 ? atol(argv[2]) : 1000000;
+    if (threads < 1)
+        threads = 1;
+    if (tasks < FANOUT + 1)
+        tasks = FANOUT + 1;
+    long parents = tasks / (FANOUT + 1);
+
+    printf("Thread pool benchmark: %d threads, %ld tasks\n", threads, tasks);
+
+    printf("External submit + wait_all:\n");
+    legacy_pool = legacy_init(threads);
+    atomic_store(&tasks_run, 0);
+    double t0 = now_seconds();
+    for (long i = 0; i < tasks; i++)
+        legacy_submit(legacy_pool, tiny_task, NULL);
+    legacy_wait_all(legacy_pool);
+    report("mutex queue (previous)", now_seconds() - t0);
+
+    steal_pool = thread_pool_init(threads);
+    atomic_store(&tasks_run, 0);
+    t0 = now_seconds();
+    for (long i = 0; i < tasks; i++)
+        thread_pool_submit(steal_pool, tiny_task, NULL);
+    thread_pool_wait_all(steal_pool);
+    report("work-stealing deques", now_seconds() - t0);
+
+    printf("Tasks submitting %d subtasks each:\n", FANOUT);
+    atomic_store(&tasks_run, 0);
+    t0 = now_seconds();
+    for (long i = 0; i < parents; i++)
+        legacy_submit(legacy_pool, legacy_parent_task, NULL);
+    // The condition is checked under the queue mutex, so children queued by a
+    // running parent are always seen before working drops to zero
+    legacy_wait_all(legacy_pool);
+    report("mutex queue (previous)", now_seconds() - t0);
+
+    atomic_store(&tasks_run, 0);
+    t0 = now_seconds();
+    for (long i = 0; i < parents; i++)
+        thread_pool_submit(steal_pool, steal_parent_task, NULL);
+    thread_pool_wait_all(steal_pool);
+    report("work-stealing deques", now_seconds() - t0);
+
+    legacy_destroy(legacy_pool);
+    thread_pool_destroy(steal_pool);
+    return 0;
+}
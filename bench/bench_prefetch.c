@@ -0,0 +1,208 @@
+/**
+ * Prefetch policy benchmark: time, page faults, dTLB misses and page-cache residency
+ * of a count-only search_file() over one file with each --prefetch policy.
+ *
+ * Every policy is run cold (the file is first dropped from the page cache with
+ * POSIX_FADV_DONTNEED, which only works for pages no other process has mapped) and
+ * warm (right after a full read of the file). "resident" is the share of the file left
+ * in the page cache after the search, i.e. how much other cached data the scan can
+ * have pushed out. dTLB misses need perf_event_open() access and print as n/a without.
+ *
+ * Build and run with: make bench
+ * Usage: bench/bench_prefetch FILE [pattern] [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Counter for data TLB read misses of this process and its threads, or -1
+static int open_dtlb_counter(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+// Fraction of the file's pages currently in the page cache
+static double resident_fraction(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = ((size_t)st.st_size + page - 1) / page;
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    unsigned char *vec = malloc(pages);
+    double fraction = -1;
+    if (map != MAP_FAILED && vec && mincore(map, st.st_size, vec) == 0)
+    {
+        size_t resident = 0;
+        for (size_t i = 0; i < pages; i++)
+            resident += vec[i] & 1;
+        fraction = (double)resident / pages;
+    }
+    free(vec);
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+    close(fd);
+    return fraction;
+}
+
+static void set_cache_state(const char *path, bool warm)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+    if (warm)
+    {
+        static char buf[1 << 20];
+        while (read(fd, buf, sizeof(buf)) > 0)
+            ;
+    }
+    else
+    {
+        fdatasync(fd);
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+}
+
+static void run_policy(const char *path, search_params_t *params, int threads, prefetch_policy_t policy,
+                       const char *name, bool warm, int dtlb_fd)
+{
+    set_cache_state(path, warm);
+    params->prefetch = policy;
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+#ifdef __linux__
+    if (dtlb_fd >= 0)
+    {
+        ioctl(dtlb_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(dtlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+
+    // The count line goes to stdout; keep it out of the table
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    double start = now_seconds();
+    int rc = search_file(params, path, threads);
+    double seconds = now_seconds() - start;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    long long dtlb = -1;
+#ifdef __linux__
+    if (dtlb_fd >= 0)
+    {
+        ioctl(dtlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(dtlb_fd, &dtlb, sizeof(dtlb)) != (ssize_t)sizeof(dtlb))
+            dtlb = -1;
+    }
+#endif
+    getrusage(RUSAGE_SELF, &after);
+
+    char dtlb_text[32] = "n/a";
+    if (dtlb >= 0)
+        snprintf(dtlb_text, sizeof(dtlb_text), "%lld", dtlb);
+    printf("  %-9s %-5s %8.3f s  %9ld minflt  %7ld majflt  dTLB-miss %12s  resident %5.1f%%%s\n", name,
+           warm ? "warm" : "cold", seconds, after.ru_minflt - before.ru_minflt, after.ru_majflt - before.ru_majflt,
+           dtlb_text, 100.0 * resident_fraction(path), rc == 2 ? "  (error)" : "");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s FILE [pattern] [threads]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[1];
+    const char *pattern = argc > 2 ? argv[2] : "ERROR";
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    const char *patterns[] = {pattern};
+    size_t pattern_lens[] = {strlen(pattern)};
+    search_params_t params = {0};
+    params.patterns = patterns;
+    params.pattern_lens = pattern_lens;
+    params.num_patterns = 1;
+    params.pattern = pattern;
+    params.pattern_len = pattern_lens[0];
+    params.case_sensitive = true;
+    params.count_lines_mode = true;
+    params.max_count = SIZE_MAX;
+    params.io_backend = IO_BACKEND_MMAP;
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        perror(path);
+        return 2;
+    }
+    int dtlb_fd = open_dtlb_counter();
+    printf("Prefetch benchmark: %s (%.1f MB), pattern \"%s\", %d threads%s\n", path, st.st_size / 1e6, pattern,
+           threads, dtlb_fd < 0 ? ", dTLB counter unavailable" : "");
+
+    static const struct
+    {
+        prefetch_policy_t policy;
+        const char *name;
+    } policies[] = {{PREFETCH_POPULATE, "populate"}, {PREFETCH_WINDOW, "window"}, {PREFETCH_NONE, "none"}};
+    for (int warm = 0; warm <= 1; warm++)
+        for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+            run_policy(path, &params, threads, policies[i].policy, policies[i].name, warm, dtlb_fd);
+
+    if (dtlb_fd >= 0)
+        close(dtlb_fd);
+    return 0;
+}
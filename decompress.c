@@ -0,0 +1,753 @@
+/* decompress.c - Streaming decompression of .gz, .zst and .lz4 input
+ *
+ * The compressed file is mapped and decoded into the streaming search, which handles
+ * the output like any pipe: in blocks, one line window at a time. Two decoding modes:
+ *
+ *  - Sequential: a single zlib / zstd / LZ4F stream context is advanced on every read.
+ *    This covers plain gzip (including concatenated members), single-frame zstd and
+ *    LZ4. The decoder still runs on the stream reader thread, so it overlaps with the
+ *    search of the previous block.
+ *  - Parallel: when the file consists of independently decodable pieces whose extent is
+ *    known without decoding them, i.e. BGZF gzip (every member records its size in the
+ *    BC extra field) or multi-frame zstd, the pieces are grouped into batches of about
+ *    DZ_BATCH_BYTES of input. Worker threads decode batches into a ring of output slots
+ *    and reads drain the slots strictly in batch order, so output order is preserved
+ *    while decoding runs several batches ahead of the search.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "decompress.h"
+
+#if KREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if KREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#if KREP_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#define DZ_BATCH_BYTES (1024 * 1024) // Compressed bytes per parallel task
+#define DZ_MAX_WORKERS 16
+#define DZ_SLOTS_PER_WORKER 2         // Decoded batches each worker may run ahead by
+#define DZ_MIN_OUTPUT (256 * 1024)    // Initial output buffer when the size is unknown
+
+typedef struct
+{
+    const unsigned char *src;
+    size_t len;
+    size_t out_hint; // Decompressed size if recorded in the file, else 0
+} dz_frame_t;
+
+typedef struct
+{
+    size_t first;    // First frame of the batch
+    size_t count;    // Frames in the batch
+    size_t out_hint; // Sum of the frames' hints
+} dz_batch_t;
+
+typedef enum
+{
+    DZ_SLOT_FREE,
+    DZ_SLOT_BUSY, // A worker is decoding into it
+    DZ_SLOT_DONE  // Ready for the reader
+} dz_slot_state_t;
+
+typedef struct
+{
+    char *out;
+    size_t len, cap;
+    size_t pos; // Bytes already handed to the reader
+    dz_slot_state_t state;
+    bool failed;
+} dz_slot_t;
+
+struct decompress
+{
+    decompress_format_t format;
+    const unsigned char *map; // Compressed file
+    size_t map_len;
+    const char *error;
+    bool eof;
+
+    // --- Sequential mode ---
+    size_t in_pos;
+#if KREP_HAVE_ZLIB
+    z_stream zs;
+    bool zs_ready;
+#endif
+#if KREP_HAVE_ZSTD
+    ZSTD_DStream *zds;
+    size_t zstd_pending; // Last ZSTD_decompressStream result: 0 at a frame boundary
+#endif
+#if KREP_HAVE_LZ4
+    LZ4F_dctx *lz4;
+#endif
+
+    // --- Parallel mode ---
+    bool parallel;
+    dz_frame_t *frames;
+    size_t num_frames;
+    dz_batch_t *batches;
+    size_t num_batches;
+    dz_slot_t *slots;
+    size_t num_slots;
+    size_t next_assign;  // Next batch a worker picks up
+    size_t next_consume; // Next batch the reader drains (its slot is next_consume % num_slots)
+    bool stop;
+    pthread_t workers[DZ_MAX_WORKERS];
+    int num_workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; // A slot became free
+    pthread_cond_t done_cond; // A slot was filled
+};
+
+// --- Format Detection ---
+
+static bool dz_has_extension(const char *filename, const char *ext)
+{
+    size_t len = strlen(filename), ext_len = strlen(ext);
+    return len > ext_len && strcasecmp(filename + len - ext_len, ext) == 0;
+}
+
+decompress_format_t decompress_detect(int fd, const char *filename)
+{
+    decompress_format_t format = DECOMPRESS_NONE;
+    if (dz_has_extension(filename, ".gz") || dz_has_extension(filename, ".tgz") || dz_has_extension(filename, ".bgz"))
+        format = DECOMPRESS_GZIP;
+    else if (dz_has_extension(filename, ".zst") || dz_has_extension(filename, ".zstd"))
+        format = DECOMPRESS_ZSTD;
+    else if (dz_has_extension(filename, ".lz4"))
+        format = DECOMPRESS_LZ4;
+    if (format == DECOMPRESS_NONE)
+        return DECOMPRESS_NONE;
+
+    // The extension only selects the candidate; the magic bytes decide
+    unsigned char magic[4];
+    if (pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic))
+        return DECOMPRESS_NONE;
+    switch (format)
+    {
+    case DECOMPRESS_GZIP:
+        return (magic[0] == 0x1f && magic[1] == 0x8b) ? format : DECOMPRESS_NONE;
+    case DECOMPRESS_ZSTD:
+        return (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) ? format : DECOMPRESS_NONE;
+    case DECOMPRESS_LZ4:
+        return (magic[0] == 0x04 && magic[1] == 0x22 && magic[2] == 0x4d && magic[3] == 0x18) ? format : DECOMPRESS_NONE;
+    default:
+        return DECOMPRESS_NONE;
+    }
+}
+
+bool decompress_supported(decompress_format_t format)
+{
+    switch (format)
+    {
+    case DECOMPRESS_GZIP:
+        return KREP_HAVE_ZLIB;
+    case DECOMPRESS_ZSTD:
+        return KREP_HAVE_ZSTD;
+    case DECOMPRESS_LZ4:
+        return KREP_HAVE_LZ4;
+    default:
+        return false;
+    }
+}
+
+const char *decompress_format_name(decompress_format_t format)
+{
+    switch (format)
+    {
+    case DECOMPRESS_GZIP:
+        return "gzip";
+    case DECOMPRESS_ZSTD:
+        return "zstd";
+    case DECOMPRESS_LZ4:
+        return "lz4";
+    default:
+        return "none";
+    }
+}
+
+const char *decompress_error(const decompress_t *decoder)
+{
+    return (decoder && decoder->error) ? decoder->error : "unknown decompression error";
+}
+
+// --- Frame Discovery for Parallel Decoding ---
+
+#if KREP_HAVE_ZLIB || KREP_HAVE_ZSTD
+static bool dz_add_frame(decompress_t *d, size_t *cap, const unsigned char *src, size_t len, size_t out_hint)
+{
+    if (d->num_frames == *cap)
+    {
+        size_t new_cap = *cap ? *cap * 2 : 256;
+        dz_frame_t *frames = realloc(d->frames, new_cap * sizeof(dz_frame_t));
+        if (!frames)
+            return false;
+        d->frames = frames;
+        *cap = new_cap;
+    }
+    d->frames[d->num_frames].src = src;
+    d->frames[d->num_frames].len = len;
+    d->frames[d->num_frames].out_hint = out_hint;
+    d->num_frames++;
+    return true;
+}
+#endif
+
+#if KREP_HAVE_ZLIB
+// Size of the BGZF member at p (from its BC extra subfield), or 0 if it is not one
+static size_t dz_bgzf_member_size(const unsigned char *p, size_t avail)
+{
+    if (avail < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 4))
+        return 0;
+    size_t xlen = (size_t)p[10] | (size_t)p[11] << 8;
+    if (avail < 12 + xlen)
+        return 0;
+    const unsigned char *extra = p + 12;
+    for (size_t i = 0; i + 4 <= xlen;)
+    {
+        size_t slen = (size_t)extra[i + 2] | (size_t)extra[i + 3] << 8;
+        if (extra[i] == 'B' && extra[i + 1] == 'C' && slen == 2 && i + 6 <= xlen)
+        {
+            size_t size = ((size_t)extra[i + 4] | (size_t)extra[i + 5] << 8) + 1;
+            return (size >= 12 + xlen + 8 && size <= avail) ? size : 0;
+        }
+        i += 4 + slen;
+    }
+    return 0;
+}
+#endif
+
+// Split the file into independently decodable frames. Leaves num_frames at 0 when the
+// format or file does not allow it (sequential decoding is used then).
+static bool dz_find_frames(decompress_t *d)
+{
+    size_t cap = 0;
+    d->num_frames = 0;
+#if KREP_HAVE_ZLIB
+    if (d->format == DECOMPRESS_GZIP)
+    {
+        for (size_t pos = 0; pos < d->map_len;)
+        {
+            size_t size = dz_bgzf_member_size(d->map + pos, d->map_len - pos);
+            if (size == 0)
+            {
+                d->num_frames = 0; // Not BGZF throughout
+                return true;
+            }
+            const unsigned char *isize = d->map + pos + size - 4;
+            size_t out_hint = (size_t)isize[0] | (size_t)isize[1] << 8 | (size_t)isize[2] << 16 | (size_t)isize[3] << 24;
+            if (!dz_add_frame(d, &cap, d->map + pos, size, out_hint))
+                return false;
+            pos += size;
+        }
+    }
+#endif
+#if KREP_HAVE_ZSTD
+    if (d->format == DECOMPRESS_ZSTD)
+    {
+        for (size_t pos = 0; pos < d->map_len;)
+        {
+            size_t size = ZSTD_findFrameCompressedSize(d->map + pos, d->map_len - pos);
+            if (ZSTD_isError(size) || size == 0)
+            {
+                d->num_frames = 0; // Let the streaming decoder report the damage in order
+                return true;
+            }
+            unsigned long long content = ZSTD_getFrameContentSize(d->map + pos, size);
+            size_t out_hint = (content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR ||
+                               content > SIZE_MAX / 2)
+                                  ? 0
+                                  : (size_t)content;
+            if (!dz_add_frame(d, &cap, d->map + pos, size, out_hint))
+                return false;
+            pos += size;
+        }
+    }
+#endif
+    (void)cap;
+    return true;
+}
+
+// --- Parallel Decoding ---
+
+static bool dz_reserve(dz_slot_t *slot, size_t extra)
+{
+    if (slot->cap - slot->len >= extra)
+        return true;
+    size_t cap = slot->cap ? slot->cap : DZ_MIN_OUTPUT;
+    while (cap - slot->len < extra)
+        cap *= 2;
+    char *out = realloc(slot->out, cap);
+    if (!out)
+        return false;
+    slot->out = out;
+    slot->cap = cap;
+    return true;
+}
+
+#if KREP_HAVE_ZLIB
+static bool dz_inflate_frames(const dz_frame_t *frames, size_t count, dz_slot_t *slot)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+        return false;
+    bool ok = true;
+    for (size_t f = 0; f < count && ok; f++)
+    {
+        inflateReset(&zs);
+        zs.next_in = (unsigned char *)frames[f].src;
+        zs.avail_in = (uInt)frames[f].len; // BGZF members are at most 64 KB
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END)
+        {
+            if (slot->cap == slot->len && !dz_reserve(slot, frames[f].out_hint ? frames[f].out_hint : DZ_MIN_OUTPUT))
+            {
+                ok = false;
+                break;
+            }
+            size_t room = slot->cap - slot->len;
+            if (room > UINT32_MAX)
+                room = UINT32_MAX;
+            zs.next_out = (unsigned char *)slot->out + slot->len;
+            zs.avail_out = (uInt)room;
+            ret = inflate(&zs, Z_NO_FLUSH);
+            slot->len += room - zs.avail_out;
+            if ((ret != Z_OK && ret != Z_STREAM_END) || (ret == Z_OK && zs.avail_in == 0 && zs.avail_out != 0))
+            {
+                ok = false; // Corrupt or truncated member
+                break;
+            }
+        }
+    }
+    inflateEnd(&zs);
+    return ok;
+}
+#endif
+
+#if KREP_HAVE_ZSTD
+static bool dz_zstd_frames(const dz_frame_t *frames, size_t count, dz_slot_t *slot)
+{
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    if (!dctx)
+        return false;
+    bool ok = true;
+    for (size_t f = 0; f < count && ok; f++)
+    {
+        if (frames[f].out_hint > 0)
+        {
+            // Size known from the frame header: decode in one call
+            if (!dz_reserve(slot, frames[f].out_hint))
+            {
+                ok = false;
+                break;
+            }
+            size_t n = ZSTD_decompressDCtx(dctx, slot->out + slot->len, slot->cap - slot->len,
+                                           frames[f].src, frames[f].len);
+            if (ZSTD_isError(n))
+                ok = false;
+            else
+                slot->len += n;
+            continue;
+        }
+
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+        ZSTD_inBuffer in = {frames[f].src, frames[f].len, 0};
+        size_t ret = 1;
+        while (ret != 0)
+        {
+            if (!dz_reserve(slot, DZ_MIN_OUTPUT))
+            {
+                ok = false;
+                break;
+            }
+            ZSTD_outBuffer out = {slot->out + slot->len, slot->cap - slot->len, 0};
+            ret = ZSTD_decompressStream(dctx, &out, &in);
+            slot->len += out.pos;
+            if (ZSTD_isError(ret) || (ret != 0 && in.pos == in.size && out.pos < out.size))
+            {
+                ok = false;
+                break;
+            }
+        }
+    }
+    ZSTD_freeDCtx(dctx);
+    return ok;
+}
+#endif
+
+static bool dz_decode_batch(decompress_t *d, const dz_batch_t *batch, dz_slot_t *slot)
+{
+    const dz_frame_t *frames = d->frames + batch->first;
+    if (batch->out_hint && !dz_reserve(slot, batch->out_hint))
+        return false;
+#if KREP_HAVE_ZLIB
+    if (d->format == DECOMPRESS_GZIP)
+        return dz_inflate_frames(frames, batch->count, slot);
+#endif
+#if KREP_HAVE_ZSTD
+    if (d->format == DECOMPRESS_ZSTD)
+        return dz_zstd_frames(frames, batch->count, slot);
+#endif
+    (void)frames;
+    return false;
+}
+
+static void *dz_worker(void *arg)
+{
+    decompress_t *d = (decompress_t *)arg;
+    pthread_mutex_lock(&d->mutex);
+    for (;;)
+    {
+        while (!d->stop && d->next_assign < d->num_batches &&
+               d->slots[d->next_assign % d->num_slots].state != DZ_SLOT_FREE)
+            pthread_cond_wait(&d->work_cond, &d->mutex);
+        if (d->stop || d->next_assign >= d->num_batches)
+            break;
+
+        const dz_batch_t *batch = &d->batches[d->next_assign];
+        dz_slot_t *slot = &d->slots[d->next_assign % d->num_slots];
+        d->next_assign++;
+        slot->state = DZ_SLOT_BUSY;
+        slot->len = 0;
+        slot->pos = 0;
+        pthread_mutex_unlock(&d->mutex);
+
+        bool ok = dz_decode_batch(d, batch, slot);
+
+        pthread_mutex_lock(&d->mutex);
+        slot->failed = !ok;
+        slot->state = DZ_SLOT_DONE;
+        pthread_cond_broadcast(&d->done_cond);
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return NULL;
+}
+
+static ssize_t dz_read_parallel(decompress_t *d, char *buf, size_t cap)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&d->mutex);
+        if (d->next_consume >= d->num_batches)
+        {
+            pthread_mutex_unlock(&d->mutex);
+            return 0;
+        }
+        dz_slot_t *slot = &d->slots[d->next_consume % d->num_slots];
+        while (slot->state != DZ_SLOT_DONE)
+            pthread_cond_wait(&d->done_cond, &d->mutex);
+        pthread_mutex_unlock(&d->mutex);
+
+        // A finished slot belongs to the reader until it is marked free again
+        if (slot->failed)
+        {
+            d->error = "corrupt or truncated compressed data";
+            errno = EBADMSG;
+            return -1;
+        }
+        size_t n = slot->len - slot->pos;
+        if (n > cap)
+            n = cap;
+        memcpy(buf, slot->out + slot->pos, n);
+        slot->pos += n;
+
+        if (slot->pos == slot->len)
+        {
+            pthread_mutex_lock(&d->mutex);
+            slot->state = DZ_SLOT_FREE;
+            d->next_consume++;
+            pthread_cond_broadcast(&d->work_cond);
+            pthread_mutex_unlock(&d->mutex);
+        }
+        if (n > 0)
+            return (ssize_t)n;
+    }
+}
+
+static bool dz_start_parallel(decompress_t *d, int threads)
+{
+    d->batches = malloc(d->num_frames * sizeof(dz_batch_t));
+    if (!d->batches)
+        return false;
+    for (size_t f = 0; f < d->num_frames;)
+    {
+        dz_batch_t *batch = &d->batches[d->num_batches++];
+        size_t in_bytes = 0;
+        batch->first = f;
+        batch->count = 0;
+        batch->out_hint = 0;
+        while (f < d->num_frames && (batch->count == 0 || in_bytes + d->frames[f].len <= DZ_BATCH_BYTES))
+        {
+            in_bytes += d->frames[f].len;
+            batch->out_hint += d->frames[f].out_hint;
+            batch->count++;
+            f++;
+        }
+    }
+
+    if (threads <= 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+    if (threads > DZ_MAX_WORKERS)
+        threads = DZ_MAX_WORKERS;
+    if ((size_t)threads > d->num_batches)
+        threads = (int)d->num_batches;
+
+    d->num_slots = (size_t)threads * DZ_SLOTS_PER_WORKER;
+    d->slots = calloc(d->num_slots, sizeof(dz_slot_t));
+    if (!d->slots)
+        return false;
+    pthread_mutex_init(&d->mutex, NULL);
+    pthread_cond_init(&d->work_cond, NULL);
+    pthread_cond_init(&d->done_cond, NULL);
+    d->parallel = true;
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&d->workers[d->num_workers], NULL, dz_worker, d) != 0)
+            break;
+        d->num_workers++;
+    }
+    return d->num_workers > 0;
+}
+
+// --- Sequential Decoding ---
+
+static ssize_t dz_read_sequential(decompress_t *d, char *buf, size_t cap)
+{
+    if (d->eof)
+        return 0;
+#if KREP_HAVE_ZLIB
+    if (d->format == DECOMPRESS_GZIP)
+    {
+        d->zs.next_out = (unsigned char *)buf;
+        d->zs.avail_out = cap > UINT32_MAX ? UINT32_MAX : (uInt)cap;
+        uInt out_room = d->zs.avail_out;
+        while (d->zs.avail_out == out_room)
+        {
+            if (d->in_pos >= d->map_len)
+            {
+                if (d->zs_ready)
+                {
+                    d->error = "truncated gzip data";
+                    errno = EBADMSG;
+                    return -1;
+                }
+                d->eof = true;
+                return 0;
+            }
+            size_t in_avail = d->map_len - d->in_pos;
+            if (!d->zs_ready)
+            {
+                // Concatenated members decode as one stream; trailing padding is ignored
+                if (in_avail < 2 || d->map[d->in_pos] != 0x1f || d->map[d->in_pos + 1] != 0x8b)
+                {
+                    d->eof = true;
+                    return 0;
+                }
+                inflateReset(&d->zs);
+                d->zs_ready = true;
+            }
+            d->zs.next_in = (unsigned char *)d->map + d->in_pos;
+            d->zs.avail_in = in_avail > UINT32_MAX ? UINT32_MAX : (uInt)in_avail;
+            uInt in_given = d->zs.avail_in;
+            int ret = inflate(&d->zs, Z_NO_FLUSH);
+            d->in_pos += in_given - d->zs.avail_in;
+            if (ret == Z_STREAM_END)
+                d->zs_ready = false;
+            else if (ret != Z_OK && !(ret == Z_BUF_ERROR && d->zs.avail_out == 0))
+            {
+                d->error = d->zs.msg ? d->zs.msg : "corrupt gzip data";
+                errno = EBADMSG;
+                return -1;
+            }
+        }
+        return (ssize_t)(out_room - d->zs.avail_out);
+    }
+#endif
+#if KREP_HAVE_ZSTD
+    if (d->format == DECOMPRESS_ZSTD)
+    {
+        ZSTD_inBuffer in = {d->map, d->map_len, d->in_pos};
+        ZSTD_outBuffer out = {buf, cap, 0};
+        while (out.pos == 0)
+        {
+            if (in.pos == in.size)
+            {
+                if (d->zstd_pending != 0)
+                {
+                    d->error = "truncated zstd data";
+                    errno = EBADMSG;
+                    return -1;
+                }
+                d->eof = true;
+                return 0;
+            }
+            size_t ret = ZSTD_decompressStream(d->zds, &out, &in);
+            d->in_pos = in.pos;
+            if (ZSTD_isError(ret))
+            {
+                d->error = ZSTD_getErrorName(ret);
+                errno = EBADMSG;
+                return -1;
+            }
+            d->zstd_pending = ret;
+        }
+        return (ssize_t)out.pos;
+    }
+#endif
+#if KREP_HAVE_LZ4
+    if (d->format == DECOMPRESS_LZ4)
+    {
+        size_t produced = 0;
+        while (produced == 0)
+        {
+            if (d->in_pos >= d->map_len)
+            {
+                d->eof = true;
+                return 0;
+            }
+            size_t dst = cap, src = d->map_len - d->in_pos;
+            size_t ret = LZ4F_decompress(d->lz4, buf, &dst, d->map + d->in_pos, &src, NULL);
+            d->in_pos += src;
+            produced = dst;
+            if (LZ4F_isError(ret))
+            {
+                d->error = LZ4F_getErrorName(ret);
+                errno = EBADMSG;
+                return -1;
+            }
+            if (ret != 0 && d->in_pos >= d->map_len && produced == 0)
+            {
+                d->error = "truncated lz4 data";
+                errno = EBADMSG;
+                return -1;
+            }
+        }
+        return (ssize_t)produced;
+    }
+#endif
+    (void)buf;
+    (void)cap;
+    d->error = "unsupported compression format";
+    errno = ENOTSUP;
+    return -1;
+}
+
+static bool dz_start_sequential(decompress_t *d)
+{
+#if KREP_HAVE_ZLIB
+    if (d->format == DECOMPRESS_GZIP)
+        return inflateInit2(&d->zs, 16 + MAX_WBITS) == Z_OK;
+#endif
+#if KREP_HAVE_ZSTD
+    if (d->format == DECOMPRESS_ZSTD)
+        return (d->zds = ZSTD_createDStream()) != NULL;
+#endif
+#if KREP_HAVE_LZ4
+    if (d->format == DECOMPRESS_LZ4)
+        return !LZ4F_isError(LZ4F_createDecompressionContext(&d->lz4, LZ4F_VERSION));
+#endif
+    (void)d;
+    return false;
+}
+
+// --- Public Interface ---
+
+decompress_t *decompress_open(int fd, decompress_format_t format, int threads)
+{
+    struct stat st;
+    if (!decompress_supported(format) || fstat(fd, &st) == -1 || st.st_size <= 0)
+        return NULL;
+
+    decompress_t *d = calloc(1, sizeof(*d));
+    if (!d)
+        return NULL;
+    d->format = format;
+    d->map_len = (size_t)st.st_size;
+    void *map = mmap(NULL, d->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        free(d);
+        return NULL;
+    }
+    d->map = map;
+    // Advice values are not flags; each needs its own call
+    (void)madvise(map, d->map_len, MADV_SEQUENTIAL);
+    (void)madvise(map, d->map_len, MADV_WILLNEED);
+
+    bool ok = dz_find_frames(d);
+    if (ok && d->num_frames > 1)
+        ok = dz_start_parallel(d, threads);
+    else if (ok)
+        ok = dz_start_sequential(d);
+    if (!ok)
+    {
+        decompress_close(d);
+        return NULL;
+    }
+    return d;
+}
+
+ssize_t decompress_read(decompress_t *decoder, char *buf, size_t cap)
+{
+    if (cap == 0)
+        return 0;
+    return decoder->parallel ? dz_read_parallel(decoder, buf, cap) : dz_read_sequential(decoder, buf, cap);
+}
+
+void decompress_close(decompress_t *d)
+{
+    if (!d)
+        return;
+    if (d->parallel)
+    {
+        pthread_mutex_lock(&d->mutex);
+        d->stop = true;
+        pthread_cond_broadcast(&d->work_cond);
+        pthread_mutex_unlock(&d->mutex);
+        for (int i = 0; i < d->num_workers; i++)
+            pthread_join(d->workers[i], NULL);
+        for (size_t i = 0; i < d->num_slots; i++)
+            free(d->slots[i].out);
+        pthread_mutex_destroy(&d->mutex);
+        pthread_cond_destroy(&d->work_cond);
+        pthread_cond_destroy(&d->done_cond);
+    }
+#if KREP_HAVE_ZLIB
+    if (d->format == DECOMPRESS_GZIP && !d->parallel)
+        inflateEnd(&d->zs);
+#endif
+#if KREP_HAVE_ZSTD
+    ZSTD_freeDStream(d->zds);
+#endif
+#if KREP_HAVE_LZ4
+    if (d->lz4)
+        LZ4F_freeDecompressionContext(d->lz4);
+#endif
+    free(d->slots);
+    free(d->batches);
+    free(d->frames);
+    if (d->map)
+        munmap((void *)d->map, d->map_len);
+    free(d);
+}
@@ -0,0 +1,63 @@
+/**
+ * Streaming decompression of compressed input files (.gz, .zst, .lz4).
+ * This header declares the decoder used to feed compressed files into the streaming search.
+ */
+
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>    // For size_t
+#include <sys/types.h> // For ssize_t
+
+// Each format is available when its library was found at build time (see the Makefile)
+#ifndef KREP_HAVE_ZLIB
+#define KREP_HAVE_ZLIB 0
+#endif
+#ifndef KREP_HAVE_ZSTD
+#define KREP_HAVE_ZSTD 0
+#endif
+#ifndef KREP_HAVE_LZ4
+#define KREP_HAVE_LZ4 0
+#endif
+
+typedef enum
+{
+    DECOMPRESS_NONE = 0, // Not compressed
+    DECOMPRESS_GZIP,     // gzip, including multi-member and BGZF files
+    DECOMPRESS_ZSTD,     // Zstandard, one or more frames
+    DECOMPRESS_LZ4       // LZ4 frame format
+} decompress_format_t;
+
+// Forward declaration for the opaque decoder
+struct decompress;
+typedef struct decompress decompress_t;
+
+// Format of the file open on fd, judged by its extension and then its magic bytes.
+// Returns DECOMPRESS_NONE for plain files. Formats not built in are still detected, so
+// that they are reported rather than searched as raw bytes (see decompress_supported).
+decompress_format_t decompress_detect(int fd, const char *filename);
+
+// True when support for format was built in
+bool decompress_supported(decompress_format_t format);
+
+// Short name of a format for messages ("gzip", "zstd", "lz4")
+const char *decompress_format_name(decompress_format_t format);
+
+// Start decoding the file open on fd; the compressed data is mapped, so fd may be closed
+// afterwards. Files made of many independent members (BGZF gzip, multi-frame zstd) are
+// decoded by up to threads worker threads (0 = one per core) that run ahead of the
+// reader; everything else is decoded on the calling thread. Returns NULL on error.
+decompress_t *decompress_open(int fd, decompress_format_t format, int threads);
+
+// Copy up to cap decompressed bytes into buf, in order. Returns the number of bytes,
+// 0 at the end of the data, or -1 on corrupt or truncated input (see decompress_error).
+ssize_t decompress_read(decompress_t *decoder, char *buf, size_t cap);
+
+// Description of the last decoding error
+const char *decompress_error(const decompress_t *decoder);
+
+// Stop the worker threads and release the decoder
+void decompress_close(decompress_t *decoder);
+
+#endif // DECOMPRESS_H
@@ -0,0 +1,489 @@
+/* ignore.c - .gitignore / .ignore rules and --glob overrides for recursive search
+ *
+ * A recursive search compiles the ignore files of each directory into one rule set per
+ * directory level, chained to the level above, so a directory's rules are parsed once
+ * and inherited by its whole subtree. Directories with no ignore file share their
+ * parent's set. Ignored directories are pruned by the walk before they are opened.
+ *
+ * Within a level the last matching rule decides, as in git. Most real rules are plain
+ * names ("node_modules", "build/") or extensions ("*.o"); those go into two hash tables
+ * that map a name or an extension to the last rule using it, so the common case costs
+ * two lookups no matter how many rules the level has. Only the remaining rules with
+ * wildcards are tried one by one: from the last rule back, stopping at the last match
+ * the tables already found, and each one first checks the literal text a match must
+ * end with before running the wildcard matcher.
+ *
+ * Pattern syntax follows gitignore: '*', '?' and '[...]' do not match '/', "**" as a
+ * whole path component matches any number of directories, a trailing '/' matches
+ * directories only, a '/' anywhere else anchors the pattern to the ignore file's
+ * directory, and a leading '!' negates the rule.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "ignore.h"
+
+typedef struct
+{
+    char *glob;       // Pattern without its '!', leading '/' and trailing '/'
+    size_t glob_len;
+    size_t tail_len;  // Literal bytes every match ends with (the end of glob)
+    bool include;     // Matching paths are kept rather than skipped
+    bool dir_only;    // Trailing '/': matches directories only
+    bool anchored;    // Matched against the path below the level, not the base name
+} ignore_rule_t;
+
+// Last rule using a name (or an extension) as its whole pattern
+typedef struct
+{
+    const char *key; // Points into the rule's glob; NULL for an empty slot
+    size_t key_len;
+    int32_t last_file; // Last such rule that applies to files, -1 for none
+    int32_t last_dir;  // Last such rule that applies to directories, -1 for none
+} ignore_slot_t;
+
+struct ignore_rules
+{
+    _Atomic int refs;
+    struct ignore_rules *parent;
+    size_t base_len;
+    ignore_rule_t *rules; // In file order
+    size_t count;
+    size_t capacity;
+    bool has_includes;
+    bool compiled;
+
+    // Built by ignore_rules_compile
+    ignore_slot_t *names;     // Rules that are a plain base name
+    ignore_slot_t *exts;      // Rules of the form "*.ext"
+    size_t table_mask;        // Both tables have table_mask + 1 slots
+    uint32_t *general;        // Every other rule, by index, in file order
+    size_t num_general;
+};
+
+enum
+{
+    GLOB_NOMATCH = 0,
+    GLOB_MATCH,
+    GLOB_ABORT_TO_STARSTAR, // A '*' cannot match past a '/'; only an enclosing "**" can
+    GLOB_ABORT_ALL          // The text ran out; no later start can match either
+};
+
+static inline bool is_glob_meta(char c)
+{
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+// Match a "[...]" class starting at p (just after '['). Sets *end to the byte after
+// the closing ']'; returns -1 when the class is not terminated.
+static int match_class(const char *p, const char *pe, unsigned char c, const char **end)
+{
+    bool negated = false;
+    if (p < pe && (*p == '!' || *p == '^'))
+    {
+        negated = true;
+        p++;
+    }
+    bool matched = false;
+    bool first = true;
+    while (p < pe && (*p != ']' || first))
+    {
+        first = false;
+        unsigned char lo = (unsigned char)*p++;
+        if (lo == '\\' && p < pe)
+            lo = (unsigned char)*p++;
+        unsigned char hi = lo;
+        if (p + 1 < pe && *p == '-' && p[1] != ']')
+        {
+            p++;
+            hi = (unsigned char)*p++;
+            if (hi == '\\' && p < pe)
+                hi = (unsigned char)*p++;
+        }
+        if (c >= lo && c <= hi)
+            matched = true;
+    }
+    if (p >= pe)
+        return -1;
+    *end = p + 1;
+    return matched != negated;
+}
+
+// Wildcard match of pattern [p, pe) against text [t, te), '/' separating components.
+// ps is the start of the whole pattern, to tell where a "**" component begins.
+static int glob_match(const char *ps, const char *p, const char *pe, const char *t, const char *te)
+{
+    for (; p < pe; p++, t++)
+    {
+        char pc = *p;
+        if (t >= te && pc != '*')
+            return GLOB_ABORT_ALL;
+        switch (pc)
+        {
+        case '\\':
+            if (++p >= pe)
+                return GLOB_NOMATCH;
+            if (*t != *p)
+                return GLOB_NOMATCH;
+            break;
+        case '?':
+            if (*t == '/')
+                return GLOB_NOMATCH;
+            break;
+        case '[':
+        {
+            const char *end = NULL;
+            int r = *t == '/' ? 0 : match_class(p + 1, pe, (unsigned char)*t, &end);
+            if (r == -1)
+                return GLOB_ABORT_ALL;
+            if (r == 0)
+                return GLOB_NOMATCH;
+            p = end - 1;
+            break;
+        }
+        case '*':
+        {
+            bool globstar = false;
+            const char *run = p;
+            while (p + 1 < pe && p[1] == '*')
+                p++;
+            if (p > run && (run == ps || run[-1] == '/') && (p + 1 == pe || p[1] == '/'))
+            {
+                globstar = true;
+                // "**/" also matches no directory at all
+                if (p + 1 < pe && glob_match(ps, p + 2, pe, t, te) == GLOB_MATCH)
+                    return GLOB_MATCH;
+            }
+            p++;
+            if (p == pe)
+            {
+                // Trailing '*' takes the rest of the component; trailing "**" everything
+                if (!globstar && memchr(t, '/', (size_t)(te - t)))
+                    return GLOB_ABORT_TO_STARSTAR;
+                return GLOB_MATCH;
+            }
+            for (;; t++)
+            {
+                int r = glob_match(ps, p, pe, t, te);
+                if (r != GLOB_NOMATCH && (!globstar || r != GLOB_ABORT_TO_STARSTAR))
+                    return r;
+                if (t >= te)
+                    return GLOB_ABORT_ALL;
+                if (!globstar && *t == '/')
+                    return GLOB_ABORT_TO_STARSTAR;
+            }
+        }
+        default:
+            if (*t != pc)
+                return GLOB_NOMATCH;
+            break;
+        }
+    }
+    return t == te ? GLOB_MATCH : GLOB_NOMATCH;
+}
+
+static inline uint32_t slot_hash(const char *key, size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
+
+static const ignore_slot_t *table_find(const ignore_slot_t *table, size_t mask, const char *key, size_t len)
+{
+    for (size_t i = slot_hash(key, len) & mask; table[i].key; i = (i + 1) & mask)
+    {
+        if (table[i].key_len == len && memcmp(table[i].key, key, len) == 0)
+            return &table[i];
+    }
+    return NULL;
+}
+
+static void table_insert(ignore_slot_t *table, size_t mask, const char *key, size_t len, int32_t index,
+                         bool dir_only)
+{
+    size_t i = slot_hash(key, len) & mask;
+    while (table[i].key && !(table[i].key_len == len && memcmp(table[i].key, key, len) == 0))
+        i = (i + 1) & mask;
+    if (!table[i].key)
+    {
+        table[i].key = key;
+        table[i].key_len = len;
+        table[i].last_file = -1;
+        table[i].last_dir = -1;
+    }
+    // Rules are inserted in order, so the last one inserted for a key wins
+    if (!dir_only)
+        table[i].last_file = index;
+    table[i].last_dir = index;
+}
+
+ignore_rules_t *ignore_rules_new(ignore_rules_t *parent, size_t base_len)
+{
+    ignore_rules_t *rules = calloc(1, sizeof(ignore_rules_t));
+    if (!rules)
+        return NULL;
+    atomic_init(&rules->refs, 1);
+    rules->parent = ignore_rules_retain(parent);
+    rules->base_len = base_len;
+    return rules;
+}
+
+// Parse one pattern line (len bytes, no newline). Blank lines and comments add nothing.
+static bool add_rule(ignore_rules_t *rules, const char *line, size_t len, bool is_glob)
+{
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+    // Trailing spaces are dropped unless escaped with a backslash
+    while (len > 0 && line[len - 1] == ' ' && !(len > 1 && line[len - 2] == '\\'))
+        len--;
+    if (len == 0 || line[0] == '#')
+        return true;
+
+    ignore_rule_t rule = {0};
+    // In ignore files "!" re-includes; for --glob a plain glob includes and "!" excludes
+    rule.include = is_glob;
+    if (line[0] == '!')
+    {
+        rule.include = !rule.include;
+        line++;
+        len--;
+    }
+    if (len > 0 && line[len - 1] == '/')
+    {
+        rule.dir_only = true;
+        len--;
+    }
+    if (len > 0 && line[0] == '/')
+    {
+        rule.anchored = true;
+        line++;
+        len--;
+    }
+    // "**/name" is just "name" when the rest has no '/'
+    while (len > 3 && memcmp(line, "**/", 3) == 0 && !memchr(line + 3, '/', len - 3))
+    {
+        line += 3;
+        len -= 3;
+        rule.anchored = false;
+    }
+    if (memchr(line, '/', len))
+        rule.anchored = true;
+    if (len == 0)
+        return true; // "/" or "!" alone
+
+    rule.glob = malloc(len + 1);
+    if (!rule.glob)
+        return false;
+    memcpy(rule.glob, line, len);
+    rule.glob[len] = '\0';
+    rule.glob_len = len;
+    if (!memchr(line, '\\', len))
+    {
+        while (rule.tail_len < len && !is_glob_meta(line[len - 1 - rule.tail_len]) &&
+               line[len - 1 - rule.tail_len] != ']')
+            rule.tail_len++;
+    }
+
+    if (rules->count == rules->capacity)
+    {
+        size_t capacity = rules->capacity ? rules->capacity * 2 : 16;
+        ignore_rule_t *grown = realloc(rules->rules, capacity * sizeof(ignore_rule_t));
+        if (!grown)
+        {
+            free(rule.glob);
+            return false;
+        }
+        rules->rules = grown;
+        rules->capacity = capacity;
+    }
+    rules->rules[rules->count++] = rule;
+    if (rule.include && is_glob)
+        rules->has_includes = true;
+    rules->compiled = false;
+    return true;
+}
+
+bool ignore_rules_add_file(ignore_rules_t *rules, const char *text, size_t len)
+{
+    const char *end = text + len;
+    while (text < end)
+    {
+        const char *newline = memchr(text, '\n', (size_t)(end - text));
+        const char *line_end = newline ? newline : end;
+        if (!add_rule(rules, text, (size_t)(line_end - text), false))
+            return false;
+        text = newline ? newline + 1 : end;
+    }
+    return true;
+}
+
+bool ignore_rules_add_glob(ignore_rules_t *rules, const char *glob)
+{
+    size_t before = rules->count;
+    if (!add_rule(rules, glob, strlen(glob), true))
+        return false;
+    return rules->count > before;
+}
+
+// "*.ext" with a plain extension: the part after a name's last '.'
+static bool rule_extension(const ignore_rule_t *rule, const char **ext, size_t *ext_len)
+{
+    if (rule->anchored || rule->glob_len < 3 || rule->glob[0] != '*' || rule->glob[1] != '.')
+        return false;
+    for (size_t i = 2; i < rule->glob_len; i++)
+    {
+        if (is_glob_meta(rule->glob[i]) || rule->glob[i] == '.')
+            return false;
+    }
+    *ext = rule->glob + 2;
+    *ext_len = rule->glob_len - 2;
+    return true;
+}
+
+static bool rule_is_name(const ignore_rule_t *rule)
+{
+    if (rule->anchored)
+        return false;
+    for (size_t i = 0; i < rule->glob_len; i++)
+    {
+        if (is_glob_meta(rule->glob[i]))
+            return false;
+    }
+    return true;
+}
+
+bool ignore_rules_compile(ignore_rules_t *rules)
+{
+    free(rules->names);
+    free(rules->exts);
+    free(rules->general);
+    rules->names = rules->exts = NULL;
+    rules->general = NULL;
+    rules->num_general = 0;
+
+    size_t slots = 16;
+    while (slots < rules->count * 2)
+        slots *= 2;
+    rules->names = calloc(slots, sizeof(ignore_slot_t));
+    rules->exts = calloc(slots, sizeof(ignore_slot_t));
+    rules->general = malloc((rules->count ? rules->count : 1) * sizeof(uint32_t));
+    if (!rules->names || !rules->exts || !rules->general)
+        return false;
+    rules->table_mask = slots - 1;
+
+    for (size_t i = 0; i < rules->count; i++)
+    {
+        const ignore_rule_t *rule = &rules->rules[i];
+        const char *ext;
+        size_t ext_len;
+        if (rule_is_name(rule))
+            table_insert(rules->names, rules->table_mask, rule->glob, rule->glob_len, (int32_t)i, rule->dir_only);
+        else if (rule_extension(rule, &ext, &ext_len))
+            table_insert(rules->exts, rules->table_mask, ext, ext_len, (int32_t)i, rule->dir_only);
+        else
+            rules->general[rules->num_general++] = (uint32_t)i;
+    }
+    rules->compiled = true;
+    return true;
+}
+
+size_t ignore_rules_count(const ignore_rules_t *rules)
+{
+    return rules ? rules->count : 0;
+}
+
+bool ignore_rules_has_includes(const ignore_rules_t *rules)
+{
+    return rules && rules->has_includes;
+}
+
+// Index of the last rule of one level matching the path, or -1
+static int32_t level_match(const ignore_rules_t *rules, const char *path, size_t path_len, const char *name,
+                           size_t name_len, bool is_dir)
+{
+    int32_t best = -1;
+    const ignore_slot_t *slot = table_find(rules->names, rules->table_mask, name, name_len);
+    if (slot)
+        best = is_dir ? slot->last_dir : slot->last_file;
+
+    const char *dot = memrchr(name, '.', name_len);
+    if (dot)
+    {
+        size_t ext_len = name_len - (size_t)(dot + 1 - name);
+        slot = ext_len ? table_find(rules->exts, rules->table_mask, dot + 1, ext_len) : NULL;
+        if (slot)
+        {
+            int32_t last = is_dir ? slot->last_dir : slot->last_file;
+            if (last > best)
+                best = last;
+        }
+    }
+
+    for (size_t g = rules->num_general; g-- > 0;)
+    {
+        int32_t index = (int32_t)rules->general[g];
+        if (index < best)
+            break;
+        const ignore_rule_t *rule = &rules->rules[index];
+        if (rule->dir_only && !is_dir)
+            continue;
+        const char *text = rule->anchored ? path : name;
+        size_t text_len = rule->anchored ? path_len : name_len;
+        if (text_len < rule->tail_len ||
+            memcmp(text + text_len - rule->tail_len, rule->glob + rule->glob_len - rule->tail_len, rule->tail_len) != 0)
+            continue;
+        if (glob_match(rule->glob, rule->glob, rule->glob + rule->glob_len, text, text + text_len) == GLOB_MATCH)
+            return index;
+    }
+    return best;
+}
+
+ignore_match_t ignore_rules_match(const ignore_rules_t *rules, const char *rel_path, size_t rel_len, bool is_dir)
+{
+    const char *slash = memrchr(rel_path, '/', rel_len);
+    const char *name = slash ? slash + 1 : rel_path;
+    size_t name_len = rel_len - (size_t)(name - rel_path);
+
+    for (; rules; rules = rules->parent)
+    {
+        if (!rules->compiled || rules->count == 0)
+            continue;
+        // The path below the level's directory
+        size_t skip = rules->base_len ? rules->base_len + 1 : 0;
+        if (skip >= rel_len)
+            continue;
+        int32_t index = level_match(rules, rel_path + skip, rel_len - skip, name, name_len, is_dir);
+        if (index >= 0)
+            return rules->rules[index].include ? IGNORE_INCLUDE : IGNORE_EXCLUDE;
+    }
+    return IGNORE_NONE;
+}
+
+ignore_rules_t *ignore_rules_retain(ignore_rules_t *rules)
+{
+    if (rules)
+        atomic_fetch_add(&rules->refs, 1);
+    return rules;
+}
+
+void ignore_rules_release(ignore_rules_t *rules)
+{
+    while (rules && atomic_fetch_sub(&rules->refs, 1) == 1)
+    {
+        ignore_rules_t *parent = rules->parent;
+        for (size_t i = 0; i < rules->count; i++)
+            free(rules->rules[i].glob);
+        free(rules->rules);
+        free(rules->names);
+        free(rules->exts);
+        free(rules->general);
+        free(rules);
+        rules = parent;
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * Ignore rules for recursive search: .gitignore / .ignore files and --glob overrides.
+ * This header declares the compiled rule sets and the path matcher the directory walk uses.
+ */
+
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+// Ignore files larger than this are not read
+#define IGNORE_FILE_MAX_SIZE (4 * 1024 * 1024)
+
+// Forward declaration for the opaque rule set
+struct ignore_rules;
+typedef struct ignore_rules ignore_rules_t;
+
+// Verdict of the last rule that matched a path
+typedef enum
+{
+   IGNORE_NONE = 0, // No rule matched
+   IGNORE_EXCLUDE,  // Skip the path (and, for a directory, everything below it)
+   IGNORE_INCLUDE   // Keep the path: a "!pattern" ignore rule, or a --glob include
+} ignore_match_t;
+
+// New, empty rule set for one directory level. base_len is the length of that
+// directory's path relative to the walk root (0 for the root); anchored patterns are
+// matched against the part of a path after it. parent (retained, may be NULL) holds
+// the rules of the directories above, which apply where this level has no match.
+ignore_rules_t *ignore_rules_new(ignore_rules_t *parent, size_t base_len);
+
+// Add the rules of an ignore file in gitignore syntax. Returns false when out of memory.
+bool ignore_rules_add_file(ignore_rules_t *rules, const char *text, size_t len);
+
+// Add one --glob override: GLOB includes matching paths, !GLOB excludes them.
+// Returns false when the glob is empty or out of memory.
+bool ignore_rules_add_glob(ignore_rules_t *rules, const char *glob);
+
+// Build the lookup tables once every rule is added; required before ignore_rules_match.
+// Returns false when out of memory.
+bool ignore_rules_compile(ignore_rules_t *rules);
+
+// Rules added to this level, not counting its parents
+size_t ignore_rules_count(const ignore_rules_t *rules);
+
+// True when this level holds a --glob include, so files matching none are skipped
+bool ignore_rules_has_includes(const ignore_rules_t *rules);
+
+// Verdict for rel_path (rel_len bytes, relative to the walk root, no trailing '/').
+// Within a level the last matching rule wins; a level with no match defers to its parent.
+ignore_match_t ignore_rules_match(const ignore_rules_t *rules, const char *rel_path, size_t rel_len, bool is_dir);
+
+// Reference counting; compiled rule sets are immutable and shared across threads.
+// Both accept NULL.
+ignore_rules_t *ignore_rules_retain(ignore_rules_t *rules);
+void ignore_rules_release(ignore_rules_t *rules);
+
+#endif // IGNORE_H
@@ -0,0 +1,574 @@
+/* io_reader.c - Read-ahead file reader for the streaming search
+ *
+ * mmap is the fastest way to search a file that sits in the page cache, but for files
+ * on NFS/FUSE mounts, or much bigger than RAM, every miss is a synchronous page fault
+ * and MAP_POPULATE holds up the search until the whole mapping is faulted in. For
+ * those files the search reads the file into the streaming search instead:
+ *
+ *  - io_uring (Linux): IO_READER_QUEUE_DEPTH aligned block reads are kept in flight,
+ *    landing directly in buffers registered with the ring (IORING_OP_READ_FIXED).
+ *    Blocks are consumed strictly in file order; a block's buffer is resubmitted for
+ *    the next unread offset as soon as it has been handed out.
+ *  - pread: one block at a time, relying on kernel readahead. Used when io_uring is
+ *    not available (older kernels, seccomp, non-Linux) or was not requested.
+ *
+ * Either can read with O_DIRECT, which skips the page cache for one-off scans of huge
+ * files; if the filesystem refuses O_DIRECT the reader quietly uses buffered reads.
+ * The io_uring ring is driven with raw syscalls, so there is no liburing dependency.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/vfs.h> // For fstatfs
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define IOR_HAVE_URING 1
+#endif
+#endif
+#endif
+#ifndef IOR_HAVE_URING
+#define IOR_HAVE_URING 0
+#endif
+
+#include "io_reader.h"
+
+#define IOR_ALIGNMENT 4096 // Buffer, offset and length alignment for O_DIRECT
+
+#if IOR_HAVE_URING
+typedef struct
+{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+    unsigned to_submit; // Prepared entries not yet passed to io_uring_enter
+} ior_ring_t;
+
+typedef struct
+{
+    off_t offset;   // File offset of the block
+    size_t len;     // Bytes read so far
+    bool submitted; // Holds (or is reading) a block; false past the end of the file
+    bool pending;   // A read for this slot is in flight
+    int error;      // errno of a failed read, 0 if none
+} ior_slot_t;
+#endif
+
+struct io_reader
+{
+    int fd;
+    bool direct;
+    size_t block_size;
+    off_t file_size;
+    off_t next_offset; // Next offset to read (pread) or to submit (io_uring)
+
+    // Block being handed out by io_reader_read
+    const char *cur;
+    size_t cur_len, cur_pos;
+
+    char *bounce; // Aligned buffer for O_DIRECT pread
+
+#if IOR_HAVE_URING
+    bool uring;
+    ior_ring_t ring;
+    char *buffers; // IO_READER_QUEUE_DEPTH registered blocks
+    ior_slot_t slots[IO_READER_QUEUE_DEPTH];
+    unsigned head;     // Slot holding the next block in file order
+    unsigned inflight; // Reads submitted and not yet completed
+#endif
+};
+
+// --- Backend Selection ---
+
+bool io_backend_parse(const char *name, io_backend_t *backend)
+{
+    static const struct
+    {
+        const char *name;
+        io_backend_t backend;
+    } names[] = {{"auto", IO_BACKEND_AUTO}, {"mmap", IO_BACKEND_MMAP}, {"read", IO_BACKEND_READ},
+                 {"uring", IO_BACKEND_URING}, {"direct", IO_BACKEND_DIRECT}};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strcmp(name, names[i].name) == 0)
+        {
+            *backend = names[i].backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *io_backend_name(io_backend_t backend)
+{
+    switch (backend)
+    {
+    case IO_BACKEND_MMAP:
+        return "mmap";
+    case IO_BACKEND_READ:
+        return "read";
+    case IO_BACKEND_URING:
+        return "uring";
+    case IO_BACKEND_DIRECT:
+        return "direct";
+    default:
+        return "auto";
+    }
+}
+
+// True for filesystems where page faults turn into network round trips
+static bool ior_is_remote_fs(int fd)
+{
+#ifdef __linux__
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) != 0)
+        return false;
+    switch ((unsigned long)sfs.f_type)
+    {
+    case 0x6969UL:     // NFS
+    case 0x65735546UL: // FUSE (sshfs, gcsfuse, s3fs, ...)
+    case 0xFF534D42UL: // CIFS
+    case 0xFE534D42UL: // SMB2
+    case 0x517BUL:     // SMB
+    case 0x01021997UL: // 9P (v9fs)
+    case 0x00C36400UL: // Ceph
+    case 0x0BD00BD0UL: // Lustre
+    case 0x6B414653UL: // AFS
+        return true;
+    default:
+        return false;
+    }
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+io_backend_t io_backend_select(int fd, const struct stat *st, io_backend_t requested)
+{
+    if (requested != IO_BACKEND_AUTO)
+        return requested;
+    if (!S_ISREG(st->st_mode) || st->st_size < IO_READER_MIN_ASYNC_SIZE)
+        return IO_BACKEND_MMAP;
+    if (ior_is_remote_fs(fd))
+        return IO_BACKEND_URING;
+
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && page_size > 0 && (uint64_t)st->st_size > (uint64_t)pages * (uint64_t)page_size / 2)
+        return IO_BACKEND_URING;
+    return IO_BACKEND_MMAP;
+}
+
+// Switch the descriptor back to buffered reads after the filesystem rejected O_DIRECT
+static void ior_drop_direct(io_reader_t *r)
+{
+    int flags = fcntl(r->fd, F_GETFL);
+    if (flags != -1)
+        (void)fcntl(r->fd, F_SETFL, flags & ~O_DIRECT);
+    r->direct = false;
+}
+
+// --- io_uring Backend ---
+
+#if IOR_HAVE_URING
+static void ior_ring_unmap(ior_ring_t *ring)
+{
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_map && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_map_len);
+    if (ring->sq_map && ring->sq_map != MAP_FAILED)
+        munmap(ring->sq_map, ring->sq_map_len);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static bool ior_ring_setup(ior_ring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0)
+    {
+        ring->fd = -1;
+        return false;
+    }
+
+    ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_map = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map && ring->cq_map_len > ring->sq_map_len)
+        ring->sq_map_len = ring->cq_map_len;
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED)
+    {
+        ior_ring_unmap(ring);
+        return false;
+    }
+    ring->cq_map = single_map ? ring->sq_map
+                              : mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->cq_map == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        ior_ring_unmap(ring);
+        return false;
+    }
+
+    char *sq = ring->sq_map, *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+static int ior_ring_enter(ior_ring_t *ring, unsigned min_complete)
+{
+    for (;;)
+    {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete,
+                               min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0)
+        {
+            ring->to_submit -= (unsigned)ret < ring->to_submit ? (unsigned)ret : ring->to_submit;
+            return 0;
+        }
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+// Queue a fixed-buffer read of the rest of slot i's block
+static void ior_queue_read(io_reader_t *r, unsigned i)
+{
+    ior_ring_t *ring = &r->ring;
+    ior_slot_t *slot = &r->slots[i];
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = r->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(r->buffers + (size_t)i * r->block_size + slot->len);
+    sqe->len = (uint32_t)(r->block_size - slot->len);
+    sqe->off = (uint64_t)(slot->offset + (off_t)slot->len);
+    sqe->buf_index = (uint16_t)i;
+    sqe->user_data = i;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+
+    slot->pending = true;
+    r->inflight++;
+}
+
+// Point slot i at the next unread block, or mark it unused past the end of the file
+static void ior_start_block(io_reader_t *r, unsigned i)
+{
+    ior_slot_t *slot = &r->slots[i];
+    slot->len = 0;
+    slot->error = 0;
+    slot->submitted = r->next_offset < r->file_size;
+    if (!slot->submitted)
+        return;
+    slot->offset = r->next_offset;
+    r->next_offset += (off_t)r->block_size;
+    ior_queue_read(r, i);
+}
+
+// Wait for at least one completion and process everything that completed
+static bool ior_reap(io_reader_t *r)
+{
+    ior_ring_t *ring = &r->ring;
+    if (ior_ring_enter(ring, 1) != 0)
+        return false;
+
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        unsigned i = (unsigned)cqe->user_data;
+        int res = cqe->res;
+        ior_slot_t *slot = &r->slots[i];
+        slot->pending = false;
+        r->inflight--;
+
+        if (res == -EINVAL && r->direct)
+        {
+            ior_drop_direct(r);
+            ior_queue_read(r, i);
+        }
+        else if (res == -EAGAIN || res == -EINTR)
+        {
+            ior_queue_read(r, i);
+        }
+        else if (res < 0)
+        {
+            slot->error = -res;
+        }
+        else
+        {
+            slot->len += (size_t)res;
+            // Short read before the end of the file (e.g. a network filesystem): read the rest
+            if (res > 0 && slot->len < r->block_size && slot->offset + (off_t)slot->len < r->file_size)
+                ior_queue_read(r, i);
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool ior_uring_open(io_reader_t *r)
+{
+    if (!ior_ring_setup(&r->ring, IO_READER_QUEUE_DEPTH))
+        return false;
+
+    size_t total = (size_t)IO_READER_QUEUE_DEPTH * r->block_size;
+    if (posix_memalign((void **)&r->buffers, IOR_ALIGNMENT, total) != 0)
+    {
+        r->buffers = NULL;
+        ior_ring_unmap(&r->ring);
+        return false;
+    }
+
+    struct iovec iov[IO_READER_QUEUE_DEPTH];
+    for (unsigned i = 0; i < IO_READER_QUEUE_DEPTH; i++)
+    {
+        iov[i].iov_base = r->buffers + (size_t)i * r->block_size;
+        iov[i].iov_len = r->block_size;
+    }
+    // Registration pins the buffers; it fails when RLIMIT_MEMLOCK is too small
+    if (syscall(__NR_io_uring_register, r->ring.fd, IORING_REGISTER_BUFFERS, iov, IO_READER_QUEUE_DEPTH) != 0)
+    {
+        free(r->buffers);
+        r->buffers = NULL;
+        ior_ring_unmap(&r->ring);
+        return false;
+    }
+
+    r->uring = true;
+    for (unsigned i = 0; i < IO_READER_QUEUE_DEPTH; i++)
+        ior_start_block(r, i);
+    if (ior_ring_enter(&r->ring, 0) != 0)
+    {
+        // Nothing was accepted; nothing is in flight
+        ior_ring_unmap(&r->ring);
+        free(r->buffers);
+        r->buffers = NULL;
+        r->uring = false;
+        r->inflight = 0;
+        r->next_offset = 0;
+        return false;
+    }
+    return true;
+}
+
+static ssize_t ior_uring_read(io_reader_t *r, char *buf, size_t cap)
+{
+    // The block handed out last is fully consumed: reuse its buffer for the next block
+    if (r->cur)
+    {
+        unsigned prev = (r->head + IO_READER_QUEUE_DEPTH - 1) % IO_READER_QUEUE_DEPTH;
+        r->cur = NULL;
+        ior_start_block(r, prev);
+        if (r->ring.to_submit && ior_ring_enter(&r->ring, 0) != 0)
+            return -1;
+    }
+
+    ior_slot_t *slot = &r->slots[r->head];
+    if (!slot->submitted)
+        return 0;
+    while (slot->pending)
+    {
+        if (!ior_reap(r))
+            return -1;
+    }
+    if (slot->error)
+    {
+        errno = slot->error;
+        return -1;
+    }
+    if (slot->len == 0)
+        return 0; // The file shrank after it was opened
+
+    r->cur = r->buffers + (size_t)r->head * r->block_size;
+    r->cur_len = slot->len;
+    r->cur_pos = 0;
+    r->head = (r->head + 1) % IO_READER_QUEUE_DEPTH;
+
+    size_t n = cap < r->cur_len ? cap : r->cur_len;
+    memcpy(buf, r->cur, n);
+    r->cur_pos = n;
+    return (ssize_t)n;
+}
+#endif // IOR_HAVE_URING
+
+// --- pread Backend ---
+
+static ssize_t ior_pread_full(io_reader_t *r, char *buf, size_t len)
+{
+    for (;;)
+    {
+        ssize_t n = pread(r->fd, buf, len, r->next_offset);
+        if (n >= 0)
+        {
+            r->next_offset += n;
+            return n;
+        }
+        if (errno == EINVAL && r->direct)
+        {
+            ior_drop_direct(r);
+            continue;
+        }
+        if (errno != EINTR)
+            return -1;
+    }
+}
+
+static ssize_t ior_pread_read(io_reader_t *r, char *buf, size_t cap)
+{
+    if (!r->direct)
+        return ior_pread_full(r, buf, cap < r->block_size ? cap : r->block_size);
+
+    // O_DIRECT needs an aligned buffer: read whole blocks into the bounce buffer
+    ssize_t n = ior_pread_full(r, r->bounce, r->block_size);
+    if (n <= 0)
+        return n;
+    r->cur = r->bounce;
+    r->cur_len = (size_t)n;
+    size_t out = cap < r->cur_len ? cap : r->cur_len;
+    memcpy(buf, r->cur, out);
+    r->cur_pos = out;
+    return (ssize_t)out;
+}
+
+// --- Public Interface ---
+
+io_reader_t *io_reader_open(int fd, io_backend_t backend, size_t block_size)
+{
+    struct stat st;
+    if (block_size == 0 || block_size % IOR_ALIGNMENT != 0 || fstat(fd, &st) == -1)
+        return NULL;
+
+    io_reader_t *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    r->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (r->fd == -1)
+    {
+        free(r);
+        return NULL;
+    }
+    r->block_size = block_size;
+    r->file_size = st.st_size;
+
+#ifdef O_DIRECT
+    if (backend == IO_BACKEND_DIRECT)
+    {
+        int flags = fcntl(r->fd, F_GETFL);
+        r->direct = flags != -1 && fcntl(r->fd, F_SETFL, flags | O_DIRECT) == 0;
+        if (r->direct && posix_memalign((void **)&r->bounce, IOR_ALIGNMENT, block_size) != 0)
+        {
+            r->bounce = NULL;
+            ior_drop_direct(r);
+        }
+    }
+#endif
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(__APPLE__)
+    if (!r->direct)
+        (void)posix_fadvise(r->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#if IOR_HAVE_URING
+    r->ring.fd = -1;
+    if (backend == IO_BACKEND_URING || backend == IO_BACKEND_DIRECT)
+        (void)ior_uring_open(r); // Falls back to pread
+#endif
+    return r;
+}
+
+ssize_t io_reader_read(io_reader_t *reader, char *buf, size_t cap)
+{
+    if (cap == 0)
+        return 0;
+    if (reader->cur && reader->cur_pos < reader->cur_len)
+    {
+        size_t n = reader->cur_len - reader->cur_pos;
+        if (n > cap)
+            n = cap;
+        memcpy(buf, reader->cur + reader->cur_pos, n);
+        reader->cur_pos += n;
+        return (ssize_t)n;
+    }
+#if IOR_HAVE_URING
+    if (reader->uring)
+        return ior_uring_read(reader, buf, cap);
+#endif
+    reader->cur = NULL;
+    return ior_pread_read(reader, buf, cap);
+}
+
+bool io_reader_uses_uring(const io_reader_t *reader)
+{
+#if IOR_HAVE_URING
+    return reader->uring;
+#else
+    (void)reader;
+    return false;
+#endif
+}
+
+bool io_reader_is_direct(const io_reader_t *reader)
+{
+    return reader->direct;
+}
+
+void io_reader_close(io_reader_t *reader)
+{
+    if (!reader)
+        return;
+#if IOR_HAVE_URING
+    if (reader->uring)
+    {
+        // The kernel may still be writing into the buffers: wait for reads in flight
+        while (reader->inflight > 0 && ior_reap(reader))
+            ;
+        ior_ring_unmap(&reader->ring);
+        free(reader->buffers);
+    }
+#endif
+    free(reader->bounce);
+    close(reader->fd);
+    free(reader);
+}
@@ -0,0 +1,62 @@
+/**
+ * Read-ahead file reader used instead of mmap for large or remote files.
+ * This header declares the I/O backend selection and the sequential block reader.
+ */
+
+#ifndef IO_READER_H
+#define IO_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>    // For size_t
+#include <sys/stat.h>  // For struct stat
+#include <sys/types.h> // For ssize_t
+
+typedef enum
+{
+    IO_BACKEND_AUTO = 0, // mmap, or async reads for large files on network/FUSE mounts or bigger than RAM
+    IO_BACKEND_MMAP,     // Map the whole file and search it in parallel chunks
+    IO_BACKEND_READ,     // Sequential pread() into the streaming search
+    IO_BACKEND_URING,    // io_uring reads kept IO_READER_QUEUE_DEPTH blocks ahead (pread if unavailable)
+    IO_BACKEND_DIRECT    // As IO_BACKEND_URING, with O_DIRECT to bypass the page cache
+} io_backend_t;
+
+// Reads kept in flight by the io_uring reader
+#define IO_READER_QUEUE_DEPTH 8
+
+// In auto mode files smaller than this are always mapped
+#define IO_READER_MIN_ASYNC_SIZE (64 * 1024 * 1024)
+
+// Forward declaration for the opaque reader
+struct io_reader;
+typedef struct io_reader io_reader_t;
+
+// Parse an --io= value ("auto", "mmap", "read", "uring", "direct"). Returns false if unknown.
+bool io_backend_parse(const char *name, io_backend_t *backend);
+
+// Name of a backend as accepted by io_backend_parse
+const char *io_backend_name(io_backend_t backend);
+
+// Resolve the requested backend for the file open on fd. Explicit choices are kept;
+// IO_BACKEND_AUTO becomes IO_BACKEND_URING for files of at least IO_READER_MIN_ASYNC_SIZE
+// that live on a network or FUSE filesystem or exceed half of physical memory, and
+// IO_BACKEND_MMAP otherwise.
+io_backend_t io_backend_select(int fd, const struct stat *st, io_backend_t requested);
+
+// Start reading the file open on fd from offset 0 in blocks of block_size bytes (a
+// multiple of 4096). fd is duplicated, so the caller may close it. Returns NULL on error.
+io_reader_t *io_reader_open(int fd, io_backend_t backend, size_t block_size);
+
+// Copy up to cap bytes of file data into buf, in file order. Returns the number of
+// bytes, 0 at the end of the file, or -1 with errno set on a read error.
+ssize_t io_reader_read(io_reader_t *reader, char *buf, size_t cap);
+
+// True when reads go through io_uring (false after falling back to pread)
+bool io_reader_uses_uring(const io_reader_t *reader);
+
+// True when the file is read with O_DIRECT
+bool io_reader_is_direct(const io_reader_t *reader);
+
+// Cancel outstanding reads and release the reader
+void io_reader_close(io_reader_t *reader);
+
+#endif // IO_READER_H
@@ -12,6 +12,14 @@
 
 #include "krep.h"         // Include the header file
 #include "aho_corasick.h" // Include AC header for build/free functions
+#include "regex_dfa.h"    // Lazy DFA regex engine
+#include "trigram_index.h" // Persistent trigram index (--index)
+#include "decompress.h"    // .gz / .zst / .lz4 input
+#include "io_reader.h"     // Read-ahead reader used instead of mmap (--io)
+#include "algo_profile.h"  // Kernel choices measured by --calibrate
+#include "stats.h"         // Phase timings and counters (--stats)
+#include "arena.h"         // Per-search bump allocator for positions and output
+#include "ignore.h"        // .gitignore / .ignore rules and --glob overrides (-r)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +32,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h> // Include for mmap, madvise constants
+#include <sys/uio.h>  // For writev of per-chunk output
 #include <pthread.h>
 #include <inttypes.h> // For PRIu64 macro
 #include <errno.h>
@@ -33,33 +42,40 @@
 #include <sys/types.h> // For mode_t, DIR*, struct dirent
 #include <getopt.h>    // For command-line parsing
 #include <stdatomic.h> // For atomic operations in multithreading
+#include <sched.h>     // For sched_yield in the thread pool
+
+// File change notification for --follow
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <sys/syscall.h>  // For the thread pool's futex parking
+#include <linux/futex.h>
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22 // Linux 5.14; older C libraries do not define it
+#endif
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#include <sys/event.h>
+#define KREP_USE_KQUEUE 1
+#define KREP_CAPTURE_FUNOPEN 1 // Output capture streams come from funopen()
+#endif
 
 // Add forward declaration for is_repetitive_pattern here
 static bool is_repetitive_pattern(const char *pattern, size_t pattern_len);
 
+// Forward declaration for select_literal_algorithm (heuristic behind select_search_algorithm)
+static search_func_t select_literal_algorithm(const search_params_t *params);
+
 // Forward declaration for ensure_line_buffer_capacity
 static bool ensure_line_buffer_capacity(char **buffer_ptr, size_t *capacity_ptr, size_t current_pos, size_t needed);
 
-// SIMD Intrinsics Includes based on compiler flags (from Makefile)
-#if defined(__AVX2__)
-#include <immintrin.h> // AVX2 intrinsics
-#define KREP_USE_AVX2 1
-#else
-#define KREP_USE_AVX2 0
-#endif
-
-#if defined(__SSE4_2__)
-#include <nmmintrin.h> // SSE4.2 intrinsics
-#define KREP_USE_SSE42 1
-#else
-#define KREP_USE_SSE42 0
+// SIMD intrinsics. x86 kernels are compiled with per-function target attributes
+// (see KREP_USE_* in krep.h), so the headers are included unconditionally there.
+#if KREP_USE_SSE42 || KREP_USE_AVX2 || KREP_USE_AVX512
+#include <immintrin.h>
 #endif
 
-#if defined(__ARM_NEON)
+#if KREP_USE_NEON
 #include <arm_neon.h> // NEON intrinsics
-#define KREP_USE_NEON 1
-#else
-#define KREP_USE_NEON 0
 #endif
 
 // Constants
@@ -72,39 +88,104 @@ static bool ensure_line_buffer_capacity(char **buffer_ptr, size_t *capacity_ptr,
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
-#define BINARY_CHECK_BUFFER_SIZE 1024  // Bytes to check for binary content
 #define MAX_PATTERN_FILE_LINE_LEN 2048 // Max length for a pattern line read from file
 
-// Determine max pattern length usable by SIMD based on highest available instruction set
-// NOTE: Current SIMD implementations only support case-sensitive search.
-#if KREP_USE_AVX2
-// AVX2 implementation handles <= 32 bytes.
-const size_t SIMD_MAX_PATTERN_LEN = 32;
-#elif KREP_USE_SSE42
-const size_t SIMD_MAX_PATTERN_LEN = 16;
-#elif KREP_USE_NEON
-const size_t SIMD_MAX_PATTERN_LEN = 16;
-#else
-const size_t SIMD_MAX_PATTERN_LEN = 0;
-#endif
+// CPU features resolved once at startup (see init_simd_dispatch). Each x86 kernel checks
+// its flag on entry and falls back to Boyer-Moore, so calling it directly is always safe.
+static bool cpu_has_sse2 = false;
+static bool cpu_has_sse42 = false;
+static bool cpu_has_avx2 = false;
+static bool cpu_has_avx512bw = false;
+
+// Longest pattern any available SIMD kernel handles (0 if none, SIZE_MAX if unlimited)
+static size_t simd_max_pattern_len = 0;
 
 // Global state (Consider encapsulating if becomes too large)
 static bool color_output_enabled KREP_UNUSED = false;
 static bool only_matching = false; // -o flag
 static bool force_no_simd = false;
-static atomic_bool global_match_found_flag = false; // Used in recursive search
-static atomic_bool madvise_warning_emitted = false;   // Suppress repeated madvise warnings
+atomic_bool global_match_found_flag = false;        // Used in recursive search
+static atomic_bool madvise_warning_emitted = false; // Suppress repeated madvise warnings
+
+// Per-thread output redirection. NULL means stdout; file-level workers in recursive
+// mode point this at a private memory stream so each file's output stays atomic.
+static _Thread_local FILE *thread_output_stream = NULL;
+
+static inline FILE *current_output(void)
+{
+    return thread_output_stream ? thread_output_stream : stdout;
+}
+
+// Set by the recursive search when an earlier file printed context groups (-A/-B/-C),
+// so the first group of the next file searched on this thread is preceded by "--"
+static _Thread_local bool context_follows_earlier_file = false;
+
+// -A/-B/-C apply to the full-line output only
+static inline bool context_lines_enabled(const search_params_t *params)
+{
+    return !only_matching && (params->context_before > 0 || params->context_after > 0);
+}
+
+// Context printing state for a whole input that starts at text
+static inline print_context_t context_for_input(const char *text, size_t text_len)
+{
+    print_context_t context = {text, text + text_len, 0, context_follows_earlier_file, context_follows_earlier_file, false};
+    return context;
+}
+
+// Print the per-input summary of a count-mode search: the count for -c, the name of a
+// matching input for -l (NULL names standard input), nothing for -q
+static void print_count_summary(const search_params_t *params, const char *filename, uint64_t count)
+{
+    FILE *out = current_output();
+    if (params->quiet)
+        return;
+    if (params->files_with_matches)
+    {
+        if (count == 0)
+            return;
+        const char *name = filename ? filename : "(standard input)";
+        if (color_output_enabled)
+            fprintf(out, "%s%s%s\n", KREP_COLOR_FILENAME, name, KREP_COLOR_RESET);
+        else
+            fprintf(out, "%s\n", name);
+    }
+    else if (filename)
+        fprintf(out, "%s:%" PRIu64 "\n", filename, count);
+    else
+        fprintf(out, "%" PRIu64 "\n", count);
+}
 
 // Global lookup table for fast lowercasing
 unsigned char lower_table[256]; // Remove static
 
-// Initialize the lower_table at program start
+// Rough relative frequency of each byte in log and source text (higher = more common).
+// Used to pick rare anchor bytes for SIMD filtering; only the ordering matters.
+static uint8_t byte_frequency[256];
+
+// Initialize the lower_table and byte_frequency tables at program start
 static void __attribute__((constructor)) init_lower_table(void)
 {
     for (int i = 0; i < 256; i++)
     {
         lower_table[i] = tolower(i);
     }
+
+    static const char letters_by_frequency[] = "etaoinsrhldcumfpgwybvkxjqz";
+    for (int i = 0; i < 256; i++)
+        byte_frequency[i] = (i >= 0x80) ? 8 : (isprint(i) ? 60 : 1);
+    for (int i = 0; letters_by_frequency[i]; i++)
+    {
+        byte_frequency[(unsigned char)letters_by_frequency[i]] = (uint8_t)(250 - 4 * i);
+        byte_frequency[toupper((unsigned char)letters_by_frequency[i])] = (uint8_t)(120 - 2 * i);
+    }
+    for (int d = '0'; d <= '9'; d++)
+        byte_frequency[d] = (d <= '2') ? 200 : 180;
+    for (const char *p = ".,:-_/=\"'()[]"; *p; p++)
+        byte_frequency[(unsigned char)*p] = 140;
+    byte_frequency[' '] = 255;
+    byte_frequency['\t'] = 100;
+    byte_frequency['\n'] = 200;
 }
 
 // --- Match Result Management ---
@@ -142,29 +223,151 @@ match_result_t *match_result_init(uint64_t initial_capacity)
 
     result->count = 0;
     result->capacity = initial_capacity;
+    result->arena = NULL;
+    result->starts = NULL;
+    result->match_len = 0;
+    return result;
+}
+
+match_result_t *match_result_init_arena(arena_t *arena, uint64_t initial_capacity)
+{
+    if (!arena)
+        return match_result_init(initial_capacity);
+
+    if (initial_capacity == 0)
+    {
+        initial_capacity = 16; // Default initial size
+    }
+    else if (initial_capacity > SIZE_MAX / sizeof(match_position_t))
+    {
+        fprintf(stderr, "Error: Requested capacity too large for match_result_init\n");
+        return NULL;
+    }
+
+    // The positions come last, so they grow in place while the arena block has room
+    match_result_t *result = arena_alloc(arena, sizeof(match_result_t));
+    match_position_t *positions = result ? arena_alloc(arena, initial_capacity * sizeof(match_position_t)) : NULL;
+    if (!positions)
+    {
+        fprintf(stderr, "Error: Arena allocation failed for match positions\n");
+        return NULL;
+    }
+
+    result->positions = positions;
+    result->count = 0;
+    result->capacity = initial_capacity;
+    result->arena = arena;
+    result->starts = NULL;
+    result->match_len = 0;
+    return result;
+}
+
+match_result_t *match_result_init_compact(arena_t *arena, uint64_t initial_capacity, size_t match_len)
+{
+    if (match_len == 0)
+        return NULL;
+    if (initial_capacity == 0)
+        initial_capacity = 16;
+    else if (initial_capacity > SIZE_MAX / sizeof(match_position_t))
+    {
+        fprintf(stderr, "Error: Requested capacity too large for match_result_init\n");
+        return NULL;
+    }
+
+    match_result_t *result = arena ? arena_alloc(arena, sizeof(match_result_t)) : malloc(sizeof(match_result_t));
+    uint32_t *starts = NULL;
+    if (result)
+        starts = arena ? arena_alloc(arena, initial_capacity * sizeof(uint32_t))
+                       : malloc(initial_capacity * sizeof(uint32_t));
+    if (!starts)
+    {
+        perror("malloc failed for compact match positions");
+        if (!arena)
+            free(result);
+        return NULL;
+    }
+
+    result->positions = NULL;
+    result->count = 0;
+    result->capacity = initial_capacity;
+    result->arena = arena;
+    result->starts = starts;
+    result->match_len = match_len;
     return result;
 }
 
+// Resize the positions (or starts) array to new_capacity entries, in its arena when it has one
+static bool match_result_resize(match_result_t *result, uint64_t new_capacity)
+{
+    size_t entry_size = result->starts ? sizeof(uint32_t) : sizeof(match_position_t);
+    void *array = result->starts ? (void *)result->starts : (void *)result->positions;
+    size_t old_bytes = result->capacity * entry_size;
+    size_t new_bytes = new_capacity * entry_size;
+    void *new_array = result->arena ? arena_grow(result->arena, array, old_bytes, new_bytes)
+                                    : realloc(array, new_bytes);
+    if (!new_array)
+        return false; // Existing array is preserved
+    if (result->starts)
+        result->starts = new_array;
+    else
+        result->positions = new_array;
+    result->capacity = new_capacity;
+    return true;
+}
+
+bool match_result_expand(match_result_t *result)
+{
+    if (!result || !result->starts)
+        return true;
+
+    uint64_t capacity = result->capacity ? result->capacity : 16;
+    if (capacity > SIZE_MAX / sizeof(match_position_t))
+        return false;
+    size_t bytes = capacity * sizeof(match_position_t);
+    match_position_t *positions = result->arena ? arena_alloc(result->arena, bytes) : malloc(bytes);
+    if (!positions)
+    {
+        perror("Error allocating match positions for a compact result");
+        return false;
+    }
+    for (uint64_t i = 0; i < result->count; i++)
+    {
+        positions[i].start_offset = result->starts[i];
+        positions[i].end_offset = result->starts[i] + result->match_len;
+    }
+
+    if (!result->arena)
+        free(result->starts); // Arena memory stays until the arena is reset
+    result->positions = positions;
+    result->capacity = capacity;
+    result->starts = NULL;
+    result->match_len = 0;
+    return true;
+}
+
 // Add a match to the result structure, reallocating if necessary
 inline bool match_result_add(match_result_t *result, size_t start_offset, size_t end_offset)
 {
     if (!result)
         return false;
 
+    // A compact result only holds 32-bit starts of its one match length
+    if (result->starts && (start_offset > UINT32_MAX || end_offset - start_offset != result->match_len) &&
+        !match_result_expand(result))
+        return false;
+
     // Check if we need to expand the capacity
     if (result->count >= result->capacity)
     {
         // Fast path for initial allocation
         if (result->capacity == 0)
         {
-            size_t initial_capacity = 16;
-            result->positions = malloc(initial_capacity * sizeof(match_position_t));
-            if (!result->positions)
+            result->positions = NULL;
+            if (!match_result_resize(result, 16))
             {
                 perror("Error allocating initial match positions array");
                 return false;
             }
-            result->capacity = initial_capacity;
         }
         else
         {
@@ -192,23 +395,24 @@ inline bool match_result_add(match_result_t *result, size_t start_offset, size_t
             }
 
             // Perform the reallocation
-            match_position_t *new_positions = realloc(result->positions,
-                                                      new_capacity * sizeof(match_position_t));
-            if (!new_positions)
+            if (!match_result_resize(result, new_capacity))
             {
                 perror("Error reallocating match positions array");
-                // Existing array is preserved by realloc semantics
                 return false;
             }
-
-            result->positions = new_positions;
-            result->capacity = new_capacity;
         }
     }
 
     // Add the new match position
-    result->positions[result->count].start_offset = start_offset;
-    result->positions[result->count].end_offset = end_offset;
+    if (result->starts)
+    {
+        result->starts[result->count] = (uint32_t)start_offset;
+    }
+    else
+    {
+        result->positions[result->count].start_offset = start_offset;
+        result->positions[result->count].end_offset = end_offset;
+    }
     result->count++;
 
     return true;
@@ -217,10 +421,12 @@ inline bool match_result_add(match_result_t *result, size_t start_offset, size_t
 // Free memory associated with match result structure
 void match_result_free(match_result_t *result)
 {
-    if (!result)
-        return;
+    if (!result || result->arena)
+        return; // Arena memory is reclaimed when the arena is reset
     if (result->positions)
         free(result->positions);
+    if (result->starts)
+        free(result->starts);
     free(result);
 }
 
@@ -279,21 +485,32 @@ bool match_result_merge(match_result_t *dest, const match_result_t *src, size_t
             return false;
         }
 
-        match_position_t *new_positions = realloc(dest->positions, new_capacity * sizeof(match_position_t));
-        if (!new_positions)
+        if (!match_result_resize(dest, new_capacity))
         {
             perror("Error reallocating destination match positions for merge");
             return false;
         }
-        dest->positions = new_positions;
-        dest->capacity = new_capacity;
     }
 
-    // Copy and adjust offsets
-    for (uint64_t i = 0; i < src->count; ++i)
+    // Copy and adjust offsets; compact to compact copies 4 bytes per match while the
+    // adjusted starts fit in 32 bits
+    uint64_t i = 0;
+    if (dest->starts && src->starts && src->match_len == dest->match_len)
+    {
+        for (; i < src->count; ++i)
+        {
+            uint64_t start = (uint64_t)src->starts[i] + chunk_offset;
+            if (start > UINT32_MAX)
+                break;
+            dest->starts[dest->count++] = (uint32_t)start;
+        }
+    }
+    if (i < src->count && !match_result_expand(dest))
+        return false;
+    for (; i < src->count; ++i)
     {
-        dest->positions[dest->count].start_offset = src->positions[i].start_offset + chunk_offset;
-        dest->positions[dest->count].end_offset = src->positions[i].end_offset + chunk_offset;
+        dest->positions[dest->count].start_offset = match_result_start(src, i) + chunk_offset;
+        dest->positions[dest->count].end_offset = match_result_end(src, i) + chunk_offset;
         dest->count++;
     }
     return true;
@@ -320,8 +537,8 @@ static bool match_result_merge_limited(match_result_t *dest,
     for (uint64_t i = 0; i < copy_count; ++i)
     {
         if (!match_result_add(dest,
-                              src->positions[i].start_offset + chunk_offset,
-                              src->positions[i].end_offset + chunk_offset))
+                              match_result_start(src, i) + chunk_offset,
+                              match_result_end(src, i) + chunk_offset))
         {
             return false;
         }
@@ -330,6 +547,32 @@ static bool match_result_merge_limited(match_result_t *dest,
     return true;
 }
 
+// Add delta to the offsets of matches first..count-1, for kernels that hand a tail of
+// their text to another kernel
+static bool match_result_shift(match_result_t *result, uint64_t first, size_t delta)
+{
+    if (result->starts)
+    {
+        bool fits = delta <= UINT32_MAX;
+        for (uint64_t k = first; fits && k < result->count; ++k)
+            fits = (uint64_t)result->starts[k] + delta <= UINT32_MAX;
+        if (fits)
+        {
+            for (uint64_t k = first; k < result->count; ++k)
+                result->starts[k] += (uint32_t)delta;
+            return true;
+        }
+        if (!match_result_expand(result))
+            return false;
+    }
+    for (uint64_t k = first; k < result->count; ++k)
+    {
+        result->positions[k].start_offset += delta;
+        result->positions[k].end_offset += delta;
+    }
+    return true;
+}
+
 // --- Line Finding Functions ---
 
 // Find the start of the line containing the given position
@@ -388,6 +631,158 @@ size_t find_line_end(const char *text, size_t text_len, size_t pos)
     // return pos; // Returns index of '\n' or text_len if no newline found
 }
 
+// --- Newline Counting and Index ---
+
+static size_t count_newlines_scalar(const char *text, size_t len)
+{
+    size_t count = 0;
+    const char *end = text + len;
+    while ((text = memchr(text, '\n', end - text)) != NULL)
+    {
+        count++;
+        text++;
+    }
+    return count;
+}
+
+#if KREP_USE_AVX512
+KREP_TARGET("avx512f,avx512bw,popcnt")
+static size_t count_newlines_avx512(const char *text, size_t len)
+{
+    const __m512i newline = _mm512_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+        count += __builtin_popcountll(_mm512_cmpeq_epi8_mask(_mm512_loadu_si512((const void *)(text + i)), newline));
+    return count + count_newlines_scalar(text + i, len - i);
+}
+#endif
+
+#if KREP_USE_AVX2
+KREP_TARGET("avx2,popcnt")
+static size_t count_newlines_avx2(const char *text, size_t len)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    // One 64-bit newline mask per 64 bytes
+    for (; i + 64 <= len; i += 64)
+    {
+        uint32_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i)), newline));
+        uint32_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(text + i + 32)), newline));
+        count += __builtin_popcountll(((uint64_t)hi << 32) | lo);
+    }
+    return count + count_newlines_scalar(text + i, len - i);
+}
+#endif
+
+#if KREP_USE_NEON
+static size_t count_newlines_neon(const char *text, size_t len)
+{
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)(text + i)), newline);
+        count += vaddvq_u8(vshrq_n_u8(eq, 7)); // 0xFF lanes become 1
+    }
+    return count + count_newlines_scalar(text + i, len - i);
+}
+#endif
+
+size_t count_newlines(const char *text, size_t len)
+{
+#if KREP_USE_AVX512
+    if (cpu_has_avx512bw)
+        return count_newlines_avx512(text, len);
+#endif
+#if KREP_USE_AVX2
+    if (cpu_has_avx2)
+        return count_newlines_avx2(text, len);
+#endif
+#if KREP_USE_NEON
+    return count_newlines_neon(text, len);
+#else
+    return count_newlines_scalar(text, len);
+#endif
+}
+
+bool newline_index_build(newline_index_t *index, const char *text, size_t text_len)
+{
+    index->text = text;
+    index->text_len = text_len;
+    index->num_blocks = (text_len + NEWLINE_INDEX_BLOCK_SIZE - 1) / NEWLINE_INDEX_BLOCK_SIZE;
+    index->newlines_before = malloc((index->num_blocks + 1) * sizeof(uint64_t));
+    if (!index->newlines_before)
+    {
+        index->num_blocks = 0;
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (size_t b = 0; b < index->num_blocks; b++)
+    {
+        size_t block_start = b * NEWLINE_INDEX_BLOCK_SIZE;
+        size_t block_len = text_len - block_start;
+        if (block_len > NEWLINE_INDEX_BLOCK_SIZE)
+            block_len = NEWLINE_INDEX_BLOCK_SIZE;
+        index->newlines_before[b] = total;
+        total += count_newlines(text + block_start, block_len);
+    }
+    index->newlines_before[index->num_blocks] = total;
+    return true;
+}
+
+void newline_index_free(newline_index_t *index)
+{
+    free(index->newlines_before);
+    index->newlines_before = NULL;
+    index->num_blocks = 0;
+}
+
+uint64_t newline_index_total(const newline_index_t *index)
+{
+    return index->newlines_before ? index->newlines_before[index->num_blocks] : 0;
+}
+
+uint64_t newline_index_line_of(const newline_index_t *index, size_t pos)
+{
+    if (pos > index->text_len)
+        pos = index->text_len;
+    size_t b = pos / NEWLINE_INDEX_BLOCK_SIZE; // b == num_blocks only at the very end of the text
+    size_t block_start = b * NEWLINE_INDEX_BLOCK_SIZE;
+    return index->newlines_before[b] + count_newlines(index->text + block_start, pos - block_start);
+}
+
+size_t newline_index_line_start(const newline_index_t *index, uint64_t line)
+{
+    if (line == 0)
+        return 0;
+    if (line > newline_index_total(index))
+        return index->text_len;
+
+    // Last block with fewer than `line` newlines before it holds the line-th newline
+    size_t lo = 0, hi = index->num_blocks - 1;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (index->newlines_before[mid] < line)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const char *p = index->text + lo * NEWLINE_INDEX_BLOCK_SIZE;
+    const char *end = index->text + index->text_len;
+    for (uint64_t remaining = line - index->newlines_before[lo]; remaining > 0; remaining--)
+    {
+        p = memchr(p, '\n', end - p);
+        p++; // The block is known to hold the newline
+    }
+    return (size_t)(p - index->text);
+}
+
 // --- Printing Function ---
 
 // Comparison function for qsort on match_position_t by start_offset
@@ -407,6 +802,102 @@ static int compare_match_positions(const void *a, const void *b)
     return 0;
 }
 
+static int compare_match_starts(const void *a, const void *b)
+{
+    uint32_t sa = *(const uint32_t *)a;
+    uint32_t sb = *(const uint32_t *)b;
+    return (sa > sb) - (sa < sb);
+}
+
+// True if result's positions are already in compare_match_positions order
+static bool match_positions_sorted(const match_result_t *result)
+{
+    if (result->starts)
+    {
+        // One match length: the starts alone decide the order
+        for (uint64_t i = 1; i < result->count; i++)
+        {
+            if (result->starts[i - 1] > result->starts[i])
+                return false;
+        }
+        return true;
+    }
+    for (uint64_t i = 1; i < result->count; i++)
+    {
+        if (compare_match_positions(&result->positions[i - 1], &result->positions[i]) > 0)
+            return false;
+    }
+    return true;
+}
+
+// Sort result into compare_match_positions order, in either form
+static void match_positions_sort(match_result_t *result)
+{
+    if (result->starts)
+        qsort(result->starts, result->count, sizeof(uint32_t), compare_match_starts);
+    else
+        qsort(result->positions, result->count, sizeof(match_position_t), compare_match_positions);
+}
+
+// --- Per-thread print scratch buffers ---
+#define PRINT_BATCH_BUFFER_SIZE (8 * 1024 * 1024) // 8MB batch buffer for aggregated output
+#define MAX_MATCHES_PER_LINE 2048                 // Doubled from original to handle more dense matches
+
+#define LINE_BUFFER_INITIAL_SIZE (512 * 1024)      // Start with 512KB, grown for longer lines
+
+typedef struct
+{
+    char *batch_buffer;                     // Aggregates formatted output before writes
+    match_position_t *line_match_positions; // Matches collected for the line being formatted
+    char *line_buffer;                      // One formatted line; kept (and grown) across calls
+    size_t line_buffer_capacity;            // Allocated size of line_buffer
+} print_scratch_t;
+
+static pthread_key_t print_scratch_key;
+static pthread_once_t print_scratch_once = PTHREAD_ONCE_INIT;
+
+static void free_print_scratch(void *ptr)
+{
+    print_scratch_t *scratch = (print_scratch_t *)ptr;
+    if (!scratch)
+        return;
+    free(scratch->batch_buffer);
+    free(scratch->line_match_positions);
+    free(scratch->line_buffer);
+    free(scratch);
+}
+
+static void create_print_scratch_key(void)
+{
+    pthread_key_create(&print_scratch_key, free_print_scratch);
+}
+
+// Returns the calling thread's scratch buffers, allocating them on first use
+static print_scratch_t *get_print_scratch(void)
+{
+    pthread_once(&print_scratch_once, create_print_scratch_key);
+    print_scratch_t *scratch = pthread_getspecific(print_scratch_key);
+    if (scratch)
+        return scratch;
+
+    scratch = calloc(1, sizeof(print_scratch_t));
+    if (scratch)
+    {
+        scratch->batch_buffer = malloc(PRINT_BATCH_BUFFER_SIZE);
+        scratch->line_match_positions = malloc(MAX_MATCHES_PER_LINE * sizeof(match_position_t));
+        scratch->line_buffer = malloc(LINE_BUFFER_INITIAL_SIZE);
+        scratch->line_buffer_capacity = LINE_BUFFER_INITIAL_SIZE;
+    }
+    if (!scratch || !scratch->batch_buffer || !scratch->line_match_positions || !scratch->line_buffer)
+    {
+        perror("malloc failed for print scratch buffers");
+        free_print_scratch(scratch);
+        return NULL;
+    }
+    pthread_setspecific(print_scratch_key, scratch);
+    return scratch;
+}
+
 // Helper function to safely append data to a batch buffer
 // Modifies the current write pointer and batch position pointer
 static inline void safe_append_to_batch(char **current_write_ptr_ptr, char *batch_buffer_end, size_t *batch_pos_ptr, size_t batch_buffer_size, const char *data, size_t data_len)
@@ -434,41 +925,138 @@ static inline void safe_append_to_batch(char **current_write_ptr_ptr, char *batc
 
 size_t print_matching_items(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params)
 {
-    // Basic validation: No results, no text, or zero matches means nothing to print.
-    if (!result || !text || result->count == 0)
-        return 0;
+    return print_matching_items_from(filename, text, text_len, result, params, 1);
+}
 
-    size_t items_printed_count = 0;
-    size_t max_count = params->max_count; // Get max_count from params
+size_t print_matching_items_from(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number)
+{
+    return print_matching_items_indexed(filename, text, text_len, result, params, first_line_number, NULL);
+}
 
-    // Get global configuration values
-    extern bool only_matching;        // External variable declared in krep.h
-    extern bool color_output_enabled; // External variable declared in krep.h
+size_t print_matching_items_indexed(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number, const newline_index_t *line_index)
+{
+    return print_matching_items_context(filename, text, text_len, result, params, first_line_number, line_index, NULL);
+}
 
-// --- Setup enhanced buffering ---
-// Use a larger stdout buffer than default to reduce syscalls
-#define STDOUT_BUFFER_SIZE (8 * 1024 * 1024) // 8MB stdout buffer
-    static char stdout_buf[STDOUT_BUFFER_SIZE];
-    static bool stdout_buffer_initialized = false;
-    if (!stdout_buffer_initialized)
+// --- Context Lines (-A / -B / -C) ---
+
+// Context lines and "--" separators go through the full-line batch buffer
+typedef struct
+{
+    FILE *out;
+    char *batch;
+    size_t *batch_pos;
+    const char *prefix; // "filename-" (colored), or the text color without a filename
+    size_t prefix_len;
+    const char *suffix; // Color reset, or empty
+    size_t suffix_len;
+} context_writer_t;
+
+// Append to a full-line batch buffer of PRINT_BATCH_BUFFER_SIZE, flushing it first
+// when data does not fit
+static void line_batch_append(FILE *out, char *batch, size_t *batch_pos, const char *data, size_t len)
+{
+    if (*batch_pos + len > PRINT_BATCH_BUFFER_SIZE)
     {
-        setvbuf(stdout, stdout_buf, _IOFBF, STDOUT_BUFFER_SIZE);
-        stdout_buffer_initialized = true;
+        if (*batch_pos > 0 && fwrite(batch, 1, *batch_pos, out) != *batch_pos)
+            perror("Error writing line batch buffer to stdout");
+        *batch_pos = 0;
+        if (len > PRINT_BATCH_BUFFER_SIZE)
+        {
+            if (fwrite(data, 1, len, out) != len)
+                perror("Error writing oversized line directly to stdout");
+            return;
+        }
     }
+    memcpy(batch + *batch_pos, data, len);
+    *batch_pos += len;
+}
 
-// --- Preallocate reusable line buffer for formatting ---
-#define LINE_BUFFER_INITIAL_SIZE (512 * 1024) // Start with 512KB
-    char *line_buffer = malloc(LINE_BUFFER_INITIAL_SIZE);
-    if (!line_buffer)
+// Print the lines in [from, to) as context lines; from is a line start
+static void context_write_lines(const context_writer_t *w, const char *from, const char *to)
+{
+    while (from < to)
     {
-        perror("malloc failed for line buffer");
+        const char *nl = memchr(from, '\n', to - from);
+        const char *end = nl ? nl : to;
+        line_batch_append(w->out, w->batch, w->batch_pos, w->prefix, w->prefix_len);
+        line_batch_append(w->out, w->batch, w->batch_pos, from, end - from);
+        line_batch_append(w->out, w->batch, w->batch_pos, w->suffix, w->suffix_len);
+        line_batch_append(w->out, w->batch, w->batch_pos, "\n", 1);
+        from = nl ? nl + 1 : to;
+    }
+}
+
+// Start of the line after up to *lines lines from p (a line start), stopping at limit.
+// *lines is reduced by the lines skipped.
+static const char *context_skip_forward(const char *p, const char *limit, size_t *lines)
+{
+    while (*lines > 0 && p < limit)
+    {
+        const char *nl = memchr(p, '\n', limit - p);
+        p = nl ? nl + 1 : limit;
+        (*lines)--;
+    }
+    return p;
+}
+
+// Start of the line up to lines lines before line_start, not going below floor (a line start)
+static const char *context_skip_backward(const char *line_start, const char *floor, size_t lines)
+{
+    const char *p = line_start;
+    while (lines > 0 && p > floor)
+    {
+        const char *nl = p - 1 > floor ? memrchr(floor, '\n', (size_t)(p - 1 - floor)) : NULL;
+        p = nl ? nl + 1 : floor;
+        lines--;
+    }
+    return p;
+}
+
+size_t print_matching_items_context(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number, const newline_index_t *line_index, print_context_t *context)
+{
+    // Context lines belong to the full-line output
+    bool with_context = context_lines_enabled(params);
+
+    // Basic validation: No results, no text, or zero matches means nothing to print,
+    // unless after-context is still owed to an earlier piece of the input.
+    static const match_result_t no_matches = {0};
+    if (!result)
+        result = &no_matches;
+    if (!text || (result->count == 0 && !(with_context && context && context->after_left > 0)))
         return 0;
+
+    size_t items_printed_count = 0;
+    size_t max_count = params->max_count; // Get max_count from params
+
+    // Get global configuration values
+    extern bool only_matching;        // External variable declared in krep.h
+    extern bool color_output_enabled; // External variable declared in krep.h
+
+    FILE *out = current_output();
+
+// --- Setup enhanced buffering ---
+// Use a larger stdout buffer than default to reduce syscalls
+#define STDOUT_BUFFER_SIZE (8 * 1024 * 1024) // 8MB stdout buffer
+    static char stdout_buf[STDOUT_BUFFER_SIZE];
+    static bool stdout_buffer_initialized = false;
+    if (out == stdout && !stdout_buffer_initialized)
+    {
+        setvbuf(stdout, stdout_buf, _IOFBF, STDOUT_BUFFER_SIZE);
+        stdout_buffer_initialized = true;
     }
-    size_t line_buffer_capacity = LINE_BUFFER_INITIAL_SIZE;
+
+    // Batch and per-line scratch buffers are per thread so several files can be
+    // formatted concurrently by the recursive file scheduler.
+    print_scratch_t *scratch = get_print_scratch();
+    if (!scratch)
+        return 0;
+
+// --- Reusable line buffer for formatting (per thread, kept across calls) ---
+    char *line_buffer = scratch->line_buffer;
 
 // --- Preallocate match position storage ---
-#define MAX_MATCHES_PER_LINE 2048 // Doubled from original to handle more dense matches
-    static match_position_t line_match_positions[MAX_MATCHES_PER_LINE];
+    match_position_t *line_match_positions = scratch->line_match_positions;
 
     // --- Precompute constant string lengths ---
     // Cache color codes and their lengths for better performance
@@ -489,44 +1077,10 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
     if (only_matching)
     {
 // Use a larger batch buffer for aggregating output before system calls
-#define O_BATCH_BUFFER_SIZE (8 * 1024 * 1024) // 8MB batch buffer (doubled from original)
-        static char o_batch_buffer[O_BATCH_BUFFER_SIZE];
+#define O_BATCH_BUFFER_SIZE PRINT_BATCH_BUFFER_SIZE
+        char *o_batch_buffer = scratch->batch_buffer;
         size_t o_batch_pos = 0; // Current position in the batch buffer
 
-        // --- Fast line number tracking ---
-        // Precompute newline positions for faster line number calculation
-        size_t *newline_positions = NULL;
-        size_t num_newlines = 0;
-        size_t newline_capacity = 0;
-
-        // Only precompute newline positions if we have more than a threshold number of matches
-        if (result->count > 10)
-        {
-            // Count newlines first to allocate properly
-            for (size_t i = 0; i < text_len; i++)
-            {
-                if (text[i] == '\n')
-                    num_newlines++;
-            }
-
-            // Allocate array for newline positions
-            newline_capacity = num_newlines + 1; // +1 for the implicit newline at the end
-            newline_positions = malloc(newline_capacity * sizeof(size_t));
-
-            // Populate the array if allocation succeeded
-            if (newline_positions)
-            {
-                size_t idx = 0;
-                for (size_t i = 0; i < text_len; i++)
-                {
-                    if (text[i] == '\n')
-                    {
-                        newline_positions[idx++] = i;
-                    }
-                }
-            }
-        }
-
         // Precompute the filename prefix string (including colors if enabled)
         char filename_prefix[PATH_MAX + 64] = ""; // Extra space for colors/separator
         size_t filename_prefix_len = 0;
@@ -558,9 +1112,8 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
         }
 
         // --- Process matches in batches for better performance ---
-        size_t current_line_number = 1;
+        size_t current_line_number = first_line_number;
         size_t last_scanned_offset = 0;
-        size_t last_newline_idx = 0;
 
         // Pre-allocate a static buffer for line numbers to avoid repeated format calls
         char lineno_buffer[32]; // Large enough for any reasonable line number
@@ -574,8 +1127,8 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
                 break; // Stop processing if limit is reached
             }
 
-            size_t start = result->positions[i].start_offset;
-            size_t end = result->positions[i].end_offset;
+            size_t start = match_result_start(result, i);
+            size_t end = match_result_end(result, i);
 
             // Validation and bounds checking
             if (start >= text_len || start > end)
@@ -588,64 +1141,16 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
             }
             size_t len = end - start;
 
-            // --- Optimized Line Number Calculation ---
-            // Faster line number calculation using precomputed newline positions when available
-            if (newline_positions && num_newlines > 0)
+            // --- Line Number Calculation ---
+            // Matches arrive in order, so counting the newlines since the previous match
+            // touches each byte once; a newline index turns long gaps into a lookup.
+            if (line_index && (start < last_scanned_offset || start - last_scanned_offset > NEWLINE_INDEX_BLOCK_SIZE))
             {
-                // Binary search to find the position in the newlines array
-                size_t left = 0;
-                size_t right = num_newlines - 1;
-
-                // Find the first newline position greater than start
-                while (left <= right)
-                {
-                    size_t mid = left + (right - left) / 2;
-                    if (newline_positions[mid] < start)
-                    {
-                        left = mid + 1;
-                    }
-                    else
-                    {
-                        if (mid == 0 || newline_positions[mid - 1] < start)
-                        {
-                            last_newline_idx = mid;
-                            break;
-                        }
-                        right = mid - 1;
-                    }
-                }
-
-                // Line number is the index of the first newline after start, plus 1
-                // (or the count of newlines before start, plus 1)
-                if (last_newline_idx > 0 && newline_positions[last_newline_idx - 1] >= start)
-                {
-                    last_newline_idx--;
-                }
-                current_line_number = last_newline_idx + 1;
+                current_line_number = first_line_number + newline_index_line_of(line_index, start);
             }
-            else
+            else if (start > last_scanned_offset)
             {
-                // Fallback: Count newlines in the segment from last position to current match
-                if (start > last_scanned_offset)
-                {
-                    const char *scan_ptr = text + last_scanned_offset;
-                    const char *end_scan_ptr = text + start;
-
-                    // Fast newline counting with memchr
-                    while (scan_ptr < end_scan_ptr)
-                    {
-                        const void *newline_found = memchr(scan_ptr, '\n', end_scan_ptr - scan_ptr);
-                        if (newline_found)
-                        {
-                            current_line_number++;
-                            scan_ptr = (const char *)newline_found + 1;
-                        }
-                        else
-                        {
-                            break;
-                        }
-                    }
-                }
+                current_line_number += count_newlines(text + last_scanned_offset, start - last_scanned_offset);
             }
             last_scanned_offset = start; // Update for next iteration
 
@@ -668,7 +1173,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
             // Flush the batch buffer to stdout if the new entry won't fit (use estimate)
             if (o_batch_pos + required_estimate > O_BATCH_BUFFER_SIZE)
             {
-                if (fwrite(o_batch_buffer, 1, o_batch_pos, stdout) != o_batch_pos)
+                if (fwrite(o_batch_buffer, 1, o_batch_pos, out) != o_batch_pos)
                 {
                     perror("Error writing batch buffer to stdout (-o mode)");
                     // Consider how to handle write errors; maybe break or return error count?
@@ -746,13 +1251,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
         // Flush any remaining content in the batch buffer
         if (o_batch_pos > 0)
         {
-            fwrite(o_batch_buffer, 1, o_batch_pos, stdout);
-        }
-
-        // Free resources
-        if (newline_positions)
-        {
-            free(newline_positions);
+            fwrite(o_batch_buffer, 1, o_batch_pos, out);
         }
     }
     // ========================================================================
@@ -795,10 +1294,30 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
 
 // --- Create a line batch buffer for full line mode ---
 // This buffer aggregates multiple formatted lines before writing to stdout
-#define LINE_BATCH_BUFFER_SIZE (8 * 1024 * 1024) // 8MB for batch output
-        static char line_batch_buffer[LINE_BATCH_BUFFER_SIZE];
+#define LINE_BATCH_BUFFER_SIZE PRINT_BATCH_BUFFER_SIZE
+        char *line_batch_buffer = scratch->batch_buffer;
         size_t line_batch_pos = 0;
 
+        // -A/-B/-C state: printed_end is the first byte not printed yet (a line start)
+        print_context_t local_context = {text, text + text_len, 0, false, false, false};
+        print_context_t *ctx = context ? context : &local_context;
+        const char *printed_end = ctx->floor;
+        char context_prefix[PATH_MAX + 64] = "";
+        context_writer_t writer = {out, line_batch_buffer, &line_batch_pos, context_prefix, 0,
+                                   color_output_enabled ? color_reset : "", len_color_reset};
+        if (with_context && filename_prefix_len > 0)
+        {
+            // "filename-" instead of "filename:" (the separator precedes the text color)
+            memcpy(context_prefix, filename_prefix, filename_prefix_len);
+            context_prefix[filename_prefix_len - (color_output_enabled ? len_color_text : 0) - 1] = '-';
+            writer.prefix_len = filename_prefix_len;
+        }
+        else if (with_context && color_output_enabled)
+        {
+            writer.prefix = color_text;
+            writer.prefix_len = len_color_text;
+        }
+
         // Iterate through matches, processing line by line
         uint64_t i = 0;
         while (i < result->count)
@@ -809,7 +1328,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
                 break; // Stop processing if limit is reached
             }
 
-            size_t first_match_start_on_line = result->positions[i].start_offset;
+            size_t first_match_start_on_line = match_result_start(result, i);
 
             // Basic validation for the starting match offset
             if (first_match_start_on_line >= text_len)
@@ -827,7 +1346,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
                 // Efficiently skip all subsequent matches that start on this *same* line
                 // Find the end of the current line first
                 size_t current_line_end = find_line_end(text, text_len, line_start); // Use text instead of text_start
-                while (i < result->count && result->positions[i].start_offset < current_line_end)
+                while (i < result->count && match_result_start(result, i) < current_line_end)
                 {
                     i++;
                 }
@@ -843,7 +1362,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
 
             while (line_match_scan_idx < result->count)
             {
-                size_t k_start = result->positions[line_match_scan_idx].start_offset;
+                size_t k_start = match_result_start(result, line_match_scan_idx);
 
                 // If the match starts at or after the end of the current line, we're done collecting for this line.
                 if (k_start >= line_end)
@@ -857,7 +1376,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
                     // Ensure we don't overflow the preallocated line_match_positions buffer
                     if (line_match_count < MAX_MATCHES_PER_LINE)
                     {
-                        size_t k_end = result->positions[line_match_scan_idx].end_offset;
+                        size_t k_end = match_result_end(result, line_match_scan_idx);
                         // Clamp match end to text length for safety
                         if (k_end > text_len)
                             k_end = text_len;
@@ -895,7 +1414,10 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
             }
 
             // --- Ensure line buffer capacity once ---
-            if (!ensure_line_buffer_capacity((char **)&line_buffer, &line_buffer_capacity, 0, max_required_size))
+            bool line_buffer_ok = ensure_line_buffer_capacity(&scratch->line_buffer, &scratch->line_buffer_capacity,
+                                                              0, max_required_size);
+            line_buffer = scratch->line_buffer;
+            if (!line_buffer_ok)
             {
                 // Handle error: cannot allocate enough buffer space for the line
                 fprintf(stderr, "Error: Failed to ensure sufficient buffer capacity (%zu bytes) for line starting at offset %zu in %s\n",
@@ -984,12 +1506,37 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
             // Calculate final buffer position based on pointer arithmetic
             buffer_pos = current_write_ptr - line_buffer;
 
+            if (with_context)
+            {
+                // After-context still owed to the previous matching line, then the
+                // before-context of this one; neither reaches a line already printed
+                const char *match_line = text + line_start;
+                if (printed_end < match_line)
+                {
+                    const char *after_end = context_skip_forward(printed_end, match_line, &ctx->after_left);
+                    context_write_lines(&writer, printed_end, after_end);
+                    printed_end = after_end;
+                }
+                const char *before_start = context_skip_backward(match_line, printed_end, params->context_before);
+                bool gap = before_start > printed_end || (before_start == ctx->floor && ctx->gap_below);
+                if (ctx->printed && (gap || ctx->new_input))
+                {
+                    if (color_output_enabled)
+                        line_batch_append(out, line_batch_buffer, &line_batch_pos,
+                                          KREP_COLOR_SEPARATOR "--" KREP_COLOR_RESET "\n",
+                                          strlen(KREP_COLOR_SEPARATOR "--" KREP_COLOR_RESET "\n"));
+                    else
+                        line_batch_append(out, line_batch_buffer, &line_batch_pos, "--\n", 3);
+                }
+                context_write_lines(&writer, before_start, match_line);
+            }
+
             // --- Efficient batch output handling ---
             // Check if the newly formatted line fits in the batch buffer
             if (line_batch_pos + buffer_pos > LINE_BATCH_BUFFER_SIZE)
             {
                 // Flush the current batch buffer before adding the new line
-                if (fwrite(line_batch_buffer, 1, line_batch_pos, stdout) != line_batch_pos)
+                if (fwrite(line_batch_buffer, 1, line_batch_pos, out) != line_batch_pos)
                 {
                     perror("Error writing line batch buffer to stdout");
                     // Consider how to handle this error; maybe stop processing?
@@ -1009,7 +1556,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
                 // If a single line is too large, write it directly (or handle error)
                 fprintf(stderr, "Warning: Single line exceeds batch buffer size (%zu > %d). Writing directly.\n",
                         buffer_pos, LINE_BATCH_BUFFER_SIZE);
-                if (fwrite(line_buffer, 1, buffer_pos, stdout) != buffer_pos)
+                if (fwrite(line_buffer, 1, buffer_pos, out) != buffer_pos)
                 {
                     perror("Error writing oversized line directly to stdout");
                 }
@@ -1018,16 +1565,33 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
             // Update tracking variables
             items_printed_count++;                // Increment after successfully printing/batching a line
             last_printed_line_start = line_start; // Mark this line as printed
+            if (with_context)
+            {
+                printed_end = text + (line_end < text_len ? line_end + 1 : text_len);
+                ctx->after_left = params->context_after;
+                ctx->printed = true;
+                ctx->new_input = false;
+            }
 
             // Advance the main loop index 'i' past all matches processed for this line
             i = line_match_scan_idx;
             continue; // Continue to the next potential line
         }
 
+        // After-context of the last matching line, possibly past the end of text
+        if (with_context)
+        {
+            const char *after_end = context_skip_forward(printed_end, ctx->limit, &ctx->after_left);
+            context_write_lines(&writer, printed_end, after_end);
+            if (after_end > ctx->floor)
+                ctx->gap_below = false; // Printing reached past floor, so nothing below it is missing
+            ctx->floor = after_end;
+        }
+
         // Flush any remaining content in the line batch buffer
         if (line_batch_pos > 0)
         {
-            if (fwrite(line_batch_buffer, 1, line_batch_pos, stdout) != line_batch_pos)
+            if (fwrite(line_batch_buffer, 1, line_batch_pos, out) != line_batch_pos)
             {
                 perror("Error writing final line batch buffer to stdout");
             }
@@ -1035,8 +1599,7 @@ size_t print_matching_items(const char *filename, const char *text, size_t text_
     }
 
     // --- Cleanup ---
-    fflush(stdout);
-    free(line_buffer);
+    fflush(out);
 
     return items_printed_count;
 }
@@ -1111,19 +1674,59 @@ void print_usage(const char *program_name)
     printf("  -i             Perform case-insensitive matching.\n");
     printf("  -c             Count matching lines. Only a count of lines is printed.\n");
     printf("  -o             Only matching. Print only the matched parts of lines, one per line.\n");
+    printf("  -l, --files-with-matches\n");
+    printf("                 Print only the names of matching files; each stops at its first match.\n");
+    printf("  -q, --quiet    Print nothing; exit 0 at the first match (with -r, no further files).\n");
     printf("  -e PATTERN     Specify pattern. Can be used multiple times (treated as OR for literal, combined for regex).\n");
     printf("  -f FILE        Read patterns from FILE, one per line.\n");
     printf("  -E             Interpret PATTERN(s) as POSIX Extended Regular Expression(s).\n");
     printf("                 If multiple -e used with -E, they are combined with '|'.\n");
     printf("  -F             Interpret PATTERN(s) as fixed strings (literal). Default if not -E.\n");
     printf("  -r             Search directories recursively. Skips binary files and common dirs.\n");
+    printf("  -I             Skip binary files (a NUL byte in the first %d bytes), also outside -r.\n",
+           BINARY_CHECK_BUFFER_SIZE);
+    printf("  -a, --text     Search binary files as text, also under -r.\n");
+    printf("  -g, --glob GLOB\n");
+    printf("                 Under -r, search only files matching GLOB (gitignore syntax; repeatable).\n");
+    printf("                 '!GLOB' excludes instead. Globs override the ignore files.\n");
+    printf("  --no-ignore    Under -r, do not read .gitignore and .ignore files. By default the\n");
+    printf("                 rules in each directory's ignore files apply to the tree below it.\n");
     printf("  -t NUM         Use NUM threads for file search (default: auto-detect cores).\n");
     printf("  -s             Search in STRING_TO_SEARCH instead of FILE or DIRECTORY.\n");
     printf("  --color[=WHEN] Control color output ('always', 'never', 'auto'). Default: 'auto'.\n");
     printf("  --no-simd      Explicitly disable SIMD acceleration.\n");
+    printf("  --follow       Keep searching FILE as it grows; handles rotation and truncation.\n");
+    printf("  --index-build DIR\n");
+    printf("                 Write a trigram index of DIR's files to DIR/%s and exit.\n", TRIGRAM_INDEX_FILENAME);
+    printf("  --index        Read only the blocks the index says can match (files changed since\n");
+    printf("                 the index was built are read in full).\n");
+    printf("  --io=BACKEND   How files are read: 'auto' (default), 'mmap', 'read', 'uring' or\n");
+    printf("                 'direct' (io_uring with O_DIRECT). 'auto' maps files, except large\n");
+    printf("                 ones on network/FUSE mounts or bigger than RAM, which are read ahead.\n");
+    printf("  --prefetch=POLICY\n");
+    printf("                 How mapped files are paged in: 'populate' (all up front), 'window'\n");
+    printf("                 (read ahead per thread and drop searched pages from the cache),\n");
+    printf("                 'none', or 'auto' (default: 'window' from 1 GB, else 'populate', or\n");
+    printf("                 'none' with -m, -q and -l, which may stop before the end).\n");
+    printf("  --calibrate    Time every kernel able to search for the (single literal) pattern on\n");
+    printf("                 the first MB of FILE and record the fastest in the profile; later\n");
+    printf("                 runs on the same CPU model use it instead of the built-in choice.\n");
+    printf("  --profile=FILE Algorithm profile to read and update (default: $KREP_PROFILE, else\n");
+    printf("                 ~/.cache/krep/algorithms).\n");
+    printf("  --stats[=FORMAT]\n");
+    printf("                 After the search, print per-phase times (map, compile, search, merge,\n");
+    printf("                 sort, print), bytes scanned, SIMD filter hit rates and thread balance\n");
+    printf("                 to stderr, as 'text' (default) or 'json'.\n");
     printf("  -v             Show version information and exit.\n");
     printf("  -h, --help     Show this help message and exit.\n");
     printf("  -m NUM         Stop reading a file after NUM matching lines.\n");
+    printf("  -A NUM, --after-context=NUM\n");
+    printf("                 Print NUM lines after each matching line ('-' after the filename).\n");
+    printf("  -B NUM, --before-context=NUM\n");
+    printf("                 Print NUM lines before each matching line.\n");
+    printf("  -C NUM, --context=NUM\n");
+    printf("                 Print NUM lines before and after (-A / -B take precedence). Groups\n");
+    printf("                 that are not adjacent are separated by '--'. Ignored with -c and -o.\n");
     printf("  -w             Select only matches that form whole words.\n\n");
     printf("EXIT STATUS:\n");
     printf("  0 if matches were found,\n");
@@ -1218,8 +1821,14 @@ uint64_t boyer_moore_search(const search_params_t *params,
     if (pattern_len == 0 || text_len < pattern_len)
         return 0;
 
-    int bad_char_table[256];
-    prepare_bad_char_table(search_pattern, pattern_len, bad_char_table, case_sensitive);
+    // Use the table from krep_compile() when there is one
+    int local_bad_char_table[256];
+    const int *bad_char_table = params->bad_char_table;
+    if (!bad_char_table)
+    {
+        prepare_bad_char_table(search_pattern, pattern_len, local_bad_char_table, case_sensitive);
+        bad_char_table = local_bad_char_table;
+    }
 
     uint64_t current_count = 0;
     size_t last_counted_line_start = SIZE_MAX;
@@ -1309,6 +1918,116 @@ uint64_t boyer_moore_search(const search_params_t *params,
 
 // --- Regex Search ---
 
+// Regex search on the lazy DFA. When the regex has a selective required literal, the
+// literal search kernels find the lines holding it and only those lines go through the
+// DFA; matches never span lines, so no other line can match.
+static uint64_t regex_search_dfa(const search_params_t *params,
+                                 const char *text_start,
+                                 size_t text_len,
+                                 match_result_t *result)
+{
+    regex_dfa_t *dfa = params->regex_dfa;
+    const bool need_start = !params->count_lines_mode || params->whole_word;
+
+    // Every line matches: -c is a SIMD newline count
+    if (params->count_lines_mode && !params->whole_word && text_len > 0 && regex_dfa_matches_every_line(dfa))
+    {
+        uint64_t lines = count_newlines(text_start, text_len) + (text_start[text_len - 1] != '\n');
+        return lines < params->max_count ? lines : params->max_count;
+    }
+
+    size_t lit_len = 0;
+    const char *lit = regex_dfa_required_literal(dfa, &lit_len);
+    if (lit && lit_len < 2 && byte_frequency[(unsigned char)lit[0]] >= 100)
+        lit = NULL; // A single common byte would stop on nearly every line
+
+    const char *lit_patterns[1] = {lit};
+    search_params_t lit_params = {0};
+    search_func_t lit_search = NULL;
+    match_result_t *lit_hits = NULL;
+    if (lit)
+    {
+        lit_params.pattern = lit;
+        lit_params.pattern_len = lit_len;
+        lit_params.patterns = lit_patterns;
+        lit_params.pattern_lens = &lit_len;
+        lit_params.num_patterns = 1;
+        lit_params.case_sensitive = params->case_sensitive;
+        lit_params.track_positions = true;
+        lit_params.max_count = 1; // Only the next occurrence
+        lit_search = select_search_algorithm(&lit_params);
+        lit_hits = match_result_init(4);
+        if (!lit_hits)
+            lit = NULL;
+    }
+
+    uint64_t count = 0;
+    size_t last_line = SIZE_MAX;
+    size_t pos = 0;
+    while (pos < text_len || (pos == 0 && text_len == 0))
+    {
+        size_t from = pos;
+        size_t limit = text_len;
+        if (lit)
+        {
+            // Narrow the DFA run to the next line holding the literal
+            lit_hits->count = 0;
+            if (lit_search(&lit_params, text_start + pos, text_len - pos, lit_hits) == 0 || lit_hits->count == 0)
+                break;
+            size_t hit = pos + lit_hits->positions[0].start_offset;
+            size_t line_start = find_line_start(text_start, text_len, hit);
+            from = line_start > pos ? line_start : pos;
+            limit = find_line_end(text_start, text_len, hit);
+        }
+
+        size_t start, end;
+        if (!regex_dfa_find(dfa, text_start, text_len, from, limit, need_start, &start, &end))
+        {
+            if (!lit)
+                break;
+            pos = limit + 1;
+            continue;
+        }
+
+        // An empty match at the very end is the start of the next chunk's first line
+        if (params->text_continues && start == text_len && end == text_len)
+            break;
+
+        if (params->whole_word && !is_whole_word_match(text_start, text_len, start, end))
+        {
+            pos = start + 1;
+            continue;
+        }
+
+        if (params->count_lines_mode)
+        {
+            size_t line_start_offset = find_line_start(text_start, text_len, start);
+            if (line_start_offset != last_line)
+            {
+                count++;
+                last_line = line_start_offset;
+            }
+            // The line is counted; move on to the next one
+            pos = find_line_end(text_start, text_len, end) + 1;
+        }
+        else
+        {
+            count++;
+            if (params->track_positions && result)
+            {
+                match_result_add(result, start, end);
+            }
+            pos = (end > start) ? end : start + 1; // Step over zero-length matches
+        }
+
+        if (count >= params->max_count)
+            break;
+    }
+
+    match_result_free(lit_hits);
+    return count;
+}
+
 uint64_t regex_search(const search_params_t *params,
                       const char *text_start,
                       size_t text_len,
@@ -1318,6 +2037,9 @@ uint64_t regex_search(const search_params_t *params,
     if (params->max_count == 0 && (params->count_lines_mode || params->track_positions)) // Check both modes
         return 0;
 
+    if (params->regex_dfa)
+        return regex_search_dfa(params, text_start, text_len, result);
+
     // Must have a compiled regex.
     if (!params->compiled_regex)
         return 0;
@@ -1405,6 +2127,10 @@ uint64_t regex_search(const search_params_t *params,
         size_t start = (cur - text_start) + so; // Absolute start offset
         size_t end = (cur - text_start) + eo;   // Absolute end offset
 
+        // An empty match at the very end is the start of the next chunk's first line
+        if (params->text_continues && start == text_len && end == text_len)
+            break;
+
         // Whole word check
         if (params->whole_word && !is_whole_word_match(text_start, text_len, start, end))
         {
@@ -1558,14 +2284,20 @@ uint64_t kmp_search(const search_params_t *params,
     if (pattern_len == 0 || text_len < pattern_len)
         return 0;
 
-    // Precompute LPS array
-    int *lps = malloc(pattern_len * sizeof(int));
+    // Precompute LPS array, unless krep_compile() already did
+    const int *lps = params->kmp_lps;
+    int *local_lps = NULL;
     if (!lps)
     {
-        perror("malloc failed for KMP LPS array");
-        return 0; // Indicate error or handle differently
+        local_lps = malloc(pattern_len * sizeof(int));
+        if (!local_lps)
+        {
+            perror("malloc failed for KMP LPS array");
+            return 0; // Indicate error or handle differently
+        }
+        compute_lps_array(search_pattern, pattern_len, local_lps, case_sensitive);
+        lps = local_lps;
     }
-    compute_lps_array(search_pattern, pattern_len, lps, case_sensitive);
 
     size_t i = 0; // index for text_start[]
     size_t j = 0; // index for search_pattern[]
@@ -1674,12 +2406,124 @@ uint64_t kmp_search(const search_params_t *params,
         }
     } // end while
 
-    free(lps);            // Free the LPS array
+    free(local_lps);      // Free the LPS array if it was built here
     return current_count; // Return line count or match count
 }
 
 // --- Search Orchestration ---
 
+// --- SIMD Kernel Dispatch ---
+
+typedef struct
+{
+    const char *name;
+    search_func_t func;
+    size_t max_pattern_len;
+    bool available; // Set by init_simd_dispatch from the running CPU
+} simd_kernel_t;
+
+// In order of preference. Every kernel handles both case-sensitive and -i search.
+static simd_kernel_t simd_kernels[] = {
+#if KREP_USE_AVX512
+    {"AVX-512BW", simd_avx512_search, 64, false},
+#endif
+#if KREP_USE_AVX2
+    {"AVX2", simd_avx2_search, 32, false},
+#endif
+#if KREP_USE_SSE42
+    {"SSE4.2", simd_sse42_search, 16, false},
+#endif
+#if KREP_USE_NEON
+    {"NEON", neon_search, 16, false},
+#endif
+#if KREP_USE_AVX2 || KREP_USE_NEON
+    {"SIMD rare-byte anchor", simd_anchor_search, SIZE_MAX, false}, // Any length
+#endif
+    {NULL, NULL, 0, false} // Terminator
+};
+
+// Resolve CPU features once, before main() and before any search can run
+static void __attribute__((constructor)) init_simd_dispatch(void)
+{
+#if KREP_USE_SSE42 || KREP_USE_AVX2 || KREP_USE_AVX512
+    __builtin_cpu_init();
+    cpu_has_sse2 = __builtin_cpu_supports("sse2");
+    cpu_has_sse42 = __builtin_cpu_supports("sse4.2");
+    cpu_has_avx2 = __builtin_cpu_supports("avx2");
+    cpu_has_avx512bw = __builtin_cpu_supports("avx512bw");
+#endif
+
+    for (simd_kernel_t *k = simd_kernels; k->func; k++)
+    {
+#if KREP_USE_AVX512
+        if (k->func == simd_avx512_search)
+            k->available = cpu_has_avx512bw;
+#endif
+#if KREP_USE_AVX2
+        if (k->func == simd_avx2_search)
+            k->available = cpu_has_avx2;
+#endif
+#if KREP_USE_SSE42
+        if (k->func == simd_sse42_search)
+            k->available = cpu_has_sse42;
+#endif
+#if KREP_USE_NEON
+        if (k->func == neon_search)
+            k->available = true;
+#endif
+#if KREP_USE_AVX2 || KREP_USE_NEON
+        if (k->func == simd_anchor_search)
+            k->available = KREP_USE_NEON || cpu_has_sse2;
+#endif
+        if (k->available && k->max_pattern_len > simd_max_pattern_len)
+            simd_max_pattern_len = k->max_pattern_len;
+    }
+}
+
+// Longest pattern func handles if it is a SIMD kernel this CPU runs, else 0
+size_t simd_kernel_max_pattern_len(search_func_t func)
+{
+    for (const simd_kernel_t *k = simd_kernels; k->func; k++)
+    {
+        if (k->func == func)
+            return k->available ? k->max_pattern_len : 0;
+    }
+    return 0;
+}
+
+// Best available SIMD kernel for a single literal pattern, or NULL
+static search_func_t select_simd_kernel(const search_params_t *params)
+{
+    if (force_no_simd)
+        return NULL;
+    for (const simd_kernel_t *k = simd_kernels; k->func; k++)
+    {
+        if (k->available && params->pattern_len <= k->max_pattern_len)
+            return k->func;
+    }
+    return NULL;
+}
+
+// Count kernel for a single literal pattern in -c mode
+static search_func_t select_count_kernel(const search_params_t *params)
+{
+    if (params->pattern_len == 1)
+        return memchr_count_lines;
+
+    // The SIMD kernels resume on the next line after a hit in -c mode, except the
+    // AVX2 one, which checks every hit against the last counted line; the rare-byte
+    // anchor kernel takes its patterns
+    search_func_t simd_func = select_simd_kernel(params);
+#if KREP_USE_AVX2
+    if (simd_func == simd_avx2_search)
+        simd_func = simd_anchor_search;
+#endif
+    if (simd_func)
+        return simd_func;
+    // Horspool shifts are too short to pay off for 2-3 byte patterns
+    return params->pattern_len < 4 ? memchr_short_search : boyer_moore_count_lines;
+}
+
 search_func_t select_search_algorithm(const search_params_t *params)
 {
     // Use regex search if requested
@@ -1696,8 +2540,25 @@ search_func_t select_search_algorithm(const search_params_t *params)
 
     // --- Single Literal Pattern ---
 
-    // Check if SIMD can be used:
-    bool can_use_simd = !force_no_simd && SIMD_MAX_PATTERN_LEN > 0 && params->pattern_len <= SIMD_MAX_PATTERN_LEN;
+    // A kernel measured faster on this CPU model by --calibrate, if one is recorded
+    if (!force_no_simd)
+    {
+        search_func_t calibrated = algo_profile_lookup(params);
+        if (calibrated)
+            return calibrated;
+    }
+    return select_literal_algorithm(params);
+}
+
+// Built-in choice for a single literal pattern, from its length and the CPU's kernels
+static search_func_t select_literal_algorithm(const search_params_t *params)
+{
+    // -c has dedicated kernels that skip the rest of a line once it matches
+    if (params->count_lines_mode)
+        return select_count_kernel(params);
+
+    // Best SIMD kernel this CPU supports for the pattern, if any
+    search_func_t simd_func = select_simd_kernel(params);
 
     // First, handle very short patterns (1-3 characters) specially
     const size_t SHORT_PATTERN_THRESH = 4; // Patterns of length 1-3 use specialized algorithms
@@ -1709,47 +2570,14 @@ search_func_t select_search_algorithm(const search_params_t *params)
     }
     else if (params->pattern_len < SHORT_PATTERN_THRESH)
     {
-        // For 2-3 character patterns, use our specialized short pattern search
-        // SIMD might still be better for case-sensitive search on supported platforms
-        if (can_use_simd && params->case_sensitive)
-        {
-// Use SIMD for short case-sensitive patterns if available
-#if KREP_USE_AVX2
-            return simd_avx2_search;
-#elif KREP_USE_SSE42
-            return simd_sse42_search;
-#elif KREP_USE_NEON
-            return neon_search;
-#else
-            return memchr_short_search;
-#endif
-        }
-        else
-        {
-            // Use our specialized function for short patterns (handles case-insensitive well)
-            return memchr_short_search;
-        }
+        // For 2-3 character patterns SIMD is still better for case-sensitive search;
+        // the specialized short pattern search handles case-insensitive well
+        return (simd_func && params->case_sensitive) ? simd_func : memchr_short_search;
     }
 
-    // For patterns 4 characters or longer, follow existing logic
-    if (can_use_simd)
-    {
-#if KREP_USE_AVX2
-        // AVX2 supports case-insensitive up to 32 bytes
-        if (params->pattern_len <= 32)
-            return simd_avx2_search;
-#endif
-#if KREP_USE_SSE42
-        // SSE4.2 only supports case-sensitive up to 16 bytes
-        if (params->pattern_len <= 16 && params->case_sensitive)
-            return simd_sse42_search;
-#endif
-#if KREP_USE_NEON
-        // NEON only supports case-sensitive up to 16 bytes
-        if (params->pattern_len <= 16 && params->case_sensitive)
-            return neon_search;
-#endif
-    }
+    // For patterns 4 characters or longer, prefer SIMD when a kernel fits
+    if (simd_func)
+        return simd_func;
 
     // Fallback to scalar algorithms for longer patterns
     const size_t KMP_THRESH = 8; // Increased threshold - KMP becomes more efficient for certain patterns
@@ -1810,24 +2638,177 @@ static bool is_repetitive_pattern(const char *pattern, size_t pattern_len)
 
 // --- Threading Logic ---
 
-// Function executed by each search thread (handles single or multiple patterns)
-void *search_chunk_thread(void *arg)
+// madvise() over the pages covering [start, start + len)
+static void advise_range(const char *start, size_t len, int advice)
 {
-    thread_data_t *data = (thread_data_t *)arg;
-    match_result_t *local_result = NULL; // Local results if tracking positions
-    uint64_t count_result = 0;           // Line or match count
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)start & ~(page - 1);
+    uintptr_t end = (uintptr_t)start + len;
+    if (len > 0)
+        (void)madvise((void *)first, end - first, advice);
+}
 
-    // Allocate local result storage if tracking positions
-    if (data->params->track_positions)
+// Drop the pages lying entirely inside a searched window. They are unmapped and, when
+// the file descriptor is known, evicted from the page cache, so a scan much larger than
+// RAM does not push other processes' data out. Lines printed later simply fault back in.
+static void prefetch_drop_window(const thread_data_t *data, const char *start, size_t len)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)start + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)start + len) & ~(page - 1);
+    if (end <= first)
+        return;
+    (void)madvise((void *)first, end - first, MADV_DONTNEED);
+#if defined(POSIX_FADV_DONTNEED) && !defined(__APPLE__)
+    if (data->file_fd >= 0 && data->file_base)
+        (void)posix_fadvise(data->file_fd, (off_t)((const char *)first - data->file_base), (off_t)(end - first),
+                            POSIX_FADV_DONTNEED);
+#endif
+}
+
+// Publish a chunk's count so far and report whether the file's result is already known
+static bool search_budget_spent(search_budget_t *budget, int chunk, uint64_t found)
+{
+    if (!budget)
+        return false;
+    atomic_store_explicit(&budget->found[chunk], found, memory_order_relaxed);
+    if (atomic_load_explicit(&budget->done, memory_order_relaxed))
+        return true;
+
+    // Counts only grow, so once enough are found nothing more here can be counted or
+    // printed: in count mode max_count lines anywhere cap the total, otherwise the
+    // chunks before this one hold all the lines -m lets through
+    int limit = budget->counts_only ? budget->num_chunks : chunk;
+    uint64_t total = 0;
+    for (int i = 0; i < limit && total < budget->max_count; i++)
+        total += atomic_load_explicit(&budget->found[i], memory_order_relaxed);
+    if (total < budget->max_count)
+        return false;
+    if (budget->counts_only)
+        atomic_store_explicit(&budget->done, true, memory_order_relaxed);
+    return true;
+}
+
+// Search a chunk for params one line-aligned window at a time. With PREFETCH_WINDOW the
+// next window is requested with MADV_WILLNEED before the current one is searched, and
+// searched windows are dropped when data->drop_behind is set. With a search budget the
+// chunk stops at the first window boundary after the file's result is known. Returns the
+// count like a search function; *searched_len receives the bytes actually searched.
+static uint64_t search_chunk_windowed(thread_data_t *data, const search_params_t *params, search_func_t search_algo,
+                                      match_result_t *local_result, size_t window, size_t *searched_len)
+{
+    const char *text = data->chunk_start;
+    size_t len = data->chunk_len;
+    bool prefetch = data->prefetch_window > 0;
+    size_t max_count = params->max_count;
+
+    match_result_t *window_result = NULL;
+    if (local_result)
     {
-        // Estimate initial capacity based on chunk length
-        uint64_t initial_cap = (data->chunk_len / 1000 > 100) ? data->chunk_len / 1000 : 100;
-        local_result = match_result_init(initial_cap);
-        if (!local_result)
+        window_result = match_result_init(window / 1000 > 100 ? window / 1000 : 100);
+        if (!window_result)
         {
-            fprintf(stderr, "krep: Thread %d: Failed to allocate local match results.\n", data->thread_id);
-            data->error_flag = true;
-            return NULL; // Signal error
+            *searched_len = len;
+            return search_algo(params, text, len, local_result);
+        }
+    }
+
+    if (prefetch)
+    {
+        advise_range(text, len, MADV_SEQUENTIAL);
+        advise_range(text, window < len ? window : len, MADV_WILLNEED);
+    }
+
+    search_params_t window_params = *params;
+    uint64_t total = 0;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        // Windows end just after a newline, like chunks, so no match crosses one
+        size_t window_len = len - pos;
+        if (window_len > window)
+        {
+            const char *nl = memchr(text + pos + window - 1, '\n', len - pos - window + 1);
+            if (nl)
+                window_len = (size_t)(nl - (text + pos)) + 1;
+        }
+
+        size_t next = pos + window_len;
+        if (prefetch && next < len)
+            advise_range(text + next, (len - next < window) ? len - next : window, MADV_WILLNEED);
+
+        if (max_count != SIZE_MAX)
+            window_params.max_count = max_count - (size_t)total;
+        window_params.text_continues = next < len || params->text_continues;
+        if (window_result)
+            window_result->count = 0;
+
+        uint64_t count = search_algo(&window_params, text + pos, window_len, window_result);
+        if (max_count != SIZE_MAX && count > window_params.max_count)
+            count = window_params.max_count;
+        if (window_result)
+        {
+            if (max_count != SIZE_MAX && window_result->count > window_params.max_count)
+                window_result->count = window_params.max_count;
+            if (!match_result_merge(local_result, window_result, pos))
+                data->error_flag = true;
+        }
+        total += count;
+
+        if (data->drop_behind)
+            prefetch_drop_window(data, text + pos, window_len);
+        pos = next;
+        if ((max_count != SIZE_MAX && total >= max_count) || data->error_flag ||
+            search_budget_spent(data->budget, data->thread_id, total))
+            break;
+    }
+
+    match_result_free(window_result);
+    *searched_len = pos;
+    return total;
+}
+
+// The length every match of params has (literal patterns of one length), or 0 when
+// match lengths vary and results need the full form
+static size_t fixed_match_length(const search_params_t *params)
+{
+    if (params->use_regex || params->num_patterns == 0 || !params->pattern_lens)
+        return 0;
+    size_t len = params->pattern_lens[0];
+    for (size_t i = 1; i < params->num_patterns; i++)
+    {
+        if (params->pattern_lens[i] != len)
+            return 0;
+    }
+    return len;
+}
+
+// Positions for a search over params, compact when every match has the same length
+static match_result_t *search_result_init(arena_t *arena, uint64_t initial_capacity, const search_params_t *params)
+{
+    size_t match_len = fixed_match_length(params);
+    return match_len > 0 ? match_result_init_compact(arena, initial_capacity, match_len)
+                         : match_result_init_arena(arena, initial_capacity);
+}
+
+// Function executed by each search thread (handles single or multiple patterns)
+void *search_chunk_thread(void *arg)
+{
+    thread_data_t *data = (thread_data_t *)arg;
+    match_result_t *local_result = NULL; // Local results if tracking positions
+    uint64_t count_result = 0;           // Line or match count
+
+    // Allocate local result storage if tracking positions
+    if (data->params->track_positions)
+    {
+        // Estimate initial capacity based on chunk length
+        uint64_t initial_cap = (data->chunk_len / 1000 > 100) ? data->chunk_len / 1000 : 100;
+        local_result = search_result_init(data->arena, initial_cap, data->params);
+        if (!local_result)
+        {
+            fprintf(stderr, "krep: Thread %d: Failed to allocate local match results.\n", data->thread_id);
+            data->error_flag = true;
+            return NULL; // Signal error
         }
         data->local_result = local_result; // Store pointer for the main thread
     }
@@ -1842,19 +2823,297 @@ void *search_chunk_thread(void *arg)
         data->search_algo = search_algo;
     }
 
-    count_result = search_algo(data->params,
-                               data->chunk_start,
-                               data->chunk_len,
-                               local_result); // Pass NULL if track_positions is false
+    // A chunk whose result is already decided by the others is not searched at all
+    if (search_budget_spent(data->budget, data->thread_id, 0))
+        return NULL;
+
+    // A chunk other than the last ends with a newline; the empty line after it is the
+    // next chunk's, so the regex searchers must not count it here as well
+    search_params_t chunk_params = *data->params;
+    chunk_params.text_continues = data->text_continues;
+
+    STATS_TIMER(search_start);
+    size_t window = data->prefetch_window ? data->prefetch_window : (data->budget ? SEARCH_BUDGET_BLOCK_SIZE : 0);
+    size_t searched_len = data->chunk_len;
+    if (window > 0 && data->chunk_len > window)
+        count_result = search_chunk_windowed(data, &chunk_params, search_algo, local_result, window, &searched_len);
+    else
+        count_result = search_algo(&chunk_params,
+                                   data->chunk_start,
+                                   data->chunk_len,
+                                   local_result); // Pass NULL if track_positions is false
+    search_budget_spent(data->budget, data->thread_id, count_result);
+    STATS_PHASE_END(STATS_PHASE_SEARCH, search_start);
+    STATS_ADD(STATS_CHUNKS, 1);
+    STATS_ADD(STATS_BYTES_SCANNED, searched_len);
+    STATS_ADD(STATS_MATCHES, count_result);
 
     // Store the count (lines or matches) found by this thread
     data->count_result = count_result;
 
+    // Context ranges are planned from each chunk's first and last matching line
+    if (local_result && local_result->count > 1 && context_lines_enabled(data->params) &&
+        !match_positions_sorted(local_result))
+        match_positions_sort(local_result);
+
+    // -o output numbers lines, so every chunk reports its newlines to the chunks after it.
+    // Chunks with matches also keep a newline index for their own line numbers.
+    if (data->index_newlines)
+    {
+        if (count_result > 0 && newline_index_build(&data->line_index, data->chunk_start, data->chunk_len))
+            data->newline_count = newline_index_total(&data->line_index);
+        else
+            data->newline_count = count_newlines(data->chunk_start, data->chunk_len);
+    }
+
     return NULL; // Success
 }
 
+// Matches recorded across all chunks
+static uint64_t chunk_positions_total(const thread_data_t *chunks, int num_chunks)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < num_chunks; i++)
+    {
+        if (chunks[i].local_result)
+            total += chunks[i].local_result->count;
+    }
+    return total;
+}
+
+// --- Output Capture ---
+
+// A FILE that appends everything written to it to a caller-owned buffer, so workers can
+// format output that is written out later in order. glibc and the BSDs write straight
+// into the buffer through a custom stream; elsewhere an open_memstream buffer is copied
+// into it when the capture is closed.
+typedef struct
+{
+    char **buf;          // Caller's buffer; output is appended after its first *len bytes
+    size_t *len;         // Bytes used in *buf
+    size_t *capacity;    // Allocated size of *buf
+    struct arena *arena; // Arena *buf was allocated from, or NULL for malloc
+    FILE *stream;
+#if !defined(__GLIBC__) && !defined(KREP_CAPTURE_FUNOPEN)
+    char *mem; // open_memstream buffer
+    size_t mem_len;
+#endif
+} output_capture_t;
+
+// Append size bytes to the capture's buffer, doubling its capacity as needed
+static bool output_capture_append(output_capture_t *cap, const char *data, size_t size)
+{
+    if (*cap->len + size > *cap->capacity)
+    {
+        size_t new_capacity = *cap->capacity ? *cap->capacity * 2 : 4096;
+        if (new_capacity < *cap->len + size)
+            new_capacity = *cap->len + size;
+        char *grown = cap->arena ? arena_grow(cap->arena, *cap->buf, *cap->len, new_capacity)
+                                 : realloc(*cap->buf, new_capacity);
+        if (!grown)
+            return false;
+        *cap->buf = grown;
+        *cap->capacity = new_capacity;
+    }
+    memcpy(*cap->buf + *cap->len, data, size);
+    *cap->len += size;
+    return true;
+}
+
+#if defined(__GLIBC__)
+static ssize_t output_capture_write(void *cookie, const char *data, size_t size)
+{
+    return output_capture_append((output_capture_t *)cookie, data, size) ? (ssize_t)size : -1;
+}
+#elif defined(KREP_CAPTURE_FUNOPEN)
+static int output_capture_write(void *cookie, const char *data, int size)
+{
+    return output_capture_append((output_capture_t *)cookie, data, (size_t)size) ? size : -1;
+}
+#endif
+
+// Open a stream appending to *buf (at *len). cap must stay valid until
+// output_capture_close(). Returns NULL if the stream cannot be created.
+static FILE *output_capture_open(output_capture_t *cap, char **buf, size_t *len, size_t *capacity,
+                                 struct arena *arena)
+{
+    memset(cap, 0, sizeof(*cap));
+    cap->buf = buf;
+    cap->len = len;
+    cap->capacity = capacity;
+    cap->arena = arena;
+#if defined(__GLIBC__)
+    cookie_io_functions_t sink = {NULL, output_capture_write, NULL, NULL};
+    cap->stream = fopencookie(cap, "w", sink);
+#elif defined(KREP_CAPTURE_FUNOPEN)
+    cap->stream = funopen(cap, NULL, output_capture_write, NULL, NULL);
+#else
+    cap->stream = open_memstream(&cap->mem, &cap->mem_len);
+#endif
+#if defined(__GLIBC__) || defined(KREP_CAPTURE_FUNOPEN)
+    // The formatter already batches its writes; skip stdio's own copy
+    if (cap->stream)
+        setvbuf(cap->stream, NULL, _IONBF, 0);
+#endif
+    return cap->stream;
+}
+
+// Close the stream; the captured bytes are then in the caller's buffer. Returns false
+// if any of them could not be stored.
+static bool output_capture_close(output_capture_t *cap)
+{
+    bool ok = fclose(cap->stream) == 0;
+#if !defined(__GLIBC__) && !defined(KREP_CAPTURE_FUNOPEN)
+    if (ok && cap->mem_len > 0)
+        ok = output_capture_append(cap, cap->mem, cap->mem_len);
+    free(cap->mem);
+#endif
+    cap->stream = NULL;
+    return ok;
+}
+
+// Format one chunk's matches into a private memory buffer. Chunks hold whole lines,
+// so the output of consecutive chunks concatenates to exactly what a single pass
+// over the file would print.
+static void *format_chunk_thread(void *arg)
+{
+    thread_data_t *data = (thread_data_t *)arg;
+
+    // Printed lines are copies of the chunk's lines plus a filename prefix
+    data->output_capacity = data->chunk_len + data->chunk_len / 4 + 4096;
+    data->output = data->arena ? arena_alloc(data->arena, data->output_capacity) : malloc(data->output_capacity);
+    output_capture_t capture;
+    data->output_len = 0;
+    if (!data->output ||
+        !output_capture_open(&capture, &data->output, &data->output_len, &data->output_capacity, data->arena))
+    {
+        data->error_flag = true;
+        return NULL;
+    }
+
+    STATS_TIMER(print_start);
+    FILE *saved_stream = thread_output_stream;
+    thread_output_stream = capture.stream;
+    size_t printed = print_matching_items_context(data->filename, data->chunk_start, data->chunk_len, data->local_result,
+                                                  data->params, data->first_line_number,
+                                                  data->line_index.newlines_before ? &data->line_index : NULL,
+                                                  data->context.limit ? &data->context : NULL);
+    thread_output_stream = saved_stream;
+    STATS_PHASE_END(STATS_PHASE_PRINT, print_start);
+    STATS_ADD(STATS_ITEMS_PRINTED, printed);
+    if (!output_capture_close(&capture))
+        data->error_flag = true;
+
+    match_result_free(data->local_result);
+    data->local_result = NULL;
+    return NULL;
+}
+
+// Give each chunk with matches the context state it starts from (-A/-B/-C). A chunk's
+// after-context runs up to the next printing chunk's first matching line, and its
+// before-context down to where the chunks before it stop printing, so the chunks can
+// still be formatted in parallel and no line is printed twice. Only the lines context
+// reaches are looked at: context crossing chunk boundaries needs no second pass.
+static void plan_chunk_context(thread_data_t *chunks, int num_chunks, const char *file_data, size_t file_size,
+                               const search_params_t *params)
+{
+    print_context_t state = context_for_input(file_data, file_size);
+    thread_data_t *prev = NULL; // Last chunk with matches, waiting for its limit
+    for (int i = 0; i <= num_chunks; i++)
+    {
+        const char *first_line = file_data + file_size;
+        if (i < num_chunks)
+        {
+            thread_data_t *chunk = &chunks[i];
+            if (!chunk->local_result || chunk->local_result->count == 0)
+                continue;
+            size_t first = match_result_start(chunk->local_result, 0);
+            first_line = chunk->chunk_start + find_line_start(chunk->chunk_start, chunk->chunk_len, first);
+        }
+
+        if (prev)
+        {
+            prev->context = state;
+            prev->context.limit = first_line;
+            // Its output ends after the last matching line and that line's after-context
+            size_t last = match_result_start(prev->local_result, prev->local_result->count - 1);
+            size_t line_end = find_line_end(prev->chunk_start, prev->chunk_len, last);
+            const char *printed_end = prev->chunk_start + (line_end < prev->chunk_len ? line_end + 1 : prev->chunk_len);
+            size_t after = params->context_after;
+            state.floor = context_skip_forward(printed_end, first_line, &after);
+            state.printed = true;
+            state.new_input = false;
+        }
+        if (i < num_chunks)
+            prev = &chunks[i];
+    }
+}
+
+// Write the chunks' formatted output in chunk order. On stdout this is one writev
+// per IOV_MAX chunks; other streams (captured recursive-mode output) get fwrite.
+static bool write_chunk_outputs(FILE *out, thread_data_t *chunks, int num_chunks)
+{
+    if (out != stdout)
+    {
+        for (int i = 0; i < num_chunks; i++)
+        {
+            if (chunks[i].output_len > 0 && fwrite(chunks[i].output, 1, chunks[i].output_len, out) != chunks[i].output_len)
+                return false;
+        }
+        return true;
+    }
+
+    fflush(stdout); // Anything already buffered goes first
+    struct iovec iov[64];
+    int i = 0;
+    while (i < num_chunks)
+    {
+        int n = 0;
+        for (; i < num_chunks && n < (int)(sizeof(iov) / sizeof(iov[0])); i++)
+        {
+            if (chunks[i].output_len == 0)
+                continue;
+            iov[n].iov_base = chunks[i].output;
+            iov[n].iov_len = chunks[i].output_len;
+            n++;
+        }
+
+        struct iovec *cur = iov;
+        while (n > 0)
+        {
+            ssize_t written = writev(STDOUT_FILENO, cur, n);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            // Skip fully written buffers, then trim a partially written one
+            while (n > 0 && (size_t)written >= cur->iov_len)
+            {
+                written -= cur->iov_len;
+                cur++;
+                n--;
+            }
+            if (n > 0)
+            {
+                cur->iov_base = (char *)cur->iov_base + written;
+                cur->iov_len -= written;
+            }
+        }
+    }
+    return true;
+}
+
 // --- Public API Implementations ---
 
+#ifdef TESTING
+void krep_set_only_matching(bool enabled)
+{
+    only_matching = enabled;
+}
+#endif
+
 // Add get_algorithm_name implementation here before search_string function
 const char *get_algorithm_name(search_func_t func)
 {
@@ -1870,20 +3129,16 @@ const char *get_algorithm_name(search_func_t func)
         return "memchr";
     else if (func == memchr_short_search)
         return "memchr-short";
-#if KREP_USE_SSE42
-    else if (func == simd_sse42_search)
-        return "SSE4.2";
-#endif
-#if KREP_USE_AVX2
-    else if (func == simd_avx2_search)
-        return "AVX2";
-#endif
-#if KREP_USE_NEON
-    else if (func == neon_search)
-        return "NEON";
-#endif
-    else
-        return "Unknown";
+    else if (func == memchr_count_lines)
+        return "memchr (count lines)";
+    else if (func == boyer_moore_count_lines)
+        return "Boyer-Moore-Horspool (count lines)";
+    for (const simd_kernel_t *k = simd_kernels; k->func; k++)
+    {
+        if (func == k->func)
+            return k->name;
+    }
+    return "Unknown";
 }
 
 // Search a string (remains single-threaded)
@@ -2049,6 +3304,7 @@ int search_string(const search_params_t *params, const char *text)
 
         regex_compiled = true;
         current_params.compiled_regex = &compiled_regex_local;
+        current_params.regex_dfa = regex_dfa_compile(regex_to_compile, current_params.case_sensitive);
     }
 
     // --- Execute Search ---
@@ -2057,7 +3313,12 @@ int search_string(const search_params_t *params, const char *text)
     search_func_t search_algo = select_search_algorithm(&current_params);
 
     // Perform search and collect results
+    STATS_TIMER(search_start);
     final_count = search_algo(&current_params, text, text_len, matches);
+    STATS_PHASE_END(STATS_PHASE_SEARCH, search_start);
+    STATS_ADD(STATS_CHUNKS, 1);
+    STATS_ADD(STATS_BYTES_SCANNED, text_len);
+    STATS_ADD(STATS_MATCHES, final_count);
 
     // Determine final result based on matches found
     bool match_found = false;
@@ -2093,7 +3354,7 @@ int search_string(const search_params_t *params, const char *text)
 
     if (current_params.count_lines_mode || current_params.count_matches_mode)
     {
-        printf("%" PRIu64 "\n", final_count);
+        print_count_summary(&current_params, NULL, final_count);
     }
     else
     {
@@ -2101,7 +3362,10 @@ int search_string(const search_params_t *params, const char *text)
         if (result_code == 0 && matches)
         {
             // No need to sort for string search (single thread)
-            print_matching_items(NULL, text, text_len, matches, &current_params); // Pass params
+            STATS_TIMER(print_start);
+            size_t printed = print_matching_items(NULL, text, text_len, matches, &current_params); // Pass params
+            STATS_PHASE_END(STATS_PHASE_PRINT, print_start);
+            STATS_ADD(STATS_ITEMS_PRINTED, printed);
         }
         // Handle case where match was found but no positions recorded (e.g., empty regex match)
         else if (result_code == 0 && (!matches || matches->count == 0))
@@ -2109,12 +3373,12 @@ int search_string(const search_params_t *params, const char *text)
             if (only_matching)
             {
                 // Print empty match for -o (consistent with grep)
-                puts("");
+                fputs("\n", current_output());
             }
             else
             {
                 // Print the whole (empty) line
-                puts("");
+                fputs("\n", current_output());
             }
         }
     }
@@ -2124,6 +3388,7 @@ cleanup:
     if (regex_compiled)
     {
         regfree(&compiled_regex_local);
+        regex_dfa_free(current_params.regex_dfa);
     }
     free(combined_regex_pattern);
     match_result_free(matches);
@@ -2136,932 +3401,3585 @@ cleanup:
     return result_code;
 }
 
-// Global thread pool
-static thread_pool_t *global_thread_pool = NULL;
+// --- Streaming Search (stdin and other non-seekable inputs) ---
+//
+// Input is consumed in fixed-size blocks through a small ring filled by a reader
+// thread, so searching overlaps with waiting on read(). Each block is searched up
+// to its last newline and the trailing partial line is carried into the next one,
+// which keeps every match (literal or regex) inside a single searched window.
+// Memory stays bounded by the ring plus the longest line, and results are printed
+// as soon as each block is searched.
 
-// Initialize the global thread pool with auto-detected core count
-static void init_global_thread_pool(int requested_thread_count)
+#define STREAM_BLOCK_SIZE (1024 * 1024) // Maximum bytes handed over per block
+#define STREAM_RING_BLOCKS 4            // Blocks the reader may run ahead by
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    bool eof;  // No more data after this block
+    int error; // errno from read(), 0 if none
+} stream_block_t;
+
+typedef struct
+{
+    int fd;
+    decompress_t *decoder; // Decompressed input instead of fd (owned by the ring), or NULL
+    io_reader_t *reader;   // Read-ahead file reader instead of fd (owned by the ring), or NULL
+    stream_block_t blocks[STREAM_RING_BLOCKS];
+    size_t head;   // Next block the searcher consumes
+    size_t tail;   // Next block the reader fills
+    size_t filled; // Blocks ready for the searcher
+    bool threaded; // Reader thread is running
+    bool stop;     // Searcher is done; reader should exit
+    int refs;      // Owners left (reader + searcher); last one frees the ring
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} stream_ring_t;
+
+// Fill one block with a single read() so interactive pipes are not held back
+// waiting for a full block.
+static void stream_read_block(const stream_ring_t *ring, stream_block_t *blk)
 {
-    if (global_thread_pool == NULL)
+    blk->len = 0;
+    blk->eof = false;
+    blk->error = 0;
+    for (;;)
     {
-        global_thread_pool = thread_pool_init(requested_thread_count);
-        if (!global_thread_pool)
+        ssize_t n;
+        if (ring->decoder)
+            n = decompress_read(ring->decoder, blk->data, STREAM_BLOCK_SIZE);
+        else if (ring->reader)
+            n = io_reader_read(ring->reader, blk->data, STREAM_BLOCK_SIZE);
+        else
+            n = read(ring->fd, blk->data, STREAM_BLOCK_SIZE);
+        if (n > 0)
+        {
+            blk->len = (size_t)n;
+            return;
+        }
+        if (n == 0)
         {
-            fprintf(stderr, "Failed to initialize thread pool. Using single-threaded mode.\n");
+            blk->eof = true;
+            return;
         }
+        if (errno == EINTR)
+            continue;
+        blk->error = errno;
+        blk->eof = true;
+        return;
     }
 }
 
-// Clean up the global thread pool
-static void KREP_UNUSED cleanup_global_thread_pool()
+static void stream_ring_release(stream_ring_t *ring)
 {
-    if (global_thread_pool)
-    {
-        thread_pool_destroy(global_thread_pool);
-        global_thread_pool = NULL;
-    }
+    pthread_mutex_lock(&ring->mutex);
+    bool last = (--ring->refs == 0);
+    pthread_mutex_unlock(&ring->mutex);
+    if (!last)
+        return;
+
+    for (int i = 0; i < STREAM_RING_BLOCKS; i++)
+        free(ring->blocks[i].data);
+    decompress_close(ring->decoder);
+    io_reader_close(ring->reader);
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+    free(ring);
 }
 
-int search_file(const search_params_t *params, const char *filename, int requested_thread_count)
+static void *stream_reader_thread(void *arg)
 {
-    search_params_t current_params = *params;
-    ac_trie_t *local_ac_trie = NULL; // Pointer for locally built trie
-
-    int result_code = 1;                         // Default: no match found
-    int fd = -1;                                 // File descriptor
-    struct stat file_stat;                       // File stats
-    size_t file_size = 0;                        // File size
-    char *file_data = MAP_FAILED;                // Mapped file data
-    match_result_t *global_matches = NULL;       // Global result collection
-    pthread_t *threads = NULL;                   // Thread handles
-    thread_data_t *thread_args = NULL;           // Thread arguments
-    regex_t compiled_regex_local;                // For local regex compilation
-    char *combined_regex_pattern = NULL;         // For combined regex patterns
-    int actual_thread_count = 0;                 // Number of threads to actually use
-    uint64_t final_count = 0;                    // Total count of lines or matches
-    size_t max_count = current_params.max_count; // Get max_count
+    stream_ring_t *ring = (stream_ring_t *)arg;
+    bool eof = false;
 
-    // Validate patterns for literal search (not for regex)
-    if (!current_params.use_regex)
+    while (!eof)
     {
-        for (size_t i = 0; i < current_params.num_patterns; ++i)
+        pthread_mutex_lock(&ring->mutex);
+        while (ring->filled == STREAM_RING_BLOCKS && !ring->stop)
+            pthread_cond_wait(&ring->not_full, &ring->mutex);
+        if (ring->stop)
         {
-            // Check for empty pattern - only allowed if there's a single pattern
-            if (current_params.pattern_lens[i] == 0)
-            {
-                if (current_params.num_patterns > 1)
-                {
-                    fprintf(stderr, "krep: %s: Error: Empty pattern provided for literal search with multiple patterns.\n", filename);
-                    return 2;
-                }
-                // Single empty pattern is allowed, continue to next pattern
-                continue;
-            }
-
-            // Check for pattern length limit
-            if (current_params.pattern_lens[i] > MAX_PATTERN_LENGTH)
-            {
-                fprintf(stderr, "krep: %s: Error: Pattern '%s' too long (max %d).\n",
-                        filename, current_params.patterns[i], MAX_PATTERN_LENGTH);
-                return 2;
-            }
+            pthread_mutex_unlock(&ring->mutex);
+            break;
         }
+        stream_block_t *blk = &ring->blocks[ring->tail];
+        pthread_mutex_unlock(&ring->mutex);
+
+        // The block at tail is owned by the reader until it is published below
+        stream_read_block(ring, blk);
+        eof = blk->eof;
+
+        pthread_mutex_lock(&ring->mutex);
+        ring->tail = (ring->tail + 1) % STREAM_RING_BLOCKS;
+        ring->filled++;
+        pthread_cond_signal(&ring->not_empty);
+        pthread_mutex_unlock(&ring->mutex);
     }
 
-    // Input from stdin
-    if (strcmp(filename, "-") == 0)
+    stream_ring_release(ring);
+    return NULL;
+}
+
+// Read from fd, or from decoder or reader when one is not NULL. The ring takes
+// ownership of the decoder and the reader, even on failure.
+static stream_ring_t *stream_ring_open(int fd, decompress_t *decoder, io_reader_t *reader)
+{
+    stream_ring_t *ring = calloc(1, sizeof(stream_ring_t));
+    if (!ring)
     {
-        // Read from stdin into a dynamically growing buffer
-        size_t buffer_size = 4 * 1024 * 1024; // Start with 4MB
-        size_t used_size = 0;
-        char *buffer = malloc(buffer_size);
-        if (!buffer)
-        {
-            fprintf(stderr, "krep: Memory allocation failed for stdin buffer\n");
-            return 2;
-        }
+        decompress_close(decoder);
+        io_reader_close(reader);
+        return NULL;
+    }
 
-        // Read stdin in chunks
-        size_t read_chunk_size = 65536; // 64KB chunks
-        size_t bytes_read;
-        while ((bytes_read = fread(buffer + used_size, 1, read_chunk_size, stdin)) > 0)
-        {
-            used_size += bytes_read;
-            // Expand buffer if needed
-            if (used_size + read_chunk_size > buffer_size)
-            {
-                buffer_size *= 2;
-                char *new_buffer = realloc(buffer, buffer_size);
-                if (!new_buffer)
-                {
-                    fprintf(stderr, "krep: Memory reallocation failed for stdin buffer\n");
-                    free(buffer);
-                    return 2;
-                }
-                buffer = new_buffer;
-            }
-        }
-        if (ferror(stdin))
+    ring->fd = fd;
+    ring->decoder = decoder;
+    ring->reader = reader;
+    ring->refs = 1;
+    for (int i = 0; i < STREAM_RING_BLOCKS; i++)
+    {
+        ring->blocks[i].data = malloc(STREAM_BLOCK_SIZE);
+        if (!ring->blocks[i].data)
         {
-            fprintf(stderr, "krep: Error reading from stdin: %s\n", strerror(errno));
-            free(buffer);
-            return 2;
+            for (int j = 0; j < i; j++)
+                free(ring->blocks[j].data);
+            decompress_close(decoder);
+            io_reader_close(reader);
+            free(ring);
+            return NULL;
         }
+    }
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+
+    // The reader thread is detached and holds its own reference, so the searcher can
+    // return early (e.g. -m reached) while the reader is still blocked in read().
+    pthread_t reader_thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ring->refs = 2;
+    ring->threaded = true;
+    if (pthread_create(&reader_thread, &attr, stream_reader_thread, ring) != 0)
+    {
+        // Fall back to reading synchronously from the searcher
+        ring->refs = 1;
+        ring->threaded = false;
+    }
+    pthread_attr_destroy(&attr);
+    return ring;
+}
 
-        // Null-terminate the buffer for search_string
-        // Realloc to exact size + 1 for null terminator
-        char *final_buffer = realloc(buffer, used_size + 1);
-        if (!final_buffer)
-        {
-            fprintf(stderr, "krep: Memory reallocation failed for final stdin buffer\n");
-            free(buffer);
-            return 2;
-        }
-        buffer = final_buffer;
-        buffer[used_size] = '\0';
+// Take the next filled block, reading it directly when no reader thread is running.
+// The block stays valid until stream_ring_done().
+static stream_block_t *stream_ring_next(stream_ring_t *ring)
+{
+    if (!ring->threaded)
+    {
+        stream_block_t *blk = &ring->blocks[0];
+        stream_read_block(ring, blk);
+        return blk;
+    }
 
-        // Need to build AC trie here too if needed for stdin search
-        bool needs_ac_trie_stdin = (current_params.num_patterns > 1 && !current_params.use_regex);
-        if (needs_ac_trie_stdin)
-        {
-            local_ac_trie = ac_trie_build(&current_params);
-            if (!local_ac_trie)
-            {
-                fprintf(stderr, "krep: Error building Aho-Corasick trie for stdin.\n");
-                free(buffer);
-                return 2;
-            }
-            current_params.ac_trie = local_ac_trie;
-        }
+    pthread_mutex_lock(&ring->mutex);
+    while (ring->filled == 0)
+        pthread_cond_wait(&ring->not_empty, &ring->mutex);
+    stream_block_t *blk = &ring->blocks[ring->head];
+    pthread_mutex_unlock(&ring->mutex);
+    return blk;
+}
 
-        // Search the buffer using search_string logic (single-threaded for stdin)
-        // search_string will now use the pre-built trie if current_params.ac_trie is set
-        result_code = search_string(&current_params, buffer);
+// Hand a consumed block back to the reader
+static void stream_ring_done(stream_ring_t *ring)
+{
+    if (!ring->threaded)
+        return;
 
-        // Cleanup for stdin
-        free(buffer);
-        if (local_ac_trie)
-        { // Free trie built for stdin
-            ac_trie_free(local_ac_trie);
-        }
-        return result_code;
-    }
+    pthread_mutex_lock(&ring->mutex);
+    ring->head = (ring->head + 1) % STREAM_RING_BLOCKS;
+    ring->filled--;
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->mutex);
+}
 
-    // --- Regular File Handling ---
-    fd = open(filename, O_RDONLY | O_CLOEXEC);
-    if (fd == -1)
+static void stream_ring_close(stream_ring_t *ring)
+{
+    pthread_mutex_lock(&ring->mutex);
+    ring->stop = true;
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->mutex);
+    stream_ring_release(ring);
+}
+
+// Build the regex string for params (combining multiple patterns and applying -w).
+// Returns the string to compile; *owned receives any allocation the caller must free.
+static const char *build_regex_pattern(const search_params_t *params, char **owned)
+{
+    *owned = NULL;
+    if (params->num_patterns == 1 && !params->whole_word)
+        return params->patterns[0];
+
+    size_t total_len = 0;
+    for (size_t i = 0; i < params->num_patterns; ++i)
+        total_len += params->pattern_lens[i] + (params->whole_word ? 6 : 2) + 1; // (\b...\b) or () + |
+
+    char *combined = malloc(total_len + 1);
+    if (!combined)
+        return NULL;
+
+    char *ptr = combined;
+    for (size_t i = 0; i < params->num_patterns; ++i)
     {
-        fprintf(stderr, "krep: %s: %s\n", filename, strerror(errno));
-        return 2;
+        if (params->num_patterns == 1)
+            ptr += sprintf(ptr, "\\b%s\\b", params->patterns[i]);
+        else if (params->whole_word)
+            ptr += sprintf(ptr, "(\\b%s\\b)", params->patterns[i]);
+        else
+            ptr += sprintf(ptr, "(%s)", params->patterns[i]);
+        if (i < params->num_patterns - 1)
+            ptr += sprintf(ptr, "|");
     }
-    if (fstat(fd, &file_stat) == -1)
+    *ptr = '\0';
+    *owned = combined;
+    return combined;
+}
+
+// True if data's first block holds a NUL byte, the usual sign of a binary file. Called
+// on the mapping or first read buffer the search uses anyway, so detection costs no
+// extra open or read; glibc's memchr does the scan with SIMD.
+static inline bool data_looks_binary(const char *data, size_t len)
+{
+    if (len > BINARY_CHECK_BUFFER_SIZE)
+        len = BINARY_CHECK_BUFFER_SIZE;
+    return len > 0 && memchr(data, '\0', len) != NULL;
+}
+
+// Running state of a streaming search, carried from one block to the next
+typedef struct
+{
+    search_params_t params; // Prepared params (trie / regex attached)
+    search_func_t search_algo;
+    match_result_t *matches; // Reused per window when tracking positions
+    const char *filename;    // Prefix for printed lines, NULL for stdin
+    size_t next_line_number; // Line number of the first line in the next window
+    uint64_t total;          // Lines/matches found so far
+    uint64_t bytes_seen;     // Bytes fed so far
+    bool limit_reached;      // max_count satisfied; stop reading
+
+    // Window = before-context tail + carried partial line + newly fed data. The tail
+    // keeps up to context_before unprinted lines of searched text for the next window.
+    char *window;
+    size_t window_capacity;
+    size_t tail_len;
+    size_t carry_len;
+    print_context_t context; // -A/-B/-C state carried from window to window
+
+    // Resources owned by the stream search
+    ac_trie_t *local_ac_trie;
+    regex_t compiled_regex_local;
+    bool regex_compiled;
+    char *combined_regex_pattern;
+} stream_search_t;
+
+// Search one window made of whole lines (or the final unterminated line)
+static void stream_search_window(stream_search_t *ss, const char *text, size_t len)
+{
+    search_params_t block_params = ss->params;
+    size_t max_count = ss->params.max_count;
+    if (max_count != SIZE_MAX)
+        block_params.max_count = max_count - (size_t)ss->total;
+
+    if (ss->matches)
+        ss->matches->count = 0;
+
+    // Context may reach back into the tail and forward to the end of the window
+    ss->context.floor = ss->window;
+    ss->context.limit = text + len;
+    if (max_count != SIZE_MAX && ss->total >= max_count)
     {
-        fprintf(stderr, "krep: %s: %s\n", filename, strerror(errno));
-        close(fd);
-        return 2;
+        // -m is satisfied; the window only supplies after-context still owed
+        print_matching_items_context(ss->filename, text, len, NULL, &block_params, ss->next_line_number, NULL,
+                                     &ss->context);
+        fflush(current_output());
+        ss->limit_reached = ss->context.after_left == 0;
+        return;
     }
-    file_size = file_stat.st_size;
 
-    // --- Handle Empty File ---
-    if (file_size == 0)
+    STATS_TIMER(search_start);
+    uint64_t count = ss->search_algo(&block_params, text, len, ss->matches);
+    STATS_PHASE_END(STATS_PHASE_SEARCH, search_start);
+    STATS_ADD(STATS_CHUNKS, 1);
+    STATS_ADD(STATS_BYTES_SCANNED, len);
+    STATS_ADD(STATS_MATCHES, count);
+    if (max_count != SIZE_MAX && count > block_params.max_count)
+        count = block_params.max_count;
+    if (ss->matches && max_count != SIZE_MAX && ss->matches->count > block_params.max_count)
+        ss->matches->count = block_params.max_count;
+
+    if (block_params.count_lines_mode || block_params.count_matches_mode)
     {
-        close(fd);
-        bool empty_match = false;
-        bool needs_ac_trie_empty = (current_params.num_patterns > 1 && !current_params.use_regex);
+        ss->total += count;
+    }
+    else if (ss->matches && (ss->matches->count > 0 || ss->context.after_left > 0))
+    {
+        STATS_TIMER(print_start);
+        size_t printed = print_matching_items_context(ss->filename, text, len, ss->matches, &block_params,
+                                                      ss->next_line_number, NULL, &ss->context);
+        ss->total += ss->matches->count;
+        fflush(current_output());
+        STATS_PHASE_END(STATS_PHASE_PRINT, print_start);
+        STATS_ADD(STATS_ITEMS_PRINTED, printed);
+    }
 
-        // Temporarily build trie just to check root outputs for empty pattern
-        if (needs_ac_trie_empty)
+    if (only_matching)
+    {
+        const char *p = text;
+        const char *end = text + len;
+        while (p < end && (p = memchr(p, '\n', end - p)) != NULL)
         {
-            ac_trie_t *temp_trie = ac_trie_build(&current_params);
-            if (ac_trie_root_has_outputs(temp_trie))
-            {
-                empty_match = true;
-            }
-            if (temp_trie)
-                ac_trie_free(temp_trie);
+            ss->next_line_number++;
+            p++;
         }
-        // Check regex empty match
-        else if (current_params.use_regex)
+    }
+
+    if (max_count != SIZE_MAX && ss->total >= max_count)
+        ss->limit_reached = ss->context.after_left == 0;
+}
+
+// Prepare the matcher (trie / regex) once for the whole stream. Returns false on error.
+static bool stream_search_begin(stream_search_t *ss, const search_params_t *params, const char *filename)
+{
+    memset(ss, 0, sizeof(*ss));
+    ss->params = *params;
+    ss->filename = filename;
+    ss->next_line_number = 1;
+    ss->context = context_for_input(NULL, 0);
+
+    if (ss->params.num_patterns == 0)
+    {
+        fprintf(stderr, "krep: No pattern specified.\n");
+        return false;
+    }
+
+    STATS_ADD(STATS_FILES, 1);
+    STATS_TIMER(compile_start);
+    if (ss->params.num_patterns > 1 && !ss->params.use_regex)
+    {
+        ss->local_ac_trie = ac_trie_build(&ss->params);
+        if (!ss->local_ac_trie)
         {
-            // Compile regex temporarily to check for empty match
-            regex_t temp_regex;
-            const char *regex_to_compile = NULL;
-            char *temp_combined_pattern = NULL;
-            if (current_params.num_patterns > 1)
+            fprintf(stderr, "krep: Error building Aho-Corasick trie for %s.\n", filename ? filename : "stdin");
+            return false;
+        }
+        ss->params.ac_trie = ss->local_ac_trie;
+    }
+
+    if (ss->params.use_regex)
+    {
+        const char *regex_to_compile = build_regex_pattern(&ss->params, &ss->combined_regex_pattern);
+        if (!regex_to_compile)
+        {
+            fprintf(stderr, "krep: Failed to allocate memory for regex pattern.\n");
+            return false;
+        }
+        int rflags = REG_EXTENDED | REG_NEWLINE | (ss->params.case_sensitive ? 0 : REG_ICASE);
+        int ret = regcomp(&ss->compiled_regex_local, regex_to_compile, rflags);
+        if (ret != 0)
+        {
+            char ebuf[256];
+            regerror(ret, &ss->compiled_regex_local, ebuf, sizeof(ebuf));
+            fprintf(stderr, "krep: Regex compilation error: %s\n", ebuf);
+            return false;
+        }
+        ss->regex_compiled = true;
+        ss->params.compiled_regex = &ss->compiled_regex_local;
+        ss->params.regex_dfa = regex_dfa_compile(regex_to_compile, ss->params.case_sensitive);
+    }
+    STATS_PHASE_END(STATS_PHASE_COMPILE, compile_start);
+
+    ss->search_algo = select_search_algorithm(&ss->params);
+
+    if (ss->params.track_positions)
+    {
+        ss->matches = match_result_init(1000);
+        if (!ss->matches)
+        {
+            fprintf(stderr, "krep: Cannot allocate memory for match results.\n");
+            return false;
+        }
+    }
+
+    ss->window_capacity = 2 * STREAM_BLOCK_SIZE;
+    ss->window = malloc(ss->window_capacity);
+    if (!ss->window)
+    {
+        fprintf(stderr, "krep: Memory allocation failed for stream buffers\n");
+        return false;
+    }
+    return true;
+}
+
+// Feed the next piece of input. Everything up to the last newline is searched; the
+// trailing partial line is kept unless final is set. Returns false on allocation failure.
+static bool stream_search_feed(stream_search_t *ss, const char *data, size_t len, bool final)
+{
+    if (ss->tail_len + ss->carry_len + len > ss->window_capacity)
+    {
+        // A single line longer than the window: grow to hold it
+        size_t new_capacity = ss->window_capacity * 2;
+        while (new_capacity < ss->tail_len + ss->carry_len + len)
+            new_capacity *= 2;
+        char *new_window = realloc(ss->window, new_capacity);
+        if (!new_window)
+        {
+            fprintf(stderr, "krep: Memory reallocation failed for stream buffer\n");
+            return false;
+        }
+        ss->window = new_window;
+        ss->window_capacity = new_capacity;
+    }
+    char *text = ss->window + ss->tail_len;
+    if (len > 0)
+        memcpy(text + ss->carry_len, data, len);
+    size_t window_len = ss->carry_len + len;
+    ss->bytes_seen += len;
+
+    size_t search_len = window_len;
+    if (!final)
+    {
+        const char *last_nl = len ? memrchr(text + ss->carry_len, '\n', len) : NULL;
+        search_len = last_nl ? (size_t)(last_nl - text) + 1 : 0;
+    }
+
+    bool searched = search_len > 0 && !ss->limit_reached;
+    if (searched)
+        stream_search_window(ss, text, search_len);
+
+    // Keep the last context_before lines not printed yet in front of the carry
+    const char *keep = text + search_len;
+    if (search_len == 0)
+    {
+        keep = ss->window; // Nothing consumed: the tail stays as it is
+    }
+    else if (searched && context_lines_enabled(&ss->params))
+    {
+        if (ss->params.context_before > 0)
+            keep = context_skip_backward(keep, ss->context.floor, ss->params.context_before);
+        // Unprinted lines dropped here put a gap between the last group and the kept tail
+        if (keep > ss->context.floor)
+            ss->context.gap_below = true;
+    }
+    ss->carry_len = window_len - search_len;
+    ss->tail_len = (size_t)(text + search_len - keep);
+    if (keep > ss->window && ss->tail_len + ss->carry_len > 0)
+        memmove(ss->window, keep, ss->tail_len + ss->carry_len);
+    return true;
+}
+
+// Drop a carried partial line without searching it (e.g. after truncation)
+static void stream_search_discard_carry(stream_search_t *ss)
+{
+    ss->carry_len = 0;
+    ss->tail_len = 0;
+}
+
+static void stream_search_end(stream_search_t *ss)
+{
+    free(ss->window);
+    match_result_free(ss->matches);
+    if (ss->regex_compiled)
+    {
+        regfree(&ss->compiled_regex_local);
+        regex_dfa_free(ss->params.regex_dfa);
+    }
+    free(ss->combined_regex_pattern);
+    if (ss->local_ac_trie)
+        ac_trie_free(ss->local_ac_trie);
+}
+
+// Print the -c summary for a finished stream
+static void stream_search_print_count(const stream_search_t *ss)
+{
+    if (!ss->params.count_lines_mode && !ss->params.count_matches_mode)
+        return;
+    print_count_summary(&ss->params, ss->filename, ss->total);
+}
+
+// Stream search over fd, or over the output of decoder or reader when one is not NULL
+// (both are closed before returning)
+static int search_stream_from(const search_params_t *params, int fd, decompress_t *decoder, io_reader_t *reader,
+                              const char *filename)
+{
+    stream_search_t ss;
+    stream_ring_t *ring = NULL;
+    int result_code = 2;
+
+    if (!stream_search_begin(&ss, params, filename))
+    {
+        decompress_close(decoder);
+        io_reader_close(reader);
+        goto cleanup_stream;
+    }
+
+    ring = stream_ring_open(fd, decoder, reader);
+    if (!ring)
+    {
+        fprintf(stderr, "krep: Memory allocation failed for stream buffers\n");
+        goto cleanup_stream;
+    }
+
+    bool eof = false;
+    int read_error = 0;
+    while (!eof && !ss.limit_reached)
+    {
+        stream_block_t *blk = stream_ring_next(ring);
+        eof = blk->eof;
+        read_error = blk->error;
+        if (ss.bytes_seen == 0 && !read_error && params->binary_files == BINARY_FILES_SKIP &&
+            data_looks_binary(blk->data, blk->len))
+        {
+            stream_ring_done(ring);
+            result_code = 1; // Binary input is skipped: nothing searched or printed
+            goto cleanup_stream;
+        }
+        bool fed = stream_search_feed(&ss, blk->data, blk->len, eof);
+        stream_ring_done(ring);
+        if (!fed)
+            goto cleanup_stream;
+    }
+
+    if (read_error)
+    {
+        if (ring->decoder)
+            fprintf(stderr, "krep: %s: %s\n", filename, decompress_error(ring->decoder));
+        else
+            fprintf(stderr, "krep: Error reading from %s: %s\n", filename ? filename : "stdin", strerror(read_error));
+        goto cleanup_stream;
+    }
+
+    if (ss.bytes_seen == 0)
+    {
+        // Empty input: keep the empty-pattern semantics of search_string
+        result_code = search_string(params, "");
+        goto cleanup_stream;
+    }
+
+    result_code = (ss.total > 0) ? 0 : 1;
+    stream_search_print_count(&ss);
+
+cleanup_stream:
+    if (ring)
+        stream_ring_close(ring);
+    stream_search_end(&ss);
+    return result_code;
+}
+
+int search_stream(const search_params_t *params, int fd, const char *filename)
+{
+    return search_stream_from(params, fd, NULL, NULL, filename);
+}
+
+// --- Compiled Matcher (library API) ---
+//
+// krep_compile() does the per-pattern work of search_string() once: it validates the
+// patterns, builds the Aho-Corasick trie or compiles the regex (and its lazy DFA),
+// precomputes the Boyer-Moore-Horspool and KMP tables for a single literal and picks
+// the search function. krep_match() then only runs that function over the buffer.
+//
+// A matcher is never written after krep_compile() returns, so one matcher can be used
+// from several threads at once: the trie and tables are read-only, regexec() is
+// reentrant and the DFA keeps its state caches per thread.
+
+struct krep_matcher
+{
+   search_params_t params;    // Prepared params; patterns point at the copies below
+   search_func_t search_algo; // Selected once by select_search_algorithm()
+   search_func_t lines_algo;  // Position-recording algorithm for batches of whole lines
+   const char **patterns;     // Copies of the caller's patterns
+   size_t *pattern_lens;
+   int bad_char_table[256];
+   int *kmp_lps;
+   ac_trie_t *ac_trie;
+   regex_t regex;
+   bool regex_compiled;
+   char *combined_regex_pattern;
+};
+
+krep_matcher_t *krep_compile(const search_params_t *params)
+{
+    if (!params || params->num_patterns == 0)
+    {
+        fprintf(stderr, "krep: No pattern specified.\n");
+        return NULL;
+    }
+
+    if (!params->use_regex)
+    {
+        for (size_t i = 0; i < params->num_patterns; ++i)
+        {
+            if (params->pattern_lens[i] == 0 && params->num_patterns > 1)
             {
-                size_t total_len = 0;
-                for (size_t i = 0; i < current_params.num_patterns; ++i)
-                    total_len += current_params.pattern_lens[i] + 3;
-                temp_combined_pattern = malloc(total_len + 1); // +1 for null
-                if (temp_combined_pattern)
-                {
-                    char *ptr = temp_combined_pattern;
-                    for (size_t i = 0; i < current_params.num_patterns; ++i)
-                    {
-                        ptr += sprintf(ptr, "(%s)", current_params.patterns[i]);
-                        if (i < current_params.num_patterns - 1)
-                            ptr += sprintf(ptr, "|");
-                    }
-                    *ptr = '\0'; // Null terminate
-                    regex_to_compile = temp_combined_pattern;
-                } // else: proceed with first pattern, might be inaccurate but avoids error
+                fprintf(stderr, "krep: Empty pattern provided for literal search with multiple patterns.\n");
+                return NULL;
             }
-            else if (current_params.num_patterns == 1)
+            if (params->pattern_lens[i] > MAX_PATTERN_LENGTH)
             {
-                regex_to_compile = current_params.patterns[0];
-            }
-            else
-            { // No patterns
-                free(temp_combined_pattern);
-                return 1;
+                fprintf(stderr, "krep: Pattern '%s' too long (max %d).\n", params->patterns[i], MAX_PATTERN_LENGTH);
+                return NULL;
             }
+        }
+    }
 
-            int rflags = REG_EXTENDED | REG_NEWLINE | (current_params.case_sensitive ? 0 : REG_ICASE);
-            if (regcomp(&temp_regex, regex_to_compile, rflags) == 0)
-            {
-                regmatch_t m;
-                if (regexec(&temp_regex, "", 1, &m, 0) == 0 && m.rm_so == 0 && m.rm_eo == 0)
-                {
-                    empty_match = true;
-                }
-                regfree(&temp_regex);
-            }
-            free(temp_combined_pattern);
+    krep_matcher_t *m = calloc(1, sizeof(*m));
+    if (!m)
+    {
+        fprintf(stderr, "krep: Cannot allocate memory for matcher.\n");
+        return NULL;
+    }
+    m->params = *params;
+    m->params.bad_char_table = NULL;
+    m->params.kmp_lps = NULL;
+
+    // Own the patterns so the caller's strings need not outlive the matcher
+    m->patterns = calloc(params->num_patterns, sizeof(*m->patterns));
+    m->pattern_lens = malloc(params->num_patterns * sizeof(*m->pattern_lens));
+    if (!m->patterns || !m->pattern_lens)
+        goto fail_alloc;
+    for (size_t i = 0; i < params->num_patterns; ++i)
+    {
+        char *copy = malloc(params->pattern_lens[i] + 1);
+        if (!copy)
+            goto fail_alloc;
+        memcpy(copy, params->patterns[i], params->pattern_lens[i]);
+        copy[params->pattern_lens[i]] = '\0';
+        m->patterns[i] = copy;
+        m->pattern_lens[i] = params->pattern_lens[i];
+    }
+    m->params.patterns = m->patterns;
+    m->params.pattern_lens = m->pattern_lens;
+    m->params.pattern = m->patterns[0];
+    m->params.pattern_len = m->pattern_lens[0];
+
+    if (m->params.num_patterns > 1 && !m->params.use_regex)
+    {
+        m->ac_trie = ac_trie_build(&m->params);
+        if (!m->ac_trie)
+        {
+            fprintf(stderr, "krep: Error building Aho-Corasick trie.\n");
+            goto fail;
         }
-        // Check single literal empty pattern
-        else if (current_params.num_patterns == 1 && current_params.pattern_lens[0] == 0)
+        m->params.ac_trie = m->ac_trie;
+    }
+
+    if (m->params.use_regex)
+    {
+        const char *regex_to_compile = build_regex_pattern(&m->params, &m->combined_regex_pattern);
+        if (!regex_to_compile)
+            goto fail_alloc;
+        int rflags = REG_EXTENDED | REG_NEWLINE | (m->params.case_sensitive ? 0 : REG_ICASE);
+        int ret = regcomp(&m->regex, regex_to_compile, rflags);
+        if (ret != 0)
+        {
+            char ebuf[256];
+            regerror(ret, &m->regex, ebuf, sizeof(ebuf));
+            fprintf(stderr, "krep: Regex compilation error: %s\n", ebuf);
+            goto fail;
+        }
+        m->regex_compiled = true;
+        m->params.compiled_regex = &m->regex;
+        m->params.regex_dfa = regex_dfa_compile(regex_to_compile, m->params.case_sensitive);
+    }
+    else if (m->params.num_patterns == 1 && m->params.pattern_len > 0)
+    {
+        prepare_bad_char_table((const unsigned char *)m->params.pattern, m->params.pattern_len,
+                               m->bad_char_table, m->params.case_sensitive);
+        m->params.bad_char_table = m->bad_char_table;
+
+        m->kmp_lps = malloc(m->params.pattern_len * sizeof(int));
+        if (!m->kmp_lps)
+            goto fail_alloc;
+        compute_lps_array((const unsigned char *)m->params.pattern, m->params.pattern_len, m->kmp_lps,
+                          m->params.case_sensitive);
+        m->params.kmp_lps = m->kmp_lps;
+    }
+
+    m->search_algo = select_search_algorithm(&m->params);
+    search_params_t positions = m->params;
+    positions.count_lines_mode = false;
+    positions.count_matches_mode = false;
+    positions.track_positions = true;
+    m->lines_algo = select_search_algorithm(&positions);
+    return m;
+
+fail_alloc:
+    fprintf(stderr, "krep: Cannot allocate memory for matcher.\n");
+fail:
+    krep_matcher_free(m);
+    return NULL;
+}
+
+uint64_t krep_match(const krep_matcher_t *matcher, const char *text, size_t text_len, match_result_t *result)
+{
+    if (!matcher || !text)
+        return 0;
+
+    // Without a result there is nothing to record positions into: count instead
+    const search_params_t *params = &matcher->params;
+    search_params_t counting;
+    if (params->track_positions && !result)
+    {
+        counting = *params;
+        counting.track_positions = false;
+        params = &counting;
+    }
+
+    uint64_t before = result ? result->count : 0;
+    uint64_t count = matcher->search_algo(params, text, text_len, params->track_positions ? result : NULL);
+
+    size_t max_count = params->max_count;
+    if (max_count != SIZE_MAX && count > max_count)
+        count = max_count;
+    if (result && params->track_positions && max_count != SIZE_MAX && result->count - before > max_count)
+        result->count = before + max_count;
+    return count;
+}
+
+const char *krep_matcher_algorithm(const krep_matcher_t *matcher)
+{
+    return matcher ? get_algorithm_name(matcher->search_algo) : "Unknown";
+}
+
+void krep_matcher_free(krep_matcher_t *matcher)
+{
+    if (!matcher)
+        return;
+    if (matcher->regex_compiled)
+    {
+        regfree(&matcher->regex);
+        regex_dfa_free(matcher->params.regex_dfa);
+    }
+    free(matcher->combined_regex_pattern);
+    if (matcher->ac_trie)
+        ac_trie_free(matcher->ac_trie);
+    free(matcher->kmp_lps);
+    if (matcher->patterns)
+    {
+        for (size_t i = 0; i < matcher->params.num_patterns; ++i)
+            free((char *)matcher->patterns[i]);
+    }
+    free(matcher->patterns);
+    free(matcher->pattern_lens);
+    free(matcher);
+}
+
+// --- Follow Mode (--follow) ---
+//
+// Like `tail -F | krep`: search the file, then keep waiting for appended data and
+// search only the new bytes. The file is re-opened when the path starts pointing at a
+// different inode (rotation) and rescanned from the start when it was truncated or
+// rewritten in place (copytruncate), even if it grew back past the read offset between
+// two checks: the last bytes read are kept and must still be there.
+
+#define FOLLOW_POLL_INTERVAL_MS 1000 // Upper bound on sleep between checks
+#define FOLLOW_TAIL_SIZE 64          // Bytes before the read offset checked for rewrites
+
+// The bytes right before the read offset, as last read
+typedef struct
+{
+    char bytes[FOLLOW_TAIL_SIZE];
+    size_t len;
+} follow_tail_t;
+
+// File change notification handle: inotify (Linux), kqueue (BSD/macOS) or plain polling
+typedef struct
+{
+    int fd;       // inotify or kqueue descriptor, -1 when polling
+    int watch_fd; // kqueue: descriptor of the watched file
+} follow_watch_t;
+
+static void follow_watch_open(follow_watch_t *w, const char *path, int file_fd)
+{
+    w->fd = -1;
+    w->watch_fd = -1;
+#if defined(__linux__)
+    (void)file_fd;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd == -1)
+        return;
+    // Watch the file itself and its directory, so a rotated-in replacement wakes us too
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (slash)
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path == 0 ? 1 : slash - path), path);
+    else
+        snprintf(dir, sizeof(dir), ".");
+    if (inotify_add_watch(w->fd, path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF) == -1 ||
+        inotify_add_watch(w->fd, dir, IN_CREATE | IN_MOVED_TO) == -1)
+    {
+        close(w->fd);
+        w->fd = -1;
+    }
+#elif defined(KREP_USE_KQUEUE)
+    (void)path;
+    w->fd = kqueue();
+    if (w->fd == -1)
+        return;
+    struct kevent ev;
+    EV_SET(&ev, file_fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME, 0, NULL);
+    if (kevent(w->fd, &ev, 1, NULL, 0, NULL) == -1)
+    {
+        close(w->fd);
+        w->fd = -1;
+        return;
+    }
+    w->watch_fd = file_fd;
+#else
+    (void)path;
+    (void)file_fd;
+#endif
+}
+
+static void follow_watch_close(follow_watch_t *w)
+{
+    if (w->fd != -1)
+        close(w->fd);
+    w->fd = -1;
+    w->watch_fd = -1;
+}
+
+// Block until the file (or its directory) changes, or the poll interval passes
+static void follow_watch_wait(follow_watch_t *w)
+{
+#if defined(__linux__)
+    if (w->fd != -1)
+    {
+        struct pollfd pfd = {.fd = w->fd, .events = POLLIN};
+        if (poll(&pfd, 1, FOLLOW_POLL_INTERVAL_MS) > 0)
+        {
+            char events[4096];
+            while (read(w->fd, events, sizeof(events)) > 0)
+                ; // Drain; the caller re-checks the file state itself
+        }
+        return;
+    }
+#elif defined(KREP_USE_KQUEUE)
+    if (w->fd != -1)
+    {
+        struct kevent ev;
+        struct timespec timeout = {FOLLOW_POLL_INTERVAL_MS / 1000, (FOLLOW_POLL_INTERVAL_MS % 1000) * 1000000L};
+        kevent(w->fd, NULL, 0, &ev, 1, &timeout);
+        return;
+    }
+#else
+    (void)w;
+#endif
+    struct timespec interval = {0, 250 * 1000000L};
+    nanosleep(&interval, NULL);
+}
+
+// Append the n bytes just read to the recorded tail, keeping its last FOLLOW_TAIL_SIZE
+static void follow_tail_append(follow_tail_t *tail, const char *data, size_t n)
+{
+    if (n >= FOLLOW_TAIL_SIZE)
+    {
+        memcpy(tail->bytes, data + n - FOLLOW_TAIL_SIZE, FOLLOW_TAIL_SIZE);
+        tail->len = FOLLOW_TAIL_SIZE;
+        return;
+    }
+    size_t keep = tail->len + n > FOLLOW_TAIL_SIZE ? FOLLOW_TAIL_SIZE - n : tail->len;
+    memmove(tail->bytes, tail->bytes + tail->len - keep, keep);
+    memcpy(tail->bytes + keep, data, n);
+    tail->len = keep + n;
+}
+
+// True when the bytes before offset are gone or differ from the recorded ones
+static bool follow_tail_changed(const follow_tail_t *tail, int fd, off_t offset)
+{
+    if (tail->len == 0)
+        return false;
+    char now[FOLLOW_TAIL_SIZE];
+    ssize_t n = pread(fd, now, tail->len, offset - (off_t)tail->len);
+    return n != (ssize_t)tail->len || memcmp(now, tail->bytes, tail->len) != 0;
+}
+
+// Read and search everything between *offset and the current end of fd
+static bool follow_read_appended(stream_search_t *ss, int fd, off_t *offset, char *buffer, follow_tail_t *tail)
+{
+    while (!ss->limit_reached)
+    {
+        ssize_t n = pread(fd, buffer, STREAM_BLOCK_SIZE, *offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "krep: %s: %s\n", ss->filename, strerror(errno));
+            return false;
+        }
+        if (n == 0)
+            return true;
+        *offset += n;
+        follow_tail_append(tail, buffer, (size_t)n);
+        if (!stream_search_feed(ss, buffer, (size_t)n, false))
+            return false;
+    }
+    return true;
+}
+
+int search_file_follow(const search_params_t *params, const char *filename)
+{
+    if (params->count_lines_mode || params->count_matches_mode)
+    {
+        fprintf(stderr, "krep: --follow cannot be combined with -c.\n");
+        return 2;
+    }
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "krep: %s: %s\n", filename, strerror(errno));
+        return 2;
+    }
+
+    stream_search_t ss;
+    char *buffer = malloc(STREAM_BLOCK_SIZE);
+    if (!buffer || !stream_search_begin(&ss, params, filename))
+    {
+        if (!buffer)
+            fprintf(stderr, "krep: Memory allocation failed for follow buffer\n");
+        else
+            stream_search_end(&ss);
+        free(buffer);
+        close(fd);
+        return 2;
+    }
+
+    follow_watch_t watch;
+    follow_watch_open(&watch, filename, fd);
+
+    int result_code = 1;
+    off_t offset = 0;
+    follow_tail_t tail = {.len = 0};
+    struct stat fd_stat;
+
+    while (!ss.limit_reached)
+    {
+        // Truncated or rewritten in place: start over from the beginning. Checked
+        // before reading, so regrown data past the old offset is not taken as appended.
+        if ((fstat(fd, &fd_stat) == 0 && fd_stat.st_size < offset) || follow_tail_changed(&tail, fd, offset))
+        {
+            stream_search_discard_carry(&ss);
+            offset = 0;
+            tail.len = 0;
+        }
+
+        if (!follow_read_appended(&ss, fd, &offset, buffer, &tail))
+        {
+            result_code = 2;
+            break;
+        }
+        if (ss.limit_reached)
+            break;
+
+        // Rotated: the path now names a different file. The old file has been read to
+        // its end above, so finish its last line and switch over.
+        struct stat path_stat;
+        if (fstat(fd, &fd_stat) == 0 && stat(filename, &path_stat) == 0 &&
+            (path_stat.st_ino != fd_stat.st_ino || path_stat.st_dev != fd_stat.st_dev))
+        {
+            int new_fd = open(filename, O_RDONLY | O_CLOEXEC);
+            if (new_fd != -1)
+            {
+                if (!stream_search_feed(&ss, NULL, 0, true))
+                {
+                    close(new_fd);
+                    result_code = 2;
+                    break;
+                }
+                close(fd);
+                fd = new_fd;
+                offset = 0;
+                tail.len = 0;
+                follow_watch_close(&watch);
+                follow_watch_open(&watch, filename, fd);
+                continue;
+            }
+        }
+
+        follow_watch_wait(&watch);
+    }
+
+    if (result_code != 2)
+        result_code = (ss.total > 0) ? 0 : 1;
+
+    follow_watch_close(&watch);
+    stream_search_end(&ss);
+    free(buffer);
+    close(fd);
+    return result_code;
+}
+
+// Global thread pool
+static thread_pool_t *global_thread_pool = NULL;
+static pthread_once_t global_thread_pool_once = PTHREAD_ONCE_INIT;
+static _Thread_local int global_thread_pool_request; // Thread count asked for by the first caller
+
+static void create_global_thread_pool(void)
+{
+    global_thread_pool = thread_pool_init(global_thread_pool_request);
+    if (!global_thread_pool)
+    {
+        fprintf(stderr, "Failed to initialize thread pool. Using single-threaded mode.\n");
+    }
+}
+
+// Initialize the global thread pool with auto-detected core count. Safe to call from
+// several threads (krep_match_spans() callers); the first call's count wins.
+static void init_global_thread_pool(int requested_thread_count)
+{
+    global_thread_pool_request = requested_thread_count;
+    pthread_once(&global_thread_pool_once, create_global_thread_pool);
+}
+
+// Clean up the global thread pool; it is not created again afterwards
+static void KREP_UNUSED cleanup_global_thread_pool()
+{
+    if (global_thread_pool)
+    {
+        thread_pool_destroy(global_thread_pool);
+        global_thread_pool = NULL;
+    }
+}
+
+// --- Batch Matching ---
+//
+// krep_match_spans() / krep_match_offsets() run a compiled matcher over many small
+// buffers in one call. The spans are split into groups of consecutive spans of about
+// equal size, one pool task per group; each group collects its positions in a local
+// result, and the groups are then appended to the caller's arena in span order.
+//
+// When the spans are consecutive lines of one buffer (krep_match_offsets() with every
+// span boundary just after a newline) and the matcher is a literal without newlines,
+// a group is searched with a single kernel call over all of its lines: no match can
+// cross a newline, so the positions are then only assigned to spans by offset.
+
+// Groups smaller than this are not worth a task of their own
+#define BATCH_MIN_GROUP_BYTES (64 * 1024)
+// Groups per pool thread, so uneven spans still balance
+#define BATCH_GROUPS_PER_THREAD 4
+
+// Completion of one call's pool tasks; other callers' tasks in the shared pool are not
+// waited for
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t done_cond;
+    size_t pending; // Submitted groups still running
+} batch_latch_t;
+
+typedef struct
+{
+    const krep_matcher_t *matcher;
+    const krep_span_t *spans; // Span array, or NULL for buf + offsets
+    const char *buf;
+    const size_t *offsets;
+    size_t first, last;    // Spans [first, last) of this group
+    uint64_t *counts;      // Per-span counts (shared, disjoint ranges)
+    size_t *span_hits;     // Per-span position counts (first_match + 1), or NULL without positions
+    match_result_t *local; // Positions of this group, span-relative, or NULL
+    bool whole_group;      // Search the group with one kernel call
+    bool error;
+    batch_latch_t *latch;  // Counted down when the group ran as a pool task
+} batch_group_t;
+
+static inline const char *batch_span(const batch_group_t *g, size_t i, size_t *len)
+{
+    if (g->spans)
+    {
+        *len = g->spans[i].len;
+        return g->spans[i].ptr;
+    }
+    *len = g->offsets[i + 1] - g->offsets[i];
+    return g->buf + g->offsets[i];
+}
+
+// One kernel call per span
+static void batch_group_each(batch_group_t *g)
+{
+    const search_params_t *params = &g->matcher->params;
+    search_params_t counting;
+    if (params->track_positions && !g->local)
+    {
+        counting = *params;
+        counting.track_positions = false;
+        params = &counting;
+    }
+    size_t max_count = params->max_count;
+
+    for (size_t i = g->first; i < g->last; i++)
+    {
+        size_t len;
+        const char *text = batch_span(g, i, &len);
+        uint64_t before = g->local ? g->local->count : 0;
+        uint64_t count = g->matcher->search_algo(params, text, len, params->track_positions ? g->local : NULL);
+        if (max_count != SIZE_MAX && count > max_count)
+            count = max_count;
+        g->counts[i] = count;
+        if (g->local)
+        {
+            if (max_count != SIZE_MAX && g->local->count - before > max_count)
+                g->local->count = before + max_count;
+            g->span_hits[i] = g->local->count - before;
+        }
+    }
+}
+
+// One kernel call over all lines of the group
+static void batch_group_whole(batch_group_t *g, match_result_t *hits)
+{
+    search_params_t params = g->matcher->params;
+    bool count_lines = params.count_lines_mode;
+    params.count_lines_mode = false;
+    params.count_matches_mode = false;
+    params.track_positions = true;
+
+    const char *base = g->buf + g->offsets[g->first];
+    g->matcher->lines_algo(&params, base, g->offsets[g->last] - g->offsets[g->first], hits);
+
+    size_t span = g->first;
+    size_t line_end = 0; // End of the last counted line (-c), relative to the span
+    bool counted_line = false;
+    memset(g->counts + g->first, 0, (g->last - g->first) * sizeof(*g->counts));
+    if (g->span_hits)
+        memset(g->span_hits + g->first, 0, (g->last - g->first) * sizeof(*g->span_hits));
+    for (uint64_t k = 0; k < hits->count; k++)
+    {
+        size_t start = hits->positions[k].start_offset + g->offsets[g->first];
+        while (start >= g->offsets[span + 1] && span + 1 < g->last)
+        {
+            span++;
+            counted_line = false;
+        }
+        size_t span_len;
+        const char *text = batch_span(g, span, &span_len);
+        size_t rel_start = start - g->offsets[span];
+        size_t rel_end = rel_start + (hits->positions[k].end_offset - hits->positions[k].start_offset);
+
+        if (count_lines)
+        {
+            // Spans may hold several lines; count each matching line once
+            if (!counted_line || rel_start >= line_end)
+            {
+                g->counts[span]++;
+                line_end = find_line_end(text, span_len, rel_start);
+                counted_line = true;
+            }
+        }
+        else
+        {
+            g->counts[span]++;
+        }
+
+        if (g->local)
+        {
+            if (!match_result_add(g->local, rel_start, rel_end))
+            {
+                g->error = true;
+                return;
+            }
+            g->span_hits[span]++;
+        }
+    }
+}
+
+static void *batch_group_run(void *arg)
+{
+    batch_group_t *g = arg;
+    if (g->whole_group)
+    {
+        match_result_t *hits = match_result_init(64);
+        if (!hits)
+        {
+            g->error = true;
+            return NULL;
+        }
+        batch_group_whole(g, hits);
+        match_result_free(hits);
+    }
+    else
+    {
+        batch_group_each(g);
+    }
+    return NULL;
+}
+
+static void *batch_group_task(void *arg)
+{
+    batch_group_t *g = arg;
+    batch_latch_t *latch = g->latch;
+    batch_group_run(g);
+
+    pthread_mutex_lock(&latch->mutex);
+    if (--latch->pending == 0)
+        pthread_cond_broadcast(&latch->done_cond);
+    pthread_mutex_unlock(&latch->mutex);
+    return NULL;
+}
+
+// True when the group's spans are whole lines that one kernel call can search together
+static bool batch_group_can_merge(const batch_group_t *g)
+{
+    const search_params_t *params = &g->matcher->params;
+    if (g->spans || params->use_regex || params->max_count != SIZE_MAX)
+        return false;
+    for (size_t i = 0; i < params->num_patterns; i++)
+        if (params->pattern_lens[i] == 0 || memchr(params->patterns[i], '\n', params->pattern_lens[i]))
+            return false;
+    for (size_t i = g->first + 1; i < g->last; i++)
+        if (g->offsets[i] > g->offsets[g->first] && g->buf[g->offsets[i] - 1] != '\n')
+            return false;
+    return true;
+}
+
+static bool krep_match_batch(const krep_matcher_t *matcher, const krep_span_t *spans, const char *buf,
+                             const size_t *offsets, size_t num_spans, uint64_t *counts, size_t *first_match,
+                             match_result_t *matches, int thread_count)
+{
+    if (!matcher || !counts || (matches && !first_match))
+        return false;
+    if (num_spans == 0)
+    {
+        if (first_match)
+            first_match[0] = matches ? matches->count : 0;
+        return true;
+    }
+
+    bool want_positions = matches && matcher->params.track_positions;
+    size_t total_bytes = 0;
+    if (spans)
+    {
+        for (size_t i = 0; i < num_spans; i++)
+            total_bytes += spans[i].len;
+    }
+    else
+    {
+        total_bytes = offsets[num_spans] - offsets[0];
+    }
+
+    int threads = thread_count > 0 ? thread_count : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+        threads = 1;
+    size_t num_groups = total_bytes / BATCH_MIN_GROUP_BYTES;
+    if (num_groups > (size_t)threads * BATCH_GROUPS_PER_THREAD)
+        num_groups = (size_t)threads * BATCH_GROUPS_PER_THREAD;
+    if (num_groups > num_spans)
+        num_groups = num_spans;
+    if (num_groups < 1 || threads == 1)
+        num_groups = 1;
+
+    batch_group_t *groups = calloc(num_groups, sizeof(*groups));
+    if (!groups)
+    {
+        fprintf(stderr, "krep: Cannot allocate memory for batch search.\n");
+        return false;
+    }
+    // Position counts are gathered in first_match[1..] and summed up afterwards
+    size_t *span_hits = want_positions ? first_match + 1 : NULL;
+
+    // Cut the spans into groups of about total_bytes / num_groups bytes
+    size_t group_target = total_bytes / num_groups + 1;
+    size_t span = 0;
+    for (size_t g = 0; g < num_groups; g++)
+    {
+        batch_group_t *group = &groups[g];
+        group->matcher = matcher;
+        group->spans = spans;
+        group->buf = buf;
+        group->offsets = offsets;
+        group->counts = counts;
+        group->span_hits = span_hits;
+        group->first = span;
+        if (g == num_groups - 1)
+        {
+            span = num_spans;
+        }
+        else if (spans)
+        {
+            size_t bytes = 0;
+            while (span < num_spans && bytes < group_target)
+                bytes += spans[span++].len;
+        }
+        else
+        {
+            // First span starting at or after the group's byte target
+            size_t target = offsets[0] + group_target * (g + 1);
+            size_t lo = span, hi = num_spans;
+            while (lo < hi)
+            {
+                size_t mid = lo + (hi - lo) / 2;
+                if (offsets[mid] < target)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            span = lo;
+        }
+        group->last = span;
+        group->whole_group = group->last > group->first + 1 && batch_group_can_merge(group);
+        group->local = want_positions ? match_result_init(64) : NULL;
+        group->error = want_positions && !group->local;
+    }
+
+    batch_latch_t latch = {.pending = 0};
+    bool pooled = false;
+    if (num_groups > 1)
+    {
+        init_global_thread_pool(threads);
+        pooled = global_thread_pool != NULL && pthread_mutex_init(&latch.mutex, NULL) == 0;
+        if (pooled && pthread_cond_init(&latch.done_cond, NULL) != 0)
+        {
+            pthread_mutex_destroy(&latch.mutex);
+            pooled = false;
+        }
+    }
+    for (size_t g = 0; g < num_groups; g++)
+    {
+        if (groups[g].error || groups[g].first == groups[g].last)
+            continue;
+        if (pooled)
+        {
+            // Counted before submitting: the task may finish before submit returns
+            groups[g].latch = &latch;
+            pthread_mutex_lock(&latch.mutex);
+            latch.pending++;
+            pthread_mutex_unlock(&latch.mutex);
+            if (thread_pool_submit(global_thread_pool, batch_group_task, &groups[g]))
+                continue;
+            pthread_mutex_lock(&latch.mutex);
+            latch.pending--;
+            pthread_mutex_unlock(&latch.mutex);
+        }
+        batch_group_run(&groups[g]);
+    }
+    if (pooled)
+    {
+        pthread_mutex_lock(&latch.mutex);
+        while (latch.pending > 0)
+            pthread_cond_wait(&latch.done_cond, &latch.mutex);
+        pthread_mutex_unlock(&latch.mutex);
+        pthread_cond_destroy(&latch.done_cond);
+        pthread_mutex_destroy(&latch.mutex);
+    }
+
+    // Append the groups' positions in span order and index them per span
+    bool ok = true;
+    for (size_t g = 0; g < num_groups; g++)
+        ok = ok && !groups[g].error;
+    if (ok && first_match)
+    {
+        first_match[0] = matches ? matches->count : 0;
+        for (size_t i = 0; i < num_spans; i++)
+            first_match[i + 1] = first_match[i] + (span_hits ? span_hits[i] : 0);
+    }
+    for (size_t g = 0; ok && want_positions && g < num_groups; g++)
+        ok = match_result_merge(matches, groups[g].local, 0);
+
+    for (size_t g = 0; g < num_groups; g++)
+        match_result_free(groups[g].local);
+    free(groups);
+    return ok;
+}
+
+bool krep_match_spans(const krep_matcher_t *matcher, const krep_span_t *spans, size_t num_spans, uint64_t *counts,
+                      size_t *first_match, match_result_t *matches, int thread_count)
+{
+    if (!spans && num_spans > 0)
+        return false;
+    return krep_match_batch(matcher, spans, NULL, NULL, num_spans, counts, first_match, matches, thread_count);
+}
+
+bool krep_match_offsets(const krep_matcher_t *matcher, const char *buf, const size_t *offsets, size_t num_spans,
+                        uint64_t *counts, size_t *first_match, match_result_t *matches, int thread_count)
+{
+    if (!buf || !offsets)
+        return false;
+    return krep_match_batch(matcher, NULL, buf, offsets, num_spans, counts, first_match, matches, thread_count);
+}
+
+// --- Indexed Search (--index) ---
+
+// Files whose candidate blocks exceed this share of the file are read sequentially
+#define INDEX_MAX_CANDIDATE_PERCENT 50
+
+typedef struct
+{
+    size_t start; // First byte of the region (a line start)
+    size_t end;   // One past its last byte (after a newline, or the end of the file)
+} index_region_t;
+
+// Search only the blocks of a file that the trigram index says can hold a match.
+// Every region is widened to whole lines, so matches and line counts inside it are
+// exactly those of a full search. Returns -1 when the index cannot help (the file is
+// not indexed or changed, no literal can be extracted, or too many blocks qualify);
+// search_file then falls back to its normal path.
+static int search_file_indexed(const search_params_t *params, const char *filename, int fd,
+                               const struct stat *file_stat)
+{
+    // Literals every match contains: the patterns themselves, or the one the DFA requires
+    const char *const *literals = params->patterns;
+    const size_t *literal_lens = params->pattern_lens;
+    size_t num_literals = params->num_patterns;
+    const char *regex_literal = NULL;
+    size_t regex_literal_len = 0;
+    if (params->use_regex)
+    {
+        regex_literal = params->regex_dfa ? regex_dfa_required_literal(params->regex_dfa, &regex_literal_len) : NULL;
+        if (!regex_literal)
+            return -1;
+        literals = &regex_literal;
+        literal_lens = &regex_literal_len;
+        num_literals = 1;
+    }
+
+    char resolved[PATH_MAX];
+    if (!realpath(filename, resolved))
+        return -1;
+    trigram_candidates_t cand;
+    if (!trigram_index_candidates(params->trigram_index, resolved, file_stat, literals, literal_lens,
+                                  num_literals, &cand))
+        return -1;
+    if ((uint64_t)cand.num_candidates * 100 > (uint64_t)cand.num_blocks * INDEX_MAX_CANDIDATE_PERCENT)
+    {
+        trigram_candidates_free(&cand);
+        return -1;
+    }
+
+    bool count_mode = params->count_lines_mode || params->count_matches_mode;
+    if (cand.num_candidates == 0)
+    {
+        trigram_candidates_free(&cand);
+        if (count_mode)
+            fprintf(current_output(), "%s:0\n", filename);
+        return 1;
+    }
+
+    // No MAP_POPULATE: only the candidate blocks are ever read
+    size_t file_size = (size_t)file_stat->st_size;
+    char *file_data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    index_region_t *regions = malloc(cand.num_candidates * sizeof(index_region_t));
+    if (file_data == MAP_FAILED || !regions)
+    {
+        if (file_data != MAP_FAILED)
+            munmap(file_data, file_size);
+        free(regions);
+        trigram_candidates_free(&cand);
+        return -1;
+    }
+    (void)madvise(file_data, file_size, MADV_RANDOM);
+    if (params->binary_files == BINARY_FILES_SKIP && data_looks_binary(file_data, file_size))
+    {
+        munmap(file_data, file_size);
+        free(regions);
+        trigram_candidates_free(&cand);
+        return 1; // Binary file skipped
+    }
+
+    // --- Turn runs of candidate blocks into line-aligned regions ---
+    size_t max_literal_len = 0;
+    for (size_t i = 0; i < num_literals; i++)
+        max_literal_len = literal_lens[i] > max_literal_len ? literal_lens[i] : max_literal_len;
+
+    size_t num_regions = 0;
+    const size_t block_size = cand.block_size;
+    for (uint32_t b = 0; b < cand.num_blocks; b++)
+    {
+        if (!((cand.candidates[b >> 6] >> (b & 63)) & 1))
+            continue;
+        uint32_t last = b;
+        while (last + 1 < cand.num_blocks && ((cand.candidates[(last + 1) >> 6] >> ((last + 1) & 63)) & 1))
+            last++;
+
+        // A match starting in the run ends at most max_literal_len - 1 bytes past it
+        size_t start = (size_t)b * block_size;
+        size_t end = ((size_t)last + 1) * block_size + max_literal_len - 1;
+        if (end > file_size)
+            end = file_size;
+        if (start > 0 && file_data[start - 1] != '\n')
+        {
+            const char *nl = memrchr(file_data, '\n', start);
+            start = nl ? (size_t)(nl - file_data) + 1 : 0;
+        }
+        if (end < file_size && file_data[end - 1] != '\n')
+        {
+            const char *nl = memchr(file_data + end, '\n', file_size - end);
+            end = nl ? (size_t)(nl - file_data) + 1 : file_size;
+        }
+
+        if (num_regions > 0 && start <= regions[num_regions - 1].end)
+        {
+            if (end > regions[num_regions - 1].end)
+                regions[num_regions - 1].end = end;
+        }
+        else
+        {
+            regions[num_regions].start = start;
+            regions[num_regions].end = end;
+            num_regions++;
+        }
+        b = last;
+    }
+
+    // --- Search each region in file order ---
+    search_params_t region_params = *params;
+    search_func_t search_algo = select_search_algorithm(&region_params);
+    const size_t max_count = params->max_count;
+    uint64_t total_count = 0;
+    int result_code = 1;
+    uint32_t lines_block = 0;   // Blocks whose newlines are summed in lines_before
+    uint64_t lines_before = 0;
+
+    // Context (-A/-B/-C) reaches across regions into the lines between them
+    print_context_t context = context_for_input(file_data, file_size);
+    bool with_context = context_lines_enabled(params);
+
+    for (size_t r = 0; r < num_regions && total_count < max_count; r++)
+    {
+        const char *region = file_data + regions[r].start;
+        size_t region_len = regions[r].end - regions[r].start;
+        region_params.max_count = (max_count == SIZE_MAX) ? SIZE_MAX : max_count - total_count;
+
+        match_result_t *result = NULL;
+        if (params->track_positions && (result = match_result_init(16)) == NULL)
+        {
+            fprintf(stderr, "krep: Error: Cannot allocate match results for %s.\n", filename);
+            result_code = 2;
+            break;
+        }
+        uint64_t count = search_algo(&region_params, region, region_len, result);
+        if (count > region_params.max_count)
+            count = region_params.max_count;
+        total_count += count;
+
+        if (result && result->count > 0)
+        {
+            // Line number of the region start from the stored per-block newline counts
+            uint32_t start_block = (uint32_t)(regions[r].start / block_size);
+            while (lines_block < start_block)
+                lines_before += cand.block_newlines[lines_block++];
+            size_t block_start = (size_t)start_block * block_size;
+            size_t first_line = 1 + lines_before + count_newlines(file_data + block_start, regions[r].start - block_start);
+
+            if (result->count > 1)
+                match_positions_sort(result);
+            context.limit = r + 1 < num_regions ? file_data + regions[r + 1].start : file_data + file_size;
+            print_matching_items_context(filename, region, region_len, result, &region_params, first_line, NULL,
+                                         &context);
+        }
+        else if (with_context && context.after_left > 0)
+        {
+            context.limit = r + 1 < num_regions ? file_data + regions[r + 1].start : file_data + file_size;
+            print_matching_items_context(filename, region, region_len, NULL, &region_params, 0, NULL, &context);
+        }
+        match_result_free(result);
+    }
+    if (with_context && context.after_left > 0 && result_code != 2)
+    {
+        // -m stopped the regions early; the last matching line still gets its after-context
+        context.limit = file_data + file_size;
+        print_matching_items_context(filename, file_data + file_size, 0, NULL, params, 0, NULL, &context);
+    }
+
+    if (result_code != 2)
+    {
+        result_code = total_count > 0 ? 0 : 1;
+        if (result_code == 0)
+            atomic_store(&global_match_found_flag, true); // Signal match found for -r
+        if (count_mode)
+            print_count_summary(params, filename, total_count);
+    }
+
+    free(regions);
+    munmap(file_data, file_size);
+    trigram_candidates_free(&cand);
+    return result_code;
+}
+
+// Map size bytes of fd read-only and page them in according to policy. With
+// use_hugepages the mapping is aligned to PREFETCH_HUGEPAGE_SIZE and marked
+// MADV_HUGEPAGE before any page is touched, so the kernel can back it with huge pages
+// where the filesystem supports large folios. Returns MAP_FAILED with errno set on error.
+static char *map_file_for_search(int fd, size_t size, prefetch_policy_t policy, bool use_hugepages,
+                                 const char *filename)
+{
+    char *data = MAP_FAILED;
+
+#ifdef MADV_HUGEPAGE
+    if (use_hugepages)
+    {
+        // Reserve an aligned range, map the file over it, and trim the slack
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t reserve_len = (size + PREFETCH_HUGEPAGE_SIZE + page - 1) & ~(page - 1);
+        char *reserve = mmap(NULL, reserve_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserve != MAP_FAILED)
+        {
+            char *aligned = (char *)(((uintptr_t)reserve + PREFETCH_HUGEPAGE_SIZE - 1) &
+                                     ~(uintptr_t)(PREFETCH_HUGEPAGE_SIZE - 1));
+            data = mmap(aligned, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+            if (data == MAP_FAILED)
+            {
+                munmap(reserve, reserve_len);
+            }
+            else
+            {
+                char *map_end = aligned + ((size + page - 1) & ~(page - 1));
+                if (aligned > reserve)
+                    munmap(reserve, (size_t)(aligned - reserve));
+                if (reserve + reserve_len > map_end)
+                    munmap(map_end, (size_t)(reserve + reserve_len - map_end));
+                (void)madvise(data, size, MADV_HUGEPAGE);
+            }
+        }
+    }
+#else
+    (void)use_hugepages;
+#endif
+
+    bool populated = false;
+    if (data == MAP_FAILED)
+    {
+#ifdef MAP_POPULATE
+        if (policy == PREFETCH_POPULATE)
+        {
+            data = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            if (data == MAP_FAILED && errno != ENOTSUP)
+                fprintf(stderr, "krep: %s: mmap with MAP_POPULATE failed (%s), retrying without...\n",
+                        filename, strerror(errno));
+            populated = (data != MAP_FAILED);
+        }
+#endif
+        if (data == MAP_FAILED)
+            data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+            return MAP_FAILED;
+    }
+
+    // MADV_SEQUENTIAL and MADV_WILLNEED are distinct advice values, not flags
+    int madvise_ret = madvise(data, size, MADV_SEQUENTIAL);
+    if (policy == PREFETCH_POPULATE && !populated && madvise_ret == 0)
+    {
+#ifdef MADV_POPULATE_READ
+        // Prefault honouring MADV_HUGEPAGE (Linux 5.14+); older kernels reject it
+        if (madvise(data, size, MADV_POPULATE_READ) != 0)
+#endif
+            madvise_ret = madvise(data, size, MADV_WILLNEED);
+    }
+    if (madvise_ret != 0)
+    {
+        int madvise_err = errno;
+        if (!atomic_exchange(&madvise_warning_emitted, true))
+        {
+            fprintf(stderr, "krep: %s: Warning: madvise failed: %s (future warnings suppressed)\n",
+                    filename, strerror(madvise_err));
+        }
+        // Continue execution since this is just an optimization
+    }
+    return data;
+}
+
+int search_file(const search_params_t *params, const char *filename, int requested_thread_count)
+{
+    search_params_t current_params = *params;
+    ac_trie_t *local_ac_trie = NULL; // Pointer for locally built trie
+
+    int result_code = 1;                         // Default: no match found
+    int fd = -1;                                 // File descriptor
+    struct stat file_stat;                       // File stats
+    size_t file_size = 0;                        // File size
+    char *file_data = MAP_FAILED;                // Mapped file data
+    match_result_t *global_matches = NULL;       // Global result collection
+    pthread_t *threads = NULL;                   // Thread handles
+    thread_data_t *thread_args = NULL;           // Thread arguments
+    int thread_args_count = 0;                   // Entries allocated in thread_args
+    arena_t *file_arena = NULL;                  // Holds global_matches when chunks are merged
+    regex_t compiled_regex_local;                // For local regex compilation
+    char *combined_regex_pattern = NULL;         // For combined regex patterns
+    int actual_thread_count = 0;                 // Number of threads to actually use
+    atomic_uint_fast64_t *budget_found = NULL;   // Per-chunk counts for early termination
+    uint64_t final_count = 0;                    // Total count of lines or matches
+    size_t max_count = current_params.max_count; // Get max_count
+
+    // Validate patterns for literal search (not for regex)
+    if (!current_params.use_regex)
+    {
+        for (size_t i = 0; i < current_params.num_patterns; ++i)
+        {
+            // Check for empty pattern - only allowed if there's a single pattern
+            if (current_params.pattern_lens[i] == 0)
+            {
+                if (current_params.num_patterns > 1)
+                {
+                    fprintf(stderr, "krep: %s: Error: Empty pattern provided for literal search with multiple patterns.\n", filename);
+                    return 2;
+                }
+                // Single empty pattern is allowed, continue to next pattern
+                continue;
+            }
+
+            // Check for pattern length limit
+            if (current_params.pattern_lens[i] > MAX_PATTERN_LENGTH)
+            {
+                fprintf(stderr, "krep: %s: Error: Pattern '%s' too long (max %d).\n",
+                        filename, current_params.patterns[i], MAX_PATTERN_LENGTH);
+                return 2;
+            }
+        }
+    }
+
+    // Input from stdin: search it as a stream of blocks instead of slurping it
+    if (strcmp(filename, "-") == 0)
+    {
+        return search_stream(&current_params, STDIN_FILENO, NULL);
+    }
+
+    // --- Regular File Handling ---
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "krep: %s: %s\n", filename, strerror(errno));
+        return 2;
+    }
+    if (fstat(fd, &file_stat) == -1)
+    {
+        fprintf(stderr, "krep: %s: %s\n", filename, strerror(errno));
+        close(fd);
+        return 2;
+    }
+    file_size = file_stat.st_size;
+
+    // --- Handle Empty File ---
+    if (file_size == 0)
+    {
+        close(fd);
+        bool empty_match = false;
+        bool needs_ac_trie_empty = (current_params.num_patterns > 1 && !current_params.use_regex);
+
+        // Temporarily build trie just to check root outputs for empty pattern
+        if (needs_ac_trie_empty)
+        {
+            ac_trie_t *temp_trie = ac_trie_build(&current_params);
+            if (ac_trie_root_has_outputs(temp_trie))
+            {
+                empty_match = true;
+            }
+            if (temp_trie)
+                ac_trie_free(temp_trie);
+        }
+        // Check regex empty match
+        else if (current_params.use_regex)
+        {
+            // Compile regex temporarily to check for empty match
+            regex_t temp_regex;
+            const char *regex_to_compile = NULL;
+            char *temp_combined_pattern = NULL;
+            if (current_params.num_patterns > 1)
+            {
+                size_t total_len = 0;
+                for (size_t i = 0; i < current_params.num_patterns; ++i)
+                    total_len += current_params.pattern_lens[i] + 3;
+                temp_combined_pattern = malloc(total_len + 1); // +1 for null
+                if (temp_combined_pattern)
+                {
+                    char *ptr = temp_combined_pattern;
+                    for (size_t i = 0; i < current_params.num_patterns; ++i)
+                    {
+                        ptr += sprintf(ptr, "(%s)", current_params.patterns[i]);
+                        if (i < current_params.num_patterns - 1)
+                            ptr += sprintf(ptr, "|");
+                    }
+                    *ptr = '\0'; // Null terminate
+                    regex_to_compile = temp_combined_pattern;
+                } // else: proceed with first pattern, might be inaccurate but avoids error
+            }
+            else if (current_params.num_patterns == 1)
+            {
+                regex_to_compile = current_params.patterns[0];
+            }
+            else
+            { // No patterns
+                free(temp_combined_pattern);
+                return 1;
+            }
+
+            int rflags = REG_EXTENDED | REG_NEWLINE | (current_params.case_sensitive ? 0 : REG_ICASE);
+            if (regcomp(&temp_regex, regex_to_compile, rflags) == 0)
+            {
+                regmatch_t m;
+                if (regexec(&temp_regex, "", 1, &m, 0) == 0 && m.rm_so == 0 && m.rm_eo == 0)
+                {
+                    empty_match = true;
+                }
+                regfree(&temp_regex);
+            }
+            free(temp_combined_pattern);
+        }
+        // Check single literal empty pattern
+        else if (current_params.num_patterns == 1 && current_params.pattern_lens[0] == 0)
+        {
+            empty_match = true;
+        }
+
+        if (empty_match)
+        {
+            if (current_params.count_lines_mode || current_params.count_matches_mode)
+            {
+                print_count_summary(&current_params, filename, 1);
+            }
+            else if (only_matching)
+            {                               // -o (global flag)
+                fprintf(current_output(), "%s::\n", filename); // Print filename:: for empty match
+            }
+            else
+            {                              // default
+                fprintf(current_output(), "%s:\n", filename); // Print filename: followed by empty line
+            }
+            atomic_store(&global_match_found_flag, true); // Signal match found for -r
+            return 0;                                     // Match found
+        }
+        else
+        {
+            if (current_params.count_lines_mode || current_params.count_matches_mode)
+                print_count_summary(&current_params, filename, 0);
+            return 1;                       // No match
+        }
+    }
+
+    // --- Compressed Files: decode into the streaming search ---
+    decompress_format_t compression = decompress_detect(fd, filename);
+    if (compression != DECOMPRESS_NONE && !decompress_supported(compression))
+    {
+        close(fd);
+        fprintf(stderr, "krep: %s: unsupported compression (built without %s support)\n", filename,
+                decompress_format_name(compression));
+        return 2;
+    }
+    if (compression != DECOMPRESS_NONE)
+    {
+        decompress_t *decoder = decompress_open(fd, compression, requested_thread_count);
+        close(fd);
+        if (!decoder)
+        {
+            fprintf(stderr, "krep: %s: Cannot open %s stream\n", filename, decompress_format_name(compression));
+            return 2;
+        }
+        int stream_code = search_stream_from(&current_params, -1, decoder, NULL, filename);
+        if (stream_code == 0)
+            atomic_store(&global_match_found_flag, true); // Signal match found for -r
+        return stream_code;
+    }
+
+    // Check if pattern is longer than file (only for single literal search)
+    if (!current_params.use_regex && current_params.num_patterns == 1 && current_params.pattern_lens[0] > file_size)
+    {
+        close(fd);
+        if (current_params.count_lines_mode || current_params.count_matches_mode)
+            print_count_summary(&current_params, filename, 0);
+        return 1; // No match possible
+    }
+
+    // --- Build Aho-Corasick Trie (if needed, once for the file) ---
+    STATS_TIMER(compile_start);
+    bool needs_ac_trie_file = (current_params.num_patterns > 1 && !current_params.use_regex);
+    if (needs_ac_trie_file)
+    {
+        local_ac_trie = ac_trie_build(&current_params);
+        if (!local_ac_trie)
+        {
+            fprintf(stderr, "krep: Error building Aho-Corasick trie for %s.\n", filename);
+            result_code = 2;
+            goto cleanup_file;
+        }
+        current_params.ac_trie = local_ac_trie; // Assign to the mutable params copy
+    }
+
+    // --- Compile Regex (if needed, once for the file) ---
+    if (current_params.use_regex)
+    {
+        const char *regex_to_compile = NULL;
+        if (current_params.num_patterns > 1)
+        {
+            // Combine multiple regex patterns with '|'
+            size_t total_len = 0;
+            for (size_t i = 0; i < current_params.num_patterns; ++i)
+            {
+                // Add 6 for wrapping with (\b...\b)
+                total_len += current_params.pattern_lens[i] + (current_params.whole_word ? 6 : 2) + 1; // () or (\b...\b) + |
+            }
+            combined_regex_pattern = malloc(total_len + 1); // +1 for null terminator
+            if (!combined_regex_pattern)
+            {
+                fprintf(stderr, "krep: %s: Failed to allocate memory for combined regex.\n", filename);
+                close(fd);
+                return 2;
+            }
+            char *ptr = combined_regex_pattern;
+            for (size_t i = 0; i < current_params.num_patterns; ++i)
+            {
+                if (current_params.whole_word)
+                    ptr += sprintf(ptr, "(\\b%s\\b)", current_params.patterns[i]);
+                else
+                    ptr += sprintf(ptr, "(%s)", current_params.patterns[i]);
+                if (i < current_params.num_patterns - 1)
+                {
+                    ptr += sprintf(ptr, "|");
+                }
+            }
+            *ptr = '\0'; // Null terminate
+            regex_to_compile = combined_regex_pattern;
+        }
+        else if (current_params.num_patterns == 1)
+        {
+            if (current_params.whole_word)
+            {
+                size_t len = strlen(current_params.patterns[0]);
+                char *tmp = malloc(len + 7); // (\b) + pattern + (\b) + null
+                if (!tmp)
+                {
+                    fprintf(stderr, "krep: Failed to allocate memory for regex pattern.\n");
+                    close(fd);
+                    return 2;
+                }
+                sprintf(tmp, "\\b%s\\b", current_params.patterns[0]);
+                regex_to_compile = tmp;
+                free(combined_regex_pattern); // In case it was set
+                combined_regex_pattern = tmp; // So it gets freed later
+            }
+            else
+            {
+                regex_to_compile = current_params.patterns[0]; // Ensure correct pattern is used
+            }
+        }
+        else
+        { // Should not happen due to earlier check
+            close(fd);
+            return 1;
+        }
+
+        int rflags = REG_EXTENDED | REG_NEWLINE | (current_params.case_sensitive ? 0 : REG_ICASE);
+        int ret = regcomp(&compiled_regex_local, regex_to_compile, rflags);
+        if (ret != 0)
+        {
+            char ebuf[256];
+            regerror(ret, &compiled_regex_local, ebuf, sizeof(ebuf));
+            fprintf(stderr, "krep: Regex compilation error for %s: %s\n", filename, ebuf);
+            close(fd);
+            free(combined_regex_pattern);
+            return 2;
+        }
+        // Modify the mutable copy of params
+        search_params_t mutable_params = current_params;
+        mutable_params.compiled_regex = &compiled_regex_local;
+        mutable_params.regex_dfa = regex_dfa_compile(regex_to_compile, mutable_params.case_sensitive);
+        current_params = mutable_params; // Update current_params to use for threads
+        // Ensure local_ac_trie is NULL if regex is used
+        if (local_ac_trie)
+        {
+            ac_trie_free(local_ac_trie);
+            local_ac_trie = NULL;
+            current_params.ac_trie = NULL;
+        }
+    }
+    STATS_PHASE_END(STATS_PHASE_COMPILE, compile_start);
+
+    // --- Indexed Search: read only the blocks the trigram index points at ---
+    if (current_params.trigram_index)
+    {
+        int indexed_code = search_file_indexed(&current_params, filename, fd, &file_stat);
+        if (indexed_code >= 0)
+        {
+            result_code = indexed_code;
+            goto cleanup_file; // fd is closed there
+        }
+    }
+
+    // --- Read Path: large files on network mounts (or bigger than RAM) skip mmap ---
+    io_backend_t io_backend = io_backend_select(fd, &file_stat, current_params.io_backend);
+    if (io_backend != IO_BACKEND_MMAP)
+    {
+        io_reader_t *reader = io_reader_open(fd, io_backend, STREAM_BLOCK_SIZE);
+        if (!reader)
+        {
+            fprintf(stderr, "krep: %s: Cannot start %s reads: %s\n", filename, io_backend_name(io_backend), strerror(errno));
+            result_code = 2;
+            goto cleanup_file;
+        }
+        // The stream search prepares its own trie and regex from the caller's params
+        result_code = search_stream_from(params, -1, NULL, reader, filename);
+        if (result_code == 0)
+            atomic_store(&global_match_found_flag, true); // Signal match found for -r
+        goto cleanup_file; // fd is closed there
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(__APPLE__)
+    // Hint the kernel about sequential access to encourage readahead
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // --- Memory Map File ---
+    prefetch_policy_t prefetch = current_params.prefetch;
+    if (prefetch == PREFETCH_AUTO)
+    {
+        // A search that can stop early does not fault in pages it may never read
+        if (file_size >= PREFETCH_WINDOW_MIN_FILE_SIZE)
+            prefetch = PREFETCH_WINDOW;
+        else
+            prefetch = (max_count != SIZE_MAX) ? PREFETCH_NONE : PREFETCH_POPULATE;
+    }
+    bool use_hugepages = file_size >= PREFETCH_HUGEPAGE_MIN_FILE_SIZE;
+
+    STATS_TIMER(map_start);
+    file_data = map_file_for_search(fd, file_size, prefetch, use_hugepages, filename);
+    STATS_PHASE_END(STATS_PHASE_MAP, map_start);
+    if (file_data == MAP_FAILED)
+    {
+        fprintf(stderr, "krep: %s: mmap: %s\n", filename, strerror(errno));
+        close(fd);
+        fd = -1;
+        // The regex, its DFA and the pattern buffer are released at cleanup_file
+        result_code = 2;
+        goto cleanup_file; // Use goto to ensure proper cleanup
+    }
+
+    // The window policy evicts searched pages through the descriptor; close it otherwise
+    if (prefetch != PREFETCH_WINDOW)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    // Binary files end here, before any chunk is searched (-I, -r)
+    if (current_params.binary_files == BINARY_FILES_SKIP && data_looks_binary(file_data, file_size))
+    {
+        result_code = 1;
+        goto cleanup_file;
+    }
+
+    // --- Determine Thread Count and Chunking ---
+    if (requested_thread_count == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        actual_thread_count = (cores > 0) ? (int)cores : 1;
+    }
+    else
+    {
+        actual_thread_count = requested_thread_count;
+    }
+    int max_threads_by_size = (file_size > 0) ? (int)((file_size + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE) : 1;
+    if (actual_thread_count > max_threads_by_size && max_threads_by_size > 0)
+    {
+        actual_thread_count = max_threads_by_size;
+    }
+    if (actual_thread_count <= 0)
+        actual_thread_count = 1;
+
+    // --- Initialize Threading Resources ---
+    threads = malloc(actual_thread_count * sizeof(pthread_t));
+    thread_args = calloc(actual_thread_count, sizeof(thread_data_t));
+    thread_args_count = thread_args ? actual_thread_count : 0;
+    if (threads)
+        memset(threads, 0, actual_thread_count * sizeof(pthread_t));
+
+    if (!threads || !thread_args)
+    {
+        perror("krep: Cannot allocate thread resources");
+        result_code = 2;
+        goto cleanup_file;
+    }
+
+    // With several chunks and no -m limit, every chunk formats its own output and the
+    // chunks are written in order; the file-wide position array is never built.
+    // (-m needs the global match order, so it keeps merging positions.)
+    bool per_chunk_output = current_params.track_positions && actual_thread_count > 1 &&
+                            !current_params.count_lines_mode && !current_params.count_matches_mode &&
+                            max_count == SIZE_MAX;
+
+    // --- Launch Threads ---
+    size_t chunk_size_calc = (file_size + actual_thread_count - 1) / actual_thread_count;
+    if (chunk_size_calc == 0 && file_size > 0)
+        chunk_size_calc = file_size;
+    // Ensure minimum chunk size
+    if (chunk_size_calc < MIN_CHUNK_SIZE && file_size > MIN_CHUNK_SIZE)
+    {
+        chunk_size_calc = MIN_CHUNK_SIZE;
+        // Recalculate thread count based on adjusted chunk size
+        actual_thread_count = (file_size + chunk_size_calc - 1) / chunk_size_calc;
+        if (actual_thread_count <= 0)
+            actual_thread_count = 1;
+        // Reallocate thread resources if count changed significantly (optional, could just use max)
+        // For simplicity, we assume initial allocation was sufficient or handle errors later.
+    }
+
+    size_t current_pos = 0;
+    int threads_launched = 0;
+
+    // Determine how many threads to use based on file size and available cores
+    int available_cores = requested_thread_count > 0 ? requested_thread_count : sysconf(_SC_NPROCESSORS_ONLN);
+    if (available_cores <= 0)
+        available_cores = 1;
+
+    // Calculate optimal number of threads: min(cores, max(1, file_size/(4MB)))
+    // This scales threads with file size, but caps at CPU core count
+    int optimal_threads = 1;
+    if (file_size > 0)
+    {
+        size_t chunk_threshold = 4 * 1024 * 1024; // 4MB per thread minimum
+        optimal_threads = file_size / chunk_threshold;
+        if (optimal_threads > available_cores)
+            optimal_threads = available_cores;
+        if (optimal_threads < 1)
+            optimal_threads = 1;
+    }
+
+    // Initialize the global thread pool if needed
+    init_global_thread_pool(optimal_threads);
+
+    // Preselect search algorithm once to avoid redundant decisions inside each worker
+    search_func_t preselected_algo = select_search_algorithm(&current_params);
+
+    // A single chunk runs on the calling thread. This avoids a pool round-trip for
+    // small files and lets file-level workers (recursive mode) call search_file
+    // without re-entering the shared thread pool.
+    bool run_inline = (actual_thread_count == 1);
+
+    // With -m (and -c, -q, -l) chunks stop once the others have decided the result
+    search_budget_t budget;
+    if (actual_thread_count > 1 && max_count != SIZE_MAX)
+    {
+        budget_found = malloc(actual_thread_count * sizeof(*budget_found));
+        if (budget_found)
+        {
+            for (int i = 0; i < actual_thread_count; i++)
+                atomic_init(&budget_found[i], 0);
+            atomic_init(&budget.done, false);
+            budget.counts_only = current_params.count_lines_mode || current_params.count_matches_mode;
+            budget.max_count = max_count;
+            budget.num_chunks = actual_thread_count;
+            budget.found = budget_found;
+        }
+    }
+
+    for (int i = 0; i < actual_thread_count; ++i)
+    {
+        if (current_pos >= file_size)
+        {
+            actual_thread_count = i; // Update actual count
+            break;
+        }
+
+        thread_args[i].thread_id = i;
+        thread_args[i].params = &current_params; // Pass params containing the pre-built trie
+        thread_args[i].chunk_start = file_data + current_pos;
+        thread_args[i].search_algo = preselected_algo;
+
+        // Chunks end just after a newline, so every line lies in exactly one chunk. No
+        // match (literal or regex) can cross a boundary and chunks need no overlap. Only
+        // the empty match right after a chunk's last newline needs care: it belongs to
+        // the next chunk (text_continues), or to the last chunk when at the file's end.
+        size_t effective_chunk_len = file_size - current_pos;
+        if (i < actual_thread_count - 1 && chunk_size_calc < effective_chunk_len)
         {
-            empty_match = true;
+            size_t split = current_pos + chunk_size_calc;
+            const char *nl = memchr(file_data + split - 1, '\n', file_size - split + 1);
+            if (nl)
+                effective_chunk_len = (size_t)(nl - file_data) + 1 - current_pos;
         }
 
-        if (empty_match)
+        thread_args[i].chunk_len = effective_chunk_len;
+        thread_args[i].text_continues = current_pos + effective_chunk_len < file_size;
+        thread_args[i].local_result = NULL;
+        thread_args[i].count_result = 0;
+        thread_args[i].error_flag = false;
+        // Positions and formatted output come from an arena reused across files
+        thread_args[i].arena = current_params.track_positions ? arena_acquire() : NULL;
+        thread_args[i].index_newlines = per_chunk_output && only_matching;
+        thread_args[i].newline_count = 0;
+        thread_args[i].filename = filename;
+        thread_args[i].first_line_number = 1;
+        thread_args[i].output = NULL;
+        thread_args[i].output_len = 0;
+        thread_args[i].output_capacity = 0;
+        thread_args[i].prefetch_window = 0;
+        thread_args[i].drop_behind = false;
+        thread_args[i].file_base = file_data;
+        thread_args[i].file_fd = fd;
+        thread_args[i].budget = budget_found ? &budget : NULL;
+        if (prefetch == PREFETCH_WINDOW)
+        {
+            thread_args[i].prefetch_window = current_params.prefetch_window ? current_params.prefetch_window
+                                                                            : PREFETCH_WINDOW_SIZE;
+            // -o line numbers re-read the whole chunk after the search; keep its pages
+            thread_args[i].drop_behind = !thread_args[i].index_newlines;
+        }
+
+        if (effective_chunk_len > 0)
         {
-            if (current_params.count_lines_mode || current_params.count_matches_mode)
+            // Use search_chunk_thread which handles multiple patterns via Aho-Corasick or Regex
+            if (run_inline)
             {
-                printf("%s:1\n", filename); // Print count 1
+                search_chunk_thread(&thread_args[i]);
             }
-            else if (only_matching)
-            {                               // -o (global flag)
-                printf("%s::\n", filename); // Print filename:: for empty match
+            else if (global_thread_pool)
+            {
+                if (!thread_pool_submit(global_thread_pool, search_chunk_thread, &thread_args[i]))
+                {
+                    fprintf(stderr, "krep: Failed to submit task for thread %d\n", i);
+                    // Handle error: maybe reduce thread count or abort
+                    thread_args[i].error_flag = true; // Mark thread data as errored
+                }
             }
             else
-            {                              // default
-                printf("%s:\n", filename); // Print filename: followed by empty line
+            {
+                int rc = pthread_create(&threads[i], NULL, search_chunk_thread, &thread_args[i]);
+                if (rc)
+                {
+                    fprintf(stderr, "krep: Error creating thread %d: %s\n", i, strerror(rc));
+                    // Handle error: maybe reduce thread count or abort
+                    threads[i] = 0;                   // Mark as not created
+                    thread_args[i].error_flag = true; // Mark thread data as errored
+                    continue;                         // Try launching fewer threads
+                }
             }
-            atomic_store(&global_match_found_flag, true); // Signal match found for -r
-            return 0;                                     // Match found
+            threads_launched++;
         }
         else
         {
-            if (current_params.count_lines_mode || current_params.count_matches_mode)
-                printf("%s:0\n", filename); // Print count 0
-            return 1;                       // No match
+            threads[i] = 0; // Mark as not launched
         }
+        current_pos += effective_chunk_len;
     }
+    actual_thread_count = threads_launched;
 
-    // Check if pattern is longer than file (only for single literal search)
-    if (!current_params.use_regex && current_params.num_patterns == 1 && current_params.pattern_lens[0] > file_size)
+    // Wait for all tasks to complete
+    if (global_thread_pool && !run_inline)
     {
-        close(fd);
-        if (current_params.count_lines_mode || current_params.count_matches_mode)
-            printf("%s:0\n", filename);
-        return 1; // No match possible
+        thread_pool_wait_all(global_thread_pool);
     }
 
-    // --- Build Aho-Corasick Trie (if needed, once for the file) ---
-    bool needs_ac_trie_file = (current_params.num_patterns > 1 && !current_params.use_regex);
-    if (needs_ac_trie_file)
+    // --- Wait for Threads and Aggregate Results ---
+    STATS_ADD(STATS_FILES, 1);
+    STATS_TIMER(merge_start);
+    bool merge_error = false;
+
+    // A single chunk's positions go to the printer as they are; several chunks are
+    // merged into one array sized for all of them
+    if (current_params.track_positions && !per_chunk_output)
     {
-        local_ac_trie = ac_trie_build(&current_params);
-        if (!local_ac_trie)
+        if (actual_thread_count == 1 && thread_args[0].local_result)
         {
-            fprintf(stderr, "krep: Error building Aho-Corasick trie for %s.\n", filename);
-            result_code = 2;
-            goto cleanup_file;
+            global_matches = thread_args[0].local_result; // The chunk starts at offset 0
+            thread_args[0].local_result = NULL;
+        }
+        else
+        {
+            file_arena = arena_acquire();
+            uint64_t total = chunk_positions_total(thread_args, actual_thread_count);
+            global_matches = search_result_init(file_arena, total < max_count ? total : max_count, &current_params);
+            if (!global_matches)
+            {
+                fprintf(stderr, "krep: Error: Cannot allocate global match results for %s.\n", filename);
+                result_code = 2;
+            }
         }
-        current_params.ac_trie = local_ac_trie; // Assign to the mutable params copy
     }
-
-    // --- Compile Regex (if needed, once for the file) ---
-    if (current_params.use_regex)
+    for (int i = 0; i < actual_thread_count; ++i)
     {
-        const char *regex_to_compile = NULL;
-        if (current_params.num_patterns > 1)
+        // Skip the pthread_join logic if using thread pool (tasks are already complete)
+        // Only try to join if not using thread pool and thread was actually created
+        if (!global_thread_pool && threads[i] != 0)
         {
-            // Combine multiple regex patterns with '|'
-            size_t total_len = 0;
-            for (size_t i = 0; i < current_params.num_patterns; ++i)
+            int rc = pthread_join(threads[i], NULL);
+            if (rc)
             {
-                // Add 6 for wrapping with (\b...\b)
-                total_len += current_params.pattern_lens[i] + (current_params.whole_word ? 6 : 2) + 1; // () or (\b...\b) + |
+                fprintf(stderr, "krep: Error joining thread %d: %s\n", i, strerror(rc));
+                result_code = 2;
             }
-            combined_regex_pattern = malloc(total_len + 1); // +1 for null terminator
-            if (!combined_regex_pattern)
+        }
+
+        if (thread_args[i].error_flag)
+        {
+            result_code = 2;
+        }
+
+        // Always process results from thread_args, regardless of how the thread was executed
+        if (result_code != 2 && !merge_error)
+        {
+            // Sum counts (lines or matches). Chunks hold whole lines, so no line is counted twice.
+            uint64_t thread_count = thread_args[i].count_result;
+            if (max_count != SIZE_MAX)
             {
-                fprintf(stderr, "krep: %s: Failed to allocate memory for combined regex.\n", filename);
-                close(fd);
-                return 2;
+                uint64_t remaining_limit = (final_count >= max_count) ? 0 : max_count - final_count;
+                if (thread_count > remaining_limit)
+                {
+                    thread_count = remaining_limit; // Cap thread count contribution
+                }
             }
-            char *ptr = combined_regex_pattern;
-            for (size_t i = 0; i < current_params.num_patterns; ++i)
+            final_count += thread_count;
+
+            // Merge position results if tracking, respecting max_count
+            if (current_params.track_positions && global_matches && thread_args[i].local_result)
             {
-                if (current_params.whole_word)
-                    ptr += sprintf(ptr, "(\\b%s\\b)", current_params.patterns[i]);
-                else
-                    ptr += sprintf(ptr, "(%s)", current_params.patterns[i]);
-                if (i < current_params.num_patterns - 1)
+                bool merge_ok = true;
+                if (max_count == SIZE_MAX)
                 {
-                    ptr += sprintf(ptr, "|");
+                    size_t chunk_offset = (size_t)(thread_args[i].chunk_start - file_data);
+                    merge_ok = match_result_merge(global_matches, thread_args[i].local_result, chunk_offset);
+                }
+                else if (global_matches->count < max_count)
+                {
+                    size_t chunk_offset = (size_t)(thread_args[i].chunk_start - file_data);
+                    uint64_t remaining_limit = max_count - global_matches->count;
+                    merge_ok = match_result_merge_limited(global_matches,
+                                                          thread_args[i].local_result,
+                                                          chunk_offset,
+                                                          remaining_limit);
+                }
+
+                if (!merge_ok)
+                {
+                    fprintf(stderr, "krep: %s: Failed to merge match result from thread %d.\n", filename, i);
+                    merge_error = true;
                 }
+
+                match_result_free(thread_args[i].local_result); // Free local result after merging/skip
+                thread_args[i].local_result = NULL;
+            }
+            else if (thread_args[i].local_result && !per_chunk_output)
+            {
+                match_result_free(thread_args[i].local_result);
+                thread_args[i].local_result = NULL;
+            }
+
+            if (merge_error)
+            {
+                result_code = 2;
+                // Continue cleanup but don't process further results
             }
-            *ptr = '\0'; // Null terminate
-            regex_to_compile = combined_regex_pattern;
         }
-        else if (current_params.num_patterns == 1)
+    }
+    // Positions used in place are capped here instead of by match_result_merge_limited
+    if (global_matches && max_count != SIZE_MAX && global_matches->count > max_count)
+        global_matches->count = max_count;
+    STATS_PHASE_END(STATS_PHASE_MERGE, merge_start);
+
+    // --- Final Processing and Output ---
+    if (result_code != 2)
+    {
+        // Determine final result code based on aggregated count/matches
+        result_code = (final_count > 0) ? 0 : 1;
+        if (result_code == 0)
+            atomic_store(&global_match_found_flag, true); // Signal match found for -r
+
+        if (current_params.count_lines_mode || current_params.count_matches_mode)
         {
-            if (current_params.whole_word)
+            print_count_summary(&current_params, filename, final_count);
+        }
+        else if (result_code == 0 && global_matches)
+        {
+            // Chunks are merged in file order, so this only sorts out-of-order kernel output
+            if (global_matches->count > 1 && !match_positions_sorted(global_matches))
             {
-                size_t len = strlen(current_params.patterns[0]);
-                char *tmp = malloc(len + 7); // (\b) + pattern + (\b) + null
-                if (!tmp)
-                {
-                    fprintf(stderr, "krep: Failed to allocate memory for regex pattern.\n");
-                    close(fd);
-                    return 2;
-                }
-                sprintf(tmp, "\\b%s\\b", current_params.patterns[0]);
-                regex_to_compile = tmp;
-                free(combined_regex_pattern); // In case it was set
-                combined_regex_pattern = tmp; // So it gets freed later
+                STATS_TIMER(sort_start);
+                match_positions_sort(global_matches);
+                STATS_PHASE_END(STATS_PHASE_SORT, sort_start);
             }
-            else
+
+            // Print matching lines/parts, respecting max_count via print_matching_items
+            STATS_TIMER(print_start);
+            print_context_t context = context_for_input(file_data, file_size);
+            size_t printed = print_matching_items_context(filename, file_data, file_size, global_matches, &current_params,
+                                                          1, NULL, &context);
+            STATS_PHASE_END(STATS_PHASE_PRINT, print_start);
+            STATS_ADD(STATS_ITEMS_PRINTED, printed);
+        }
+        else if (result_code == 0 && per_chunk_output && chunk_positions_total(thread_args, actual_thread_count) > 0)
+        {
+            // Number each chunk's lines from the newlines of the chunks before it
+            size_t line_number = 1;
+            for (int i = 0; i < actual_thread_count; i++)
             {
-                regex_to_compile = current_params.patterns[0]; // Ensure correct pattern is used
+                thread_args[i].first_line_number = line_number;
+                line_number += thread_args[i].newline_count;
+            }
+
+            if (context_lines_enabled(&current_params))
+                plan_chunk_context(thread_args, actual_thread_count, file_data, file_size, &current_params);
+
+            for (int i = 0; i < actual_thread_count; i++)
+            {
+                if (!thread_args[i].local_result || thread_args[i].local_result->count == 0)
+                    continue;
+                if (!global_thread_pool || !thread_pool_submit(global_thread_pool, format_chunk_thread, &thread_args[i]))
+                    format_chunk_thread(&thread_args[i]);
+            }
+            if (global_thread_pool)
+                thread_pool_wait_all(global_thread_pool);
+
+            bool format_ok = true;
+            for (int i = 0; i < actual_thread_count; i++)
+                format_ok &= !thread_args[i].error_flag;
+            STATS_TIMER(write_start);
+            if (!format_ok || !write_chunk_outputs(current_output(), thread_args, actual_thread_count))
+            {
+                perror("krep: Error writing formatted output");
+                result_code = 2;
             }
+            STATS_PHASE_END(STATS_PHASE_PRINT, write_start);
         }
-        else
-        { // Should not happen due to earlier check
-            close(fd);
-            return 1;
+        // Handle case where match was found but no positions recorded (e.g., empty regex match)
+        else if (result_code == 0 && (!global_matches || global_matches->count == 0))
+        {
+            if (only_matching)
+            {
+                fprintf(current_output(), "%s:1:\n", filename); // Line number 1, empty match
+            }
+            else
+            {
+                fprintf(current_output(), "%s:\n", filename); // Empty line
+            }
         }
+    }
 
-        int rflags = REG_EXTENDED | REG_NEWLINE | (current_params.case_sensitive ? 0 : REG_ICASE);
-        int ret = regcomp(&compiled_regex_local, regex_to_compile, rflags);
-        if (ret != 0)
+cleanup_file:
+    // --- Cleanup Resources ---
+    if (file_data != MAP_FAILED)
+        munmap(file_data, file_size);
+    if (current_params.use_regex && current_params.compiled_regex == &compiled_regex_local)
+    {
+        regfree(&compiled_regex_local);
+        regex_dfa_free(current_params.regex_dfa);
+    }
+    free(combined_regex_pattern);
+    match_result_free(global_matches);
+    if (thread_args)
+    {
+        for (int i = 0; i < actual_thread_count; i++)
         {
-            char ebuf[256];
-            regerror(ret, &compiled_regex_local, ebuf, sizeof(ebuf));
-            fprintf(stderr, "krep: Regex compilation error for %s: %s\n", filename, ebuf);
-            close(fd);
-            free(combined_regex_pattern);
-            return 2;
+            match_result_free(thread_args[i].local_result);
+            if (!thread_args[i].arena)
+                free(thread_args[i].output);
+            newline_index_free(&thread_args[i].line_index);
         }
-        // Modify the mutable copy of params
-        search_params_t mutable_params = current_params;
-        mutable_params.compiled_regex = &compiled_regex_local;
-        current_params = mutable_params; // Update current_params to use for threads
-        // Ensure local_ac_trie is NULL if regex is used
-        if (local_ac_trie)
+        for (int i = 0; i < thread_args_count; i++)
+            arena_release(thread_args[i].arena);
+    }
+    arena_release(file_arena);
+    free(budget_found);
+    free(threads);
+    free(thread_args);
+    if (fd != -1)
+        close(fd);
+    // Free the Aho-Corasick trie if it was built for this file
+    if (local_ac_trie)
+    {
+        ac_trie_free(local_ac_trie);
+    }
+
+    return result_code;
+}
+
+// --- Recursive Directory Search ---
+
+// Check if a directory name should be skipped
+static bool should_skip_directory(const char *dirname)
+{
+    // Skip hidden directories starting with '.' (in addition to "." and "..")
+    if (dirname[0] == '.' && strcmp(dirname, ".") != 0 && strcmp(dirname, "..") != 0)
+    {
+        return true;
+    }
+    // Check against the predefined list of directories to skip
+    for (size_t i = 0; i < num_skip_directories; ++i)
+    {
+        if (strcmp(dirname, skip_directories[i]) == 0)
         {
-            ac_trie_free(local_ac_trie);
-            local_ac_trie = NULL;
-            current_params.ac_trie = NULL;
+            return true;
         }
     }
+    return false;
+}
 
-#if defined(POSIX_FADV_SEQUENTIAL) && !defined(__APPLE__)
-    // Hint the kernel about sequential access to encourage readahead
-    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif
+// skip_extensions as an open-addressed hash set of lowercased extensions, built once, so
+// a file costs one hash and usually one compare instead of a scan of the whole list
+#define SKIP_EXT_TABLE_SIZE 256 // Power of two, more than twice the list
+#define SKIP_EXT_MAX_LEN 16     // Longer than any listed extension, dot included
 
-    // --- Memory Map File ---
-    // FIX: Use conditional compilation for MAP_POPULATE
-    int mmap_base_flags = MAP_PRIVATE;
-    file_data = MAP_FAILED; // Initialize file_data
+typedef struct
+{
+    char ext[SKIP_EXT_MAX_LEN];
+    size_t len; // 0 for an empty slot
+} skip_ext_slot_t;
 
-#ifdef MAP_POPULATE
-    // Try with MAP_POPULATE first
-    int mmap_flags_populate = mmap_base_flags | MAP_POPULATE;
-    file_data = mmap(NULL, file_size, PROT_READ, mmap_flags_populate, fd, 0);
+static skip_ext_slot_t skip_ext_table[SKIP_EXT_TABLE_SIZE];
+static pthread_once_t skip_ext_once = PTHREAD_ONCE_INIT;
 
-    // If MAP_POPULATE failed, try without it
-    if (file_data == MAP_FAILED && errno == ENOTSUP) // Check if MAP_POPULATE is specifically not supported
+// FNV-1a of ext[0..len) lowercased; the lowercased bytes are stored in lower
+static uint32_t skip_ext_hash(const char *ext, size_t len, char *lower)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
     {
-        // fprintf(stderr, "krep: %s: mmap with MAP_POPULATE not supported, retrying without...\n", filename);
-        file_data = mmap(NULL, file_size, PROT_READ, mmap_base_flags, fd, 0);
+        lower[i] = (char)tolower((unsigned char)ext[i]);
+        hash = (hash ^ (unsigned char)lower[i]) * 16777619u;
     }
-    else if (file_data == MAP_FAILED)
+    return hash;
+}
+
+static void build_skip_ext_table(void)
+{
+    for (size_t i = 0; i < num_skip_extensions; ++i)
     {
-        fprintf(stderr, "krep: %s: mmap with MAP_POPULATE failed (%s), retrying without...\n", filename, strerror(errno));
-        file_data = mmap(NULL, file_size, PROT_READ, mmap_base_flags, fd, 0);
+        size_t len = strlen(skip_extensions[i]);
+        char lower[SKIP_EXT_MAX_LEN];
+        if (len >= SKIP_EXT_MAX_LEN)
+            continue;
+        uint32_t slot = skip_ext_hash(skip_extensions[i], len, lower) & (SKIP_EXT_TABLE_SIZE - 1);
+        while (skip_ext_table[slot].len)
+            slot = (slot + 1) & (SKIP_EXT_TABLE_SIZE - 1);
+        memcpy(skip_ext_table[slot].ext, lower, len);
+        skip_ext_table[slot].len = len;
     }
-#else
-    // MAP_POPULATE not defined, just call mmap without it
-    file_data = mmap(NULL, file_size, PROT_READ, mmap_base_flags, fd, 0);
-#endif
+}
 
-    // Check if mmap failed even after potential fallback
-    if (file_data == MAP_FAILED)
+// Check if a file extension should be skipped
+static bool should_skip_extension(const char *filename)
+{
+    // Find the last dot in the filename
+    const char *dot = strrchr(filename, '.');
+
+    // If no dot, or dot is at the beginning (hidden file), or dot is the last character,
+    // it's not an extension we check here.
+    if (!dot || dot == filename || *(dot + 1) == '\0')
     {
-        fprintf(stderr, "krep: %s: mmap: %s\n", filename, strerror(errno));
-        close(fd);
-        if (current_params.use_regex && current_params.compiled_regex == &compiled_regex_local)
-            regfree(&compiled_regex_local);
-        free(combined_regex_pattern);
-        // No need to free global_matches, threads, thread_args here, handled by goto cleanup_file
-        result_code = 2;
-        goto cleanup_file; // Use goto to ensure proper cleanup
+        return false; // Not an extension we care about
     }
 
-    // Advise the kernel about expected access pattern
-    int madvise_ret = madvise(file_data, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
-    if (madvise_ret != 0)
+    // Check for .min. files (minified files like .min.js, .min.css)
+    // These are common enough to merit a special check
+    const char *min_ext = strstr(dot, ".min.");
+    if (min_ext && min_ext == dot)
     {
-        int madvise_err = errno;
-        if (!atomic_exchange(&madvise_warning_emitted, true))
-        {
-            fprintf(stderr, "krep: %s: Warning: madvise failed: %s (future warnings suppressed)\n",
-                    filename, strerror(madvise_err));
-        }
-        // Continue execution since this is just an optimization
+        return true; // Skip minified files
     }
 
-    close(fd); // Close file descriptor after mmap
-    fd = -1;
-
-    // --- Determine Thread Count and Chunking ---
-    if (requested_thread_count == 0)
+    // Look the lowercased extension up in the hash set of the predefined list
+    size_t len = strlen(dot);
+    if (len >= SKIP_EXT_MAX_LEN)
+        return false; // Longer than any listed extension
+    char lower[SKIP_EXT_MAX_LEN];
+    uint32_t hash = skip_ext_hash(dot, len, lower);
+    pthread_once(&skip_ext_once, build_skip_ext_table);
+    for (uint32_t i = hash & (SKIP_EXT_TABLE_SIZE - 1); skip_ext_table[i].len; i = (i + 1) & (SKIP_EXT_TABLE_SIZE - 1))
     {
-        long cores = sysconf(_SC_NPROCESSORS_ONLN);
-        actual_thread_count = (cores > 0) ? (int)cores : 1;
+        if (skip_ext_table[i].len == len && memcmp(skip_ext_table[i].ext, lower, len) == 0)
+            return true;
     }
+
+    return false;
+}
+
+// --- File-Level Scheduling for Recursive Search ---
+
+// Files up to this size are searched whole by a single pool worker. Larger files are
+// searched on the calling thread, which splits them into chunks across the pool.
+#define FILE_TASK_MAX_SIZE (4 * MIN_CHUNK_SIZE)
+// In-flight file tasks per worker thread; bounds memory held by captured output.
+#define FILE_SCHED_TASKS_PER_THREAD 4
+
+struct file_scheduler;
+
+typedef struct
+{
+    struct file_scheduler *sched;  // Owning scheduler
+    const search_params_t *params; // Shared search parameters
+    char *path;                    // Owned copy of the file path
+    char *output;                  // Captured output, kept by the slot across files
+    size_t output_len;             // Length of captured output
+    size_t output_capacity;        // Allocated size of output
+    int result;                    // search_file return code
+    bool done;                     // Set by the worker under sched->mutex
+} file_task_t;
+
+typedef struct file_scheduler
+{
+    const search_params_t *params;
+    int thread_count;        // Requested per-file thread count (used for large files)
+    bool parallel;           // False when no multi-threaded pool is available
+    file_task_t *window;     // Ring buffer of in-flight tasks, oldest at 'head'
+    size_t capacity;         // Ring capacity
+    size_t head;             // Index of the oldest in-flight task
+    size_t count;            // Number of in-flight tasks
+    int errors;              // Files that returned 2
+    bool context_printed;    // A file printed context groups, so the next one starts with "--"
+    pthread_mutex_t mutex;   // Protects task 'done' flags
+    pthread_cond_t done_cond; // Signalled whenever a task finishes
+} file_scheduler_t;
+
+// Pool task: search one whole file with its output captured in memory
+static void *file_task_run(void *arg)
+{
+    file_task_t *task = (file_task_t *)arg;
+    task->output_len = 0;
+    output_capture_t capture;
+    FILE *stream = output_capture_open(&capture, &task->output, &task->output_len, &task->output_capacity, NULL);
+
+    thread_output_stream = stream; // NULL falls back to stdout (ordering lost, output kept)
+    if (task->params->quiet && atomic_load(&global_match_found_flag))
+        task->result = 1; // -q already has its answer from an earlier file
     else
+        task->result = search_file(task->params, task->path, 1);
+    thread_output_stream = NULL;
+    if (stream && !output_capture_close(&capture))
     {
-        actual_thread_count = requested_thread_count;
+        fprintf(stderr, "krep: %s: Failed to capture output\n", task->path);
+        task->result = 2;
     }
-    int max_threads_by_size = (file_size > 0) ? (int)((file_size + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE) : 1;
-    if (actual_thread_count > max_threads_by_size && max_threads_by_size > 0)
+
+    pthread_mutex_lock(&task->sched->mutex);
+    task->done = true;
+    pthread_cond_broadcast(&task->sched->done_cond);
+    pthread_mutex_unlock(&task->sched->mutex);
+    return NULL;
+}
+
+static void file_scheduler_init(file_scheduler_t *sched, const search_params_t *params, int thread_count)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->params = params;
+    sched->thread_count = thread_count;
+
+    init_global_thread_pool(thread_count);
+    if (!global_thread_pool || global_thread_pool->num_threads < 2)
+        return; // Serial mode: nothing to allocate
+
+    sched->capacity = (size_t)global_thread_pool->num_threads * FILE_SCHED_TASKS_PER_THREAD;
+    sched->window = calloc(sched->capacity, sizeof(file_task_t));
+    if (!sched->window)
+        return; // Fall back to serial mode
+    if (pthread_mutex_init(&sched->mutex, NULL) != 0)
     {
-        actual_thread_count = max_threads_by_size;
+        free(sched->window);
+        sched->window = NULL;
+        return;
     }
-    if (actual_thread_count <= 0)
-        actual_thread_count = 1;
+    if (pthread_cond_init(&sched->done_cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&sched->mutex);
+        free(sched->window);
+        sched->window = NULL;
+        return;
+    }
+    sched->parallel = true;
+}
 
-    // --- Initialize Threading Resources ---
-    threads = malloc(actual_thread_count * sizeof(pthread_t));
-    thread_args = malloc(actual_thread_count * sizeof(thread_data_t));
-    if (threads)
-        memset(threads, 0, actual_thread_count * sizeof(pthread_t));
+// Wait for the oldest in-flight task, then emit its output and release it
+static void file_scheduler_retire_oldest(file_scheduler_t *sched)
+{
+    file_task_t *task = &sched->window[sched->head];
 
-    if (!threads || !thread_args)
+    pthread_mutex_lock(&sched->mutex);
+    while (!task->done)
+        pthread_cond_wait(&sched->done_cond, &sched->mutex);
+    pthread_mutex_unlock(&sched->mutex);
+
+    if (task->output_len > 0 && context_lines_enabled(sched->params))
     {
-        perror("krep: Cannot allocate thread resources");
-        result_code = 2;
-        goto cleanup_file;
+        if (sched->context_printed)
+            fputs(color_output_enabled ? KREP_COLOR_SEPARATOR "--" KREP_COLOR_RESET "\n" : "--\n", stdout);
+        sched->context_printed = true;
     }
+    if (task->output_len > 0 && fwrite(task->output, 1, task->output_len, stdout) != task->output_len)
+        perror("krep: Error writing buffered file output");
+    if (task->result == 2)
+        sched->errors++;
+
+    free(task->path);
+    // The slot keeps its output buffer for the next file it carries
+    char *output = task->output;
+    size_t output_capacity = task->output_capacity;
+    memset(task, 0, sizeof(*task));
+    task->output = output;
+    task->output_capacity = output_capacity;
+    sched->head = (sched->head + 1) % sched->capacity;
+    sched->count--;
+}
 
-    // Allocate global results structure if tracking positions
-    if (current_params.track_positions)
+// Emit all in-flight tasks in submission order
+static void file_scheduler_drain(file_scheduler_t *sched)
+{
+    while (sched->count > 0)
+        file_scheduler_retire_oldest(sched);
+    fflush(stdout);
+}
+
+// Queue one regular file for searching. Output order matches submission order.
+static void file_scheduler_submit(file_scheduler_t *sched, const char *path, size_t file_size)
+{
+    if (!sched->parallel || file_size > FILE_TASK_MAX_SIZE)
     {
-        uint64_t initial_cap = (file_size / 1000 > 1000) ? file_size / 1000 : 1000;
-        global_matches = match_result_init(initial_cap);
-        if (!global_matches)
-        {
-            fprintf(stderr, "krep: Error: Cannot allocate global match results for %s.\n", filename);
-            result_code = 2;
-            goto cleanup_file;
-        }
+        // Large files keep intra-file chunking; earlier output must be flushed first
+        if (sched->parallel)
+            file_scheduler_drain(sched);
+        context_follows_earlier_file = sched->context_printed;
+        int result = search_file(sched->params, path, sched->thread_count);
+        context_follows_earlier_file = false;
+        if (result == 0 && context_lines_enabled(sched->params))
+            sched->context_printed = true;
+        if (result == 2)
+            sched->errors++;
+        return;
     }
 
-    // --- Launch Threads ---
-    size_t chunk_size_calc = (file_size + actual_thread_count - 1) / actual_thread_count;
-    if (chunk_size_calc == 0 && file_size > 0)
-        chunk_size_calc = file_size;
-    // Ensure minimum chunk size
-    if (chunk_size_calc < MIN_CHUNK_SIZE && file_size > MIN_CHUNK_SIZE)
+    if (sched->count == sched->capacity)
+        file_scheduler_retire_oldest(sched);
+
+    file_task_t *task = &sched->window[(sched->head + sched->count) % sched->capacity];
+    task->sched = sched;
+    task->params = sched->params;
+    task->path = strdup(path);
+    task->done = false;
+    if (!task->path)
     {
-        chunk_size_calc = MIN_CHUNK_SIZE;
-        // Recalculate thread count based on adjusted chunk size
-        actual_thread_count = (file_size + chunk_size_calc - 1) / chunk_size_calc;
-        if (actual_thread_count <= 0)
-            actual_thread_count = 1;
-        // Reallocate thread resources if count changed significantly (optional, could just use max)
-        // For simplicity, we assume initial allocation was sufficient or handle errors later.
+        perror("krep: Error allocating file task path");
+        sched->errors++;
+        return;
     }
+    sched->count++;
 
-    size_t current_pos = 0;
-    int threads_launched = 0;
-    // Calculate max pattern length for overlap (only for literal search)
-    size_t max_literal_pattern_len = 0;
-    if (!current_params.use_regex)
+    if (!thread_pool_submit(global_thread_pool, file_task_run, task))
     {
-        for (size_t i = 0; i < current_params.num_patterns; ++i)
-        {
-            if (current_params.pattern_lens[i] > max_literal_pattern_len)
-            {
-                max_literal_pattern_len = current_params.pattern_lens[i];
-            }
-        }
+        file_task_run(task); // Run on the calling thread; still captured and ordered
     }
+}
 
-    // Determine how many threads to use based on file size and available cores
-    int available_cores = requested_thread_count > 0 ? requested_thread_count : sysconf(_SC_NPROCESSORS_ONLN);
-    if (available_cores <= 0)
-        available_cores = 1;
+// walk_directory visitor; search errors are counted by the scheduler
+static int file_scheduler_visit(void *ctx, const char *path, size_t file_size)
+{
+    file_scheduler_submit((file_scheduler_t *)ctx, path, file_size);
+    return 0;
+}
 
-    // Calculate optimal number of threads: min(cores, max(1, file_size/(4MB)))
-    // This scales threads with file size, but caps at CPU core count
-    int optimal_threads = 1;
-    if (file_size > 0)
-    {
-        size_t chunk_threshold = 4 * 1024 * 1024; // 4MB per thread minimum
-        optimal_threads = file_size / chunk_threshold;
-        if (optimal_threads > available_cores)
-            optimal_threads = available_cores;
-        if (optimal_threads < 1)
-            optimal_threads = 1;
-    }
+static void file_scheduler_finish(file_scheduler_t *sched)
+{
+    if (!sched->parallel)
+        return;
+    file_scheduler_drain(sched);
+    pthread_cond_destroy(&sched->done_cond);
+    pthread_mutex_destroy(&sched->mutex);
+    for (size_t i = 0; i < sched->capacity; i++)
+        free(sched->window[i].output);
+    free(sched->window);
+    sched->window = NULL;
+}
 
-    // Initialize the global thread pool if needed
-    init_global_thread_pool(optimal_threads);
+// --- Directory Walk ---
 
-    // Preselect search algorithm once to avoid redundant decisions inside each worker
-    search_func_t preselected_algo = select_search_algorithm(&current_params);
+// Called for every eligible regular file found by walk_directory; returns its error count
+typedef int (*walk_visit_func_t)(void *ctx, const char *path, size_t file_size);
 
-    for (int i = 0; i < actual_thread_count; ++i)
-    {
-        if (current_pos >= file_size)
-        {
-            actual_thread_count = i; // Update actual count
-            break;
-        }
+// Directories listed ahead of the visit by pool workers. Past this the visiting thread
+// lists a directory itself when it gets there.
+#define WALK_PREFETCH_DIRS 128
 
-        thread_args[i].thread_id = i;
-        thread_args[i].params = &current_params; // Pass params containing the pre-built trie
-        thread_args[i].chunk_start = file_data + current_pos;
-        thread_args[i].search_algo = preselected_algo;
+enum
+{
+    WALK_PENDING, // Not listed yet
+    WALK_LISTING, // Claimed by a worker or the visiting thread
+    WALK_LISTED   // Entries are complete
+};
 
-        size_t this_chunk_len = (current_pos + chunk_size_calc > file_size) ? (file_size - current_pos) : chunk_size_calc;
+enum
+{
+    WALK_FILE,
+    WALK_DIR,
+    WALK_ERROR,   // An entry that could not be stat'ed
+    WALK_UNSTATED // A regular file not stat'ed yet (only while its directory is listed)
+};
 
-        // Overlap needed for literal patterns. Regex handled differently (often needs no overlap or different logic).
-        size_t overlap = (!current_params.use_regex && max_literal_pattern_len > 0 && i < actual_thread_count - 1) ? max_literal_pattern_len - 1 : 0;
-        size_t effective_chunk_len = (current_pos + this_chunk_len + overlap > file_size) ? (file_size - current_pos) : (this_chunk_len + overlap);
+// Ignore files read in each directory, in increasing precedence
+static const char *const walk_ignore_files[] = {".gitignore", ".ignore"};
 
-        // Ensure chunk length isn't zero if there's still data
-        if (effective_chunk_len == 0 && current_pos < file_size)
-        {
-            effective_chunk_len = file_size - current_pos;
-        }
+struct walk_dir;
+struct walker;
 
-        thread_args[i].chunk_len = effective_chunk_len;
-        thread_args[i].local_result = NULL;
-        thread_args[i].count_result = 0;
-        thread_args[i].error_flag = false;
+typedef struct
+{
+    uint32_t name_offset;   // Into the directory's names buffer
+    uint32_t name_len;      // Without the terminating NUL
+    int kind;               // WALK_FILE, WALK_DIR or WALK_ERROR
+    int error;              // WALK_ERROR: errno of the failed stat
+    size_t size;            // WALK_FILE: file size
+    struct walk_dir *child; // WALK_DIR: the subdirectory's listing
+} walk_entry_t;
+
+// One directory's eligible entries in readdir order
+typedef struct walk_dir
+{
+    struct walker *walker;
+    struct walk_dir *parent; // NULL for the root
+    const char *name;        // Opened relative to the parent's fd; the root's path
+    int fd;                  // Kept until released so the children open relative to it
+    int open_error;          // errno when the directory could not be opened or fully read
+    _Atomic int state;       // WALK_PENDING, WALK_LISTING or WALK_LISTED
+    _Atomic int refs;        // The visiting thread, plus a queued listing task
+    bool queued;             // Handed to the pool; counts against WALK_PREFETCH_DIRS
+    walk_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    char *names; // NUL-terminated entry names
+    size_t names_len;
+    size_t names_capacity;
+    size_t prefetch_next; // Next entry to consider for read-ahead
+    ignore_rules_t *ignore; // Ignore file rules for the entries, own and inherited; NULL for none
+    char *rel_path;         // Path from the walk root ("" as NULL for the root), when filtering
+    size_t rel_len;
+} walk_dir_t;
+
+typedef struct walker
+{
+    thread_pool_t *pool;   // NULL: every directory is listed by the visiting thread
+    _Atomic int ahead;     // Queued directories not yet visited
+    _Atomic int tasks;     // Listing tasks not yet finished
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;   // Signalled when a listing or a listing task finishes
+    const ignore_rules_t *globs; // --glob overrides, NULL when none
+    bool use_ignore_files;       // Read walk_ignore_files in every directory
+    const atomic_bool *stop;     // Once set, no further files are visited; NULL for never
+} walker_t;
+
+static walk_dir_t *walk_dir_new(walker_t *walker, walk_dir_t *parent, const char *name)
+{
+    walk_dir_t *node = calloc(1, sizeof(walk_dir_t));
+    if (!node)
+        return NULL;
+    node->walker = walker;
+    node->parent = parent;
+    node->name = name;
+    node->fd = -1;
+    atomic_init(&node->state, WALK_PENDING);
+    atomic_init(&node->refs, 1);
+    return node;
+}
 
-        if (effective_chunk_len > 0)
-        {
-            // Use search_chunk_thread which handles multiple patterns via Aho-Corasick or Regex
-            if (global_thread_pool)
-            {
-                if (!thread_pool_submit(global_thread_pool, search_chunk_thread, &thread_args[i]))
-                {
-                    fprintf(stderr, "krep: Failed to submit task for thread %d\n", i);
-                    // Handle error: maybe reduce thread count or abort
-                    thread_args[i].error_flag = true; // Mark thread data as errored
-                }
-            }
-            else
-            {
-                int rc = pthread_create(&threads[i], NULL, search_chunk_thread, &thread_args[i]);
-                if (rc)
-                {
-                    fprintf(stderr, "krep: Error creating thread %d: %s\n", i, strerror(rc));
-                    // Handle error: maybe reduce thread count or abort
-                    threads[i] = 0;                   // Mark as not created
-                    thread_args[i].error_flag = true; // Mark thread data as errored
-                    continue;                         // Try launching fewer threads
-                }
-            }
-            threads_launched++;
-        }
-        else
+static void walk_dir_release(walk_dir_t *node)
+{
+    if (atomic_fetch_sub(&node->refs, 1) != 1)
+        return;
+    if (node->fd != -1)
+        close(node->fd);
+    ignore_rules_release(node->ignore);
+    free(node->rel_path);
+    free(node->entries);
+    free(node->names);
+    free(node);
+}
+
+// Append an entry named name (len bytes); NULL when out of memory
+static walk_entry_t *walk_dir_add(walk_dir_t *node, const char *name, size_t len, int kind)
+{
+    if (node->count == node->capacity)
+    {
+        size_t capacity = node->capacity ? node->capacity * 2 : 64;
+        walk_entry_t *entries = realloc(node->entries, capacity * sizeof(walk_entry_t));
+        if (!entries)
+            return NULL;
+        node->entries = entries;
+        node->capacity = capacity;
+    }
+    if (node->names_len + len + 1 > node->names_capacity || node->names_len + len + 1 > UINT32_MAX)
+    {
+        size_t capacity = node->names_capacity ? node->names_capacity * 2 : 1024;
+        while (capacity < node->names_len + len + 1)
+            capacity *= 2;
+        char *names = capacity <= UINT32_MAX ? realloc(node->names, capacity) : NULL;
+        if (!names)
+            return NULL;
+        node->names = names;
+        node->names_capacity = capacity;
+    }
+
+    walk_entry_t *entry = &node->entries[node->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->name_offset = (uint32_t)node->names_len;
+    entry->name_len = (uint32_t)len;
+    entry->kind = kind;
+    memcpy(node->names + node->names_len, name, len + 1);
+    node->names_len += len + 1;
+    return entry;
+}
+
+static void walk_prefetch(walker_t *walker, walk_dir_t *node);
+
+// Read one ignore file of node's directory; false when it is missing or unreadable
+static bool walk_read_ignore_file(walk_dir_t *node, const char *name, ignore_rules_t *rules)
+{
+    int fd = openat(node->fd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    struct stat st;
+    if (fd == -1)
+        return false;
+    bool ok = false;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size <= IGNORE_FILE_MAX_SIZE)
+    {
+        size_t size = (size_t)st.st_size;
+        char *text = malloc(size ? size : 1);
+        size_t got = 0;
+        while (text && got < size)
         {
-            threads[i] = 0; // Mark as not launched
+            ssize_t n = read(fd, text + got, size - got);
+            if (n <= 0)
+                break;
+            got += (size_t)n;
         }
-        current_pos += this_chunk_len; // Advance by non-overlapped length
+        ok = text && ignore_rules_add_file(rules, text, got);
+        free(text);
+    }
+    close(fd);
+    return ok;
+}
+
+// The rules in force for node's entries: its parent's, plus a new level compiled from
+// the ignore files found in the listing (present_mask has bit i for walk_ignore_files[i])
+static ignore_rules_t *walk_load_ignore(walk_dir_t *node, unsigned present_mask)
+{
+    ignore_rules_t *inherited = node->parent ? node->parent->ignore : NULL;
+    if (!present_mask)
+        return ignore_rules_retain(inherited);
+
+    ignore_rules_t *level = ignore_rules_new(inherited, node->rel_len);
+    if (!level)
+        return ignore_rules_retain(inherited);
+    for (size_t i = 0; i < sizeof(walk_ignore_files) / sizeof(walk_ignore_files[0]); i++)
+    {
+        if (present_mask & (1u << i))
+            walk_read_ignore_file(node, walk_ignore_files[i], level);
+    }
+    if (ignore_rules_count(level) == 0 || !ignore_rules_compile(level))
+    {
+        ignore_rules_release(level);
+        return ignore_rules_retain(inherited);
+    }
+    return level;
+}
+
+// Whether an entry of node is filtered out by --glob or the ignore files
+static bool walk_is_ignored(const walker_t *walker, const walk_dir_t *node, const char *name, size_t name_len,
+                            bool is_dir)
+{
+    char rel[PATH_MAX];
+    size_t rel_len = node->rel_len + (node->rel_len > 0) + name_len;
+    if (rel_len >= sizeof(rel))
+        return false; // Reported as too long when visited
+    if (node->rel_len > 0)
+    {
+        memcpy(rel, node->rel_path, node->rel_len);
+        rel[node->rel_len] = '/';
+    }
+    memcpy(rel + rel_len - name_len, name, name_len);
+
+    if (walker->globs)
+    {
+        ignore_match_t verdict = ignore_rules_match(walker->globs, rel, rel_len, is_dir);
+        if (verdict != IGNORE_NONE)
+            return verdict == IGNORE_EXCLUDE; // Overrides take precedence over ignore files
+        if (!is_dir && ignore_rules_has_includes(walker->globs))
+            return true;
     }
-    actual_thread_count = threads_launched;
+    return node->ignore && ignore_rules_match(node->ignore, rel, rel_len, is_dir) == IGNORE_EXCLUDE;
+}
 
-    // Wait for all tasks to complete
-    if (global_thread_pool)
+// Read node's directory. d_type tells directories from regular files without a stat.
+// Entries are collected first, then filtered by the ignore rules (which need the whole
+// listing to know whether the directory has ignore files); only files that will be
+// searched are stat'ed, for their size, relative to the directory's fd like every
+// other lookup.
+static void walk_list(walker_t *walker, walk_dir_t *node)
+{
+    int parent_fd = node->parent ? node->parent->fd : AT_FDCWD;
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (node->parent ? O_NOFOLLOW : 0);
+    node->fd = openat(parent_fd, node->name, flags);
+    int list_fd = node->fd == -1 ? -1 : dup(node->fd); // closedir closes its own fd
+    DIR *dir = list_fd == -1 ? NULL : fdopendir(list_fd);
+    if (!dir)
     {
-        thread_pool_wait_all(global_thread_pool);
+        node->open_error = errno;
+        if (list_fd != -1)
+            close(list_fd);
     }
 
-    // --- Wait for Threads and Aggregate Results ---
-    bool merge_error = false;
-    for (int i = 0; i < actual_thread_count; ++i)
+    unsigned ignore_files_present = 0;
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL)
     {
-        // Skip the pthread_join logic if using thread pool (tasks are already complete)
-        // Only try to join if not using thread pool and thread was actually created
-        if (!global_thread_pool && threads[i] != 0)
-        {
-            int rc = pthread_join(threads[i], NULL);
-            if (rc)
-            {
-                fprintf(stderr, "krep: Error joining thread %d: %s\n", i, strerror(rc));
-                result_code = 2;
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue; // "." and ".."
+
+        size_t name_len = strlen(name);
+        struct stat entry_stat;
+        bool have_stat = false;
+        bool is_dir = entry->d_type == DT_DIR;
+        bool is_reg = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN)
+        {
+            // Filesystems without d_type; like lstat, symlinks are not followed
+            if (fstatat(node->fd, name, &entry_stat, AT_SYMLINK_NOFOLLOW) == -1)
+            {
+                walk_entry_t *failed = errno == ENOENT ? NULL : walk_dir_add(node, name, name_len, WALK_ERROR);
+                if (failed)
+                    failed->error = errno;
+                continue;
             }
+            have_stat = true;
+            is_dir = S_ISDIR(entry_stat.st_mode);
+            is_reg = S_ISREG(entry_stat.st_mode);
         }
 
-        if (thread_args[i].error_flag)
+        walk_entry_t *added = NULL;
+        if (is_dir)
         {
-            result_code = 2;
+            if (should_skip_directory(name))
+                continue;
+            added = walk_dir_add(node, name, name_len, WALK_DIR);
         }
-
-        // Always process results from thread_args, regardless of how the thread was executed
-        if (result_code != 2 && !merge_error)
+        else if (is_reg)
         {
-            // Sum counts (lines or matches). Note: Line count might be slightly off at boundaries.
-            uint64_t thread_count = thread_args[i].count_result;
-            if (max_count != SIZE_MAX)
+            if (walker->use_ignore_files && name[0] == '.')
             {
-                uint64_t remaining_limit = (final_count >= max_count) ? 0 : max_count - final_count;
-                if (thread_count > remaining_limit)
+                for (size_t i = 0; i < sizeof(walk_ignore_files) / sizeof(walk_ignore_files[0]); i++)
                 {
-                    thread_count = remaining_limit; // Cap thread count contribution
+                    if (strcmp(name, walk_ignore_files[i]) == 0)
+                        ignore_files_present |= 1u << i;
                 }
             }
-            final_count += thread_count;
-
-            // Merge position results if tracking, respecting max_count
-            if (current_params.track_positions && global_matches && thread_args[i].local_result)
-            {
-                bool merge_ok = true;
-                if (max_count == SIZE_MAX)
-                {
-                    size_t chunk_offset = (size_t)(thread_args[i].chunk_start - file_data);
-                    merge_ok = match_result_merge(global_matches, thread_args[i].local_result, chunk_offset);
-                }
-                else if (global_matches->count < max_count)
-                {
-                    size_t chunk_offset = (size_t)(thread_args[i].chunk_start - file_data);
-                    uint64_t remaining_limit = max_count - global_matches->count;
-                    merge_ok = match_result_merge_limited(global_matches,
-                                                          thread_args[i].local_result,
-                                                          chunk_offset,
-                                                          remaining_limit);
-                }
-
-                if (!merge_ok)
-                {
-                    fprintf(stderr, "krep: %s: Failed to merge match result from thread %d.\n", filename, i);
-                    merge_error = true;
-                }
+            // Skip by extension, and never search or index the trigram index itself
+            // (or its temporary file)
+            if (should_skip_extension(name) ||
+                strncmp(name, TRIGRAM_INDEX_FILENAME, strlen(TRIGRAM_INDEX_FILENAME)) == 0)
+                continue;
+            // Binary files are detected by the search itself, on the data it reads
+            added = walk_dir_add(node, name, name_len, have_stat ? WALK_FILE : WALK_UNSTATED);
+            if (added && have_stat)
+                added->size = (size_t)entry_stat.st_size;
+        }
+        else
+        {
+            continue; // Symlinks, sockets, pipes, etc.
+        }
 
-                match_result_free(thread_args[i].local_result); // Free local result after merging/skip
-                thread_args[i].local_result = NULL;
-            }
-            else if (thread_args[i].local_result)
+        if (!added)
+        {
+            node->open_error = ENOMEM;
+            break;
+        }
+    }
+    if (dir)
+        closedir(dir);
+
+    // Drop ignored entries and stat the files that are left
+    if (walker->use_ignore_files)
+        node->ignore = walk_load_ignore(node, ignore_files_present);
+    bool filtering = walker->globs || node->ignore;
+    size_t kept = 0;
+    for (size_t i = 0; i < node->count; i++)
+    {
+        walk_entry_t *e = &node->entries[i];
+        const char *name = node->names + e->name_offset;
+        if (filtering && e->kind != WALK_ERROR && walk_is_ignored(walker, node, name, e->name_len, e->kind == WALK_DIR))
+            continue;
+        if (e->kind == WALK_UNSTATED)
+        {
+            struct stat entry_stat;
+            if (fstatat(node->fd, name, &entry_stat, AT_SYMLINK_NOFOLLOW) == -1)
             {
-                match_result_free(thread_args[i].local_result);
-                thread_args[i].local_result = NULL;
+                if (errno == ENOENT)
+                    continue;
+                e->kind = WALK_ERROR;
+                e->error = errno;
             }
-
-            if (merge_error)
+            else
             {
-                result_code = 2;
-                // Continue cleanup but don't process further results
+                e->kind = WALK_FILE;
+                e->size = (size_t)entry_stat.st_size;
             }
         }
+        node->entries[kept++] = *e;
     }
+    node->count = kept;
 
-    // --- Final Processing and Output ---
-    if (result_code != 2)
+    // The names buffer is complete, so the children can point into it
+    for (size_t i = 0; i < node->count; i++)
     {
-        // Determine final result code based on aggregated count/matches
-        result_code = (final_count > 0) ? 0 : 1;
-        if (result_code == 0)
-            atomic_store(&global_match_found_flag, true); // Signal match found for -r
-
-        if (current_params.count_lines_mode || current_params.count_matches_mode)
-        {
-            printf("%s:%" PRIu64 "\n", filename, final_count);
-        }
-        else if (result_code == 0 && global_matches)
-        {
-            if (global_matches->count > 1)
-            {
-                qsort(global_matches->positions, global_matches->count, sizeof(match_position_t), compare_match_positions);
-            }
-
-            // Print matching lines/parts, respecting max_count via print_matching_items
-            print_matching_items(filename, file_data, file_size, global_matches, &current_params); // Pass params
-        }
-        // Handle case where match was found but no positions recorded (e.g., empty regex match)
-        else if (result_code == 0 && (!global_matches || global_matches->count == 0))
+        walk_entry_t *e = &node->entries[i];
+        if (e->kind != WALK_DIR)
+            continue;
+        e->child = walk_dir_new(walker, node, node->names + e->name_offset);
+        if (e->child && (walker->globs || walker->use_ignore_files))
         {
-            if (only_matching)
+            // Filtering needs each directory's path from the root
+            size_t rel_len = node->rel_len + (node->rel_len > 0) + e->name_len;
+            e->child->rel_path = malloc(rel_len + 1);
+            if (e->child->rel_path)
             {
-                printf("%s:1:\n", filename); // Line number 1, empty match
+                if (node->rel_len > 0)
+                {
+                    memcpy(e->child->rel_path, node->rel_path, node->rel_len);
+                    e->child->rel_path[node->rel_len] = '/';
+                }
+                memcpy(e->child->rel_path + rel_len - e->name_len, e->child->name, e->name_len + 1);
+                e->child->rel_len = rel_len;
             }
             else
             {
-                printf("%s:\n", filename); // Empty line
+                walk_dir_release(e->child);
+                e->child = NULL;
             }
         }
+        if (!e->child)
+        {
+            e->kind = WALK_ERROR;
+            e->error = ENOMEM;
+        }
     }
+    walk_prefetch(walker, node);
 
-cleanup_file:
-    // --- Cleanup Resources ---
-    if (file_data != MAP_FAILED)
-        munmap(file_data, file_size);
-    if (current_params.use_regex && current_params.compiled_regex == &compiled_regex_local)
-        regfree(&compiled_regex_local);
-    free(combined_regex_pattern);
-    match_result_free(global_matches);
-    free(threads);
-    free(thread_args);
-    if (fd != -1)
-        close(fd);
-    // Free the Aho-Corasick trie if it was built for this file
-    if (local_ac_trie)
-    {
-        ac_trie_free(local_ac_trie);
-    }
-
-    return result_code;
+    pthread_mutex_lock(&walker->mutex);
+    atomic_store(&node->state, WALK_LISTED);
+    pthread_cond_broadcast(&walker->cond);
+    pthread_mutex_unlock(&walker->mutex);
 }
 
-// --- Recursive Directory Search ---
+// Pool task: list a directory ahead of the visit unless the visiting thread got there first
+static void *walk_list_task(void *arg)
+{
+    walk_dir_t *node = (walk_dir_t *)arg;
+    walker_t *walker = node->walker;
+    int expected = WALK_PENDING;
+    if (atomic_compare_exchange_strong(&node->state, &expected, WALK_LISTING))
+        walk_list(walker, node);
+    walk_dir_release(node);
+
+    pthread_mutex_lock(&walker->mutex);
+    atomic_fetch_sub(&walker->tasks, 1);
+    pthread_cond_broadcast(&walker->cond);
+    pthread_mutex_unlock(&walker->mutex);
+    return NULL;
+}
 
-// Check if a directory name should be skipped
-static bool should_skip_directory(const char *dirname)
+// Queue node's next subdirectories for listing while the read-ahead budget allows.
+// Called by whoever lists node, and by the visiting thread as it moves through node.
+static void walk_prefetch(walker_t *walker, walk_dir_t *node)
 {
-    // Skip hidden directories starting with '.' (in addition to "." and "..")
-    if (dirname[0] == '.' && strcmp(dirname, ".") != 0 && strcmp(dirname, "..") != 0)
-    {
-        return true;
-    }
-    // Check against the predefined list of directories to skip
-    for (size_t i = 0; i < num_skip_directories; ++i)
+    if (!walker->pool)
+        return;
+    while (node->prefetch_next < node->count && atomic_load(&walker->ahead) < WALK_PREFETCH_DIRS)
     {
-        if (strcmp(dirname, skip_directories[i]) == 0)
-        {
-            return true;
+        walk_entry_t *e = &node->entries[node->prefetch_next++];
+        if (e->kind != WALK_DIR)
+            continue;
+        walk_dir_t *child = e->child;
+        atomic_fetch_add(&child->refs, 1);
+        atomic_fetch_add(&walker->tasks, 1);
+        atomic_fetch_add(&walker->ahead, 1);
+        child->queued = true;
+        if (!thread_pool_submit(walker->pool, walk_list_task, child))
+        {
+            // The visiting thread lists it instead
+            child->queued = false;
+            atomic_fetch_sub(&walker->ahead, 1);
+            atomic_fetch_sub(&walker->tasks, 1);
+            atomic_fetch_sub(&child->refs, 1);
+            return;
         }
     }
-    return false;
 }
 
-// Check if a file extension should be skipped
-static bool should_skip_extension(const char *filename)
+// Wait for node's listing, listing it here if no worker has started on it
+static void walk_wait_listed(walker_t *walker, walk_dir_t *node)
 {
-    // Find the last dot in the filename
-    const char *dot = strrchr(filename, '.');
+    int expected = WALK_PENDING;
+    if (atomic_compare_exchange_strong(&node->state, &expected, WALK_LISTING))
+    {
+        walk_list(walker, node);
+        return;
+    }
+    pthread_mutex_lock(&walker->mutex);
+    while (atomic_load(&node->state) != WALK_LISTED)
+        pthread_cond_wait(&walker->cond, &walker->mutex);
+    pthread_mutex_unlock(&walker->mutex);
+}
 
-    // If no dot, or dot is at the beginning (hidden file), or dot is the last character,
-    // it's not an extension we check here.
-    if (!dot || dot == filename || *(dot + 1) == '\0')
+// Release node and its subtree without visiting it
+static void walk_dir_discard(walker_t *walker, walk_dir_t *node)
+{
+    walk_wait_listed(walker, node);
+    for (size_t i = 0; i < node->count; i++)
     {
-        return false; // Not an extension we care about
+        if (node->entries[i].kind == WALK_DIR)
+            walk_dir_discard(walker, node->entries[i].child);
     }
+    if (node->queued)
+        atomic_fetch_sub(&walker->ahead, 1);
+    walk_dir_release(node);
+}
 
-    // Check for .min. files (minified files like .min.js, .min.css)
-    // These are common enough to merit a special check
-    const char *min_ext = strstr(dot, ".min.");
-    if (min_ext && min_ext == dot)
+// Visit node's files in readdir order, depth first, exactly like a serial walk. path
+// holds node's path (path_len bytes), and entry paths are built in place after it.
+static int walk_visit_dir(walker_t *walker, walk_dir_t *node, char *path, size_t path_len,
+                          walk_visit_func_t visit, void *ctx)
+{
+    walk_wait_listed(walker, node);
+    walk_prefetch(walker, node);
+
+    int total_errors = 0;
+    if (node->open_error)
     {
-        return true; // Skip minified files
+        // Better error handling: print more informative message for common errors
+        if (node->open_error == EACCES)
+        {
+            fprintf(stderr, "krep: %s: Permission denied\n", path);
+        }
+        else if (node->open_error != ENOENT)
+        { // Still silent for not found
+            fprintf(stderr, "krep: %s: %s\n", path, strerror(node->open_error));
+        }
+        // No errors for permission/not found, 1 otherwise
+        if (node->open_error != EACCES && node->open_error != ENOENT)
+            total_errors++;
     }
 
-    // Check against the predefined list
-    for (size_t i = 0; i < num_skip_extensions; ++i)
+    bool add_slash = path_len > 0 && path[path_len - 1] != '/';
+    for (size_t i = 0; i < node->count; i++)
     {
-        if (strcasecmp(dot, skip_extensions[i]) == 0)
+        walk_entry_t *e = &node->entries[i];
+        if (walker->stop && atomic_load(walker->stop))
         {
-            return true;
+            for (; i < node->count; i++)
+            {
+                if (node->entries[i].kind == WALK_DIR)
+                    walk_dir_discard(walker, node->entries[i].child);
+            }
+            break;
+        }
+        const char *name = node->names + e->name_offset;
+        size_t entry_len = path_len + add_slash + e->name_len;
+        if (entry_len >= PATH_MAX)
+        {
+            fprintf(stderr, "krep: Error constructing path for %s/%s (too long?)\n", path, name);
+            total_errors++;
+            if (e->kind == WALK_DIR)
+                walk_dir_discard(walker, e->child);
+            continue;
+        }
+        if (add_slash)
+            path[path_len] = '/';
+        memcpy(path + path_len + add_slash, name, e->name_len + 1);
+
+        if (e->kind == WALK_DIR)
+        {
+            walk_prefetch(walker, node);
+            total_errors += walk_visit_dir(walker, e->child, path, entry_len, visit, ctx);
+        }
+        else if (e->kind == WALK_FILE)
+        {
+            // Note: global_match_found_flag is set within search_file if matches are found
+            total_errors += visit(ctx, path, e->size);
+        }
+        else
+        {
+            fprintf(stderr, "krep: %s: %s\n", path, strerror(e->error));
+            total_errors++;
         }
+        path[path_len] = '\0';
     }
 
-    return false;
+    if (node->queued)
+        atomic_fetch_sub(&walker->ahead, 1);
+    walk_dir_release(node);
+    return total_errors;
 }
 
-// Check if a file appears to be binary
-static bool is_binary_file(const char *filepath)
+// Walk a directory tree, handing every eligible regular file to visit on the calling
+// thread. With a multi-threaded pool, pool workers list directories ahead of the visit
+// (each opened with openat relative to its parent's fd); the files are still visited
+// in the order a serial depth-first walk would reach them. Entries matched by globs or,
+// with use_ignore_files, by the .gitignore / .ignore files on the way down are dropped
+// while their directory is listed, so ignored subtrees are never opened. The walk ends
+// early once stop (when not NULL) is set.
+static int walk_directory(const char *base_dir, const ignore_rules_t *globs, bool use_ignore_files,
+                          const atomic_bool *stop, walk_visit_func_t visit, void *ctx)
 {
-    // Open file and check for binary content
-    FILE *f = fopen(filepath, "rb");
-    if (!f)
+    size_t base_len = strlen(base_dir);
+    char path[PATH_MAX];
+    if (base_len >= sizeof(path))
     {
-        return false; // Treat fopen error as non-binary (might be permission issue)
+        fprintf(stderr, "krep: %s: Path too long\n", base_dir);
+        return 1;
+    }
+    memcpy(path, base_dir, base_len + 1);
+
+    walker_t walker;
+    walker.pool = (global_thread_pool && global_thread_pool->num_threads >= 2) ? global_thread_pool : NULL;
+    atomic_init(&walker.ahead, 0);
+    atomic_init(&walker.tasks, 0);
+    walker.globs = globs;
+    walker.use_ignore_files = use_ignore_files;
+    walker.stop = stop;
+    if (pthread_mutex_init(&walker.mutex, NULL) != 0)
+        return 1;
+    if (pthread_cond_init(&walker.cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&walker.mutex);
+        return 1;
     }
 
-    char buffer[BINARY_CHECK_BUFFER_SIZE];
-    // Read a chunk from the beginning of the file
-    size_t bytes_read = fread(buffer, 1, sizeof(buffer), f);
-    fclose(f);
-
-    if (bytes_read == 0)
-        return false; // Empty file is not binary
-
-    // Check if a null byte exists within the read buffer
-    return memchr(buffer, '\0', bytes_read) != NULL;
+    int total_errors = 1;
+    walk_dir_t *root = walk_dir_new(&walker, NULL, base_dir);
+    if (root)
+        total_errors = walk_visit_dir(&walker, root, path, base_len, visit, ctx);
+    else
+        perror("krep: Error allocating directory listing");
+
+    // Tasks for directories the visiting thread listed itself may still be queued
+    pthread_mutex_lock(&walker.mutex);
+    while (atomic_load(&walker.tasks) > 0)
+        pthread_cond_wait(&walker.cond, &walker.mutex);
+    pthread_mutex_unlock(&walker.mutex);
+    pthread_cond_destroy(&walker.cond);
+    pthread_mutex_destroy(&walker.mutex);
+    return total_errors;
 }
 
 // Recursive directory search function
-// Note: Directory traversal itself remains serial. Parallelism happens within search_file.
+// Directories are listed ahead on the thread pool, whole files are spread across it by
+// the file scheduler, and output is emitted per file in traversal order.
 int search_directory_recursive(const char *base_dir, const search_params_t *params, int thread_count)
 {
-    // Try opening the directory
-    DIR *dir = opendir(base_dir);
-    if (!dir)
+    file_scheduler_t sched;
+    file_scheduler_init(&sched, params, thread_count);
+
+    // -q is answered by the first match, so the walk ends there
+    const atomic_bool *stop = params->quiet ? &global_match_found_flag : NULL;
+    int total_errors = walk_directory(base_dir, params->glob_rules, !params->no_ignore, stop, file_scheduler_visit, &sched);
+
+    file_scheduler_finish(&sched);
+    return total_errors + sched.errors;
+}
+
+// --- Trigram Index Build (--index-build) ---
+
+// Add one file to the index under its realpath, which is how searches look it up
+static int index_file_visit(void *ctx, const char *path, size_t walk_size)
+{
+    trigram_index_writer_t *writer = (trigram_index_writer_t *)ctx;
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved))
     {
-        // Better error handling: print more informative message for common errors
-        if (errno == EACCES)
-        {
-            fprintf(stderr, "krep: %s: Permission denied\n", base_dir);
-        }
-        else if (errno != ENOENT)
-        { // Still silent for not found
-            fprintf(stderr, "krep: %s: %s\n", base_dir, strerror(errno));
-        }
-        // Return 0 errors for permission/not found, 1 otherwise
-        return (errno == EACCES || errno == ENOENT) ? 0 : 1;
+        fprintf(stderr, "krep: %s: %s\n", path, strerror(errno));
+        return 1;
     }
 
-    struct dirent *entry;       // Structure to hold directory entry info
-    int total_errors = 0;       // Accumulator for errors during recursion
-    char path_buffer[PATH_MAX]; // Buffer to construct full paths
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
+    if (fd == -1 || fstat(fd, &file_stat) == -1)
+    {
+        fprintf(stderr, "krep: %s: %s\n", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return 1;
+    }
+    (void)walk_size; // The fingerprint comes from the open file, not the directory walk
+    if (decompress_detect(fd, path) != DECOMPRESS_NONE)
+    {
+        close(fd); // Compressed files are always decoded and searched in full
+        return 0;
+    }
 
-    // Read directory entries one by one
-    while ((entry = readdir(dir)) != NULL)
+    size_t file_size = (size_t)file_stat.st_size;
+    char *file_data = NULL;
+    if (file_size > 0)
     {
-        // Skip "." and ".." entries
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        file_data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file_data == MAP_FAILED)
         {
-            continue;
+            fprintf(stderr, "krep: %s: mmap: %s\n", path, strerror(errno));
+            close(fd);
+            return 1;
         }
+        // Advice values are not flags; each needs its own call
+        (void)madvise(file_data, file_size, MADV_SEQUENTIAL);
+        (void)madvise(file_data, file_size, MADV_WILLNEED);
+    }
+    close(fd);
 
-        // Construct the full path for the entry - more robust path joining
-        int path_len;
-        if (base_dir[strlen(base_dir) - 1] == '/')
-        {
-            path_len = snprintf(path_buffer, sizeof(path_buffer), "%s%s", base_dir, entry->d_name);
-        }
-        else
-        {
-            path_len = snprintf(path_buffer, sizeof(path_buffer), "%s/%s", base_dir, entry->d_name);
-        }
+    bool ok = trigram_index_writer_add(writer, resolved, file_data, file_size, &file_stat);
+    if (file_data)
+        munmap(file_data, file_size);
+    if (!ok)
+    {
+        fprintf(stderr, "krep: %s: Could not add file to the index\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// Build DIR/.krep-index over the files a recursive search of DIR would read (honoring
+// its ignore files; --glob does not narrow the index)
+int build_trigram_index(const char *dir)
+{
+    char index_path[PATH_MAX];
+    int len = snprintf(index_path, sizeof(index_path), "%s/%s", dir, TRIGRAM_INDEX_FILENAME);
+    if (len < 0 || (size_t)len >= sizeof(index_path))
+    {
+        fprintf(stderr, "krep: %s: Path too long for the index file\n", dir);
+        return 2;
+    }
+
+    trigram_index_writer_t *writer = trigram_index_writer_open(index_path);
+    if (!writer)
+    {
+        fprintf(stderr, "krep: %s: Cannot create index: %s\n", index_path, strerror(errno));
+        return 2;
+    }
+    int errors = walk_directory(dir, NULL, true, NULL, index_file_visit, writer);
+    size_t num_files = trigram_index_writer_count(writer);
+    if (!trigram_index_writer_close(writer, true))
+    {
+        fprintf(stderr, "krep: %s: Error writing index\n", index_path);
+        return 2;
+    }
+    printf("Indexed %zu files into %s\n", num_files, index_path);
+    if (errors > 0)
+    {
+        fprintf(stderr, "krep: Encountered %d errors while indexing; those files are searched in full.\n", errors);
+        return 2;
+    }
+    return 0;
+}
+
+// Open the index covering target: DIR/.krep-index in target's directory or the closest
+// ancestor that has one. Returns NULL if there is none.
+static KREP_UNUSED trigram_index_t *open_trigram_index_for(const char *target, bool target_is_dir)
+{
+    char dir[PATH_MAX];
+    if (!realpath(target, dir))
+        return NULL;
+    if (!target_is_dir)
+    {
+        char *slash = strrchr(dir, '/');
+        if (slash)
+            *(slash == dir ? slash + 1 : slash) = '\0';
+    }
 
-        // Check for path construction errors (e.g., path too long)
-        if (path_len < 0 || (size_t)path_len >= sizeof(path_buffer))
+    for (;;)
+    {
+        char index_path[PATH_MAX];
+        int len = snprintf(index_path, sizeof(index_path), "%s%s%s", dir,
+                           strcmp(dir, "/") == 0 ? "" : "/", TRIGRAM_INDEX_FILENAME);
+        if (len > 0 && (size_t)len < sizeof(index_path))
         {
-            fprintf(stderr, "krep: Error constructing path for %s/%s (too long?)\n", base_dir, entry->d_name);
-            total_errors++;
-            continue;
+            trigram_index_t *index = trigram_index_open(index_path);
+            if (index)
+                return index;
         }
+        char *slash = strrchr(dir, '/');
+        if (!slash || strcmp(dir, "/") == 0)
+            return NULL;
+        *(slash == dir ? slash + 1 : slash) = '\0';
+    }
+}
 
-        struct stat entry_stat; // Structure to hold file status info
-        // Use lstat to get info about the entry itself (doesn't follow symlinks)
-        if (lstat(path_buffer, &entry_stat) == -1)
-        {
-            // Ignore "No such file or directory" errors (e.g., broken symlink), report others
-            if (errno != ENOENT)
-            {
-                fprintf(stderr, "krep: %s: %s\n", path_buffer, strerror(errno));
-                total_errors++;
-            }
-            continue;
-        }
+// --- Main Entry Point ---
 
-        // If the entry is a directory:
-        if (S_ISDIR(entry_stat.st_mode))
-        {
-            // Check if this directory should be skipped
-            if (should_skip_directory(entry->d_name))
-            {
-                continue; // Skip this directory
-            }
-            // Otherwise, recurse into the subdirectory
-            total_errors += search_directory_recursive(path_buffer, params, thread_count);
-        }
-        // If the entry is a regular file:
-        else if (S_ISREG(entry_stat.st_mode))
-        {
-            // Check if the file should be skipped based on extension
-            if (should_skip_extension(entry->d_name))
-            {
-                continue; // Skip this file
-            }
+// Exclude main if TESTING is defined (for linking with test harness)
+#if !defined(TESTING)
 
-            // Don't check binary files too aggressively as it might miss valid text files
-            // Only check files larger than a certain threshold
-            if (entry_stat.st_size > 1024 * 1024 && is_binary_file(path_buffer))
-            {
-                continue; // Skip this file - it's binary and large
-            }
+// --calibrate: time the kernels on the first ALGO_PROFILE_SAMPLE_SIZE bytes of the
+// target (or the -s string) and record the fastest in the profile
+static void calibrate_for_target(const search_params_t *params, bool string_mode, const char *target,
+                                 const char *profile_path)
+{
+    char cls[ALGO_PROFILE_CLASS_MAX];
+    if (force_no_simd)
+    {
+        fprintf(stderr, "krep: Warning: --calibrate is ignored with --no-simd.\n");
+        return;
+    }
+    if (!algo_profile_class(params, cls, sizeof(cls)))
+    {
+        fprintf(stderr, "krep: Warning: --calibrate only applies to a single literal pattern.\n");
+        return;
+    }
+    if (!profile_path)
+    {
+        fprintf(stderr, "krep: Warning: No profile path for --calibrate (set --profile or HOME).\n");
+        return;
+    }
 
-            // Otherwise, search the file using search_file (which handles parallelism)
-            int file_result = search_file(params, path_buffer, thread_count);
-            // If search_file returns 2, it indicates an error
-            if (file_result == 2)
-            {
-                total_errors++;
-            }
-            // Note: global_match_found_flag is set within search_file if matches are found
+    char *sample = NULL;
+    size_t len = 0;
+    if (string_mode)
+    {
+        len = strlen(target);
+        if (len > ALGO_PROFILE_SAMPLE_SIZE)
+            len = ALGO_PROFILE_SAMPLE_SIZE;
+        sample = malloc(len + 1);
+        if (sample)
+            memcpy(sample, target, len);
+    }
+    else
+    {
+        struct stat st;
+        int fd = strcmp(target, "-") == 0 ? -1 : open(target, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            fprintf(stderr, "krep: Warning: --calibrate needs a regular FILE or -s STRING to sample.\n");
+            if (fd != -1)
+                close(fd);
+            return;
         }
-        // Ignore other file types (symlinks are not followed by lstat, sockets, pipes, etc.)
+        sample = malloc(ALGO_PROFILE_SAMPLE_SIZE);
+        ssize_t got = sample ? pread(fd, sample, ALGO_PROFILE_SAMPLE_SIZE, 0) : -1;
+        len = got > 0 ? (size_t)got : 0;
+        close(fd);
+        // Only whole lines, like the chunks the search hands to the kernels
+        char *last_newline = (len == ALGO_PROFILE_SAMPLE_SIZE) ? memrchr(sample, '\n', len) : NULL;
+        if (last_newline)
+            len = (size_t)(last_newline - sample) + 1;
+    }
+    if (!sample || len == 0)
+    {
+        fprintf(stderr, "krep: Warning: Nothing to sample for --calibrate.\n");
+        free(sample);
+        return;
     }
 
-    closedir(dir);       // Close the directory stream
-    return total_errors; // Return the total count of errors encountered
+    double gbps = 0, heuristic_gbps = 0;
+    search_func_t heuristic = select_literal_algorithm(params);
+    search_func_t best = algo_profile_calibrate(params, heuristic, sample, len, &gbps, &heuristic_gbps);
+    free(sample);
+    if (!best)
+    {
+        fprintf(stderr, "krep: Warning: Calibration failed.\n");
+        return;
+    }
+    fprintf(stderr, "krep: Calibrated %s on %s: %s (%.2f GB/s; built-in choice %s %.2f GB/s)\n", cls,
+            algo_profile_cpu_model(), get_algorithm_name(best), gbps, get_algorithm_name(heuristic), heuristic_gbps);
+    if (!algo_profile_save(profile_path))
+        fprintf(stderr, "krep: Warning: Cannot write algorithm profile %s: %s\n", profile_path, strerror(errno));
 }
 
-// --- Main Entry Point ---
-
-// Exclude main if TESTING is defined (for linking with test harness)
-#if !defined(TESTING)
 int main(int argc, char *argv[])
 {
     // --- Argument Parsing State ---
@@ -3084,17 +7002,48 @@ int main(int argc, char *argv[])
     bool recursive_mode = false;             // Flag for -r (recursive directory search)
     int thread_count = DEFAULT_THREAD_COUNT; // Thread count (0 = auto)
     const char *color_when = "auto";         // Color output control ('auto', 'always', 'never')
+    bool follow_mode = false;                // Flag for --follow (tail -F style)
+    const char *index_build_dir = NULL;      // Directory for --index-build
+    bool index_mode = false;                 // Flag for --index
+    bool calibrate_mode = false;             // Flag for --calibrate
+    const char *profile_path = NULL;         // --profile=FILE, else algo_profile_default_path()
+    bool stats_mode = false;                 // Flag for --stats
+    int binary_choice = -1;                  // -I / -a, whichever came last; -1 if neither
+    ignore_rules_t *glob_rules = NULL;       // --glob overrides, compiled once parsing is done
+    long context_before_arg = -1;            // -B NUM; -1 if not given
+    long context_after_arg = -1;             // -A NUM; -1 if not given
+    long context_both_arg = -1;              // -C NUM, used where -A / -B are not given
+    bool quiet_flag = false;                 // Flag for -q (exit status only)
+    bool list_files_flag = false;            // Flag for -l (names of matching files)
+    stats_format_t stats_format = STATS_FORMAT_TEXT;
 
     // --- getopt_long Setup ---
     struct option long_options[] = {
-        {"color", optional_argument, 0, 'C'},     // --color[=WHEN]
-        {"no-simd", no_argument, 0, 'S'},         // --no-simd
-        {"help", no_argument, 0, 'h'},            // --help
-        {"version", no_argument, 0, 'v'},         // --version
-        {"fixed-strings", no_argument, 0, 'F'},   // --fixed-strings, same as default
-        {"regexp", required_argument, 0, 'e'},    // Treat -e as --regexp for consistency
-        {"max-count", required_argument, 0, 'm'}, // --max-count=NUM option
-        {0, 0, 0, 0}                              // Terminator
+        {"color", optional_argument, 0, 'U'},          // --color[=WHEN]
+        {"no-simd", no_argument, 0, 'S'},              // --no-simd
+        {"help", no_argument, 0, 'h'},                 // --help
+        {"version", no_argument, 0, 'v'},              // --version
+        {"fixed-strings", no_argument, 0, 'F'},        // --fixed-strings, same as default
+        {"regexp", required_argument, 0, 'e'},         // Treat -e as --regexp for consistency
+        {"max-count", required_argument, 0, 'm'},      // --max-count=NUM option
+        {"follow", no_argument, 0, 'L'},               // --follow, keep searching appended data
+        {"index-build", required_argument, 0, 'X'},    // --index-build DIR, write a trigram index
+        {"index", no_argument, 0, 'N'},                // --index, search through the trigram index
+        {"io", required_argument, 0, 'O'},             // --io=BACKEND, how files are read
+        {"prefetch", required_argument, 0, 'P'},       // --prefetch=POLICY, how mapped files are paged in
+        {"calibrate", no_argument, 0, 'K'},            // --calibrate, time the kernels on the input
+        {"profile", required_argument, 0, 'Y'},        // --profile=FILE, algorithm profile to use
+        {"stats", optional_argument, 0, 'T'},          // --stats[=FORMAT], phase timings and counters
+        {"text", no_argument, 0, 'a'},                 // --text, same as -a
+        {"glob", required_argument, 0, 'g'},           // --glob GLOB, same as -g
+        {"no-ignore", no_argument, 0, 'G'},            // --no-ignore, skip .gitignore / .ignore files
+        {"after-context", required_argument, 0, 'A'},  // --after-context=NUM, same as -A
+        {"before-context", required_argument, 0, 'B'}, // --before-context=NUM, same as -B
+        {"context", required_argument, 0, 'C'},        // --context=NUM, same as -C
+        {"quiet", no_argument, 0, 'q'},                // --quiet, same as -q
+        {"silent", no_argument, 0, 'q'},               // --silent, same as -q
+        {"files-with-matches", no_argument, 0, 'l'},   // --files-with-matches, same as -l
+        {0, 0, 0, 0}                                   // Terminator
     };
     int option_index = 0;
     int opt;
@@ -3103,7 +7052,7 @@ int main(int argc, char *argv[])
     params.max_count = SIZE_MAX;
 
     // --- Parse Command Line Options ---
-    while ((opt = getopt_long(argc, argv, "+e:f:icm:oEFrt:s:vhw", long_options, &option_index)) != -1)
+    while ((opt = getopt_long(argc, argv, "+e:f:icm:oEFrt:s:vhwIag:A:B:C:ql", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -3116,6 +7065,12 @@ int main(int argc, char *argv[])
         case 'o': // Only matching parts
             only_matching = true;
             break;
+        case 'q': // Quiet: exit status only
+            quiet_flag = true;
+            break;
+        case 'l': // List matching files
+            list_files_flag = true;
+            break;
         case 'm': // Max count
         {
             char *endptr = NULL;
@@ -3141,6 +7096,15 @@ int main(int argc, char *argv[])
         case 'r': // Recursive search
             recursive_mode = true;
             break;
+        case 'L': // Follow appended data
+            follow_mode = true;
+            break;
+        case 'X': // Build a trigram index
+            index_build_dir = optarg;
+            break;
+        case 'N': // Use the trigram index
+            index_mode = true;
+            break;
         case 't': // Set thread count
         {
             char *endptr = NULL;
@@ -3226,16 +7190,17 @@ int main(int argc, char *argv[])
 
         case 'v': // Version
             printf("krep v%s\n", VERSION);
-#if KREP_USE_AVX2
-            printf("SIMD: Compiled with AVX2 support.\n");
-#elif KREP_USE_SSE42
-            printf("SIMD: Compiled with SSE4.2 support.\n");
-#elif KREP_USE_NEON
-            printf("SIMD: Compiled with NEON support.\n");
-#else
-            printf("SIMD: Compiled without specific SIMD support.\n");
-#endif
-            printf("Max SIMD Pattern Length: %zu bytes\n", SIMD_MAX_PATTERN_LEN);
+            printf("SIMD kernels available on this CPU:");
+            for (const simd_kernel_t *k = simd_kernels; k->func; k++)
+            {
+                if (k->available)
+                    printf(" %s", k->name);
+            }
+            printf("%s\n", simd_max_pattern_len ? "" : " none");
+            if (simd_max_pattern_len == SIZE_MAX)
+                printf("Max SIMD Pattern Length: unlimited\n");
+            else
+                printf("Max SIMD Pattern Length: %zu bytes\n", simd_max_pattern_len);
             return 0;
         case 'h': // Help
             print_usage(argv[0]);
@@ -3256,7 +7221,27 @@ int main(int argc, char *argv[])
             }
             break;
 
-        case 'C': // --color option
+        case 'A': // Context after each matching line
+        case 'B': // Context before each matching line
+        case 'C': // Context on both sides
+        {
+            char *endptr = NULL;
+            errno = 0;
+            long val = strtol(optarg, &endptr, 10);
+            if (errno != 0 || optarg == endptr || *endptr != '\0' || val < 0)
+            {
+                fprintf(stderr, "krep: Error: Invalid context length argument '%s'\n", optarg);
+                return 2;
+            }
+            if (opt == 'A')
+                context_after_arg = val;
+            else if (opt == 'B')
+                context_before_arg = val;
+            else
+                context_both_arg = val;
+        }
+        break;
+        case 'U': // --color option
             if (optarg == NULL || strcmp(optarg, "auto") == 0)
                 color_when = "auto";
             else if (strcmp(optarg, "always") == 0)
@@ -3273,9 +7258,70 @@ int main(int argc, char *argv[])
         case 'S': // --no-simd option
             force_no_simd = true;
             break;
+        case 'P': // --prefetch=POLICY
+            if (strcmp(optarg, "auto") == 0)
+                params.prefetch = PREFETCH_AUTO;
+            else if (strcmp(optarg, "populate") == 0)
+                params.prefetch = PREFETCH_POPULATE;
+            else if (strcmp(optarg, "window") == 0)
+                params.prefetch = PREFETCH_WINDOW;
+            else if (strcmp(optarg, "none") == 0)
+                params.prefetch = PREFETCH_NONE;
+            else
+            {
+                fprintf(stderr, "krep: Error: Invalid argument for --prefetch: %s\n", optarg);
+                print_usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'I': // Skip binary files
+            binary_choice = BINARY_FILES_SKIP;
+            break;
+        case 'a': // Binary files as text
+            binary_choice = BINARY_FILES_TEXT;
+            break;
+        case 'g': // --glob GLOB
+            if (!glob_rules)
+                glob_rules = ignore_rules_new(NULL, 0);
+            if (!glob_rules || !ignore_rules_add_glob(glob_rules, optarg))
+            {
+                fprintf(stderr, "krep: Error: Invalid argument for --glob: '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'G': // --no-ignore
+            params.no_ignore = true;
+            break;
+        case 'O': // --io=BACKEND
+            if (!io_backend_parse(optarg, &params.io_backend))
+            {
+                fprintf(stderr, "krep: Error: Invalid argument for --io: %s\n", optarg);
+                print_usage(argv[0]);
+                return 2;
+            }
+            break;
         case 'w': // Whole word
             params.whole_word = true;
             break;
+        case 'K': // --calibrate
+            calibrate_mode = true;
+            break;
+        case 'Y': // --profile=FILE
+            profile_path = optarg;
+            break;
+        case 'T': // --stats[=FORMAT]
+            if (optarg == NULL || strcmp(optarg, "text") == 0)
+                stats_format = STATS_FORMAT_TEXT;
+            else if (strcmp(optarg, "json") == 0)
+                stats_format = STATS_FORMAT_JSON;
+            else
+            {
+                fprintf(stderr, "krep: Error: Invalid argument for --stats: %s\n", optarg);
+                print_usage(argv[0]);
+                return 2;
+            }
+            stats_mode = true;
+            break;
         case '?': // Unknown option or missing argument from getopt
         default:  // Should not happen
             print_usage(argv[0]);
@@ -3293,6 +7339,18 @@ int main(int argc, char *argv[])
     else                                              // "auto" (default)
         color_output_enabled = isatty(STDOUT_FILENO); // Enable only if stdout is a TTY
 
+    // --index-build takes no pattern: index DIR and exit
+    if (index_build_dir)
+    {
+        struct stat dir_stat;
+        if (stat(index_build_dir, &dir_stat) == -1 || !S_ISDIR(dir_stat.st_mode))
+        {
+            fprintf(stderr, "krep: %s: Is not a directory (required for --index-build)\n", index_build_dir);
+            return 2;
+        }
+        return build_trigram_index(index_build_dir);
+    }
+
     // Get pattern argument(s)
     if (num_patterns_found == 0)
     {                      // No patterns from -e, -f, or -s
@@ -3371,7 +7429,8 @@ int main(int argc, char *argv[])
                 return 2;
             }
             // If num_patterns_found == 0, error was already caught.
-            // If !isatty(STDIN_FILENO), target_arg is NULL (stdin).
+            // Otherwise input comes from the pipe/redirect on stdin.
+            target_arg = "-";
         }
     }
 
@@ -3390,18 +7449,85 @@ int main(int argc, char *argv[])
         print_usage(argv[0]);
         return 2;
     }
+    if (follow_mode && (string_mode || recursive_mode))
+    {
+        fprintf(stderr, "krep: Error: Option --follow requires a single FILE (not -s or -r).\n");
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    // -q and -l only need to know whether each input matches: count its lines and stop at one
+    params.quiet = quiet_flag;
+    params.files_with_matches = list_files_flag && !quiet_flag;
+    if (quiet_flag || list_files_flag)
+    {
+        count_only_flag = true;
+        only_matching = false;
+        if (params.max_count > 1)
+            params.max_count = 1;
+    }
 
     // Set final counting/tracking modes in params
     params.count_lines_mode = count_only_flag && !only_matching;  // -c only
     params.count_matches_mode = count_only_flag && only_matching; // -co (internal concept, currently unused externally)
-    // Track positions unless only counting lines (-c without -o)
-    params.track_positions = !(count_only_flag && !only_matching);
+    // Track positions only when they are printed; -c and -co just count
+    params.track_positions = !count_only_flag;
+    // Binary files are skipped under -r or with -I, searched otherwise or with -a
+    if (binary_choice >= 0)
+        params.binary_files = (binary_files_t)binary_choice;
+    else
+        params.binary_files = recursive_mode ? BINARY_FILES_SKIP : BINARY_FILES_TEXT;
+    if (glob_rules && !ignore_rules_compile(glob_rules))
+    {
+        fprintf(stderr, "krep: Error: Out of memory compiling --glob rules\n");
+        return 2;
+    }
+    params.glob_rules = glob_rules;
+    // Context lines belong to full-line output; -c and -o print none
+    if (!count_only_flag && !only_matching)
+    {
+        long before = context_before_arg >= 0 ? context_before_arg : context_both_arg;
+        long after = context_after_arg >= 0 ? context_after_arg : context_both_arg;
+        params.context_before = before > 0 ? (size_t)before : 0;
+        params.context_after = after > 0 ? (size_t)after : 0;
+    }
 
     // If counting (-c) or printing only matches (-o), disable summary
 
+    // Kernel choices measured on this CPU model by an earlier --calibrate
+    char default_profile[4096];
+    if (!profile_path)
+        profile_path = algo_profile_default_path(default_profile, sizeof(default_profile));
+    if (profile_path && !algo_profile_load(profile_path))
+        fprintf(stderr, "krep: Warning: Cannot read algorithm profile %s: %s\n", profile_path, strerror(errno));
+    if (calibrate_mode)
+        calibrate_for_target(&params, string_mode, target_arg, profile_path);
+
+    // Load the trigram index covering the target; without one every file is read in full
+    trigram_index_t *trigram_index = NULL;
+    if (index_mode && !string_mode && strcmp(target_arg, "-") != 0)
+    {
+        trigram_index = open_trigram_index_for(target_arg, recursive_mode);
+        if (!trigram_index)
+            fprintf(stderr, "krep: Warning: No usable %s found for %s; searching without it.\n",
+                    TRIGRAM_INDEX_FILENAME, target_arg);
+        params.trigram_index = trigram_index;
+    }
+
     // Initialize thread pool early with the requested thread count
     init_global_thread_pool(thread_count);
 
+    if (stats_mode)
+    {
+#ifndef KREP_NO_STATS
+        stats_start();
+#else
+        fprintf(stderr, "krep: Warning: --stats is unavailable (built with KREP_NO_STATS).\n");
+        stats_mode = false;
+        (void)stats_format;
+#endif
+    }
+
     // --- Execute Search ---
     int exit_code = 1; // Default exit code: 1 (no match found)
 
@@ -3426,7 +7552,11 @@ int main(int argc, char *argv[])
         }
         atomic_store(&global_match_found_flag, false); // Reset global flag
         int errors = search_directory_recursive(target_arg, &params, thread_count);
-        if (errors > 0)
+        if (params.quiet && atomic_load(&global_match_found_flag))
+        {
+            exit_code = 0; // -q: a match wins over errors in files searched alongside it
+        }
+        else if (errors > 0)
         {
             fprintf(stderr, "krep: Encountered %d errors during recursive search.\n", errors);
             exit_code = 2; // Exit code 2 if errors occurred
@@ -3447,11 +7577,25 @@ int main(int argc, char *argv[])
             return 2;
         }
         // Call search_file (handles stdin via target_arg == "-")
-        exit_code = search_file(&params, target_arg, thread_count);
+        if (follow_mode && strcmp(target_arg, "-") != 0)
+            exit_code = search_file_follow(&params, target_arg);
+        else
+            exit_code = search_file(&params, target_arg, thread_count);
+    }
+
+#ifndef KREP_NO_STATS
+    // Every search task has finished, so the per-thread counters are final
+    if (stats_mode)
+    {
+        fflush(stdout);
+        stats_report(stderr, stats_format);
     }
+#endif
 
     // Clean up thread pool before exiting
     cleanup_global_thread_pool();
+    trigram_index_close(trigram_index);
+    ignore_rules_release(glob_rules);
 
     // Cleanup before exit - free any memory allocated for patterns read from file
     if (num_patterns_found > 0)
@@ -3496,26 +7640,32 @@ uint64_t memchr_search(const search_params_t *params,
     size_t last_counted_line_start = SIZE_MAX;
     size_t pos = 0;
 
+    // Next occurrence of each case, SIZE_MAX until searched; the other case is only
+    // searched for -i, and each is rescanned only once pos has passed it
+    const bool both_cases = !params->case_sensitive && target_case != target;
+    size_t next_target = SIZE_MAX;
+    size_t next_other = both_cases ? SIZE_MAX : text_len;
+
     // Fast byte-by-byte scan
     while (pos < text_len)
     {
-        const char *found;
-
         // Use platform-optimized memchr
-        found = memchr(text_start + pos, target, text_len - pos);
-
-        // Handle case insensitive - we need to check both cases
-        if (!params->case_sensitive && !found && target_case != target)
+        if (next_target == SIZE_MAX || next_target < pos)
         {
-            found = memchr(text_start + pos, target_case, text_len - pos);
+            const char *found = memchr(text_start + pos, target, text_len - pos);
+            next_target = found ? (size_t)(found - text_start) : text_len;
+        }
+        if (next_other == SIZE_MAX || next_other < pos)
+        {
+            const char *found = memchr(text_start + pos, target_case, text_len - pos);
+            next_other = found ? (size_t)(found - text_start) : text_len;
         }
 
-        if (!found)
+        // Calculate absolute position of the earlier of the two
+        size_t match_pos = next_target < next_other ? next_target : next_other;
+        if (match_pos >= text_len)
             break;
 
-        // Calculate absolute position
-        size_t match_pos = found - text_start;
-
         // Match found at match_pos
         // Whole word check
         if (params->whole_word && !is_whole_word_match(text_start, text_len, match_pos, match_pos + 1))
@@ -3615,66 +7765,445 @@ uint64_t memchr_search(const search_params_t *params,
         }
     }
 
-    return current_count; // Return line count or match count
+    return current_count; // Return line count or match count
+}
+
+// --- Count-Only Kernels (-c) ---
+// A matching line is counted once, so after its first hit the scan resumes at the next
+// line. Every hit found is then on a new line: no line-start lookups, no
+// last-counted-line bookkeeping and no match storage. Nothing here allocates.
+
+// Offset just past the line holding pos (text_len on the last line)
+static inline size_t next_line_offset(const char *text, size_t text_len, size_t pos)
+{
+    const char *newline = memchr(text + pos, '\n', text_len - pos);
+    return newline ? (size_t)(newline - text) + 1 : text_len;
+}
+
+// Single byte, either case for -i. Each case's next occurrence is remembered, so
+// a rare case never rescans the text behind a common one.
+uint64_t memchr_count_lines(const search_params_t *params,
+                            const char *text_start,
+                            size_t text_len,
+                            match_result_t *result)
+{
+    (void)result;
+    if (params->max_count == 0)
+        return 0;
+
+    const unsigned char target = (unsigned char)params->pattern[0];
+    const unsigned char other = params->case_sensitive ? target : (unsigned char)(islower(target) ? toupper(target) : tolower(target));
+    uint64_t count = 0;
+    size_t pos = 0;
+    size_t next_target = SIZE_MAX;                               // SIZE_MAX: not searched yet
+    size_t next_other = (other == target) ? text_len : SIZE_MAX; // Same byte: never searched
+
+    while (pos < text_len)
+    {
+        if (next_target == SIZE_MAX || next_target < pos)
+        {
+            const char *found = memchr(text_start + pos, target, text_len - pos);
+            next_target = found ? (size_t)(found - text_start) : text_len;
+        }
+        if (next_other == SIZE_MAX || next_other < pos)
+        {
+            const char *found = memchr(text_start + pos, other, text_len - pos);
+            next_other = found ? (size_t)(found - text_start) : text_len;
+        }
+        size_t match_pos = next_target < next_other ? next_target : next_other;
+        if (match_pos >= text_len)
+            break;
+
+        if (params->whole_word && !is_whole_word_match(text_start, text_len, match_pos, match_pos + 1))
+        {
+            pos = match_pos + 1;
+            continue;
+        }
+        if (++count >= params->max_count)
+            break;
+        pos = next_line_offset(text_start, text_len, match_pos);
+    }
+    return count;
+}
+
+// Boyer-Moore-Horspool for single literals when no SIMD kernel applies
+uint64_t boyer_moore_count_lines(const search_params_t *params,
+                                 const char *text_start,
+                                 size_t text_len,
+                                 match_result_t *result)
+{
+    (void)result;
+    const unsigned char *text = (const unsigned char *)text_start;
+    const unsigned char *pattern = (const unsigned char *)params->pattern;
+    const size_t pattern_len = params->pattern_len;
+    const bool case_sensitive = params->case_sensitive;
+    if (params->max_count == 0 || pattern_len == 0 || text_len < pattern_len)
+        return 0;
+
+    int local_bad_char_table[256];
+    const int *bad_char_table = params->bad_char_table;
+    if (!bad_char_table)
+    {
+        prepare_bad_char_table(pattern, pattern_len, local_bad_char_table, case_sensitive);
+        bad_char_table = local_bad_char_table;
+    }
+    const unsigned char last = case_sensitive ? pattern[pattern_len - 1] : lower_table[pattern[pattern_len - 1]];
+
+    uint64_t count = 0;
+    size_t i = 0;
+    const size_t search_limit = text_len - pattern_len + 1;
+    while (i < search_limit)
+    {
+        unsigned char tc_last = text[i + pattern_len - 1];
+        if ((case_sensitive ? tc_last : lower_table[tc_last]) == last &&
+            (case_sensitive ? memcmp(text + i, pattern, pattern_len - 1) == 0
+                            : memory_equals_case_insensitive(text + i, pattern, pattern_len - 1)) &&
+            (!params->whole_word || is_whole_word_match(text_start, text_len, i, i + pattern_len)))
+        {
+            if (++count >= params->max_count)
+                break;
+            i = next_line_offset(text_start, text_len, i);
+            continue;
+        }
+        i += bad_char_table[tc_last];
+    }
+    return count;
+}
+
+// --- Thread Pool Implementation ---
+
+// Workers keep a deque of tasks each and steal from the inject deque (tasks submitted
+// from outside the pool) or from a random victim when their own deque is empty. Task
+// nodes come from a preallocated free list; only when it runs dry does submit malloc.
+// Idle workers and thread_pool_wait_all park on futex words; the idle-worker mutex is
+// only taken when a worker parks or is woken, never per task.
+
+#define TASK_POOL_NODES 1024      // Preallocated task nodes per pool
+#define TASK_DEQUE_INITIAL 256    // Initial ring capacity of each deque (power of two)
+#define TASK_POOL_SPIN_ROUNDS 64  // Steal attempts before an idle worker parks
+
+// Worker identity of the calling thread, so tasks submitted from a task go to its own deque
+static _Thread_local task_deque_t *pool_self_deque = NULL;
+static _Thread_local uint32_t pool_self_rng = 0;
+
+// Sleep while *word == expected (spurious wakeups allowed)
+static void pool_park(thread_pool_t *pool, atomic_uint *word, unsigned int expected)
+{
+#if defined(__linux__)
+    (void)pool;
+    syscall(SYS_futex, (unsigned int *)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&pool->park_mutex);
+    if (atomic_load(word) == expected)
+        pthread_cond_wait(&pool->park_cond, &pool->park_mutex);
+    pthread_mutex_unlock(&pool->park_mutex);
+#endif
+}
+
+static void pool_unpark(thread_pool_t *pool, atomic_uint *word, int count)
+{
+#if defined(__linux__)
+    (void)pool;
+    syscall(SYS_futex, (unsigned int *)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)count;
+    pthread_mutex_lock(&pool->park_mutex);
+    pthread_cond_broadcast(&pool->park_cond);
+    pthread_mutex_unlock(&pool->park_mutex);
+#endif
+}
+
+static task_ring_t *task_ring_new(int64_t capacity)
+{
+    task_ring_t *ring = malloc(sizeof(task_ring_t) + (size_t)capacity * sizeof(_Atomic(task_t *)));
+    if (!ring)
+        return NULL;
+    ring->mask = capacity - 1;
+    ring->retired = NULL;
+    return ring;
+}
+
+static bool task_deque_init(task_deque_t *d, thread_pool_t *pool)
+{
+    atomic_init(&d->wake, 0);
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    d->pool = pool;
+    task_ring_t *ring = task_ring_new(TASK_DEQUE_INITIAL);
+    atomic_init(&d->ring, ring);
+    return ring != NULL;
+}
+
+static void task_deque_destroy(task_deque_t *d)
+{
+    task_ring_t *ring = atomic_load_explicit(&d->ring, memory_order_relaxed);
+    while (ring)
+    {
+        task_ring_t *older = ring->retired;
+        free(ring);
+        ring = older;
+    }
+}
+
+// Owner only: push at the bottom, doubling the ring when full
+static bool task_deque_push(task_deque_t *d, task_t *task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    task_ring_t *ring = atomic_load_explicit(&d->ring, memory_order_relaxed);
+
+    if (b - t > ring->mask)
+    {
+        task_ring_t *bigger = task_ring_new((ring->mask + 1) * 2);
+        if (!bigger)
+            return false;
+        for (int64_t i = t; i < b; i++)
+        {
+            task_t *x = atomic_load_explicit(&ring->slots[i & ring->mask], memory_order_relaxed);
+            atomic_store_explicit(&bigger->slots[i & bigger->mask], x, memory_order_relaxed);
+        }
+        bigger->retired = ring;
+        atomic_store_explicit(&d->ring, bigger, memory_order_release);
+        ring = bigger;
+    }
+
+    atomic_store_explicit(&ring->slots[b & ring->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+// Owner only: take the most recently pushed task, or NULL
+static task_t *task_deque_take(task_deque_t *d)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    task_ring_t *ring = atomic_load_explicit(&d->ring, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    task_t *task = NULL;
+    if (t <= b)
+    {
+        task = atomic_load_explicit(&ring->slots[b & ring->mask], memory_order_relaxed);
+        if (t == b)
+        {
+            // Last task: race thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                         memory_order_seq_cst, memory_order_relaxed))
+                task = NULL;
+            atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        }
+    }
+    else
+    {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Any thread: steal the oldest task. NULL if empty or another thread won the race.
+static task_t *task_deque_steal(task_deque_t *d)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b)
+        return NULL;
+
+    task_ring_t *ring = atomic_load_explicit(&d->ring, memory_order_acquire);
+    task_t *task = atomic_load_explicit(&ring->slots[t & ring->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return task;
+}
+
+static bool task_deque_has_work(task_deque_t *d)
+{
+    return atomic_load_explicit(&d->top, memory_order_acquire) <
+           atomic_load_explicit(&d->bottom, memory_order_acquire);
+}
+
+// Pop a node off the free stack (tagged to avoid ABA), or malloc one
+static task_t *task_node_alloc(thread_pool_t *pool)
+{
+    uint_fast64_t head = atomic_load_explicit(&pool->free_top, memory_order_acquire);
+    while ((uint32_t)head != 0)
+    {
+        task_t *node = &pool->nodes[(uint32_t)head - 1];
+        uint_fast64_t next = atomic_load_explicit(&node->next, memory_order_relaxed);
+        uint_fast64_t replacement = ((head >> 32) + 1) << 32 | next;
+        if (atomic_compare_exchange_weak_explicit(&pool->free_top, &head, replacement,
+                                                  memory_order_acquire, memory_order_acquire))
+            return node;
+    }
+
+    task_t *node = malloc(sizeof(task_t));
+    if (node)
+        node->pooled = false;
+    return node;
 }
 
-// --- Thread Pool Implementation ---
+static void task_node_free(thread_pool_t *pool, task_t *node)
+{
+    if (!node->pooled)
+    {
+        free(node);
+        return;
+    }
+    uint_fast64_t index = (uint_fast64_t)(node - pool->nodes) + 1;
+    uint_fast64_t head = atomic_load_explicit(&pool->free_top, memory_order_relaxed);
+    do
+    {
+        atomic_store_explicit(&node->next, (uint32_t)head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_top, &head, ((head >> 32) + 1) << 32 | index,
+                                                    memory_order_release, memory_order_relaxed));
+}
 
-// Worker thread function that processes tasks from the queue
-static void *thread_pool_worker(void *arg)
+static inline uint32_t pool_next_random(void)
 {
-    thread_pool_t *pool = (thread_pool_t *)arg;
-    task_t *task;
+    // xorshift32; seeded per worker
+    uint32_t x = pool_self_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pool_self_rng = x;
+    return x;
+}
+
+// Find work for worker self: own deque, then the inject deque, then random victims
+static task_t *pool_find_task(thread_pool_t *pool, task_deque_t *self)
+{
+    task_t *task = task_deque_take(self);
+    if (task)
+        return task;
+    task = task_deque_steal(&pool->inject);
+    if (task)
+        return task;
+
+    int n = pool->num_threads;
+    int first = (int)(pool_next_random() % (uint32_t)n);
+    for (int i = 0; i < n; i++)
+    {
+        task_deque_t *victim = &pool->deques[(first + i) % n];
+        if (victim == self)
+            continue;
+        task = task_deque_steal(victim);
+        if (task)
+            return task;
+    }
+    return NULL;
+}
 
-    while (true)
+static bool pool_has_work(thread_pool_t *pool)
+{
+    if (task_deque_has_work(&pool->inject))
+        return true;
+    for (int i = 0; i < pool->num_threads; i++)
     {
-        // Lock the queue mutex to safely access the task queue
-        pthread_mutex_lock(&pool->queue_mutex);
+        if (task_deque_has_work(&pool->deques[i]))
+            return true;
+    }
+    return false;
+}
 
-        // Wait for a task or shutdown signal
-        while (pool->task_queue == NULL && !atomic_load(&pool->shutdown))
-        {
-            pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
-        }
+static void pool_run_task(thread_pool_t *pool, task_t *task)
+{
+    void *(*func)(void *) = task->func;
+    void *arg = task->arg;
+    task_node_free(pool, task);
+    func(arg);
+
+    // Last outstanding task: release thread_pool_wait_all
+    if (atomic_fetch_sub(&pool->pending, 1) == 1 && atomic_load(&pool->waiters) > 0)
+        pool_unpark(pool, &pool->pending, INT_MAX);
+}
 
-        // Check if we should shutdown
-        if (atomic_load(&pool->shutdown) && pool->task_queue == NULL)
-        {
-            pthread_mutex_unlock(&pool->queue_mutex);
-            break;
-        }
+// Wake one parked worker, handing it the searching role so that further submits
+// skip the syscall until it has looked for work
+static void pool_wake_one(thread_pool_t *pool)
+{
+    if (atomic_load(&pool->idle_count) == 0)
+        return;
+    pthread_mutex_lock(&pool->idle_mutex);
+    task_deque_t *w = NULL;
+    if (pool->idle_top > 0)
+    {
+        w = pool->idle[--pool->idle_top];
+        atomic_fetch_sub(&pool->idle_count, 1);
+        atomic_fetch_add(&pool->searching, 1);
+        atomic_store(&w->wake, 1);
+    }
+    pthread_mutex_unlock(&pool->idle_mutex);
+    if (w)
+        pool_unpark(pool, &w->wake, 1);
+}
 
-        // Get a task from the queue
-        task = pool->task_queue;
-        pool->task_queue = task->next;
-        if (pool->task_queue == NULL)
+// Take worker self off the idle stack if no one woke it yet; false if already woken
+static bool pool_cancel_idle(thread_pool_t *pool, task_deque_t *self)
+{
+    bool removed = false;
+    pthread_mutex_lock(&pool->idle_mutex);
+    for (int i = 0; i < pool->idle_top; i++)
+    {
+        if (pool->idle[i] == self)
         {
-            pool->task_queue_tail = NULL;
+            pool->idle[i] = pool->idle[--pool->idle_top];
+            atomic_fetch_sub(&pool->idle_count, 1);
+            removed = true;
+            break;
         }
+    }
+    pthread_mutex_unlock(&pool->idle_mutex);
+    return removed;
+}
 
-        // Increment the working threads counter
-        pool->working_threads++;
-
-        // Unlock the queue to allow other threads to get tasks
-        pthread_mutex_unlock(&pool->queue_mutex);
+// Worker thread: run tasks until shutdown, parking when no work can be found.
+// A worker counts as searching while it looks for work; submit skips the wakeup
+// while any worker is searching, since that worker is bound to see the new task.
+static void *thread_pool_worker(void *arg)
+{
+    task_deque_t *self = (task_deque_t *)arg;
+    thread_pool_t *pool = self->pool;
+    pool_self_deque = self;
+    pool_self_rng = 2654435761u * (uint32_t)(self - pool->deques + 1);
+    atomic_fetch_add(&pool->searching, 1);
 
-        // Execute the task
-        if (task != NULL)
-        {
-            task->func(task->arg);
-            free(task);
+    while (!atomic_load(&pool->shutdown))
+    {
+        task_t *task = NULL;
+        for (int round = 0; round < TASK_POOL_SPIN_ROUNDS && !task; round++)
+            task = pool_find_task(pool, self);
+        if (task)
+        {
+            // The last searcher to find work hands the search on if more is queued
+            if (atomic_fetch_sub(&pool->searching, 1) == 1 && pool_has_work(pool))
+                pool_wake_one(pool);
+            pool_run_task(pool, task);
+            atomic_fetch_add(&pool->searching, 1);
+            continue;
         }
 
-        // Mark thread as no longer working and signal if all work is done
-        pthread_mutex_lock(&pool->queue_mutex);
-        pool->working_threads--;
-        if (pool->working_threads == 0 && pool->task_queue == NULL)
+        // Park. Searching drops before the final check for work: a submit that saw
+        // this worker searching published its task before that check.
+        atomic_fetch_sub(&pool->searching, 1);
+        pthread_mutex_lock(&pool->idle_mutex);
+        atomic_store(&self->wake, 0);
+        pool->idle[pool->idle_top++] = self;
+        atomic_fetch_add(&pool->idle_count, 1);
+        pthread_mutex_unlock(&pool->idle_mutex);
+
+        if (pool_has_work(pool) || atomic_load(&pool->shutdown))
         {
-            pthread_cond_signal(&pool->complete_cond);
+            if (pool_cancel_idle(pool, self))
+                atomic_fetch_add(&pool->searching, 1);
+            continue; // Otherwise a waker already made this worker searching
         }
-        pthread_mutex_unlock(&pool->queue_mutex);
+        while (atomic_load(&self->wake) == 0)
+            pool_park(pool, &self->wake, 0);
     }
-
     return NULL;
 }
 
@@ -3691,70 +8220,62 @@ thread_pool_t *thread_pool_init(int num_threads)
         }
     }
 
-    thread_pool_t *pool = malloc(sizeof(thread_pool_t));
+    thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
     if (!pool)
     {
         return NULL;
     }
 
-    // Initialize pool structure
-    pool->threads = malloc(num_threads * sizeof(pthread_t));
-    if (!pool->threads)
-    {
-        free(pool);
-        return NULL;
-    }
-
     pool->num_threads = num_threads;
-    pool->task_queue = NULL;
-    pool->task_queue_tail = NULL;
-    pool->working_threads = 0;
-    atomic_init(&pool->shutdown, false);
-
-    if (pthread_mutex_init(&pool->queue_mutex, NULL) != 0)
-    {
-        free(pool->threads);
-        free(pool);
-        return NULL;
-    }
-
-    if (pthread_cond_init(&pool->queue_cond, NULL) != 0)
+    pool->threads = calloc(num_threads, sizeof(pthread_t));
+    pool->deques = calloc(num_threads, sizeof(task_deque_t));
+    pool->nodes = calloc(TASK_POOL_NODES, sizeof(task_t));
+    pool->idle = calloc(num_threads, sizeof(task_deque_t *));
+    bool ok = pool->threads && pool->deques && pool->nodes && pool->idle && task_deque_init(&pool->inject, pool);
+    for (int i = 0; ok && i < num_threads; i++)
+        ok = task_deque_init(&pool->deques[i], pool);
+    if (!ok || pthread_mutex_init(&pool->inject_mutex, NULL) != 0)
     {
-        pthread_mutex_destroy(&pool->queue_mutex);
+        free(pool->idle);
+        if (pool->deques)
+        {
+            for (int i = 0; i < num_threads; i++)
+                task_deque_destroy(&pool->deques[i]);
+        }
+        task_deque_destroy(&pool->inject);
+        free(pool->nodes);
+        free(pool->deques);
         free(pool->threads);
         free(pool);
         return NULL;
     }
+    pthread_mutex_init(&pool->idle_mutex, NULL);
+    pthread_mutex_init(&pool->park_mutex, NULL);
+    pthread_cond_init(&pool->park_cond, NULL);
 
-    if (pthread_cond_init(&pool->complete_cond, NULL) != 0)
+    // Thread every preallocated node onto the free stack
+    for (uint32_t i = 0; i < TASK_POOL_NODES; i++)
     {
-        pthread_cond_destroy(&pool->queue_cond);
-        pthread_mutex_destroy(&pool->queue_mutex);
-        free(pool->threads);
-        free(pool);
-        return NULL;
+        pool->nodes[i].pooled = true;
+        atomic_init(&pool->nodes[i].next, i + 1 < TASK_POOL_NODES ? i + 2 : 0);
     }
+    atomic_init(&pool->free_top, 1);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->idle_count, 0);
+    atomic_init(&pool->waiters, 0);
+    atomic_init(&pool->searching, 0);
+    atomic_init(&pool->shutdown, false);
 
     // Create worker threads
     for (int i = 0; i < num_threads; i++)
     {
-        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) != 0)
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, &pool->deques[i]) != 0)
         {
-            // Handle failure - stop and clean up
-            atomic_store(&pool->shutdown, true);
-            pthread_cond_broadcast(&pool->queue_cond);
-
-            // Wait for any started threads and clean up
-            for (int j = 0; j < i; j++)
-            {
-                pthread_join(pool->threads[j], NULL);
-            }
-
-            pthread_cond_destroy(&pool->complete_cond);
-            pthread_cond_destroy(&pool->queue_cond);
-            pthread_mutex_destroy(&pool->queue_mutex);
-            free(pool->threads);
-            free(pool);
+            // Handle failure - stop the threads already started and clean up
+            for (int j = i; j < num_threads; j++)
+                task_deque_destroy(&pool->deques[j]);
+            pool->num_threads = i;
+            thread_pool_destroy(pool);
             return NULL;
         }
     }
@@ -3770,36 +8291,36 @@ bool thread_pool_submit(thread_pool_t *pool, void *(*func)(void *), void *arg)
         return false;
     }
 
-    // Create a new task
-    task_t *task = malloc(sizeof(task_t));
+    task_t *task = task_node_alloc(pool);
     if (!task)
     {
         return false;
     }
-
     task->func = func;
     task->arg = arg;
-    task->next = NULL;
-
-    // Add task to queue
-    pthread_mutex_lock(&pool->queue_mutex);
 
-    if (pool->task_queue == NULL)
+    atomic_fetch_add(&pool->pending, 1);
+    bool pushed;
+    if (pool_self_deque && pool_self_deque->pool == pool)
     {
-        // Queue was empty
-        pool->task_queue = task;
-        pool->task_queue_tail = task;
+        pushed = task_deque_push(pool_self_deque, task); // Worker: own deque, no lock
     }
     else
     {
-        // Append to end of queue
-        pool->task_queue_tail->next = task;
-        pool->task_queue_tail = task;
+        pthread_mutex_lock(&pool->inject_mutex);
+        pushed = task_deque_push(&pool->inject, task);
+        pthread_mutex_unlock(&pool->inject_mutex);
+    }
+    if (!pushed)
+    {
+        atomic_fetch_sub(&pool->pending, 1);
+        task_node_free(pool, task);
+        return false;
     }
 
-    // Signal that work is available
-    pthread_cond_signal(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
+    // Wake a parked worker unless one is already searching for work
+    if (atomic_load(&pool->searching) == 0)
+        pool_wake_one(pool);
 
     return true;
 }
@@ -3812,15 +8333,21 @@ void thread_pool_wait_all(thread_pool_t *pool)
         return;
     }
 
-    pthread_mutex_lock(&pool->queue_mutex);
-
-    // Wait until the task queue is empty and all threads are idle
-    while (pool->task_queue != NULL || pool->working_threads > 0)
+    for (int spin = 0; spin < TASK_POOL_SPIN_ROUNDS; spin++)
     {
-        pthread_cond_wait(&pool->complete_cond, &pool->queue_mutex);
+        if (atomic_load(&pool->pending) == 0)
+            return;
+        sched_yield();
     }
 
-    pthread_mutex_unlock(&pool->queue_mutex);
+    unsigned int pending;
+    while ((pending = atomic_load(&pool->pending)) != 0)
+    {
+        atomic_fetch_add(&pool->waiters, 1);
+        if (atomic_load(&pool->pending) == pending)
+            pool_park(pool, &pool->pending, pending);
+        atomic_fetch_sub(&pool->waiters, 1);
+    }
 }
 
 // Destroy the thread pool
@@ -3831,13 +8358,10 @@ void thread_pool_destroy(thread_pool_t *pool)
         return;
     }
 
-    // Set the shutdown flag to true
+    // Set the shutdown flag and wake every parked worker
     atomic_store(&pool->shutdown, true);
-
-    // Wake up all worker threads
-    pthread_mutex_lock(&pool->queue_mutex);
-    pthread_cond_broadcast(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
+    while (atomic_load(&pool->idle_count) > 0)
+        pool_wake_one(pool);
 
     // Wait for all threads to finish
     for (int i = 0; i < pool->num_threads; i++)
@@ -3845,19 +8369,26 @@ void thread_pool_destroy(thread_pool_t *pool)
         pthread_join(pool->threads[i], NULL);
     }
 
-    // Clean up any remaining tasks (should be none if wait_all was called)
-    task_t *task = pool->task_queue;
-    while (task != NULL)
+    // Release nodes of tasks never run (none if wait_all was called)
+    task_t *task;
+    while ((task = task_deque_steal(&pool->inject)) != NULL)
+        task_node_free(pool, task);
+    for (int i = 0; i < pool->num_threads; i++)
     {
-        task_t *next = task->next;
-        free(task);
-        task = next;
+        while ((task = task_deque_steal(&pool->deques[i])) != NULL)
+            task_node_free(pool, task);
+        task_deque_destroy(&pool->deques[i]);
     }
+    task_deque_destroy(&pool->inject);
 
     // Clean up resources
-    pthread_cond_destroy(&pool->complete_cond);
-    pthread_cond_destroy(&pool->queue_cond);
-    pthread_mutex_destroy(&pool->queue_mutex);
+    pthread_cond_destroy(&pool->park_cond);
+    pthread_mutex_destroy(&pool->park_mutex);
+    pthread_mutex_destroy(&pool->idle_mutex);
+    pthread_mutex_destroy(&pool->inject_mutex);
+    free(pool->idle);
+    free(pool->nodes);
+    free(pool->deques);
     free(pool->threads);
     free(pool);
 }
@@ -3935,8 +8466,8 @@ uint64_t memchr_short_search(const search_params_t *params,
             // Whole word check
             if (params->whole_word && !is_whole_word_match(text_start, text_len, match_start_offset, match_start_offset + pattern_len))
             {
-                current_pos = potential_match + 1;
                 remaining_len -= (potential_match - current_pos) + 1;
+                current_pos = potential_match + 1;
                 continue;
             }
 
@@ -3974,7 +8505,8 @@ uint64_t memchr_short_search(const search_params_t *params,
             }
         }
 
-        size_t advance = (potential_match - current_pos) + (only_matching ? pattern_len : 1);
+        // -o steps over a match; a failed candidate may still start one a byte later
+        size_t advance = (potential_match - current_pos) + (full_match && only_matching ? pattern_len : 1);
         if (advance > remaining_len)
             break;
         current_pos += advance;
@@ -3984,33 +8516,138 @@ uint64_t memchr_short_search(const search_params_t *params,
     return current_count;
 }
 
-#ifdef __ARM_NEON
+#if KREP_USE_NEON
+// NEON search function
+// Handles patterns up to 16 bytes, case-sensitive or case-insensitive, with a first/last
+// byte filter over 16-byte blocks. For -i each filter byte is compared against both cases.
+// The scan resumes past each match, so matches do not overlap.
 uint64_t neon_search(const search_params_t *params,
                      const char *text_start,
                      size_t text_len,
                      match_result_t *result)
 {
-    if (params->pattern_len > 16 || !params->case_sensitive)
+    // Precondition checks
+    if (params->pattern_len == 0 || params->pattern_len > 16 || text_len < params->pattern_len)
     {
         return boyer_moore_search(params, text_start, text_len, result);
     }
+    if (params->max_count == 0 && (params->count_lines_mode || params->track_positions))
+        return 0;
+
+    uint64_t current_count = 0;
+    const size_t pattern_len = params->pattern_len;
+    const unsigned char *pattern = (const unsigned char *)params->pattern;
+    const unsigned char *text = (const unsigned char *)text_start;
+    const bool case_sensitive = params->case_sensitive;
+    const bool count_lines_mode = params->count_lines_mode;
+    const bool track_positions = params->track_positions;
+    const size_t max_count = params->max_count;
+
+    const unsigned char first = pattern[0];
+    const unsigned char last = pattern[pattern_len - 1];
+    const unsigned char first_alt = case_sensitive ? first : (unsigned char)toupper(lower_table[first]);
+    const unsigned char last_alt = case_sensitive ? last : (unsigned char)toupper(lower_table[last]);
+    const uint8x16_t first_a = vdupq_n_u8(case_sensitive ? first : lower_table[first]);
+    const uint8x16_t first_b = vdupq_n_u8(first_alt);
+    const uint8x16_t last_a = vdupq_n_u8(case_sensitive ? last : lower_table[last]);
+    const uint8x16_t last_b = vdupq_n_u8(last_alt);
+    const size_t last_start = text_len - pattern_len; // Last offset a match can start at
+
+    size_t pos = 0;
+    while (pos <= last_start)
+    {
+        // Candidate starts in this block: bit 4*i+3 is set for offset pos+i
+        uint64_t candidates = 0;
+        size_t block = last_start - pos + 1;
+        if (block >= 16)
+        {
+            block = 16;
+            uint8x16_t head = vld1q_u8(text + pos);
+            uint8x16_t tail = vld1q_u8(text + pos + pattern_len - 1);
+            uint8x16_t eq = vandq_u8(vorrq_u8(vceqq_u8(head, first_a), vceqq_u8(head, first_b)),
+                                     vorrq_u8(vceqq_u8(tail, last_a), vceqq_u8(tail, last_b)));
+            candidates = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0) &
+                         0x8888888888888888ULL;
+        }
+        else
+        {
+            // Fewer than 16 starts left: build the same mask byte by byte
+            for (size_t i = 0; i < block; i++)
+            {
+                unsigned char h = text[pos + i];
+                unsigned char t = text[pos + i + pattern_len - 1];
+                if ((h == first || h == first_alt || (!case_sensitive && lower_table[h] == lower_table[first])) &&
+                    (t == last || t == last_alt || (!case_sensitive && lower_table[t] == lower_table[last])))
+                    candidates |= 8ULL << (4 * i);
+            }
+        }
+
+        size_t next_pos = pos + block;
+        while (candidates != 0)
+        {
+            size_t match_start = pos + (size_t)(__builtin_ctzll(candidates) >> 2);
+            candidates &= candidates - 1;
+            STATS_ADD(STATS_FILTER_CANDIDATES, 1);
+
+            bool equal = case_sensitive ? memcmp(text + match_start, pattern, pattern_len) == 0
+                                        : memory_equals_case_insensitive(text + match_start, pattern, pattern_len);
+            if (!equal)
+                continue;
+            STATS_ADD(STATS_FILTER_VERIFIED, 1);
+            if (params->whole_word && !is_whole_word_match(text_start, text_len, match_start, match_start + pattern_len))
+                continue;
+
+            if (count_lines_mode)
+            {
+                // Count the line once and resume scanning on the next line
+                current_count++;
+                if (current_count >= max_count)
+                    return current_count;
+                size_t line_end = find_line_end(text_start, text_len, match_start);
+                next_pos = line_end + 1;
+                break;
+            }
+
+            current_count++;
+            if (track_positions && result && !match_result_add(result, match_start, match_start + pattern_len))
+            {
+                fprintf(stderr, "Warning: Failed to add NEON match position.\n");
+            }
+            if (current_count >= max_count)
+                return current_count;
+            next_pos = match_start + pattern_len;
+            break;
+        }
+        pos = next_pos;
+    }
 
-    return boyer_moore_search(params, text_start, text_len, result);
+    return current_count;
 }
 #endif
 
 // --- SIMD Implementations (Placeholders/Actual) ---
 
 #if KREP_USE_SSE42
+// Fold ASCII 'A'-'Z' to lower case, leaving every other byte unchanged
+KREP_TARGET("sse4.2")
+static inline __m128i sse_fold_case(__m128i v)
+{
+    __m128i rel = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i is_upper = _mm_cmpeq_epi8(_mm_min_epu8(rel, _mm_set1_epi8(25)), rel);
+    return _mm_or_si128(v, _mm_and_si128(is_upper, _mm_set1_epi8(0x20)));
+}
+
 // SSE4.2 search function using _mm_cmpestri
-// Handles case-sensitive patterns up to 16 bytes.
+// Handles patterns up to 16 bytes. For case-insensitive search both the pattern and
+// each text block are case-folded before the compare.
+KREP_TARGET("sse4.2")
 uint64_t simd_sse42_search(const search_params_t *params,
                            const char *text_start,
                            size_t text_len,
                            match_result_t *result)
 {
     // Precondition checks
-    if (params->pattern_len == 0 || params->pattern_len > 16 || !params->case_sensitive || text_len < params->pattern_len)
+    if (!cpu_has_sse42 || params->pattern_len == 0 || params->pattern_len > 16 || text_len < params->pattern_len)
     {
         // Fallback if preconditions not met
         return boyer_moore_search(params, text_start, text_len, result);
@@ -4025,9 +8662,14 @@ uint64_t simd_sse42_search(const search_params_t *params,
     bool track_positions = params->track_positions;
     size_t max_count = params->max_count;
     size_t last_counted_line_start = SIZE_MAX;
+    const bool fold_case = !params->case_sensitive;
 
     // Load the pattern into an XMM register
-    __m128i pattern_vec = _mm_loadu_si128((const __m128i *)pattern);
+    char pattern_buffer[16] = {0};
+    memcpy(pattern_buffer, pattern, pattern_len);
+    __m128i pattern_vec = _mm_loadu_si128((const __m128i *)pattern_buffer);
+    if (fold_case)
+        pattern_vec = sse_fold_case(pattern_vec);
 
     const char *current_pos = text_start;
     size_t remaining_len = text_len;
@@ -4057,6 +8699,8 @@ uint64_t simd_sse42_search(const search_params_t *params,
         {
             text_vec = _mm_loadu_si128((const __m128i *)current_pos);
         }
+        if (fold_case)
+            text_vec = sse_fold_case(text_vec);
 
         // Compare pattern against the text chunk
         // _mm_cmpestri returns the index of the first byte of the first match
@@ -4069,7 +8713,9 @@ uint64_t simd_sse42_search(const search_params_t *params,
             size_t match_start_offset = (current_pos - text_start) + index;
 
             // Fast path: skip whole word check if not needed
-            if (!params->whole_word || is_whole_word_match(text_start, text_len, match_start_offset, match_start_offset + pattern_len))
+            bool accepted = !params->whole_word ||
+                            is_whole_word_match(text_start, text_len, match_start_offset, match_start_offset + pattern_len);
+            if (accepted)
             {
                 bool count_incremented_this_match = false;
 
@@ -4118,7 +8764,7 @@ uint64_t simd_sse42_search(const search_params_t *params,
                         if (current_count <= max_count)
                         {
                             // Minimize error checking in tight loop for better performance
-                            if (result->count < result->capacity)
+                            if (result->positions && result->count < result->capacity)
                             {
                                 result->positions[result->count].start_offset = match_start_offset;
                                 result->positions[result->count].end_offset = match_start_offset + pattern_len;
@@ -4139,18 +8785,11 @@ uint64_t simd_sse42_search(const search_params_t *params,
                 }
             }
 
-            // More aggressive advancement strategy
-            // Advance to just after the match instead of just by one byte
-            size_t advance = index + 1;
-
-            // If not looking for overlapping matches, can advance by pattern length
-            if (!only_matching)
-            { // only_matching mode needs to find overlapping matches
-                advance = index + pattern_len;
-                // Ensure we don't advance too far if near end
-                if (advance > remaining_len)
-                    advance = remaining_len;
-            }
+            // Step over a match, so matches do not overlap; a candidate rejected by -w
+            // may still overlap the next match
+            size_t advance = (size_t)index + (accepted ? pattern_len : 1);
+            if (advance > remaining_len)
+                advance = remaining_len;
 
             current_pos += advance;
             remaining_len -= advance;
@@ -4176,16 +8815,18 @@ uint64_t simd_sse42_search(const search_params_t *params,
 
 #if KREP_USE_AVX2
 // AVX2 search function
-// Handles case-sensitive patterns up to 32 bytes.
+// Handles patterns up to 32 bytes. For case-insensitive search the first/last byte
+// filter compares against both cases and candidates are verified case-insensitively.
 // Uses SSE4.2 logic for patterns <= 16 bytes.
 // Uses a simplified first/last byte check for patterns > 16 bytes.
+KREP_TARGET("avx2")
 uint64_t simd_avx2_search(const search_params_t *params,
                           const char *text_start,
                           size_t text_len,
                           match_result_t *result)
 {
     // Precondition checks
-    if (params->pattern_len == 0 || params->pattern_len > 32 || !params->case_sensitive || text_len < params->pattern_len)
+    if (!cpu_has_avx2 || params->pattern_len == 0 || params->pattern_len > 32 || text_len < params->pattern_len)
     {
         return boyer_moore_search(params, text_start, text_len, result);
     }
@@ -4209,9 +8850,15 @@ uint64_t simd_avx2_search(const search_params_t *params,
     size_t max_count = params->max_count;
     size_t last_counted_line_start = SIZE_MAX;
 
-    // Create vectors for the first and last bytes of the pattern
-    __m256i first_byte_vec = _mm256_set1_epi8(pattern[0]);
-    __m256i last_byte_vec = _mm256_set1_epi8(pattern[pattern_len - 1]);
+    const bool case_sensitive = params->case_sensitive;
+
+    // Create vectors for the first and last bytes of the pattern (and their other case)
+    unsigned char first_byte = (unsigned char)pattern[0];
+    unsigned char last_byte = (unsigned char)pattern[pattern_len - 1];
+    __m256i first_byte_vec = _mm256_set1_epi8((char)(case_sensitive ? first_byte : lower_table[first_byte]));
+    __m256i last_byte_vec = _mm256_set1_epi8((char)(case_sensitive ? last_byte : lower_table[last_byte]));
+    __m256i first_alt_vec = _mm256_set1_epi8((char)toupper(lower_table[first_byte]));
+    __m256i last_alt_vec = _mm256_set1_epi8((char)toupper(lower_table[last_byte]));
 
     const char *current_pos = text_start;
     size_t remaining_len = text_len;
@@ -4234,6 +8881,8 @@ uint64_t simd_avx2_search(const search_params_t *params,
 
         // Compare first byte of pattern with text
         __m256i first_cmp = _mm256_cmpeq_epi8(first_byte_vec, text_vec);
+        if (!case_sensitive)
+            first_cmp = _mm256_or_si256(first_cmp, _mm256_cmpeq_epi8(first_alt_vec, text_vec));
 
         // Compare last byte of pattern with text shifted by pattern_len - 1
         // This requires loading potentially unaligned data for the last byte comparison
@@ -4254,6 +8903,8 @@ uint64_t simd_avx2_search(const search_params_t *params,
             text_last_byte_vec = _mm256_loadu_si256((const __m256i *)(current_pos + last_byte_offset));
         }
         __m256i last_cmp = _mm256_cmpeq_epi8(last_byte_vec, text_last_byte_vec);
+        if (!case_sensitive)
+            last_cmp = _mm256_or_si256(last_cmp, _mm256_cmpeq_epi8(last_alt_vec, text_last_byte_vec));
 
         // Combine the masks: a potential match starts where both first and last bytes match
         // Note: _mm256_and_si256 operates on the comparison results directly
@@ -4265,16 +8916,22 @@ uint64_t simd_avx2_search(const search_params_t *params,
 
         // Combine masks: potential match starts at index 'i' if bit 'i' is set in both masks.
         uint32_t potential_starts_mask = first_mask & last_mask;
+        size_t advance = 32; // Past a recorded match instead, so matches do not overlap
 
         // Iterate through potential start positions indicated by the combined mask
         while (potential_starts_mask != 0)
         {
             // Find the index of the lowest set bit (potential match start)
             int index = __builtin_ctz(potential_starts_mask); // Use compiler intrinsic for count trailing zeros
+            STATS_ADD(STATS_FILTER_CANDIDATES, 1);
 
             // Verify the full pattern match at this position
-            if (memcmp(current_pos + index, pattern, pattern_len) == 0)
+            bool equal = case_sensitive ? memcmp(current_pos + index, pattern, pattern_len) == 0
+                                        : memory_equals_case_insensitive((const unsigned char *)current_pos + index,
+                                                                         (const unsigned char *)pattern, pattern_len);
+            if (equal)
             {
+                STATS_ADD(STATS_FILTER_VERIFIED, 1);
                 // Full match confirmed
                 size_t match_start_offset = (current_pos - text_start) + index;
                 // Whole word check
@@ -4317,17 +8974,22 @@ uint64_t simd_avx2_search(const search_params_t *params,
                 {
                     goto end_avx2_search; // Exit outer loop
                 }
+                if (!count_lines_mode)
+                {
+                    advance = (size_t)index + pattern_len;
+                    break;
+                }
             }
 
             // Clear the found bit to find the next potential start
             potential_starts_mask &= potential_starts_mask - 1;
         }
 
-        // Advance position. Advance by 32 for simplicity, might miss overlaps near boundary.
-        // A safer advance would be smaller, e.g., 1 or based on last potential match.
-        // For this basic version, we advance by 32.
-        current_pos += 32;
-        remaining_len -= 32;
+        // Every start in the block was checked, unless a match moved the scan past itself
+        if (advance > remaining_len)
+            advance = remaining_len;
+        current_pos += advance;
+        remaining_len -= advance;
     }
 
     // Handle the remaining tail (less than 32 bytes) using scalar search
@@ -4355,11 +9017,8 @@ uint64_t simd_avx2_search(const search_params_t *params,
             uint64_t added_by_bm = result->count - bm_start_index;
 
             size_t tail_offset = current_pos - text_start;
-            for (uint64_t k = 0; k < added_by_bm; ++k)
-            {
-                result->positions[bm_start_index + k].start_offset += tail_offset;
-                result->positions[bm_start_index + k].end_offset += tail_offset;
-            }
+            if (added_by_bm > 0 && !match_result_shift(result, bm_start_index, tail_offset))
+                fprintf(stderr, "Warning: Failed to adjust AVX2 tail match positions.\n");
         }
         current_count += tail_count;
         // Ensure final count doesn't exceed max_count
@@ -4375,3 +9034,357 @@ end_avx2_search:
     return current_count;
 }
 #endif
+
+#if KREP_USE_AVX512
+// AVX-512BW search function
+// Handles patterns up to 64 bytes with a first/last byte filter over 64-byte blocks;
+// for case-insensitive search each filter byte is compared against both cases. Masked
+// loads never fault past the end of the text, so no scalar tail is needed. The scan
+// resumes past each match, so matches do not overlap.
+KREP_TARGET("avx512f,avx512bw")
+uint64_t simd_avx512_search(const search_params_t *params,
+                            const char *text_start,
+                            size_t text_len,
+                            match_result_t *result)
+{
+    // Precondition checks
+    if (!cpu_has_avx512bw || params->pattern_len == 0 || params->pattern_len > 64 || text_len < params->pattern_len)
+    {
+        return boyer_moore_search(params, text_start, text_len, result);
+    }
+    if (params->max_count == 0 && (params->count_lines_mode || params->track_positions))
+        return 0;
+
+    uint64_t current_count = 0;
+    const size_t pattern_len = params->pattern_len;
+    const char *pattern = params->pattern;
+    const bool count_lines_mode = params->count_lines_mode;
+    const bool track_positions = params->track_positions;
+    const size_t max_count = params->max_count;
+
+    const bool case_sensitive = params->case_sensitive;
+
+    const unsigned char first_byte = (unsigned char)pattern[0];
+    const unsigned char last_byte = (unsigned char)pattern[pattern_len - 1];
+    const __m512i first_byte_vec = _mm512_set1_epi8((char)(case_sensitive ? first_byte : lower_table[first_byte]));
+    const __m512i last_byte_vec = _mm512_set1_epi8((char)(case_sensitive ? last_byte : lower_table[last_byte]));
+    const __m512i first_alt_vec = _mm512_set1_epi8((char)toupper(lower_table[first_byte]));
+    const __m512i last_alt_vec = _mm512_set1_epi8((char)toupper(lower_table[last_byte]));
+    const size_t last_start = text_len - pattern_len; // Last offset a match can start at
+
+    size_t pos = 0;
+    while (pos <= last_start)
+    {
+        size_t starts = last_start - pos + 1; // Candidate start offsets left
+        __mmask64 load_mask = starts >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << starts) - 1);
+
+        __m512i head = _mm512_maskz_loadu_epi8(load_mask, text_start + pos);
+        __m512i tail = _mm512_maskz_loadu_epi8(load_mask, text_start + pos + pattern_len - 1);
+        uint64_t first_hits = _mm512_mask_cmpeq_epi8_mask(load_mask, head, first_byte_vec);
+        uint64_t last_hits = _mm512_mask_cmpeq_epi8_mask(load_mask, tail, last_byte_vec);
+        if (!case_sensitive)
+        {
+            first_hits |= _mm512_mask_cmpeq_epi8_mask(load_mask, head, first_alt_vec);
+            last_hits |= _mm512_mask_cmpeq_epi8_mask(load_mask, tail, last_alt_vec);
+        }
+        uint64_t candidates = first_hits & last_hits;
+
+        size_t next_pos = pos + 64;
+        while (candidates != 0)
+        {
+            size_t match_start = pos + (size_t)__builtin_ctzll(candidates);
+            candidates &= candidates - 1;
+            STATS_ADD(STATS_FILTER_CANDIDATES, 1);
+
+            bool equal = case_sensitive ? memcmp(text_start + match_start, pattern, pattern_len) == 0
+                                        : memory_equals_case_insensitive((const unsigned char *)text_start + match_start,
+                                                                         (const unsigned char *)pattern, pattern_len);
+            if (!equal)
+                continue;
+            STATS_ADD(STATS_FILTER_VERIFIED, 1);
+            if (params->whole_word && !is_whole_word_match(text_start, text_len, match_start, match_start + pattern_len))
+                continue;
+
+            if (count_lines_mode)
+            {
+                // Count the line once and resume scanning on the next line
+                current_count++;
+                if (current_count >= max_count)
+                    return current_count;
+                size_t line_end = find_line_end(text_start, text_len, match_start);
+                next_pos = line_end + 1;
+                break;
+            }
+
+            current_count++;
+            if (track_positions && result && !match_result_add(result, match_start, match_start + pattern_len))
+            {
+                fprintf(stderr, "Warning: Failed to add AVX-512 match position.\n");
+            }
+            if (current_count >= max_count)
+                return current_count;
+            next_pos = match_start + pattern_len;
+            break;
+        }
+        pos = next_pos;
+    }
+
+    return current_count;
+}
+#endif
+
+#if KREP_USE_AVX2 || KREP_USE_NEON
+// --- Rare-byte anchor search ---
+// Works for any pattern length: the two pattern offsets holding the rarest bytes (by
+// byte_frequency) are compared across a vector of candidate starts at once, and only
+// starts where both anchors match are verified with a full compare. Choosing rare
+// anchors keeps false candidates low even where first/last byte filters degrade, e.g.
+// for patterns that start with a space or end in a common letter.
+
+typedef struct
+{
+    const search_params_t *params;
+    const char *text;
+    size_t text_len;
+    match_result_t *result;
+    uint64_t count;
+    size_t off1, off2;        // Anchor offsets inside the pattern
+    unsigned char b1, b1_alt; // First anchor byte and its other case (equal if case-sensitive)
+    unsigned char b2, b2_alt; // Second anchor byte and its other case
+} anchor_search_t;
+
+enum
+{
+    ANCHOR_NEXT,   // Keep checking candidates
+    ANCHOR_RESUME, // Match recorded; resume at *next_pos (the next line for -c, past the match otherwise)
+    ANCHOR_STOP    // max_count reached
+};
+
+static void anchor_choose(anchor_search_t *a)
+{
+    const unsigned char *pattern = (const unsigned char *)a->params->pattern;
+    const size_t pattern_len = a->params->pattern_len;
+    const bool case_sensitive = a->params->case_sensitive;
+    unsigned int best[2] = {UINT_MAX, UINT_MAX};
+    size_t best_off[2] = {0, pattern_len - 1};
+
+    for (size_t i = 0; i < pattern_len; i++)
+    {
+        unsigned char c = pattern[i];
+        unsigned int freq = byte_frequency[c];
+        if (!case_sensitive)
+        {
+            // Both cases match, so the anchor is as common as the commoner case
+            unsigned int other = byte_frequency[(unsigned char)toupper(lower_table[c])];
+            unsigned int lower = byte_frequency[lower_table[c]];
+            freq = other > lower ? other : lower;
+        }
+        if (freq < best[0])
+        {
+            best[1] = best[0];
+            best_off[1] = best_off[0];
+            best[0] = freq;
+            best_off[0] = i;
+        }
+        else if (freq < best[1])
+        {
+            best[1] = freq;
+            best_off[1] = i;
+        }
+    }
+    if (best_off[0] == best_off[1]) // Only reachable when pattern_len < 2
+        best_off[1] = pattern_len - 1;
+
+    a->off1 = best_off[0];
+    a->off2 = best_off[1];
+    unsigned char c1 = pattern[a->off1];
+    unsigned char c2 = pattern[a->off2];
+    a->b1 = case_sensitive ? c1 : lower_table[c1];
+    a->b1_alt = case_sensitive ? c1 : (unsigned char)toupper(lower_table[c1]);
+    a->b2 = case_sensitive ? c2 : lower_table[c2];
+    a->b2_alt = case_sensitive ? c2 : (unsigned char)toupper(lower_table[c2]);
+}
+
+// Verify a candidate start and record it
+static inline int anchor_candidate(anchor_search_t *a, size_t start, size_t *next_pos)
+{
+    const search_params_t *params = a->params;
+    const size_t pattern_len = params->pattern_len;
+    STATS_ADD(STATS_FILTER_CANDIDATES, 1);
+
+    bool equal = params->case_sensitive
+                     ? memcmp(a->text + start, params->pattern, pattern_len) == 0
+                     : memory_equals_case_insensitive((const unsigned char *)a->text + start,
+                                                      (const unsigned char *)params->pattern, pattern_len);
+    if (!equal)
+        return ANCHOR_NEXT;
+    STATS_ADD(STATS_FILTER_VERIFIED, 1);
+    if (params->whole_word && !is_whole_word_match(a->text, a->text_len, start, start + pattern_len))
+        return ANCHOR_NEXT;
+
+    a->count++;
+    if (params->count_lines_mode)
+    {
+        // Count the line once and resume scanning on the next line
+        if (a->count >= params->max_count)
+            return ANCHOR_STOP;
+        *next_pos = find_line_end(a->text, a->text_len, start) + 1;
+        return ANCHOR_RESUME;
+    }
+    if (params->track_positions && a->result && !match_result_add(a->result, start, start + pattern_len))
+    {
+        fprintf(stderr, "Warning: Failed to add anchor match position.\n");
+    }
+    if (a->count >= params->max_count)
+        return ANCHOR_STOP;
+    // Matches do not overlap, as with the scalar searchers
+    *next_pos = start + pattern_len;
+    return ANCHOR_RESUME;
+}
+
+// Scalar scan of candidate starts [pos, last_start]; returns where it stopped, SIZE_MAX on max_count
+static size_t anchor_scan_scalar(anchor_search_t *a, size_t pos, size_t last_start)
+{
+    const unsigned char *text = (const unsigned char *)a->text;
+    while (pos <= last_start)
+    {
+        unsigned char c1 = text[pos + a->off1];
+        unsigned char c2 = text[pos + a->off2];
+        size_t next_pos = pos + 1;
+        if ((c1 == a->b1 || c1 == a->b1_alt) && (c2 == a->b2 || c2 == a->b2_alt) &&
+            anchor_candidate(a, pos, &next_pos) == ANCHOR_STOP)
+            return SIZE_MAX;
+        pos = next_pos;
+    }
+    return pos;
+}
+
+#if KREP_USE_AVX2
+KREP_TARGET("avx2")
+static size_t anchor_scan_avx2(anchor_search_t *a, size_t pos, size_t last_start)
+{
+    const unsigned char *text = (const unsigned char *)a->text;
+    const __m256i v1 = _mm256_set1_epi8((char)a->b1), v1_alt = _mm256_set1_epi8((char)a->b1_alt);
+    const __m256i v2 = _mm256_set1_epi8((char)a->b2), v2_alt = _mm256_set1_epi8((char)a->b2_alt);
+
+    // Anchor offsets are below pattern_len, so a full block never reads past the text
+    while (pos <= last_start && last_start - pos >= 31)
+    {
+        __m256i h1 = _mm256_loadu_si256((const __m256i *)(text + pos + a->off1));
+        __m256i h2 = _mm256_loadu_si256((const __m256i *)(text + pos + a->off2));
+        __m256i hit = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(h1, v1), _mm256_cmpeq_epi8(h1, v1_alt)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(h2, v2), _mm256_cmpeq_epi8(h2, v2_alt)));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+
+        size_t next_pos = pos + 32;
+        while (mask != 0)
+        {
+            size_t start = pos + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            int status = anchor_candidate(a, start, &next_pos);
+            if (status == ANCHOR_STOP)
+                return SIZE_MAX;
+            if (status == ANCHOR_RESUME)
+                break;
+        }
+        pos = next_pos;
+    }
+    return pos;
+}
+
+KREP_TARGET("sse2")
+static size_t anchor_scan_sse2(anchor_search_t *a, size_t pos, size_t last_start)
+{
+    const unsigned char *text = (const unsigned char *)a->text;
+    const __m128i v1 = _mm_set1_epi8((char)a->b1), v1_alt = _mm_set1_epi8((char)a->b1_alt);
+    const __m128i v2 = _mm_set1_epi8((char)a->b2), v2_alt = _mm_set1_epi8((char)a->b2_alt);
+
+    while (pos <= last_start && last_start - pos >= 15)
+    {
+        __m128i h1 = _mm_loadu_si128((const __m128i *)(text + pos + a->off1));
+        __m128i h2 = _mm_loadu_si128((const __m128i *)(text + pos + a->off2));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(h1, v1), _mm_cmpeq_epi8(h1, v1_alt)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(h2, v2), _mm_cmpeq_epi8(h2, v2_alt)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hit);
+
+        size_t next_pos = pos + 16;
+        while (mask != 0)
+        {
+            size_t start = pos + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            int status = anchor_candidate(a, start, &next_pos);
+            if (status == ANCHOR_STOP)
+                return SIZE_MAX;
+            if (status == ANCHOR_RESUME)
+                break;
+        }
+        pos = next_pos;
+    }
+    return pos;
+}
+#elif KREP_USE_NEON
+static size_t anchor_scan_neon(anchor_search_t *a, size_t pos, size_t last_start)
+{
+    const unsigned char *text = (const unsigned char *)a->text;
+    const uint8x16_t v1 = vdupq_n_u8(a->b1), v1_alt = vdupq_n_u8(a->b1_alt);
+    const uint8x16_t v2 = vdupq_n_u8(a->b2), v2_alt = vdupq_n_u8(a->b2_alt);
+
+    while (pos <= last_start && last_start - pos >= 15)
+    {
+        uint8x16_t h1 = vld1q_u8(text + pos + a->off1);
+        uint8x16_t h2 = vld1q_u8(text + pos + a->off2);
+        uint8x16_t hit = vandq_u8(vorrq_u8(vceqq_u8(h1, v1), vceqq_u8(h1, v1_alt)),
+                                  vorrq_u8(vceqq_u8(h2, v2), vceqq_u8(h2, v2_alt)));
+        // Narrow to 4 bits per byte; bit 4*i+3 marks a candidate at pos+i
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0) &
+                        0x8888888888888888ULL;
+
+        size_t next_pos = pos + 16;
+        while (mask != 0)
+        {
+            size_t start = pos + (size_t)(__builtin_ctzll(mask) >> 2);
+            mask &= mask - 1;
+            int status = anchor_candidate(a, start, &next_pos);
+            if (status == ANCHOR_STOP)
+                return SIZE_MAX;
+            if (status == ANCHOR_RESUME)
+                break;
+        }
+        pos = next_pos;
+    }
+    return pos;
+}
+#endif
+
+uint64_t simd_anchor_search(const search_params_t *params,
+                            const char *text_start,
+                            size_t text_len,
+                            match_result_t *result)
+{
+    // Precondition checks
+    if (params->pattern_len < 2 || text_len < params->pattern_len)
+    {
+        return boyer_moore_search(params, text_start, text_len, result);
+    }
+    if (params->max_count == 0 && (params->count_lines_mode || params->track_positions))
+        return 0;
+
+    anchor_search_t a = {.params = params, .text = text_start, .text_len = text_len, .result = result};
+    anchor_choose(&a);
+
+    const size_t last_start = text_len - params->pattern_len;
+    size_t pos = 0;
+#if KREP_USE_AVX2
+    if (cpu_has_avx2)
+        pos = anchor_scan_avx2(&a, pos, last_start);
+    else if (cpu_has_sse2)
+        pos = anchor_scan_sse2(&a, pos, last_start);
+#elif KREP_USE_NEON
+    pos = anchor_scan_neon(&a, pos, last_start);
+#endif
+    if (pos != SIZE_MAX)
+        anchor_scan_scalar(&a, pos, last_start);
+
+    return a.count;
+}
+#endif
@@ -15,6 +15,8 @@
 #include <stdatomic.h> // For atomic types used in structs
 #include <ctype.h>     // For isalnum function
 
+#include "io_reader.h" // For io_backend_t
+
 // --- Global Variables (declared extern) ---
 extern unsigned char lower_table[256];
 
@@ -22,6 +24,18 @@ extern unsigned char lower_table[256];
 struct ac_trie;
 typedef struct ac_trie ac_trie_t;
 
+// Forward declaration for the lazy DFA regex matcher (regex_dfa.h)
+struct regex_dfa;
+typedef struct regex_dfa regex_dfa_t;
+
+// Forward declaration for the persistent trigram index (trigram_index.h)
+struct trigram_index;
+typedef struct trigram_index trigram_index_t;
+
+// Forward declaration for compiled ignore rules and --glob overrides (ignore.h)
+struct ignore_rules;
+typedef struct ignore_rules ignore_rules_t;
+
 /* --- Compiler-specific macros --- */
 #ifdef __GNUC__
 #define KREP_UNUSED __attribute__((unused))
@@ -29,6 +43,29 @@ typedef struct ac_trie ac_trie_t;
 #define KREP_UNUSED
 #endif
 
+/* --- SIMD kernels built into the binary ---
+ * On x86 every kernel is compiled with its own target attribute and the best one the
+ * running CPU supports is picked at startup, so no -m flags are needed. NEON is part of
+ * the aarch64 baseline and stays a compile-time choice.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KREP_USE_SSE42 1
+#define KREP_USE_AVX2 1
+#define KREP_USE_AVX512 1
+#define KREP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KREP_USE_SSE42 0
+#define KREP_USE_AVX2 0
+#define KREP_USE_AVX512 0
+#define KREP_TARGET(isa)
+#endif
+
+#if defined(__ARM_NEON)
+#define KREP_USE_NEON 1
+#else
+#define KREP_USE_NEON 0
+#endif
+
 /* --- ANSI Color Codes --- */
 // Define colors consistently
 #define KREP_COLOR_RESET "\033[0m"
@@ -37,6 +74,29 @@ typedef struct ac_trie ac_trie_t;
 #define KREP_COLOR_MATCH "\033[1;31m"     // Bright Red
 #define KREP_COLOR_TEXT "\033[0m"         // Default terminal text color
 
+/* --- Prefetch Policy for Mapped Files --- */
+typedef enum
+{
+   PREFETCH_AUTO = 0, // POPULATE below PREFETCH_WINDOW_MIN_FILE_SIZE (NONE with -m, -q, -l), WINDOW from there on
+   PREFETCH_POPULATE, // Fault the whole file in up front (MAP_POPULATE / MADV_POPULATE_READ)
+   PREFETCH_WINDOW,   // Per chunk: MADV_WILLNEED one window ahead, drop searched windows from the page cache
+   PREFETCH_NONE      // Demand paging with kernel readahead only
+} prefetch_policy_t;
+
+/* --- Binary File Handling --- */
+typedef enum
+{
+   BINARY_FILES_TEXT = 0, // Search binary files like text (-a; files named on the command line)
+   BINARY_FILES_SKIP      // Treat binary files as not matching, before any search work (-I; -r)
+} binary_files_t;
+
+#define BINARY_CHECK_BUFFER_SIZE 4096 // Leading bytes checked for a NUL (one page of the mapping)
+
+#define PREFETCH_WINDOW_SIZE (8 * 1024 * 1024)                  // Default bytes per prefetch window
+#define PREFETCH_WINDOW_MIN_FILE_SIZE (1024ULL * 1024 * 1024)   // Auto policy switches to WINDOW here
+#define PREFETCH_HUGEPAGE_MIN_FILE_SIZE (32 * 1024 * 1024)      // Smallest mapping given MADV_HUGEPAGE
+#define PREFETCH_HUGEPAGE_SIZE (2 * 1024 * 1024)                // PMD size mappings are aligned to
+
 /* --- Match tracking structure --- */
 // Define match_position_t BEFORE match_result_t
 typedef struct
@@ -45,11 +105,18 @@ typedef struct
    size_t end_offset;   // Ending position of the match (exclusive)
 } match_position_t;
 
+// Results come in two forms. The full form stores a match_position_t per match. The
+// compact form, for patterns whose matches all have one length, stores only a 32-bit
+// start per match (4 bytes instead of 16) and implies the end; a result converts itself
+// to the full form when a match does not fit. Read either with match_result_start/end.
 typedef struct match_result_t // Add the struct tag here
 {
-   match_position_t *positions; // Dynamically resizing array of match positions
+   match_position_t *positions; // Dynamically resizing array of match positions (NULL when compact)
    uint64_t count;              // Number of matches found and stored
-   uint64_t capacity;           // Current allocated capacity of the positions array
+   uint64_t capacity;           // Current allocated capacity of the positions (or starts) array
+   struct arena *arena;         // Arena holding the struct and positions; NULL if malloc'd
+   uint32_t *starts;            // Compact form: start offsets; NULL in the full form
+   size_t match_len;            // Compact form: length of every match
 } match_result_t;               // Typedef remains the same
 
 /* --- Structures for Multithreading --- */
@@ -78,12 +145,51 @@ typedef struct search_params
    // Compiled regex (if applicable, compiled once per file/string)
    const regex_t *compiled_regex;
 
+   // Lazy DFA for the same regex, NULL when the pattern needs POSIX regexec
+   regex_dfa_t *regex_dfa;
+
    // Compiled Aho-Corasick trie (if applicable)
    ac_trie_t *ac_trie; // Add pointer for pre-built trie
 
+   // Tables precomputed by krep_compile() for the single literal pattern, or NULL
+   const int *bad_char_table; // Boyer-Moore-Horspool shift table (256 entries)
+   const int *kmp_lps;        // KMP longest-proper-prefix array (pattern_len entries)
+
    // Max count limit from options
    size_t max_count;
 
+   // Trigram index from --index; files it covers are searched block by block
+   const trigram_index_t *trigram_index;
+
+   // How files are read (--io); IO_BACKEND_AUTO picks mmap or async reads per file
+   io_backend_t io_backend;
+
+   // How mapped files are paged in (--prefetch), and the window size (0 = PREFETCH_WINDOW_SIZE)
+   prefetch_policy_t prefetch;
+   size_t prefetch_window;
+
+   // What to do with files whose first block holds a NUL byte (-I / -a)
+   binary_files_t binary_files;
+
+   // Recursive search filters: --glob overrides (NULL when none), and --no-ignore,
+   // which stops .gitignore and .ignore files from being read
+   const ignore_rules_t *glob_rules;
+   bool no_ignore;
+
+   // Context lines printed before / after each matching line (-B / -A; -C sets both).
+   // Used by the full-line output only.
+   size_t context_before;
+   size_t context_after;
+
+   // Only whether a file matches is wanted: -l prints its name, -q prints nothing.
+   // Both search in count mode with max_count 1 and stop at the first match.
+   bool files_with_matches;
+   bool quiet;
+
+   // More lines follow the searched text (a chunk or window other than the file's last).
+   // The regex searchers then leave an empty match at the text's end to the next one.
+   bool text_continues;
+
 } search_params_t;
 
 /* --- Function Pointer Type for Search Algorithms --- */
@@ -93,6 +199,52 @@ typedef uint64_t (*search_func_t)(const search_params_t *params,
                                   size_t text_len,
                                   match_result_t *result);
 
+/* --- Newline Index --- */
+#define NEWLINE_INDEX_BLOCK_SIZE 4096 // Bytes summarized by each index entry
+
+// Cumulative newline counts per fixed-size block of a text. Line numbers and line
+// starts come from one table lookup (or binary search) plus a SIMD count or scan
+// over at most one block. 2 bytes of index per KiB of text.
+typedef struct
+{
+   const char *text;
+   size_t text_len;
+   size_t num_blocks;
+   uint64_t *newlines_before; // newlines_before[b] = newlines in text[0, b * BLOCK_SIZE); num_blocks + 1 entries
+} newline_index_t;
+
+/* --- Context Lines --- */
+// Printer state for -A/-B/-C, carried across the calls that print consecutive pieces
+// of one input (chunks, stream windows, index regions). Context may reach outside the
+// piece into [floor, limit), which the caller keeps readable.
+typedef struct
+{
+   const char *floor; // First byte not printed yet; before-context stops here
+   const char *limit; // After-context stops here (the next piece's first match line, or end of input)
+   size_t after_left; // After-context lines still owed to the last matching line
+   bool printed;      // A group was printed before, so the next one after a gap gets "--"
+   bool new_input;    // The group before was another input's, so the next one gets "--" anyway
+   bool gap_below;    // Lines right below floor were dropped unprinted (stream windows), so a
+                      // group starting at floor still follows a gap
+} print_context_t;
+
+/* --- Early Termination --- */
+// Blocks a chunk worker searches between checks of the search budget
+#define SEARCH_BUDGET_BLOCK_SIZE (1024 * 1024)
+
+// Shared by the chunk workers of one file search. Each worker publishes its count after
+// every block and stops once the file's result is known: max_count found anywhere when
+// only the count matters (-c, -q, -l), or by the chunks before its own when lines are
+// printed (-m keeps the first max_count lines, which those chunks hold).
+typedef struct
+{
+   atomic_bool done;            // Set once the whole file's result is known
+   bool counts_only;            // Counts are summed and capped; no positions are kept
+   size_t max_count;            // -m limit (1 for -q / -l)
+   int num_chunks;              // Entries in found
+   atomic_uint_fast64_t *found; // Per chunk: lines or matches counted so far
+} search_budget_t;
+
 // Data passed to each search thread
 typedef struct
 {
@@ -100,11 +252,33 @@ typedef struct
    const search_params_t *params; // Pointer to shared search parameters
    const char *chunk_start;       // Pointer to the start of the memory chunk for this thread
    size_t chunk_len;              // Length of the chunk to process (may include overlap)
+   bool text_continues;           // Later chunks hold more of the file (all but the last)
    search_func_t search_algo;     // Pre-selected search algorithm for this chunk
 
    // Thread-specific results
    match_result_t *local_result; // For position tracking (default/-o)
    uint64_t count_result;        // For line counting (-c) or match counting (-co)
+   struct arena *arena;          // Chunk's arena for local_result and output (NULL: malloc)
+
+   // Per-chunk output: each chunk formats its own matches, written out in chunk order
+   bool index_newlines;        // Count/index the chunk's newlines (needed for -o line numbers)
+   size_t newline_count;       // Newlines in the chunk
+   newline_index_t line_index; // Newline index of the chunk (built when it has matches)
+   const char *filename;       // Filename prefix for formatted lines
+   size_t first_line_number;   // Line number of the chunk's first line
+   print_context_t context;    // Context printing state planned for the chunk (-A/-B/-C)
+   char *output;               // Formatted output
+   size_t output_len;          // Length of formatted output
+   size_t output_capacity;     // Allocated size of output
+
+   // Early termination shared with the file's other chunks (NULL: search it all)
+   search_budget_t *budget;
+
+   // Sliding-window prefetch (PREFETCH_WINDOW)
+   size_t prefetch_window; // Bytes searched per window; 0 searches the chunk in one call
+   bool drop_behind;       // Release each window's pages once it has been searched
+   const char *file_base;  // Start of the mapping, for file offsets
+   int file_fd;            // Descriptor for POSIX_FADV_DONTNEED, -1 if none
 
    // Status flags
    bool error_flag; // Flag to indicate an error occurred in the thread
@@ -113,22 +287,53 @@ typedef struct
 /* --- Thread Pool Implementation --- */
 typedef struct task
 {
-   void *(*func)(void *); // Task function
-   void *arg;             // Function argument
-   struct task *next;     // Next task in queue
+   void *(*func)(void *);     // Task function
+   void *arg;                 // Function argument
+   atomic_uint_fast32_t next; // Next free node index + 1 (node pool free list)
+   bool pooled;               // Node lives in the preallocated node pool
 } task_t;
 
+// Growable ring of task pointers backing a deque; replaced rings stay allocated
+// until the pool is destroyed because a thief may still be reading them
+typedef struct task_ring
+{
+   int64_t mask;              // Capacity - 1 (capacity is a power of two)
+   struct task_ring *retired; // Previous (smaller) ring
+   _Atomic(task_t *) slots[]; // Task pointers
+} task_ring_t;
+
+struct thread_pool;
+
+// Chase-Lev work-stealing deque: the owner pushes and takes at the bottom,
+// other threads steal from the top without locks
 typedef struct
 {
-   pthread_t *threads;           // Array of worker threads
-   int num_threads;              // Number of worker threads
-   task_t *task_queue;           // Task queue head
-   task_t *task_queue_tail;      // Task queue tail for faster enqueue
-   pthread_mutex_t queue_mutex;  // Mutex for task queue access
-   pthread_cond_t queue_cond;    // Condition variable for task availability
-   pthread_cond_t complete_cond; // Condition variable for task completion
-   size_t working_threads;       // Counter for busy threads
-   atomic_bool shutdown;         // Shutdown flag
+   _Alignas(64) atomic_int_fast64_t top;
+   _Alignas(64) atomic_int_fast64_t bottom;
+   _Atomic(task_ring_t *) ring;
+   struct thread_pool *pool; // Owning pool (handed to the worker thread)
+   atomic_uint wake;         // Set when the owning worker is woken (futex word)
+} task_deque_t;
+
+typedef struct thread_pool
+{
+   pthread_t *threads;            // Array of worker threads
+   int num_threads;               // Number of worker threads
+   task_deque_t *deques;          // One deque per worker
+   task_deque_t inject;           // Tasks submitted from outside the pool
+   pthread_mutex_t inject_mutex;  // Serializes pushes onto the inject deque
+   task_t *nodes;                 // Preallocated task nodes
+   atomic_uint_fast64_t free_top; // Free node stack: ABA tag << 32 | index + 1
+   atomic_uint pending;           // Submitted tasks not yet finished (futex word)
+   atomic_int searching;          // Workers awake and looking for a task
+   task_deque_t **idle;           // Parked workers (stack)
+   int idle_top;                  // Entries in idle, under idle_mutex
+   atomic_int idle_count;         // Mirror of idle_top readable without the lock
+   pthread_mutex_t idle_mutex;    // Protects idle / idle_top
+   atomic_int waiters;            // Threads parked in thread_pool_wait_all
+   pthread_mutex_t park_mutex;    // Parking fallback where futexes are unavailable
+   pthread_cond_t park_cond;
+   atomic_bool shutdown;          // Shutdown flag
 } thread_pool_t;
 
 /* --- Thread Pool API --- */
@@ -158,6 +363,106 @@ int search_file(const search_params_t *params, const char *filename, int request
  */
 int search_string(const search_params_t *params, const char *text);
 
+/**
+ * @brief Searches a stream (pipe, socket, terminal) in fixed-size blocks.
+ *
+ * Memory use is bounded by a small block ring plus the longest line, and results
+ * are printed as each block is searched rather than at end of input.
+ *
+ * @param params Search parameters including patterns and options.
+ * @param fd Readable file descriptor; it is not closed.
+ * @param filename Prefix for output lines, or NULL for none (stdin).
+ * @return 0 if matches found, 1 if no matches found, 2 on error.
+ */
+int search_stream(const search_params_t *params, int fd, const char *filename);
+
+/**
+ * @brief Searches a file and keeps following it as it grows (like `tail -F`).
+ *
+ * Only newly appended bytes are searched after the initial pass. Rotation (the path
+ * names a new file) and truncation are detected and handled. Returns only on error
+ * or once max_count matching lines have been printed.
+ *
+ * @param params Search parameters including patterns and options (-c is not supported).
+ * @param filename Path of the file to follow.
+ * @return 0 if matches found, 1 if no matches found, 2 on error.
+ */
+int search_file_follow(const search_params_t *params, const char *filename);
+
+/* --- Compiled Matcher --- */
+
+// Patterns prepared once for repeated searches of many small buffers (opaque)
+typedef struct krep_matcher krep_matcher_t;
+
+/**
+ * @brief Prepares params for repeated krep_match() calls.
+ *
+ * Builds the trie, regex and DFA, or the shift tables of a single literal, and selects
+ * the search algorithm once. The patterns are copied, so params need not outlive the
+ * matcher. The matcher is read-only afterwards and may be shared between threads.
+ *
+ * @param params Search parameters including patterns and options.
+ * @return The matcher, or NULL (with a message on stderr) if the patterns are invalid.
+ */
+krep_matcher_t *krep_compile(const search_params_t *params);
+
+/**
+ * @brief Searches a buffer with a compiled matcher. Nothing is printed.
+ *
+ * @param matcher Matcher from krep_compile().
+ * @param text Buffer to search; it need not be NUL-terminated.
+ * @param text_len Length of the buffer.
+ * @param result Receives match positions when the matcher tracks positions; may be NULL
+ *               to only count. Positions are appended, so reset result->count to reuse it.
+ *               It may be full or compact (match_result_init_compact); iterate it with
+ *               match_result_start/end.
+ * @return Number of matching lines (-c) or matches, capped at max_count.
+ */
+uint64_t krep_match(const krep_matcher_t *matcher, const char *text, size_t text_len, match_result_t *result);
+
+// Name of the search algorithm the matcher selected
+const char *krep_matcher_algorithm(const krep_matcher_t *matcher);
+
+// Release a matcher (NULL is ignored)
+void krep_matcher_free(krep_matcher_t *matcher);
+
+// One buffer of a batch search
+typedef struct
+{
+   const char *ptr;
+   size_t len;
+} krep_span_t;
+
+/**
+ * @brief Searches many small buffers with one matcher in a single call.
+ *
+ * Each span is searched on its own, exactly as krep_match() would. Batches larger than
+ * a few hundred KB are split across the thread pool.
+ *
+ * @param matcher Matcher from krep_compile().
+ * @param spans Buffers to search.
+ * @param num_spans Number of spans.
+ * @param counts Receives krep_match()'s count for each span (num_spans entries).
+ * @param first_match With matches, receives num_spans + 1 indexes into matches->positions:
+ *                    the positions of span i are [first_match[i], first_match[i + 1]).
+ * @param matches Flat arena the positions are appended to, relative to the start of
+ *                their span; NULL to only count.
+ * @param thread_count Threads to use (0 for one per core).
+ * @return false on allocation failure or invalid arguments.
+ */
+bool krep_match_spans(const krep_matcher_t *matcher, const krep_span_t *spans, size_t num_spans, uint64_t *counts,
+                      size_t *first_match, match_result_t *matches, int thread_count);
+
+/**
+ * @brief As krep_match_spans(), for spans stored back to back in one buffer.
+ *
+ * Span i is buf[offsets[i], offsets[i + 1]), so offsets has num_spans + 1 entries. When
+ * every span starts just after a newline and the patterns are literals, whole runs of
+ * spans are searched with one kernel call.
+ */
+bool krep_match_offsets(const krep_matcher_t *matcher, const char *buf, const size_t *offsets, size_t num_spans,
+                        uint64_t *counts, size_t *first_match, match_result_t *matches, int thread_count);
+
 /**
  * @brief Recursively searches a directory for the given pattern(s).
  *
@@ -168,11 +473,41 @@ int search_string(const search_params_t *params, const char *text);
  */
 int search_directory_recursive(const char *base_dir, const search_params_t *params, int thread_count);
 
+/**
+ * @brief Builds the trigram index DIR/.krep-index for later --index searches.
+ *
+ * Indexes every file a recursive search of dir would read, keyed by realpath and
+ * fingerprinted by size and mtime.
+ *
+ * @param dir The directory to index.
+ * @return 0 on success, 2 if the index could not be written or a file failed.
+ */
+int build_trigram_index(const char *dir);
+
 /* --- Match result management functions --- */
 match_result_t *match_result_init(uint64_t initial_capacity);
+// Like match_result_init, with the struct and positions in arena; match_result_free is
+// then a no-op and the memory is reclaimed when the arena is reset
+match_result_t *match_result_init_arena(struct arena *arena, uint64_t initial_capacity);
+// A compact result (see match_result_t) for matches of match_len bytes, in arena when it
+// is not NULL. match_len must be at least 1.
+match_result_t *match_result_init_compact(struct arena *arena, uint64_t initial_capacity, size_t match_len);
 bool match_result_add(match_result_t *result, size_t start_offset, size_t end_offset);
 void match_result_free(match_result_t *result);
 bool match_result_merge(match_result_t *dest, const match_result_t *src, size_t chunk_offset);
+// Convert a compact result to the full form so positions[] can be used; no-op when full
+bool match_result_expand(match_result_t *result);
+
+// Start and end (exclusive) of match i, in either form
+static inline size_t match_result_start(const match_result_t *result, uint64_t i)
+{
+   return result->starts ? result->starts[i] : result->positions[i].start_offset;
+}
+
+static inline size_t match_result_end(const match_result_t *result, uint64_t i)
+{
+   return result->starts ? result->starts[i] + result->match_len : result->positions[i].end_offset;
+}
 
 /**
  * @brief Prints matching lines or parts based on the provided results and parameters.
@@ -188,9 +523,37 @@ bool match_result_merge(match_result_t *dest, const match_result_t *src, size_t
  */
 size_t print_matching_items(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params);
 
+/**
+ * @brief Same as print_matching_items, but numbers lines starting at first_line_number.
+ *
+ * Used by the streaming search, where text is one block of a larger input.
+ */
+size_t print_matching_items_from(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number);
+
+/**
+ * @brief Same as print_matching_items_from, with an optional newline index over text.
+ *
+ * The index (may be NULL) resolves -o line numbers across large gaps between matches.
+ */
+size_t print_matching_items_indexed(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number, const newline_index_t *line_index);
+
+/**
+ * @brief Same as print_matching_items_indexed, with context lines (-A/-B/-C).
+ *
+ * context (may be NULL for a self-contained text) is read and updated, so a later call
+ * for the following piece of the same input continues the groups without printing a
+ * line twice. With an empty result it only prints after-context still owed.
+ */
+size_t print_matching_items_context(const char *filename, const char *text, size_t text_len, const match_result_t *result, const search_params_t *params, size_t first_line_number, const newline_index_t *line_index, print_context_t *context);
+
 // Print usage information
 void print_usage(const char *program_name);
 
+#ifdef TESTING
+// -o is a command-line flag; tests switch it directly (only in -DTESTING builds)
+void krep_set_only_matching(bool enabled);
+#endif
+
 /* --- Internal Search Algorithm Declarations (Updated Signature) --- */
 
 uint64_t boyer_moore_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
@@ -199,24 +562,38 @@ uint64_t regex_search(const search_params_t *params, const char *text_start, siz
 uint64_t memchr_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
 uint64_t memchr_short_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result); // New function for short patterns
 
-// SIMD functions (only declared if supported by compiler flags)
-#if defined(__SSE4_2__)
+// Count-only kernels for -c: count matching lines, never record positions or allocate
+uint64_t memchr_count_lines(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
+uint64_t boyer_moore_count_lines(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
+
+// SIMD functions (declared when built into the binary; x86 ones check the CPU at run time)
+#if KREP_USE_SSE42
 uint64_t simd_sse42_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
 #endif
 
-#if defined(__AVX2__)
+#if KREP_USE_AVX2
 uint64_t simd_avx2_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
 #endif
 
-#if defined(__ARM_NEON)
+#if KREP_USE_AVX512
+uint64_t simd_avx512_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
+#endif
+
+#if KREP_USE_NEON
 uint64_t neon_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
 #endif
 
+// Rare-byte anchor filter for patterns of any length (SSE2/AVX2 on x86, NEON on ARM)
+#if KREP_USE_AVX2 || KREP_USE_NEON
+uint64_t simd_anchor_search(const search_params_t *params, const char *text_start, size_t text_len, match_result_t *result);
+#endif
+
 /* --- Helper Functions --- */
 bool memory_equals_case_insensitive(const unsigned char *s1, const unsigned char *s2, size_t n);
 void prepare_bad_char_table(const unsigned char *pattern, size_t pattern_len, int *bad_char_table, bool case_sensitive);
 search_func_t select_search_algorithm(const search_params_t *params);
 const char *get_algorithm_name(search_func_t func);
+size_t simd_kernel_max_pattern_len(search_func_t func); // 0 unless func is a SIMD kernel this CPU supports
 
 /* --- Skip Lists for Recursive Search --- */
 // Defined here so they are accessible by search_directory_recursive in krep.c
@@ -232,7 +609,10 @@ static const char *skip_extensions[] = {
     // Object files, libraries, executables
     ".o", ".so", ".a", ".dll", ".exe", ".lib", ".dylib", ".class", ".pyc", ".pyo", ".obj", ".elf", ".wasm",
     // Archives
-    ".zip", ".tar", ".gz", ".bz2", ".xz", ".rar", ".7z", ".jar", ".war", ".ear", ".iso", ".img", ".pkg", ".deb", ".rpm",
+    ".zip", ".tar", ".bz2", ".xz", ".rar", ".7z", ".jar", ".war", ".ear", ".iso", ".img", ".pkg", ".deb", ".rpm",
+#if !KREP_HAVE_ZLIB
+    ".gz", // Searched through the gzip decoder when zlib is available
+#endif
     // Images
     ".jpg", ".jpeg", ".png", ".gif", ".bmp", ".tiff", ".webp", ".svg", ".ico", ".psd", ".ai",
     // Audio/Video
@@ -272,6 +652,38 @@ size_t find_line_start(const char *text, size_t max_len, size_t pos);
  */
 size_t find_line_end(const char *text, size_t text_len, size_t pos);
 
+/**
+ * @brief Count the newlines in a buffer (AVX-512/AVX2/NEON when available).
+ */
+size_t count_newlines(const char *text, size_t len);
+
+/**
+ * @brief Build a newline index over text. The index refers to text, which must outlive it.
+ *
+ * @return false if the block table cannot be allocated.
+ */
+bool newline_index_build(newline_index_t *index, const char *text, size_t text_len);
+
+/**
+ * @brief Free the block table of a newline index (safe on a zeroed index).
+ */
+void newline_index_free(newline_index_t *index);
+
+/**
+ * @brief Number of newlines in the indexed text.
+ */
+uint64_t newline_index_total(const newline_index_t *index);
+
+/**
+ * @brief Number of newlines before pos, i.e. the 0-based line number of pos.
+ */
+uint64_t newline_index_line_of(const newline_index_t *index, size_t pos);
+
+/**
+ * @brief Offset of the first byte of a 0-based line (text_len if the text has fewer lines).
+ */
+size_t newline_index_line_start(const newline_index_t *index, uint64_t line);
+
 /* --- Word Character and Whole Word Match Helpers --- */
 
 /**
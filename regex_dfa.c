@@ -0,0 +1,1527 @@
+/* regex_dfa.c - Lazy DFA engine for the common POSIX ERE subset
+ *
+ * The pattern is parsed into a small syntax tree, compiled to a Thompson NFA over byte
+ * equivalence classes and then run as a DFA whose states are built on demand:
+ *
+ *  - A DFA state is the set of NFA states reached after the last byte (the "kernel")
+ *    plus whether that byte was a newline, which is all ^ needs. $ only depends on the
+ *    next byte, so every state records whether it matches before a newline / end of
+ *    text and whether it matches anywhere else.
+ *  - Transitions are computed the first time they are taken and cached in a bounded
+ *    per-thread table. When the table is full it is flushed and rebuilt lazily.
+ *  - Searching runs the unanchored DFA to the end of the earliest-ending match and then
+ *    anchored DFAs from each start in that line to recover POSIX leftmost-longest
+ *    positions. Counting lines never needs the second step.
+ *
+ * Semantics follow regcomp(REG_EXTENDED | REG_NEWLINE) in the C locale: '.' and negated
+ * brackets never match a newline (and '.' never matches NUL), so no match spans lines.
+ * Anything the engine does not model makes regex_dfa_compile return NULL, and the
+ * caller keeps POSIX regexec for that pattern.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "regex_dfa.h"
+
+#define RD_MAX_NFA_STATES 20000    // Larger patterns (mostly big {m,n} expansions) use POSIX
+#define RD_MAX_REPEAT 255          // Largest bound accepted in {m,n}
+#define RD_MAX_DEPTH 200           // Deepest group / quantifier nesting accepted
+#define RD_MAX_LITERAL 255         // Longest required literal extracted
+#define RD_CACHE_BYTES (2u << 20)  // Transition table budget per thread
+#define RD_MIN_CACHE_STATES 64
+#define RD_MAX_CACHE_STATES 65536
+#define RD_TLS_SLOTS 4             // Matchers a thread keeps a cache pointer for
+#define RD_MAX_SKIP_BYTES 16       // Most distinct first bytes the start-state skip handles
+
+// --- Syntax tree ---
+
+typedef enum
+{
+    RN_SET,    // One byte from a set
+    RN_CAT,    // Children in sequence
+    RN_ALT,    // Any one child
+    RN_STAR,   // child*
+    RN_PLUS,   // child+
+    RN_QUEST,  // child?
+    RN_REPEAT, // child{min,max}
+    RN_BOL,    // ^
+    RN_EOL     // $
+} rd_node_type_t;
+
+typedef struct
+{
+    rd_node_type_t type;
+    int child;         // Unary operators: the operand
+    int first_kid;     // RN_CAT / RN_ALT: offset into the kids array
+    int num_kids;      // RN_CAT / RN_ALT: number of operands
+    int set;           // RN_SET: index into the set table
+    int min, max;      // RN_REPEAT: bounds, max == -1 for no upper bound
+} rd_node_t;
+
+typedef struct
+{
+    uint64_t bits[4];
+} rd_byteset_t;
+
+typedef struct
+{
+    const unsigned char *p; // Parse cursor
+    bool icase;
+    bool ok;
+    int depth;
+    rd_node_t *nodes;
+    int num_nodes, cap_nodes;
+    int *kids;
+    int num_kids, cap_kids;
+    rd_byteset_t *sets;
+    int num_sets, cap_sets;
+} rd_parser_t;
+
+static inline bool rd_set_has(const rd_byteset_t *s, unsigned int b)
+{
+    return (s->bits[b >> 6] >> (b & 63)) & 1;
+}
+
+static inline void rd_set_add(rd_byteset_t *s, unsigned int b)
+{
+    s->bits[b >> 6] |= (uint64_t)1 << (b & 63);
+}
+
+static int rd_set_count(const rd_byteset_t *s)
+{
+    return __builtin_popcountll(s->bits[0]) + __builtin_popcountll(s->bits[1]) +
+           __builtin_popcountll(s->bits[2]) + __builtin_popcountll(s->bits[3]);
+}
+
+static int rd_new_node(rd_parser_t *ps, rd_node_type_t type)
+{
+    if (ps->num_nodes == ps->cap_nodes)
+    {
+        int cap = ps->cap_nodes ? ps->cap_nodes * 2 : 64;
+        rd_node_t *nodes = realloc(ps->nodes, (size_t)cap * sizeof(rd_node_t));
+        if (!nodes)
+        {
+            ps->ok = false;
+            return -1;
+        }
+        ps->nodes = nodes;
+        ps->cap_nodes = cap;
+    }
+    rd_node_t *n = &ps->nodes[ps->num_nodes];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->child = -1;
+    return ps->num_nodes++;
+}
+
+// Add a byte set node. With REG_ICASE a byte matches if either of its cases is in the set.
+static int rd_new_set_node(rd_parser_t *ps, rd_byteset_t set, bool negate)
+{
+    if (ps->icase)
+    {
+        rd_byteset_t folded = set;
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            if (rd_set_has(&set, b))
+            {
+                rd_set_add(&folded, (unsigned int)tolower((int)b));
+                rd_set_add(&folded, (unsigned int)toupper((int)b));
+            }
+        }
+        set = folded;
+    }
+    if (negate)
+    {
+        for (int i = 0; i < 4; i++)
+            set.bits[i] = ~set.bits[i];
+        set.bits['\n' >> 6] &= ~((uint64_t)1 << ('\n' & 63)); // REG_NEWLINE
+    }
+    if (rd_set_has(&set, '\n'))
+    {
+        ps->ok = false; // Could match across lines; leave it to POSIX
+        return -1;
+    }
+
+    if (ps->num_sets == ps->cap_sets)
+    {
+        int cap = ps->cap_sets ? ps->cap_sets * 2 : 16;
+        rd_byteset_t *sets = realloc(ps->sets, (size_t)cap * sizeof(rd_byteset_t));
+        if (!sets)
+        {
+            ps->ok = false;
+            return -1;
+        }
+        ps->sets = sets;
+        ps->cap_sets = cap;
+    }
+    ps->sets[ps->num_sets] = set;
+
+    int id = rd_new_node(ps, RN_SET);
+    if (id >= 0)
+        ps->nodes[id].set = ps->num_sets++;
+    return id;
+}
+
+static bool rd_add_kid(rd_parser_t *ps, int node)
+{
+    if (ps->num_kids == ps->cap_kids)
+    {
+        int cap = ps->cap_kids ? ps->cap_kids * 2 : 64;
+        int *kids = realloc(ps->kids, (size_t)cap * sizeof(int));
+        if (!kids)
+            return false;
+        ps->kids = kids;
+        ps->cap_kids = cap;
+    }
+    ps->kids[ps->num_kids++] = node;
+    return true;
+}
+
+// Add the C-locale members of a [:name:] class; false if the name is unknown
+static bool rd_add_named_class(rd_byteset_t *set, const char *name, size_t len)
+{
+    static const struct
+    {
+        const char *name;
+        int (*test)(int);
+    } classes[] = {
+        {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum}, {"upper", isupper},
+        {"lower", islower}, {"space", isspace}, {"blank", isblank}, {"punct", ispunct},
+        {"print", isprint}, {"graph", isgraph}, {"cntrl", iscntrl}, {"xdigit", isxdigit},
+    };
+
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
+    {
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0)
+        {
+            for (int b = 0; b < 256; b++)
+            {
+                if (classes[i].test(b))
+                    rd_set_add(set, (unsigned int)b);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bracket expression; the cursor is just past '['
+static int rd_parse_bracket(rd_parser_t *ps)
+{
+    rd_byteset_t set = {{0, 0, 0, 0}};
+    bool negate = false;
+    bool first = true;
+
+    if (*ps->p == '^')
+    {
+        negate = true;
+        ps->p++;
+    }
+
+    for (;;)
+    {
+        unsigned char c = *ps->p;
+        if (c == '\0')
+        {
+            ps->ok = false;
+            return -1;
+        }
+        if (c == ']' && !first)
+        {
+            ps->p++;
+            break;
+        }
+        first = false;
+
+        if (c == '[' && ps->p[1] == ':')
+        {
+            const char *name = (const char *)ps->p + 2;
+            const char *close = strstr(name, ":]");
+            if (!close || !rd_add_named_class(&set, name, (size_t)(close - name)))
+            {
+                ps->ok = false;
+                return -1;
+            }
+            ps->p = (const unsigned char *)close + 2;
+            continue;
+        }
+        if (c == '[' && (ps->p[1] == '.' || ps->p[1] == '='))
+        {
+            ps->ok = false; // Collating elements and equivalence classes
+            return -1;
+        }
+
+        ps->p++;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0')
+        {
+            unsigned char hi = ps->p[1];
+            if (hi == '[' || hi < c)
+            {
+                ps->ok = false;
+                return -1;
+            }
+            for (unsigned int b = c; b <= hi; b++)
+                rd_set_add(&set, b);
+            ps->p += 2;
+        }
+        else
+        {
+            rd_set_add(&set, c);
+        }
+    }
+
+    return rd_new_set_node(ps, set, negate);
+}
+
+static int rd_parse_alt(rd_parser_t *ps);
+
+static int rd_parse_atom(rd_parser_t *ps)
+{
+    unsigned char c = *ps->p;
+    rd_byteset_t set = {{0, 0, 0, 0}};
+
+    switch (c)
+    {
+    case '(':
+    {
+        ps->p++;
+        if (*ps->p == ')' || ++ps->depth > RD_MAX_DEPTH)
+        {
+            ps->ok = false;
+            return -1;
+        }
+        int inner = rd_parse_alt(ps);
+        ps->depth--;
+        if (!ps->ok || *ps->p != ')')
+        {
+            ps->ok = false;
+            return -1;
+        }
+        ps->p++;
+        return inner;
+    }
+    case '[':
+        ps->p++;
+        return rd_parse_bracket(ps);
+    case '.':
+        ps->p++;
+        for (unsigned int b = 1; b < 256; b++)
+        {
+            if (b != '\n')
+                rd_set_add(&set, b);
+        }
+        return rd_new_set_node(ps, set, false);
+    case '^':
+        ps->p++;
+        return rd_new_node(ps, RN_BOL);
+    case '$':
+        ps->p++;
+        return rd_new_node(ps, RN_EOL);
+    case '\\':
+        // Only escaped metacharacters; \1, \b, \w and friends are left to POSIX
+        if (ps->p[1] == '\0' || !strchr(".[]()*+?{}|^$\\", ps->p[1]))
+        {
+            ps->ok = false;
+            return -1;
+        }
+        rd_set_add(&set, ps->p[1]);
+        ps->p += 2;
+        return rd_new_set_node(ps, set, false);
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+    case ')':
+    case '|':
+    case '\0':
+        ps->ok = false;
+        return -1;
+    default:
+        ps->p++;
+        rd_set_add(&set, c);
+        return rd_new_set_node(ps, set, false);
+    }
+}
+
+static bool rd_parse_number(rd_parser_t *ps, int *out)
+{
+    if (!isdigit(*ps->p))
+        return false;
+    int v = 0;
+    while (isdigit(*ps->p))
+    {
+        v = v * 10 + (*ps->p++ - '0');
+        if (v > RD_MAX_REPEAT)
+            return false;
+    }
+    *out = v;
+    return true;
+}
+
+static int rd_parse_piece(rd_parser_t *ps)
+{
+    int node = rd_parse_atom(ps);
+    int quantifiers = 0;
+
+    while (ps->ok)
+    {
+        unsigned char c = *ps->p;
+        rd_node_type_t type;
+        int min = 0, max = -1;
+
+        if (c == '*')
+            type = RN_STAR;
+        else if (c == '+')
+            type = RN_PLUS;
+        else if (c == '?')
+            type = RN_QUEST;
+        else if (c == '{')
+        {
+            type = RN_REPEAT;
+            ps->p++;
+            if (!rd_parse_number(ps, &min))
+            {
+                ps->ok = false;
+                break;
+            }
+            max = min;
+            if (*ps->p == ',')
+            {
+                ps->p++;
+                max = -1;
+                if (*ps->p != '}' && (!rd_parse_number(ps, &max) || max < min))
+                {
+                    ps->ok = false;
+                    break;
+                }
+            }
+            if (*ps->p != '}')
+            {
+                ps->ok = false;
+                break;
+            }
+        }
+        else
+            break;
+        ps->p++;
+
+        rd_node_type_t target = ps->nodes[node].type;
+        if (target == RN_BOL || target == RN_EOL || ++quantifiers > RD_MAX_DEPTH)
+        {
+            ps->ok = false; // Quantified anchors are left to POSIX
+            break;
+        }
+        int q = rd_new_node(ps, type);
+        if (q < 0)
+            break;
+        ps->nodes[q].child = node;
+        ps->nodes[q].min = min;
+        ps->nodes[q].max = max;
+        node = q;
+    }
+    return ps->ok ? node : -1;
+}
+
+// Build an n-ary node over items, stored contiguously in the kids array
+static int rd_make_list(rd_parser_t *ps, rd_node_type_t type, const int *items, int count)
+{
+    if (count == 1)
+        return items[0];
+    int first = ps->num_kids;
+    for (int i = 0; i < count; i++)
+    {
+        if (!rd_add_kid(ps, items[i]))
+        {
+            ps->ok = false;
+            return -1;
+        }
+    }
+    int node = rd_new_node(ps, type);
+    if (node < 0)
+        return -1;
+    ps->nodes[node].first_kid = first;
+    ps->nodes[node].num_kids = count;
+    return node;
+}
+
+// Collect operands in a growable local list, then store them contiguously
+typedef struct
+{
+    int *items;
+    int count, cap;
+} rd_list_t;
+
+static bool rd_list_push(rd_list_t *l, int v)
+{
+    if (l->count == l->cap)
+    {
+        int cap = l->cap ? l->cap * 2 : 16;
+        int *items = realloc(l->items, (size_t)cap * sizeof(int));
+        if (!items)
+            return false;
+        l->items = items;
+        l->cap = cap;
+    }
+    l->items[l->count++] = v;
+    return true;
+}
+
+static int rd_parse_branch(rd_parser_t *ps)
+{
+    rd_list_t pieces = {NULL, 0, 0};
+    while (ps->ok && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+    {
+        int piece = rd_parse_piece(ps);
+        if (piece < 0 || !rd_list_push(&pieces, piece))
+            ps->ok = false;
+    }
+    int node = -1;
+    if (ps->ok && pieces.count == 0)
+        ps->ok = false; // Empty branch
+    if (ps->ok)
+        node = rd_make_list(ps, RN_CAT, pieces.items, pieces.count);
+    free(pieces.items);
+    return ps->ok ? node : -1;
+}
+
+static int rd_parse_alt(rd_parser_t *ps)
+{
+    rd_list_t branches = {NULL, 0, 0};
+    for (;;)
+    {
+        int branch = rd_parse_branch(ps);
+        if (branch < 0 || !rd_list_push(&branches, branch))
+        {
+            ps->ok = false;
+            break;
+        }
+        if (*ps->p != '|')
+            break;
+        ps->p++;
+    }
+    int node = -1;
+    if (ps->ok)
+        node = rd_make_list(ps, RN_ALT, branches.items, branches.count);
+    free(branches.items);
+    return ps->ok ? node : -1;
+}
+
+// --- Required literal ---
+
+typedef struct
+{
+    bool is_exact;                       // Node matches exactly the string in exact[]
+    size_t exact_len;
+    size_t best_len;                     // Longest substring every match contains
+    unsigned char exact[RD_MAX_LITERAL];
+    unsigned char best[RD_MAX_LITERAL];
+} rd_literal_t;
+
+static void rd_literal_consider(rd_literal_t *out, const unsigned char *s, size_t len)
+{
+    if (len > out->best_len)
+    {
+        memcpy(out->best, s, len);
+        out->best_len = len;
+    }
+}
+
+// The byte a set stands for if it is a single character (both cases of it with REG_ICASE)
+static bool rd_set_single_char(const rd_parser_t *ps, const rd_byteset_t *set, unsigned char *out)
+{
+    int count = rd_set_count(set);
+    if (count != 1 && !(ps->icase && count == 2))
+        return false;
+    for (unsigned int b = 0; b < 256; b++)
+    {
+        if (!rd_set_has(set, b))
+            continue;
+        if (count == 2 && !(isalpha((int)b) && rd_set_has(set, (unsigned int)toupper((int)b)) &&
+                            rd_set_has(set, (unsigned int)tolower((int)b))))
+            return false;
+        *out = ps->icase ? (unsigned char)tolower((int)b) : (unsigned char)b;
+        return true;
+    }
+    return false;
+}
+
+static void rd_literal(const rd_parser_t *ps, int id, rd_literal_t *out)
+{
+    const rd_node_t *n = &ps->nodes[id];
+    out->is_exact = false;
+    out->exact_len = 0;
+    out->best_len = 0;
+
+    switch (n->type)
+    {
+    case RN_SET:
+    {
+        unsigned char c;
+        if (rd_set_single_char(ps, &ps->sets[n->set], &c))
+        {
+            out->is_exact = true;
+            out->exact[0] = c;
+            out->exact_len = 1;
+            rd_literal_consider(out, out->exact, 1);
+        }
+        break;
+    }
+    case RN_BOL:
+    case RN_EOL:
+        out->is_exact = true; // Zero width
+        break;
+    case RN_CAT:
+    {
+        rd_literal_t *kid = malloc(sizeof(rd_literal_t));
+        if (!kid)
+            break;
+        bool all_exact = true;
+        for (int i = 0; i < n->num_kids; i++)
+        {
+            rd_literal(ps, ps->kids[n->first_kid + i], kid);
+            if (kid->is_exact && out->exact_len + kid->exact_len <= RD_MAX_LITERAL)
+            {
+                memcpy(out->exact + out->exact_len, kid->exact, kid->exact_len);
+                out->exact_len += kid->exact_len;
+                continue;
+            }
+            // The run of exact operands ends here
+            rd_literal_consider(out, out->exact, out->exact_len);
+            rd_literal_consider(out, kid->best, kid->best_len);
+            all_exact = false;
+            out->exact_len = 0;
+            if (kid->is_exact) // Too long to append; start a new run with it
+            {
+                memcpy(out->exact, kid->exact, kid->exact_len);
+                out->exact_len = kid->exact_len;
+            }
+        }
+        rd_literal_consider(out, out->exact, out->exact_len);
+        out->is_exact = all_exact;
+        free(kid);
+        break;
+    }
+    case RN_ALT:
+    {
+        rd_literal_t *kid = malloc(sizeof(rd_literal_t));
+        if (!kid)
+            break;
+        // Exact only if every alternative is the same string
+        for (int i = 0; i < n->num_kids; i++)
+        {
+            rd_literal(ps, ps->kids[n->first_kid + i], kid);
+            if (!kid->is_exact || (i > 0 && (kid->exact_len != out->exact_len ||
+                                             memcmp(kid->exact, out->exact, kid->exact_len) != 0)))
+            {
+                out->is_exact = false;
+                out->exact_len = 0;
+                break;
+            }
+            memcpy(out->exact, kid->exact, kid->exact_len);
+            out->exact_len = kid->exact_len;
+            out->is_exact = true;
+        }
+        if (out->is_exact)
+            rd_literal_consider(out, out->exact, out->exact_len);
+        free(kid);
+        break;
+    }
+    case RN_PLUS:
+    case RN_REPEAT:
+    {
+        if (n->type == RN_REPEAT && n->min == 0)
+            break;
+        rd_literal(ps, n->child, out);
+        bool exact = out->is_exact && n->type == RN_REPEAT && n->min == n->max &&
+                     out->exact_len * (size_t)n->min <= RD_MAX_LITERAL;
+        if (exact)
+        {
+            size_t unit = out->exact_len;
+            for (int i = 1; i < n->min; i++)
+                memcpy(out->exact + unit * i, out->exact, unit);
+            out->exact_len = unit * (size_t)n->min;
+            rd_literal_consider(out, out->exact, out->exact_len);
+        }
+        out->is_exact = exact;
+        if (!exact)
+            out->exact_len = 0;
+        break;
+    }
+    case RN_STAR:
+    case RN_QUEST:
+        break;
+    }
+}
+
+// --- NFA ---
+
+typedef enum
+{
+    NS_MATCH,
+    NS_SET,   // Consume a byte whose class is in the set, go to out
+    NS_SPLIT, // Go to out and out1
+    NS_BOL,   // Go to out at the start of a line
+    NS_EOL    // Go to out at the end of a line
+} rd_nfa_type_t;
+
+typedef struct
+{
+    uint8_t type;
+    int32_t set;
+    uint32_t out;
+    uint32_t out1;
+} rd_nfa_state_t;
+
+struct rd_cache;
+
+static atomic_uint_fast64_t rd_next_serial = 1;
+
+struct regex_dfa
+{
+    rd_nfa_state_t *nfa;
+    uint32_t nfa_len;
+    uint32_t start;
+
+    uint16_t byte_class[256];
+    uint32_t num_classes;
+    uint32_t nl_class;
+    uint8_t *set_class; // num_sets * num_classes: class is in the set
+
+    unsigned char *literal;
+    size_t literal_len;
+
+    // Bytes that leave the unanchored start state; any other byte loops back to it,
+    // so scans jump between occurrences of these with memchr
+    bool skip_enabled;
+    int num_skip_bytes;
+    unsigned char skip_bytes[RD_MAX_SKIP_BYTES];
+    bool skip_stop[256];
+
+    bool matches_every_line; // An empty match exists on every line (e.g. ^, $, x*)
+
+    uint64_t serial; // Identifies the matcher in per-thread cache slots
+    pthread_mutex_t cache_lock;
+    struct rd_cache *caches; // Every cache created, freed with the matcher
+};
+
+typedef struct
+{
+    const rd_parser_t *ps;
+    rd_nfa_state_t *states;
+    uint32_t len, cap;
+    bool ok;
+} rd_nfa_builder_t;
+
+static uint32_t rd_nfa_add(rd_nfa_builder_t *b, uint8_t type, int32_t set, uint32_t out, uint32_t out1)
+{
+    if (b->len >= RD_MAX_NFA_STATES)
+    {
+        b->ok = false;
+        return 0;
+    }
+    if (b->len == b->cap)
+    {
+        uint32_t cap = b->cap ? b->cap * 2 : 64;
+        rd_nfa_state_t *states = realloc(b->states, cap * sizeof(rd_nfa_state_t));
+        if (!states)
+        {
+            b->ok = false;
+            return 0;
+        }
+        b->states = states;
+        b->cap = cap;
+    }
+    b->states[b->len] = (rd_nfa_state_t){type, set, out, out1};
+    return b->len++;
+}
+
+// Compile node so that it continues to state next; returns the entry state
+static uint32_t rd_nfa_compile(rd_nfa_builder_t *b, int id, uint32_t next)
+{
+    if (!b->ok)
+        return 0;
+    const rd_node_t *n = &b->ps->nodes[id];
+    const int *kids = b->ps->kids;
+
+    switch (n->type)
+    {
+    case RN_SET:
+        return rd_nfa_add(b, NS_SET, n->set, next, 0);
+    case RN_BOL:
+        return rd_nfa_add(b, NS_BOL, -1, next, 0);
+    case RN_EOL:
+        return rd_nfa_add(b, NS_EOL, -1, next, 0);
+    case RN_CAT:
+        for (int i = n->num_kids - 1; i >= 0; i--)
+            next = rd_nfa_compile(b, kids[n->first_kid + i], next);
+        return next;
+    case RN_ALT:
+    {
+        uint32_t entry = rd_nfa_compile(b, kids[n->first_kid + n->num_kids - 1], next);
+        for (int i = n->num_kids - 2; i >= 0; i--)
+        {
+            uint32_t branch = rd_nfa_compile(b, kids[n->first_kid + i], next);
+            entry = rd_nfa_add(b, NS_SPLIT, -1, branch, entry);
+        }
+        return entry;
+    }
+    case RN_STAR:
+    case RN_PLUS:
+    {
+        uint32_t loop = rd_nfa_add(b, NS_SPLIT, -1, 0, next);
+        uint32_t body = rd_nfa_compile(b, n->child, loop);
+        if (b->ok)
+            b->states[loop].out = body;
+        return n->type == RN_STAR ? loop : body;
+    }
+    case RN_QUEST:
+    {
+        uint32_t body = rd_nfa_compile(b, n->child, next);
+        return rd_nfa_add(b, NS_SPLIT, -1, body, next);
+    }
+    case RN_REPEAT:
+    {
+        // x{m,n} is m copies of x followed by n-m nested optional copies (or x* if unbounded)
+        uint32_t tail = next;
+        if (n->max < 0)
+        {
+            uint32_t loop = rd_nfa_add(b, NS_SPLIT, -1, 0, next);
+            uint32_t body = rd_nfa_compile(b, n->child, loop);
+            if (b->ok)
+                b->states[loop].out = body;
+            tail = loop;
+        }
+        else
+        {
+            for (int i = n->min; i < n->max && b->ok; i++)
+            {
+                uint32_t body = rd_nfa_compile(b, n->child, tail);
+                tail = rd_nfa_add(b, NS_SPLIT, -1, body, next);
+            }
+        }
+        for (int i = 0; i < n->min && b->ok; i++)
+            tail = rd_nfa_compile(b, n->child, tail);
+        return tail;
+    }
+    }
+    b->ok = false;
+    return 0;
+}
+
+// Split bytes into classes that no set (nor the newline check) can tell apart
+static bool rd_build_classes(regex_dfa_t *dfa, const rd_parser_t *ps)
+{
+    uint16_t *cls = dfa->byte_class;
+    uint32_t num = 1;
+    int16_t remap[512];
+    memset(cls, 0, sizeof(dfa->byte_class));
+
+    for (int s = -1; s < ps->num_sets; s++)
+    {
+        memset(remap, -1, sizeof(remap));
+        uint32_t next_num = 0;
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            bool in = (s < 0) ? (b == '\n') : rd_set_has(&ps->sets[s], b);
+            unsigned int key = cls[b] * 2u + (in ? 1u : 0u);
+            if (remap[key] < 0)
+                remap[key] = (int16_t)next_num++;
+            cls[b] = (uint16_t)remap[key];
+        }
+        num = next_num;
+    }
+    dfa->num_classes = num;
+    dfa->nl_class = cls['\n'];
+
+    dfa->set_class = calloc((size_t)(ps->num_sets ? ps->num_sets : 1) * num, 1);
+    if (!dfa->set_class)
+        return false;
+    for (int s = 0; s < ps->num_sets; s++)
+    {
+        for (unsigned int b = 0; b < 256; b++)
+        {
+            if (rd_set_has(&ps->sets[s], b))
+                dfa->set_class[(size_t)s * num + cls[b]] = 1;
+        }
+    }
+    return true;
+}
+
+// Collect the bytes that can begin a match away from a line start. The skip stays off
+// when the empty string matches or when too many distinct bytes could begin a match.
+static void rd_build_skip(regex_dfa_t *dfa)
+{
+    dfa->skip_enabled = false;
+    uint32_t *stack = malloc(dfa->nfa_len * sizeof(uint32_t));
+    uint8_t *seen = calloc(dfa->nfa_len, 1);
+    if (!stack || !seen)
+    {
+        free(stack);
+        free(seen);
+        return;
+    }
+
+    bool first[256] = {false};
+    bool has_bol = false, empty_match = false;
+    for (uint32_t i = 0; i < dfa->nfa_len; i++)
+        has_bol |= (dfa->nfa[i].type == NS_BOL);
+
+    uint32_t sp = 0;
+    stack[sp++] = dfa->start;
+    seen[dfa->start] = 1;
+    while (sp > 0)
+    {
+        const rd_nfa_state_t *st = &dfa->nfa[stack[--sp]];
+        switch (st->type)
+        {
+        case NS_MATCH:
+            empty_match = true;
+            break;
+        case NS_SET:
+            for (unsigned int b = 0; b < 256; b++)
+                first[b] |= dfa->set_class[(size_t)st->set * dfa->num_classes + dfa->byte_class[b]];
+            break;
+        case NS_SPLIT:
+            if (!seen[st->out1])
+            {
+                seen[st->out1] = 1;
+                stack[sp++] = st->out1;
+            }
+            if (!seen[st->out])
+            {
+                seen[st->out] = 1;
+                stack[sp++] = st->out;
+            }
+            break;
+        default: // NS_BOL, NS_EOL never hold before a non-newline byte mid-line
+            break;
+        }
+    }
+    free(stack);
+    free(seen);
+
+    // A newline moves to the line-start state, which matters only if the pattern has ^
+    first['\n'] |= has_bol;
+    int n = 0;
+    for (unsigned int b = 0; b < 256; b++)
+    {
+        if (!first[b])
+            continue;
+        if (n == RD_MAX_SKIP_BYTES)
+            return;
+        dfa->skip_bytes[n++] = (unsigned char)b;
+        dfa->skip_stop[b] = true;
+    }
+    dfa->num_skip_bytes = n;
+    dfa->skip_enabled = !empty_match;
+}
+
+// True when NS_MATCH is reachable from the start without consuming a byte, passing
+// only through splits and assertions of the given type (NS_BOL, NS_EOL, or NS_MATCH
+// for none). That assertion holds once on every line, so then every line matches.
+static bool rd_empty_match_with(const regex_dfa_t *dfa, uint8_t assertion)
+{
+    uint32_t *stack = malloc(dfa->nfa_len * sizeof(uint32_t));
+    uint8_t *seen = calloc(dfa->nfa_len, 1);
+    bool found = false;
+    uint32_t sp = 0;
+    if (stack && seen)
+    {
+        stack[sp++] = dfa->start;
+        seen[dfa->start] = 1;
+    }
+    while (sp > 0 && !found)
+    {
+        const rd_nfa_state_t *st = &dfa->nfa[stack[--sp]];
+        uint32_t next[2];
+        int n = 0;
+        if (st->type == NS_MATCH)
+            found = true;
+        else if (st->type == NS_SPLIT)
+        {
+            next[n++] = st->out;
+            next[n++] = st->out1;
+        }
+        else if (st->type == assertion)
+            next[n++] = st->out;
+        for (int k = 0; k < n; k++)
+        {
+            if (!seen[next[k]])
+            {
+                seen[next[k]] = 1;
+                stack[sp++] = next[k];
+            }
+        }
+    }
+    free(stack);
+    free(seen);
+    return found;
+}
+
+regex_dfa_t *regex_dfa_compile(const char *pattern, bool case_sensitive)
+{
+    if (!pattern || !*pattern)
+        return NULL;
+
+    rd_parser_t ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.p = (const unsigned char *)pattern;
+    ps.icase = !case_sensitive;
+    ps.ok = true;
+
+    int root = rd_parse_alt(&ps);
+    if (ps.ok && *ps.p != '\0')
+        ps.ok = false; // Unmatched ')'
+
+    regex_dfa_t *dfa = NULL;
+    rd_nfa_builder_t b = {&ps, NULL, 0, 0, true};
+    rd_literal_t *lit = NULL;
+
+    if (!ps.ok || root < 0)
+        goto done;
+
+    uint32_t match = rd_nfa_add(&b, NS_MATCH, -1, 0, 0);
+    uint32_t start = rd_nfa_compile(&b, root, match);
+    if (!b.ok)
+        goto done;
+
+    dfa = calloc(1, sizeof(regex_dfa_t));
+    lit = malloc(sizeof(rd_literal_t));
+    if (!dfa || !lit || !rd_build_classes(dfa, &ps))
+        goto fail;
+
+    dfa->nfa = b.states;
+    b.states = NULL;
+    dfa->nfa_len = b.len;
+    dfa->start = start;
+    rd_build_skip(dfa);
+    dfa->matches_every_line = rd_empty_match_with(dfa, NS_MATCH) || rd_empty_match_with(dfa, NS_BOL) ||
+                              rd_empty_match_with(dfa, NS_EOL);
+
+    rd_literal(&ps, root, lit);
+    if (lit->best_len > 0)
+    {
+        dfa->literal = malloc(lit->best_len + 1);
+        if (!dfa->literal)
+            goto fail;
+        memcpy(dfa->literal, lit->best, lit->best_len);
+        dfa->literal[lit->best_len] = '\0';
+        dfa->literal_len = lit->best_len;
+    }
+
+    dfa->serial = atomic_fetch_add(&rd_next_serial, 1);
+    pthread_mutex_init(&dfa->cache_lock, NULL);
+    goto done;
+
+fail:
+    if (dfa)
+    {
+        free(dfa->set_class);
+        free(dfa->literal);
+        free(dfa->nfa);
+        free(dfa);
+    }
+    dfa = NULL;
+done:
+    free(lit);
+    free(b.states);
+    free(ps.nodes);
+    free(ps.kids);
+    free(ps.sets);
+    return dfa;
+}
+
+const char *regex_dfa_required_literal(const regex_dfa_t *dfa, size_t *len)
+{
+    if (!dfa || !dfa->literal)
+        return NULL;
+    *len = dfa->literal_len;
+    return (const char *)dfa->literal;
+}
+
+bool regex_dfa_matches_every_line(const regex_dfa_t *dfa)
+{
+    return dfa && dfa->matches_every_line;
+}
+
+// --- Lazy DFA state cache ---
+
+#define RD_F_BOL 0x01       // Previous byte was a newline (or start of text)
+#define RD_F_ANCHORED 0x02  // No new match attempts start inside this state
+#define RD_F_MATCH 0x04     // A match ends here whatever the next byte is
+#define RD_F_MATCH_EOL 0x08 // A match ends here if the next byte is a newline / end of text
+#define RD_F_DEAD 0x10      // Anchored and no thread left
+
+typedef struct rd_cache
+{
+    const regex_dfa_t *dfa;
+    struct rd_cache *next_cache;
+
+    uint32_t num_states;
+    uint32_t max_states;
+    int32_t *trans;         // max_states * num_classes, -1 until computed
+    uint8_t *flags;         // RD_F_* per state
+    uint32_t *kernel_start; // max_states + 1 offsets into pool
+    uint32_t *pool;         // Sorted NFA state lists
+    size_t pool_cap;
+    uint32_t *table; // Hash of states: id + 1, 0 = empty
+    uint32_t table_mask;
+    int32_t start[4]; // [anchored * 2 + bol]
+
+    // Scratch, nfa_len (or more) entries each
+    uint32_t *closure;
+    uint32_t *stack;
+    uint32_t *kernel_buf;
+    uint32_t *mark;
+    uint32_t generation;
+} rd_cache_t;
+
+static void rd_cache_free(rd_cache_t *c)
+{
+    if (!c)
+        return;
+    free(c->trans);
+    free(c->flags);
+    free(c->kernel_start);
+    free(c->pool);
+    free(c->table);
+    free(c->closure);
+    free(c->stack);
+    free(c->kernel_buf);
+    free(c->mark);
+    free(c);
+}
+
+static void rd_cache_flush(rd_cache_t *c)
+{
+    c->num_states = 0;
+    c->kernel_start[0] = 0;
+    memset(c->table, 0, ((size_t)c->table_mask + 1) * sizeof(uint32_t));
+    for (int i = 0; i < 4; i++)
+        c->start[i] = -1;
+}
+
+static rd_cache_t *rd_cache_new(const regex_dfa_t *dfa)
+{
+    rd_cache_t *c = calloc(1, sizeof(rd_cache_t));
+    if (!c)
+        return NULL;
+    c->dfa = dfa;
+
+    size_t per_state = (size_t)dfa->num_classes * sizeof(int32_t) + 16;
+    size_t max_states = RD_CACHE_BYTES / per_state;
+    if (max_states < RD_MIN_CACHE_STATES)
+        max_states = RD_MIN_CACHE_STATES;
+    if (max_states > RD_MAX_CACHE_STATES)
+        max_states = RD_MAX_CACHE_STATES;
+    c->max_states = (uint32_t)max_states;
+
+    uint32_t table_size = 1;
+    while (table_size < 2 * c->max_states)
+        table_size <<= 1;
+    c->table_mask = table_size - 1;
+
+    size_t n = dfa->nfa_len;
+    c->pool_cap = max_states * 8 > n + 1 ? max_states * 8 : n + 1;
+    c->trans = malloc(max_states * dfa->num_classes * sizeof(int32_t));
+    c->flags = malloc(max_states);
+    c->kernel_start = malloc((max_states + 1) * sizeof(uint32_t));
+    c->pool = malloc(c->pool_cap * sizeof(uint32_t));
+    c->table = malloc((size_t)table_size * sizeof(uint32_t));
+    c->closure = malloc(n * sizeof(uint32_t));
+    c->stack = malloc((3 * n + 1) * sizeof(uint32_t));
+    c->kernel_buf = malloc((n + 1) * sizeof(uint32_t));
+    c->mark = calloc(n, sizeof(uint32_t));
+    if (!c->trans || !c->flags || !c->kernel_start || !c->pool || !c->table || !c->closure || !c->stack ||
+        !c->kernel_buf || !c->mark)
+    {
+        rd_cache_free(c);
+        return NULL;
+    }
+    rd_cache_flush(c);
+    return c;
+}
+
+// Each thread remembers its caches by matcher serial, so a freed matcher's slot can never
+// be mistaken for a later one allocated at the same address
+static _Thread_local struct
+{
+    uint64_t serial;
+    rd_cache_t *cache;
+} rd_tls[RD_TLS_SLOTS];
+static _Thread_local unsigned int rd_tls_next;
+
+static rd_cache_t *rd_get_cache(regex_dfa_t *dfa)
+{
+    for (int i = 0; i < RD_TLS_SLOTS; i++)
+    {
+        if (rd_tls[i].serial == dfa->serial)
+            return rd_tls[i].cache;
+    }
+    rd_cache_t *c = rd_cache_new(dfa);
+    if (!c)
+        return NULL;
+    unsigned int slot = rd_tls_next++ % RD_TLS_SLOTS;
+    rd_tls[slot].serial = dfa->serial;
+    rd_tls[slot].cache = c; // An evicted cache stays on the matcher's list until it is freed
+    pthread_mutex_lock(&dfa->cache_lock);
+    c->next_cache = dfa->caches;
+    dfa->caches = c;
+    pthread_mutex_unlock(&dfa->cache_lock);
+    return c;
+}
+
+static inline uint32_t rd_next_generation(rd_cache_t *c)
+{
+    if (++c->generation == 0)
+    {
+        memset(c->mark, 0, c->dfa->nfa_len * sizeof(uint32_t));
+        c->generation = 1;
+    }
+    return c->generation;
+}
+
+// Epsilon closure of a kernel at a position with the given line context; returns its size
+static uint32_t rd_closure(rd_cache_t *c, const uint32_t *kernel, uint32_t n, bool bol, bool eol)
+{
+    const rd_nfa_state_t *nfa = c->dfa->nfa;
+    uint32_t gen = rd_next_generation(c);
+    uint32_t sp = 0, count = 0;
+
+    for (uint32_t i = n; i > 0; i--)
+        c->stack[sp++] = kernel[i - 1];
+    while (sp > 0)
+    {
+        uint32_t s = c->stack[--sp];
+        if (c->mark[s] == gen)
+            continue;
+        c->mark[s] = gen;
+        c->closure[count++] = s;
+
+        const rd_nfa_state_t *st = &nfa[s];
+        switch (st->type)
+        {
+        case NS_SPLIT:
+            if (c->mark[st->out1] != gen)
+                c->stack[sp++] = st->out1;
+            if (c->mark[st->out] != gen)
+                c->stack[sp++] = st->out;
+            break;
+        case NS_BOL:
+            if (bol && c->mark[st->out] != gen)
+                c->stack[sp++] = st->out;
+            break;
+        case NS_EOL:
+            if (eol && c->mark[st->out] != gen)
+                c->stack[sp++] = st->out;
+            break;
+        default:
+            break;
+        }
+    }
+    return count;
+}
+
+static bool rd_closure_matches(const rd_cache_t *c, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (c->dfa->nfa[c->closure[i]].type == NS_MATCH)
+            return true;
+    }
+    return false;
+}
+
+static int rd_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t rd_hash(const uint32_t *kernel, uint32_t n, uint8_t flags)
+{
+    uint32_t h = 2166136261u ^ flags;
+    for (uint32_t i = 0; i < n; i++)
+        h = (h ^ kernel[i]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+// Find or add the state (kernel, flags); -1 when the cache is full
+static int32_t rd_intern(rd_cache_t *c, const uint32_t *kernel, uint32_t n, uint8_t flags)
+{
+    uint32_t h = rd_hash(kernel, n, flags) & c->table_mask;
+    for (;; h = (h + 1) & c->table_mask)
+    {
+        uint32_t slot = c->table[h];
+        if (slot == 0)
+            break;
+        uint32_t id = slot - 1;
+        uint32_t len = c->kernel_start[id + 1] - c->kernel_start[id];
+        if ((c->flags[id] & (RD_F_BOL | RD_F_ANCHORED)) == flags && len == n &&
+            memcmp(c->pool + c->kernel_start[id], kernel, n * sizeof(uint32_t)) == 0)
+            return (int32_t)id;
+    }
+
+    if (c->num_states == c->max_states)
+        return -1;
+    size_t used = c->kernel_start[c->num_states];
+    if (used + n > c->pool_cap)
+    {
+        size_t cap = c->pool_cap * 2;
+        if (cap * sizeof(uint32_t) > 4 * (size_t)RD_CACHE_BYTES)
+            return -1;
+        uint32_t *pool = realloc(c->pool, cap * sizeof(uint32_t));
+        if (!pool)
+            return -1;
+        c->pool = pool;
+        c->pool_cap = cap;
+    }
+
+    uint32_t id = c->num_states++;
+    memcpy(c->pool + used, kernel, n * sizeof(uint32_t));
+    c->kernel_start[id + 1] = (uint32_t)(used + n);
+
+    bool bol = flags & RD_F_BOL;
+    uint8_t f = flags;
+    if (rd_closure_matches(c, rd_closure(c, kernel, n, bol, false)))
+        f |= RD_F_MATCH;
+    if (rd_closure_matches(c, rd_closure(c, kernel, n, bol, true)))
+        f |= RD_F_MATCH_EOL;
+    if ((flags & RD_F_ANCHORED) && n == 0)
+        f |= RD_F_DEAD;
+    c->flags[id] = f;
+
+    int32_t *row = c->trans + (size_t)id * c->dfa->num_classes;
+    for (uint32_t i = 0; i < c->dfa->num_classes; i++)
+        row[i] = -1;
+    c->table[h] = id + 1;
+    return (int32_t)id;
+}
+
+static int32_t rd_start_state(rd_cache_t *c, bool anchored, bool bol)
+{
+    int idx = (anchored ? 2 : 0) + (bol ? 1 : 0);
+    if (c->start[idx] < 0)
+    {
+        uint8_t flags = (anchored ? RD_F_ANCHORED : 0) | (bol ? RD_F_BOL : 0);
+        int32_t id = rd_intern(c, &c->dfa->start, 1, flags);
+        if (id < 0)
+        {
+            rd_cache_flush(c);
+            id = rd_intern(c, &c->dfa->start, 1, flags);
+        }
+        c->start[idx] = id;
+    }
+    return c->start[idx];
+}
+
+// Compute (and cache) the transition of state sid on byte class cls
+static int32_t rd_transition(rd_cache_t *c, int32_t sid, uint32_t cls)
+{
+    const regex_dfa_t *dfa = c->dfa;
+    uint8_t flags = c->flags[sid];
+    bool anchored = flags & RD_F_ANCHORED;
+    bool eol = (cls == dfa->nl_class);
+
+    uint32_t count = rd_closure(c, c->pool + c->kernel_start[sid], c->kernel_start[sid + 1] - c->kernel_start[sid],
+                                flags & RD_F_BOL, eol);
+    uint32_t gen = rd_next_generation(c);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const rd_nfa_state_t *st = &dfa->nfa[c->closure[i]];
+        if (st->type == NS_SET && dfa->set_class[(size_t)st->set * dfa->num_classes + cls] &&
+            c->mark[st->out] != gen)
+        {
+            c->mark[st->out] = gen;
+            c->kernel_buf[n++] = st->out;
+        }
+    }
+    if (!anchored && c->mark[dfa->start] != gen)
+        c->kernel_buf[n++] = dfa->start; // A new match attempt starts at every position
+    if (n > 1)
+        qsort(c->kernel_buf, n, sizeof(uint32_t), rd_cmp_u32);
+
+    uint8_t next_flags = (anchored ? RD_F_ANCHORED : 0) | (eol ? RD_F_BOL : 0);
+    int32_t next = rd_intern(c, c->kernel_buf, n, next_flags);
+    if (next < 0)
+    {
+        // Cache full: start over with only the state we are moving to
+        rd_cache_flush(c);
+        return rd_intern(c, c->kernel_buf, n, next_flags);
+    }
+    c->trans[(size_t)sid * dfa->num_classes + cls] = next;
+    return next;
+}
+
+static inline bool rd_matches_before(uint8_t flags, bool eol)
+{
+    return (flags & RD_F_MATCH) || (eol && (flags & RD_F_MATCH_EOL));
+}
+
+// Next offset in [p, limit) holding one of the skip bytes, or limit
+static size_t rd_skip(const regex_dfa_t *dfa, const unsigned char *text, size_t p, size_t limit)
+{
+    if (dfa->num_skip_bytes == 1)
+    {
+        const unsigned char *hit = memchr(text + p, dfa->skip_bytes[0], limit - p);
+        return hit ? (size_t)(hit - text) : limit;
+    }
+    const bool *stop = dfa->skip_stop;
+    while (p + 4 <= limit)
+    {
+        if (stop[text[p]])
+            return p;
+        if (stop[text[p + 1]])
+            return p + 1;
+        if (stop[text[p + 2]])
+            return p + 2;
+        if (stop[text[p + 3]])
+            return p + 3;
+        p += 4;
+    }
+    while (p < limit && !stop[text[p]])
+        p++;
+    return p;
+}
+
+// Unanchored scan of [from, limit) for the end of the earliest-ending match
+static bool rd_scan_earliest(rd_cache_t *c, const unsigned char *text, size_t text_len, size_t from, size_t limit,
+                             size_t *end)
+{
+    const uint16_t *byte_class = c->dfa->byte_class;
+    const size_t num_classes = c->dfa->num_classes;
+    const bool skip = c->dfa->skip_enabled;
+    if (skip)
+        rd_start_state(c, false, false);
+    int32_t sid = rd_start_state(c, false, from == 0 || text[from - 1] == '\n');
+
+    for (size_t p = from; p < limit; p++)
+    {
+        if (skip && sid == c->start[0])
+        {
+            // Bytes other than the skip bytes keep the scan in the start state
+            p = rd_skip(c->dfa, text, p, limit);
+            if (p >= limit)
+                break;
+        }
+        unsigned char b = text[p];
+        uint8_t f = c->flags[sid];
+        if ((f & (RD_F_MATCH | RD_F_MATCH_EOL)) && rd_matches_before(f, b == '\n'))
+        {
+            *end = p;
+            return true;
+        }
+        uint32_t cls = byte_class[b];
+        int32_t next = c->trans[(size_t)sid * num_classes + cls];
+        if (next < 0)
+            next = rd_transition(c, sid, cls);
+        sid = next;
+    }
+
+    if (rd_matches_before(c->flags[sid], limit == text_len || text[limit] == '\n'))
+    {
+        *end = limit;
+        return true;
+    }
+    return false;
+}
+
+// Longest match starting exactly at start
+static bool rd_longest_at(rd_cache_t *c, const unsigned char *text, size_t text_len, size_t start, size_t limit,
+                          size_t *end)
+{
+    const uint16_t *byte_class = c->dfa->byte_class;
+    const size_t num_classes = c->dfa->num_classes;
+    int32_t sid = rd_start_state(c, true, start == 0 || text[start - 1] == '\n');
+    bool found = false;
+
+    for (size_t p = start; p < limit; p++)
+    {
+        uint8_t f = c->flags[sid];
+        if (f & RD_F_DEAD)
+            return found;
+        unsigned char b = text[p];
+        if (rd_matches_before(f, b == '\n'))
+        {
+            found = true;
+            *end = p;
+        }
+        uint32_t cls = byte_class[b];
+        int32_t next = c->trans[(size_t)sid * num_classes + cls];
+        if (next < 0)
+            next = rd_transition(c, sid, cls);
+        sid = next;
+    }
+
+    if (rd_matches_before(c->flags[sid], limit == text_len || text[limit] == '\n'))
+    {
+        found = true;
+        *end = limit;
+    }
+    return found;
+}
+
+bool regex_dfa_find(regex_dfa_t *dfa, const char *text, size_t text_len, size_t from, size_t limit,
+                    bool need_start, size_t *match_start, size_t *match_end)
+{
+    rd_cache_t *c = rd_get_cache(dfa);
+    if (!c)
+    {
+        fprintf(stderr, "krep: Warning: Cannot allocate regex DFA cache.\n");
+        return false;
+    }
+    const unsigned char *utext = (const unsigned char *)text;
+
+    size_t first_end;
+    if (!rd_scan_earliest(c, utext, text_len, from, limit, &first_end))
+        return false;
+    if (!need_start)
+    {
+        *match_start = first_end;
+        *match_end = first_end;
+        return true;
+    }
+
+    // The leftmost match starts on the same line, at or before first_end
+    size_t line_start = first_end;
+    while (line_start > from && utext[line_start - 1] != '\n')
+        line_start--;
+    for (size_t s = line_start; s <= first_end; s++)
+    {
+        if (rd_longest_at(c, utext, text_len, s, limit, match_end))
+        {
+            *match_start = s;
+            return true;
+        }
+    }
+
+    // Not reached: the match ending at first_end starts in [line_start, first_end]
+    *match_start = first_end;
+    *match_end = first_end;
+    return true;
+}
+
+void regex_dfa_free(regex_dfa_t *dfa)
+{
+    if (!dfa)
+        return;
+    pthread_mutex_destroy(&dfa->cache_lock);
+    for (rd_cache_t *c = dfa->caches; c;)
+    {
+        rd_cache_t *next = c->next_cache;
+        rd_cache_free(c);
+        c = next;
+    }
+    free(dfa->nfa);
+    free(dfa->set_class);
+    free(dfa->literal);
+    free(dfa);
+}
@@ -0,0 +1,40 @@
+/**
+ * Lazy DFA engine for the common POSIX ERE subset.
+ * This header declares the compiled matcher and its search entry points.
+ */
+
+#ifndef REGEX_DFA_H
+#define REGEX_DFA_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+
+// Forward declaration for the compiled matcher
+struct regex_dfa;
+typedef struct regex_dfa regex_dfa_t;
+
+// Compile an ERE with the semantics of regcomp(REG_EXTENDED | REG_NEWLINE [| REG_ICASE]).
+// Returns NULL when the pattern uses anything outside the supported subset (backreferences,
+// GNU escapes such as \b or \w, collating elements, patterns that can match a newline, ...),
+// in which case the caller keeps using POSIX regexec.
+regex_dfa_t *regex_dfa_compile(const char *pattern, bool case_sensitive);
+
+// Free the matcher and every per-thread state cache built for it
+void regex_dfa_free(regex_dfa_t *dfa);
+
+// A literal every match contains (lower-cased when case-insensitive), or NULL if none.
+// Matches never span lines, so only lines holding the literal need to be run through the DFA.
+const char *regex_dfa_required_literal(const regex_dfa_t *dfa, size_t *len);
+
+// True when the regex matches (the empty string) on every line, as ^, $ or x* do.
+// Counting matching lines then reduces to counting lines.
+bool regex_dfa_matches_every_line(const regex_dfa_t *dfa);
+
+// Find the leftmost-longest match starting in [from, limit). limit must be text_len or
+// the offset of a newline. With need_start false only the end of the earliest-ending
+// match is computed and *match_start is set to the same offset, which is enough to tell
+// which line matches. Safe to call from several threads at once.
+bool regex_dfa_find(regex_dfa_t *dfa, const char *text, size_t text_len, size_t from, size_t limit,
+                    bool need_start, size_t *match_start, size_t *match_end);
+
+#endif // REGEX_DFA_H
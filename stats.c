@@ -0,0 +1,223 @@
+/* stats.c - Run statistics for --stats
+ *
+ * Every thread that reaches a hook gets its own block of phase times and counters,
+ * registered on a global list the first time it is used, so the hot paths never share
+ * a cache line or take a lock. stats_report() merges the blocks once the search is
+ * done and reports the totals, the search throughput, how often the SIMD filters'
+ * candidates were real matches and how evenly the search time was spread over the
+ * threads.
+ *
+ * Building with -DKREP_NO_STATS (make STATS=0) turns every hook into nothing and
+ * leaves this file empty.
+ */
+
+#ifndef KREP_NO_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "stats.h"
+
+bool stats_enabled = false;
+
+// The owning thread is the only writer; relaxed atomics let the report read the
+// blocks of pool threads that are still alive without a data race
+typedef struct stats_block
+{
+    _Atomic uint64_t phase_ns[STATS_PHASE_COUNT];
+    _Atomic uint64_t counters[STATS_COUNTER_COUNT];
+    struct stats_block *next;
+} stats_block_t;
+
+static __thread stats_block_t *thread_block = NULL;
+static stats_block_t *all_blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t start_ns = 0;
+
+static const char *const phase_names[STATS_PHASE_COUNT] = {"map", "compile", "search", "merge", "sort", "print"};
+static const char *const counter_names[STATS_COUNTER_COUNT] = {
+    "files", "chunks", "bytes_scanned", "matches", "filter_candidates", "filter_verified", "items_printed"};
+
+uint64_t stats_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// The calling thread's block, registered on first use. NULL if it cannot be allocated.
+static stats_block_t *stats_block(void)
+{
+    if (thread_block)
+        return thread_block;
+    stats_block_t *block = calloc(1, sizeof(stats_block_t));
+    if (!block)
+        return NULL;
+    pthread_mutex_lock(&blocks_lock);
+    block->next = all_blocks;
+    all_blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+    thread_block = block;
+    return block;
+}
+
+static inline void block_add(_Atomic uint64_t *slot, uint64_t n)
+{
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+void stats_phase_add(stats_phase_t phase, uint64_t ns)
+{
+    stats_block_t *block = stats_block();
+    if (block)
+        block_add(&block->phase_ns[phase], ns);
+}
+
+void stats_counter_add(stats_counter_t counter, uint64_t n)
+{
+    stats_block_t *block = stats_block();
+    if (block)
+        block_add(&block->counters[counter], n);
+}
+
+void stats_start(void)
+{
+    start_ns = stats_now_ns();
+    stats_enabled = true;
+}
+
+void stats_reset(void)
+{
+    stats_enabled = false;
+    pthread_mutex_lock(&blocks_lock);
+    for (stats_block_t *b = all_blocks; b; b = b->next)
+    {
+        for (int i = 0; i < STATS_PHASE_COUNT; i++)
+            atomic_store_explicit(&b->phase_ns[i], 0, memory_order_relaxed);
+        for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+            atomic_store_explicit(&b->counters[i], 0, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+uint64_t stats_phase_total(stats_phase_t phase)
+{
+    uint64_t total = 0;
+    pthread_mutex_lock(&blocks_lock);
+    for (stats_block_t *b = all_blocks; b; b = b->next)
+        total += atomic_load_explicit(&b->phase_ns[phase], memory_order_relaxed);
+    pthread_mutex_unlock(&blocks_lock);
+    return total;
+}
+
+uint64_t stats_counter_total(stats_counter_t counter)
+{
+    uint64_t total = 0;
+    pthread_mutex_lock(&blocks_lock);
+    for (stats_block_t *b = all_blocks; b; b = b->next)
+        total += atomic_load_explicit(&b->counters[counter], memory_order_relaxed);
+    pthread_mutex_unlock(&blocks_lock);
+    return total;
+}
+
+// Search time per thread that searched: how many, and the least, mean and most
+typedef struct
+{
+    int threads;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    double mean_ns;
+} stats_balance_t;
+
+static stats_balance_t stats_search_balance(void)
+{
+    stats_balance_t balance = {0, UINT64_MAX, 0, 0.0};
+    uint64_t sum = 0;
+    pthread_mutex_lock(&blocks_lock);
+    for (stats_block_t *b = all_blocks; b; b = b->next)
+    {
+        uint64_t ns = atomic_load_explicit(&b->phase_ns[STATS_PHASE_SEARCH], memory_order_relaxed);
+        if (ns == 0)
+            continue;
+        balance.threads++;
+        sum += ns;
+        if (ns < balance.min_ns)
+            balance.min_ns = ns;
+        if (ns > balance.max_ns)
+            balance.max_ns = ns;
+    }
+    pthread_mutex_unlock(&blocks_lock);
+    if (balance.threads == 0)
+        balance.min_ns = 0;
+    else
+        balance.mean_ns = (double)sum / balance.threads;
+    return balance;
+}
+
+void stats_report(FILE *out, stats_format_t format)
+{
+    uint64_t wall_ns = stats_now_ns() - start_ns;
+    uint64_t phases[STATS_PHASE_COUNT];
+    uint64_t counters[STATS_COUNTER_COUNT];
+    uint64_t phase_sum = 0;
+    for (int i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        phases[i] = stats_phase_total((stats_phase_t)i);
+        phase_sum += phases[i];
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+        counters[i] = stats_counter_total((stats_counter_t)i);
+    stats_balance_t balance = stats_search_balance();
+    double imbalance = balance.mean_ns > 0 ? balance.max_ns / balance.mean_ns : 0.0;
+
+    if (format == STATS_FORMAT_JSON)
+    {
+        fprintf(out, "{\"wall_ns\": %" PRIu64 ", \"phases_ns\": {", wall_ns);
+        for (int i = 0; i < STATS_PHASE_COUNT; i++)
+            fprintf(out, "%s\"%s\": %" PRIu64, i ? ", " : "", phase_names[i], phases[i]);
+        fprintf(out, "}, \"counters\": {");
+        for (int i = 0; i < STATS_COUNTER_COUNT; i++)
+            fprintf(out, "%s\"%s\": %" PRIu64, i ? ", " : "", counter_names[i], counters[i]);
+        fprintf(out,
+                "}, \"search_threads\": {\"count\": %d, \"min_ns\": %" PRIu64 ", \"mean_ns\": %.0f, "
+                "\"max_ns\": %" PRIu64 ", \"imbalance\": %.3f}}\n",
+                balance.threads, balance.min_ns, balance.mean_ns, balance.max_ns, imbalance);
+        return;
+    }
+
+    fprintf(out, "krep: statistics\n");
+    fprintf(out, "  %-18s %12.3f ms\n", "wall time", wall_ns / 1e6);
+    for (int i = 0; i < STATS_PHASE_COUNT; i++)
+    {
+        fprintf(out, "  %-18s %12.3f ms  %5.1f%%\n", phase_names[i], phases[i] / 1e6,
+                phase_sum ? 100.0 * phases[i] / phase_sum : 0.0);
+    }
+    fprintf(out, "  (phase times are summed over threads)\n");
+    fprintf(out, "  %-18s %12" PRIu64 "\n", "files", counters[STATS_FILES]);
+    fprintf(out, "  %-18s %12" PRIu64 "\n", "chunks", counters[STATS_CHUNKS]);
+    fprintf(out, "  %-18s %12" PRIu64, "bytes scanned", counters[STATS_BYTES_SCANNED]);
+    if (phases[STATS_PHASE_SEARCH] > 0)
+        fprintf(out, " (%.2f GB/s per search thread)",
+                (double)counters[STATS_BYTES_SCANNED] / phases[STATS_PHASE_SEARCH]);
+    fprintf(out, "\n");
+    fprintf(out, "  %-18s %12" PRIu64 "\n", "matches", counters[STATS_MATCHES]);
+    fprintf(out, "  %-18s %12" PRIu64, "filter candidates", counters[STATS_FILTER_CANDIDATES]);
+    if (counters[STATS_FILTER_CANDIDATES] > 0)
+        fprintf(out, " (%" PRIu64 " verified, %.1f%%)", counters[STATS_FILTER_VERIFIED],
+                100.0 * counters[STATS_FILTER_VERIFIED] / counters[STATS_FILTER_CANDIDATES]);
+    fprintf(out, "\n");
+    fprintf(out, "  %-18s %12" PRIu64 "\n", "items printed", counters[STATS_ITEMS_PRINTED]);
+    fprintf(out, "  %-18s %12d", "search threads", balance.threads);
+    if (balance.threads > 0)
+        fprintf(out, " (min/mean/max %.3f/%.3f/%.3f ms, imbalance %.2f)", balance.min_ns / 1e6,
+                balance.mean_ns / 1e6, balance.max_ns / 1e6, imbalance);
+    fprintf(out, "\n");
+}
+
+#endif // KREP_NO_STATS
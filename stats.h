@@ -0,0 +1,100 @@
+/**
+ * Run statistics for --stats: per-phase timings and hot-path counters.
+ * This header declares the per-thread accumulators and the report that merges them.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Phases timed by --stats. Times are summed over the threads that ran the phase.
+typedef enum
+{
+   STATS_PHASE_MAP,     // mmap and page population of input files
+   STATS_PHASE_COMPILE, // Aho-Corasick trie build, regex and DFA compilation
+   STATS_PHASE_SEARCH,  // Search kernels over chunks, windows and stream blocks
+   STATS_PHASE_MERGE,   // match_result_merge of per-chunk results
+   STATS_PHASE_SORT,    // Sorting merged match positions
+   STATS_PHASE_PRINT,   // print_matching_items formatting and the output writes
+   STATS_PHASE_COUNT
+} stats_phase_t;
+
+// Counters kept by --stats
+typedef enum
+{
+   STATS_FILES,             // Files (or streams) searched
+   STATS_CHUNKS,            // Search kernel invocations (chunks, windows, stream blocks)
+   STATS_BYTES_SCANNED,     // Bytes handed to the search kernels
+   STATS_MATCHES,           // Lines counted or matches found by the kernels
+   STATS_FILTER_CANDIDATES, // Positions passing a SIMD first/last byte filter
+   STATS_FILTER_VERIFIED,   // Candidates confirmed by comparing the whole pattern
+   STATS_ITEMS_PRINTED,     // Lines or -o matches written by print_matching_items
+   STATS_COUNTER_COUNT
+} stats_counter_t;
+
+// Report formats for stats_report
+typedef enum
+{
+   STATS_FORMAT_TEXT,
+   STATS_FORMAT_JSON
+} stats_format_t;
+
+#ifndef KREP_NO_STATS
+
+// Set by --stats. Every hook below is a single predictable branch while it is false.
+extern bool stats_enabled;
+
+// Monotonic clock in nanoseconds
+uint64_t stats_now_ns(void);
+
+// Add to the calling thread's accumulators (registered on first use)
+void stats_phase_add(stats_phase_t phase, uint64_t ns);
+void stats_counter_add(stats_counter_t counter, uint64_t n);
+
+// Start collecting: enables the hooks and starts the wall clock
+void stats_start(void);
+
+// Merge every thread's accumulators and write the report to out. Call only once the
+// threads that searched are idle.
+void stats_report(FILE *out, stats_format_t format);
+
+// Zero every thread's accumulators and disable collection
+void stats_reset(void);
+
+// Merged totals over all threads (for tests and the report)
+uint64_t stats_phase_total(stats_phase_t phase);
+uint64_t stats_counter_total(stats_counter_t counter);
+
+#define STATS_ACTIVE() __builtin_expect(stats_enabled, 0)
+// Declare and start a phase timer
+#define STATS_TIMER(name) uint64_t name = STATS_ACTIVE() ? stats_now_ns() : 0
+// Add the time since STATS_TIMER(name) to phase
+#define STATS_PHASE_END(phase, name)                           \
+   do                                                          \
+   {                                                           \
+      if (STATS_ACTIVE())                                      \
+         stats_phase_add((phase), stats_now_ns() - (name));    \
+   } while (0)
+#define STATS_ADD(counter, n)                                  \
+   do                                                          \
+   {                                                           \
+      if (STATS_ACTIVE())                                      \
+         stats_counter_add((counter), (uint64_t)(n));          \
+   } while (0)
+
+#else // KREP_NO_STATS: every hook compiles to nothing
+
+#define STATS_ACTIVE() 0
+#define STATS_TIMER(name) \
+   do                     \
+   {                      \
+   } while (0)
+#define STATS_PHASE_END(phase, name) ((void)0)
+#define STATS_ADD(counter, n) ((void)(n))
+
+#endif // KREP_NO_STATS
+
+#endif // STATS_H
@@ -0,0 +1,183 @@
+/**
+ * Test suite for the per-search arena allocator
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../arena.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define ARENA_TEST_FILE "/tmp/krep_test_arena.txt"
+
+void test_arena_basic(void)
+{
+    printf("\n=== Arena Allocation Tests ===\n");
+    arena_t *arena = arena_create();
+    TEST_ASSERT(arena != NULL, "Arena created");
+    if (!arena)
+        return;
+
+    char *a = arena_alloc(arena, 10);
+    char *b = arena_alloc(arena, 100);
+    TEST_ASSERT(a && b && ((uintptr_t)a % 16) == 0 && ((uintptr_t)b % 16) == 0, "Allocations are 16-byte aligned");
+    TEST_ASSERT(b >= a + 10, "Allocations do not overlap");
+
+    memset(b, 'x', 100);
+    char *grown = arena_grow(arena, b, 100, 4000);
+    TEST_ASSERT(grown == b, "The most recent allocation grows in place");
+
+    char *c = arena_alloc(arena, 16);
+    memset(a, 'y', 10);
+    char *moved = arena_grow(arena, a, 10, 64);
+    TEST_ASSERT(moved && moved != a && memcmp(moved, "yyyyyyyyyy", 10) == 0, "Older allocations are copied when grown");
+    TEST_ASSERT(c != NULL && grown[99] == 'x', "Growing another allocation leaves the rest intact");
+
+    // Past the first block: a new, larger block
+    char *big = arena_alloc(arena, ARENA_MIN_BLOCK_SIZE * 3);
+    TEST_ASSERT(big != NULL && arena_capacity(arena) >= ARENA_MIN_BLOCK_SIZE * 4, "Large allocations add a block");
+    big[ARENA_MIN_BLOCK_SIZE * 3 - 1] = 'z';
+
+    arena_reset(arena);
+    size_t kept = arena_capacity(arena);
+    TEST_ASSERT(kept >= ARENA_MIN_BLOCK_SIZE * 3 && kept <= ARENA_RETAIN_MAX, "Reset keeps the largest block");
+    char *reused = arena_alloc(arena, ARENA_MIN_BLOCK_SIZE * 2);
+    TEST_ASSERT(reused != NULL && arena_capacity(arena) == kept, "Allocation after reset reuses the kept block");
+
+    char *huge = arena_alloc(arena, ARENA_RETAIN_MAX * 2);
+    TEST_ASSERT(huge != NULL, "Allocations larger than the retain limit succeed");
+    arena_reset(arena);
+    TEST_ASSERT(arena_capacity(arena) <= ARENA_RETAIN_MAX, "Reset frees blocks over the retain limit");
+    arena_destroy(arena);
+
+    // The thread cache hands back released arenas
+    arena_t *first = arena_acquire();
+    arena_release(first);
+    arena_t *second = arena_acquire();
+    TEST_ASSERT(first && second == first, "Released arenas are reused by the same thread");
+    arena_release(second);
+    arena_release(NULL);
+}
+
+void test_arena_match_results(void)
+{
+    printf("\n=== Arena Match Result Tests ===\n");
+    arena_t *arena = arena_acquire();
+    match_result_t *result = match_result_init_arena(arena, 4);
+    TEST_ASSERT(result != NULL && result->arena == arena, "Match results can live in an arena");
+    if (!result)
+    {
+        arena_release(arena);
+        return;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < 100000; i++)
+        ok &= match_result_add(result, i * 3, i * 3 + 2);
+    TEST_ASSERT(ok && result->count == 100000, "Arena results grow like malloc'd ones");
+    TEST_ASSERT(result->positions[99999].start_offset == 299997 && result->positions[0].end_offset == 2,
+                "Positions survive growth");
+
+    match_result_t *src = match_result_init(1);
+    match_result_add(src, 1, 2);
+    match_result_add(src, 5, 9);
+    TEST_ASSERT(match_result_merge(result, src, 1000000) && result->count == 100002 &&
+                    result->positions[100001].start_offset == 1000005,
+                "Merge into an arena result");
+    match_result_free(src);
+
+    match_result_free(result); // No-op: reclaimed with the arena
+    arena_release(arena);
+
+    match_result_t *heap = match_result_init_arena(NULL, 8);
+    TEST_ASSERT(heap != NULL && heap->arena == NULL, "A NULL arena falls back to malloc");
+    match_result_free(heap);
+}
+
+void test_arena_search_reuse(void)
+{
+    printf("\n=== Arena Reuse Across Searches ===\n");
+    FILE *f = fopen(ARENA_TEST_FILE, "w");
+    if (!f)
+    {
+        TEST_ASSERT(false, "Arena test file written");
+        return;
+    }
+    for (int i = 0; i < 20000; i++)
+        fprintf(f, i % 7 ? "%d quiet line\n" : "%d loud WARN line WARN\n", i);
+    fclose(f);
+
+    // Repeated searches reuse the arenas and line buffers of earlier ones
+    search_params_t params = create_literal_params("WARN", true, false, false);
+    char *first = NULL;
+    capture_search_output(&params, ARENA_TEST_FILE, 1, &first);
+    char *second = NULL;
+    capture_search_output(&params, ARENA_TEST_FILE, 1, &second);
+    TEST_ASSERT(first && second && strlen(first) > 0 && strcmp(first, second) == 0,
+                "Repeated searches print the same lines");
+    char *threaded = NULL;
+    capture_search_output(&params, ARENA_TEST_FILE, 4, &threaded);
+    TEST_ASSERT(threaded && first && strcmp(first, threaded) == 0, "Chunked search prints the same lines");
+    cleanup_params(&params);
+
+    // -m over a single chunk caps the positions used in place
+    params = create_literal_params("loud", true, false, false);
+    params.max_count = 3;
+    char *limited = NULL;
+    capture_search_output(&params, ARENA_TEST_FILE, 1, &limited);
+    size_t lines = 0;
+    for (const char *p = limited; p && *p; p++)
+        lines += (*p == '\n');
+    TEST_ASSERT(lines == 3, "-m caps positions handed to the printer");
+    cleanup_params(&params);
+
+    free(first);
+    free(second);
+    free(threaded);
+    free(limited);
+    unlink(ARENA_TEST_FILE);
+}
+
+void run_arena_tests(void)
+{
+    printf("\n--- Running Arena Tests ---\n");
+
+    test_arena_basic();
+    test_arena_match_results();
+    test_arena_search_reuse();
+
+    printf("\n--- Completed Arena Tests ---\n");
+}
@@ -0,0 +1,215 @@
+/**
+ * Test suite for context lines (-A / -B / -C)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define CONTEXT_TEST_FILE "/tmp/krep_test_context.txt"
+#define CONTEXT_TEST_LINES 600000 // 20-byte lines: 12 MB, three chunks with 4 threads
+#define CONTEXT_STREAM_BLOCK_SIZE (1024 * 1024) // STREAM_BLOCK_SIZE in krep.c
+
+// Line i of the test file; matching lines hold "hit!"
+static void context_line(char *buf, size_t i, bool hit)
+{
+    snprintf(buf, 21, hit ? "%07zu hit! marker\n" : "%07zu filler text\n", i);
+}
+
+static bool write_context_file(const size_t *hits, size_t num_hits)
+{
+    FILE *f = fopen(CONTEXT_TEST_FILE, "w");
+    if (!f)
+        return false;
+    char line[32];
+    size_t next = 0;
+    for (size_t i = 0; i < CONTEXT_TEST_LINES; i++)
+    {
+        bool hit = next < num_hits && hits[next] == i;
+        next += hit;
+        context_line(line, i, hit);
+        fputs(line, f);
+    }
+    return fclose(f) == 0;
+}
+
+// What grep -A after -B before prints for the file, with prefix before every line
+static char *expected_context(const size_t *hits, size_t num_hits, size_t before, size_t after, const char *prefix)
+{
+    size_t prefix_len = prefix ? strlen(prefix) : 0;
+    char *out = malloc((size_t)CONTEXT_TEST_LINES * (prefix_len + 24) + 1);
+    if (!out)
+        return NULL;
+    char *p = out;
+    size_t printed_end = 0; // First line not printed yet
+    bool printed = false;
+    char line[32];
+    for (size_t h = 0; h < num_hits; h++)
+    {
+        size_t first = hits[h] > before ? hits[h] - before : 0;
+        size_t last = hits[h] + after < CONTEXT_TEST_LINES ? hits[h] + after : CONTEXT_TEST_LINES - 1;
+        if (h + 1 < num_hits && last >= hits[h + 1])
+            last = hits[h + 1] - 1; // The next matching line takes over
+        if (first < printed_end)
+            first = printed_end;
+        if (printed && first > printed_end)
+            p += sprintf(p, "--\n");
+        for (size_t i = first; i <= last; i++)
+        {
+            bool hit = i == hits[h];
+            context_line(line, i, hit);
+            if (prefix)
+                p += sprintf(p, "%s%c", prefix, hit ? ':' : '-');
+            p += sprintf(p, "%s", line);
+        }
+        printed_end = last + 1;
+        printed = true;
+    }
+    *p = '\0';
+    return out;
+}
+
+// Compare file (1 and 4 threads) and stream output against the expected groups
+static void check_context(const char *name, const size_t *hits, size_t num_hits, size_t before, size_t after)
+{
+    char message[160];
+    if (!write_context_file(hits, num_hits))
+    {
+        TEST_ASSERT(false, "Context test file written");
+        return;
+    }
+    search_params_t params = create_literal_params("hit!", true, false, false);
+    params.context_before = before;
+    params.context_after = after;
+
+    char *expected_file = expected_context(hits, num_hits, before, after, CONTEXT_TEST_FILE);
+    char *expected_stream = expected_context(hits, num_hits, before, after, NULL);
+    char *single = NULL;
+    capture_search_output(&params, CONTEXT_TEST_FILE, 1, &single);
+    char *chunked = NULL;
+    capture_search_output(&params, CONTEXT_TEST_FILE, 4, &chunked);
+    char *streamed = NULL;
+    capture_search_output(&params, CONTEXT_TEST_FILE, 0, &streamed);
+
+    snprintf(message, sizeof(message), "%s: single chunk", name);
+    TEST_ASSERT(expected_file && single && strcmp(single, expected_file) == 0, message);
+    snprintf(message, sizeof(message), "%s: across chunk boundaries", name);
+    TEST_ASSERT(expected_file && chunked && strcmp(chunked, expected_file) == 0, message);
+    snprintf(message, sizeof(message), "%s: across stream blocks", name);
+    TEST_ASSERT(expected_stream && streamed && strcmp(streamed, expected_stream) == 0, message);
+
+    free(expected_file);
+    free(expected_stream);
+    free(single);
+    free(chunked);
+    free(streamed);
+    cleanup_params(&params);
+}
+
+void test_context_groups(void)
+{
+    printf("\n=== Context Group Tests ===\n");
+    // Overlapping and adjacent groups merge; the first and last lines have no neighbours.
+    // Chunks of 4 MB end near lines 209715 and 419430.
+    const size_t hits[] = {0, 4, 10, 16, 209714, 209716, 419431, 599999};
+    check_context("-B 2 -A 3", hits, sizeof(hits) / sizeof(hits[0]), 2, 3);
+    check_context("-A 1 only", hits, sizeof(hits) / sizeof(hits[0]), 0, 1);
+    check_context("-B 4 only", hits, sizeof(hits) / sizeof(hits[0]), 4, 0);
+}
+
+void test_context_long_ranges(void)
+{
+    printf("\n=== Long Context Range Tests ===\n");
+    // Context reaching across a chunk boundary into a chunk without matches
+    const size_t crossing[] = {180000, 400000};
+    check_context("-C 50000", crossing, 2, 50000, 50000);
+    // Two groups that meet with no gap, over a middle chunk without matches
+    const size_t spanning[] = {100000, 500000};
+    check_context("-C 200000", spanning, 2, 200000, 200000);
+}
+
+void test_context_stream_windows(void)
+{
+    printf("\n=== Context Across Stream Windows Tests ===\n");
+    // Stream windows end at STREAM_BLOCK_SIZE reads; the lines kept in front of a window
+    // are all that remain of a gap, so a match on the window's first new line (the
+    // carried line 52428, then 104857) still follows skipped lines
+    const size_t block = CONTEXT_STREAM_BLOCK_SIZE;
+    const size_t hits[] = {100, block / 20, 2 * block / 20, 300000};
+    check_context("-B 2 -A 1 at window starts", hits, sizeof(hits) / sizeof(hits[0]), 2, 1);
+    check_context("-C 2 at window starts", hits, sizeof(hits) / sizeof(hits[0]), 2, 2);
+    check_context("-B 3 at window starts", hits, sizeof(hits) / sizeof(hits[0]), 3, 0);
+}
+
+void test_context_max_count(void)
+{
+    printf("\n=== Context With -m Tests ===\n");
+    const size_t hits[] = {10, 11, 20};
+    if (!write_context_file(hits, 3))
+    {
+        TEST_ASSERT(false, "Context test file written");
+        return;
+    }
+    search_params_t params = create_literal_params("hit!", true, false, false);
+    params.context_after = 2;
+    params.max_count = 1;
+    char *out = NULL;
+    capture_search_output(&params, CONTEXT_TEST_FILE, 1, &out);
+    char *streamed = NULL;
+    capture_search_output(&params, CONTEXT_TEST_FILE, 0, &streamed);
+    // The last counted line still gets its after-context, where a later match is context
+    TEST_ASSERT(out && strstr(out, ":0000010 hit!") && strstr(out, "-0000011 hit!") && strstr(out, "-0000012 filler") &&
+                    !strstr(out, "0000013"),
+                "-m keeps the after-context of the last matching line");
+    TEST_ASSERT(streamed && strcmp(streamed, "0000010 hit! marker\n0000011 hit! marker\n0000012 filler text\n") == 0,
+                "Streams read on for after-context owed once -m is reached");
+    free(out);
+    free(streamed);
+    cleanup_params(&params);
+}
+
+void run_context_tests(void)
+{
+    printf("\n--- Running Context Line Tests ---\n");
+
+    test_context_groups();
+    test_context_long_ranges();
+    test_context_stream_windows();
+    test_context_max_count();
+
+    unlink(CONTEXT_TEST_FILE);
+    printf("\n--- Completed Context Line Tests ---\n");
+}
@@ -0,0 +1,401 @@
+/**
+ * Test suite for searching compressed input files (.gz, .zst, .lz4)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../decompress.h"
+#include "test_krep.h"
+
+#if KREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#if KREP_HAVE_ZLIB
+
+#define DZ_TEST_PLAIN "/tmp/krep_test_dz_plain.txt"
+#define DZ_TEST_GZIP "/tmp/krep_test_dz_plain.txt.gz"
+#define DZ_TEST_BGZF "/tmp/krep_test_dz_bgzf.txt.gz"
+#define DZ_TEST_TRUNCATED "/tmp/krep_test_dz_truncated.gz"
+#define DZ_TEST_ZSTD "/tmp/krep_test_dz_fake.txt.zst"
+#define DZ_TEST_LZ4 "/tmp/krep_test_dz_fake.txt.lz4"
+
+/* Lines in the generated input; a few MB once decompressed */
+#define DZ_TEST_LINES 150000
+
+/* Uncompressed bytes per BGZF member (the format caps members at 64KB) */
+#define DZ_BGZF_MEMBER (60 * 1024)
+
+static char *dz_input = NULL;
+static size_t dz_input_len = 0;
+
+/**
+ * Build the input in memory: every 500th line holds "needle", the rest is filler
+ */
+static bool build_dz_input(void)
+{
+    size_t cap = (size_t)DZ_TEST_LINES * 48;
+    dz_input = malloc(cap);
+    if (!dz_input)
+        return false;
+    dz_input_len = 0;
+    for (int i = 1; i <= DZ_TEST_LINES; i++)
+    {
+        const char *fmt = (i % 500 == 0) ? "line %d has a Needle in it\n" : "line %d is just some filler text\n";
+        dz_input_len += snprintf(dz_input + dz_input_len, cap - dz_input_len, fmt, i);
+    }
+    return true;
+}
+
+static bool write_plain_and_gzip(void)
+{
+    FILE *f = fopen(DZ_TEST_PLAIN, "w");
+    if (!f)
+        return false;
+    bool ok = fwrite(dz_input, 1, dz_input_len, f) == dz_input_len;
+    ok = (fclose(f) == 0) && ok;
+
+    gzFile gz = gzopen(DZ_TEST_GZIP, "wb6");
+    if (!gz)
+        return false;
+    ok = gzwrite(gz, dz_input, (unsigned)dz_input_len) == (int)dz_input_len && ok;
+    return gzclose(gz) == Z_OK && ok;
+}
+
+static void put_le16(unsigned char *p, unsigned v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_le32(unsigned char *p, unsigned long v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, (v >> 16) & 0xffff);
+}
+
+/**
+ * Write the input as BGZF: independent gzip members, each with the "BC" extra field
+ * holding the member size, followed by the empty end-of-file member.
+ */
+static bool write_bgzf(void)
+{
+    FILE *f = fopen(DZ_TEST_BGZF, "wb");
+    if (!f)
+        return false;
+
+    unsigned char member[18 + 70000 + 8];
+    bool ok = true;
+    size_t off = 0;
+    do
+    {
+        size_t len = dz_input_len - off < DZ_BGZF_MEMBER ? dz_input_len - off : DZ_BGZF_MEMBER;
+        z_stream zs = {0};
+        if (deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            ok = false;
+            break;
+        }
+        zs.next_in = (Bytef *)dz_input + off;
+        zs.avail_in = (uInt)len;
+        zs.next_out = member + 18;
+        zs.avail_out = 70000;
+        int zrc = deflate(&zs, Z_FINISH);
+        size_t clen = zs.total_out;
+        deflateEnd(&zs);
+        if (zrc != Z_STREAM_END)
+        {
+            ok = false;
+            break;
+        }
+
+        static const unsigned char header[16] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+        memcpy(member, header, sizeof(header));
+        size_t total = 18 + clen + 8;
+        put_le16(member + 16, (unsigned)(total - 1));
+        put_le32(member + 18 + clen, crc32(crc32(0L, Z_NULL, 0), (const Bytef *)dz_input + off, (uInt)len));
+        put_le32(member + 18 + clen + 4, (unsigned long)len);
+        ok = fwrite(member, 1, total, f) == total && ok;
+        off += len;
+    } while (off < dz_input_len);
+
+    static const unsigned char eof_member[28] = {0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C',
+                                                 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    ok = fwrite(eof_member, 1, sizeof(eof_member), f) == sizeof(eof_member) && ok;
+    return fclose(f) == 0 && ok;
+}
+
+/**
+ * Copy the first half of the gzip file: the stream ends in the middle of a deflate block
+ */
+static bool write_truncated(void)
+{
+    FILE *in = fopen(DZ_TEST_GZIP, "rb");
+    FILE *out = fopen(DZ_TEST_TRUNCATED, "wb");
+    bool ok = in && out;
+    if (ok)
+    {
+        fseek(in, 0, SEEK_END);
+        long half = ftell(in) / 2;
+        fseek(in, 0, SEEK_SET);
+        char buf[4096];
+        while (ok && half > 0)
+        {
+            size_t want = half < (long)sizeof(buf) ? (size_t)half : sizeof(buf);
+            ok = fread(buf, 1, want, in) == want && fwrite(buf, 1, want, out) == want;
+            half -= want;
+        }
+    }
+    if (in)
+        fclose(in);
+    if (out)
+        ok = (fclose(out) == 0) && ok;
+    return ok;
+}
+
+/**
+ * Run search_file on path with stdout captured; the "path:" prefix of each printed line
+ * is dropped so searches of different files can be compared. Returns the result code.
+ */
+static int run_dz_capture(const search_params_t *params, const char *path, char **output)
+{
+    int rc = capture_search_output(params, path, 1, output);
+    size_t prefix = strlen(path) + 1;
+    char *in = *output, *out = *output;
+    while (in && *in)
+    {
+        if (strncmp(in, path, prefix - 1) == 0 && in[prefix - 1] == ':')
+            in += prefix;
+        const char *newline = strchr(in, '\n');
+        size_t len = newline ? (size_t)(newline - in) + 1 : strlen(in);
+        memmove(out, in, len);
+        out += len;
+        in += len;
+    }
+    if (out)
+        *out = '\0';
+    return rc;
+}
+
+/**
+ * True when searching the compressed file prints what searching the plain file prints
+ */
+static bool compressed_matches_plain(const search_params_t *params, const char *path)
+{
+    char *plain = NULL, *compressed = NULL;
+    int rc_plain = run_dz_capture(params, DZ_TEST_PLAIN, &plain);
+    int rc_compressed = run_dz_capture(params, path, &compressed);
+    bool same = rc_plain == rc_compressed && plain && compressed && strcmp(plain, compressed) == 0;
+    free(plain);
+    free(compressed);
+    return same;
+}
+
+/**
+ * Write a format's magic bytes followed by plain text, which no decoder accepts
+ */
+static bool write_fake_compressed(const char *path, const unsigned char magic[4])
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    fwrite(magic, 1, 4, f);
+    fputs("Needle in raw bytes\n", f);
+    return fclose(f) == 0;
+}
+
+/**
+ * Decode a whole file through the decoder API in small reads
+ */
+static bool decodes_to_input(const char *path, int threads)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    decompress_format_t format = decompress_detect(fd, path);
+    decompress_t *d = format == DECOMPRESS_GZIP ? decompress_open(fd, format, threads) : NULL;
+    close(fd);
+    if (!d)
+        return false;
+
+    char *out = malloc(dz_input_len + 1);
+    size_t n = 0;
+    ssize_t got;
+    while (out && (got = decompress_read(d, out + n, (dz_input_len + 1 - n) < 7777 ? dz_input_len + 1 - n : 7777)) > 0)
+        n += got;
+    bool same = out && got == 0 && n == dz_input_len && memcmp(out, dz_input, n) == 0;
+    free(out);
+    decompress_close(d);
+    return same;
+}
+
+void test_decompress_api(void)
+{
+    printf("\n=== Decompression API Tests ===\n");
+
+    int fd = open(DZ_TEST_PLAIN, O_RDONLY);
+    TEST_ASSERT(fd != -1 && decompress_detect(fd, DZ_TEST_PLAIN) == DECOMPRESS_NONE,
+                "Plain files are not detected as compressed");
+    if (fd != -1)
+        close(fd);
+
+    // The extension picks the candidate format and the magic bytes confirm it
+    rename(DZ_TEST_BGZF, DZ_TEST_BGZF ".data");
+    fd = open(DZ_TEST_BGZF ".data", O_RDONLY);
+    TEST_ASSERT(fd != -1 && decompress_detect(fd, DZ_TEST_BGZF ".data") == DECOMPRESS_NONE,
+                "gzip data without a compressed extension is searched as is");
+    if (fd != -1)
+        close(fd);
+    rename(DZ_TEST_BGZF ".data", DZ_TEST_BGZF);
+
+    fd = open(DZ_TEST_PLAIN, O_RDONLY);
+    TEST_ASSERT(fd != -1 && decompress_detect(fd, DZ_TEST_GZIP) == DECOMPRESS_NONE,
+                "A .gz name without the gzip magic is not decoded");
+    if (fd != -1)
+        close(fd);
+
+    fd = open(DZ_TEST_BGZF, O_RDONLY);
+    TEST_ASSERT(fd != -1 && decompress_detect(fd, DZ_TEST_BGZF) == DECOMPRESS_GZIP, "gzip files are detected");
+    if (fd != -1)
+        close(fd);
+
+    // zstd and lz4 are detected whether or not their libraries were built in
+    const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    const unsigned char lz4_magic[] = {0x04, 0x22, 0x4d, 0x18};
+    bool fakes = write_fake_compressed(DZ_TEST_ZSTD, zstd_magic) && write_fake_compressed(DZ_TEST_LZ4, lz4_magic);
+    fd = open(DZ_TEST_ZSTD, O_RDONLY);
+    TEST_ASSERT(fakes && fd != -1 && decompress_detect(fd, DZ_TEST_ZSTD) == DECOMPRESS_ZSTD &&
+                    decompress_supported(DECOMPRESS_ZSTD) == KREP_HAVE_ZSTD,
+                "zstd files are detected");
+    if (fd != -1)
+        close(fd);
+    fd = open(DZ_TEST_LZ4, O_RDONLY);
+    TEST_ASSERT(fakes && fd != -1 && decompress_detect(fd, DZ_TEST_LZ4) == DECOMPRESS_LZ4 &&
+                    decompress_supported(DECOMPRESS_LZ4) == KREP_HAVE_LZ4,
+                "lz4 files are detected");
+    if (fd != -1)
+        close(fd);
+
+    TEST_ASSERT(decodes_to_input(DZ_TEST_GZIP, 1), "Single-member gzip decodes to the original data");
+    TEST_ASSERT(decodes_to_input(DZ_TEST_BGZF, 1), "BGZF decodes to the original data on one worker");
+    TEST_ASSERT(decodes_to_input(DZ_TEST_BGZF, 4), "BGZF decodes in order on several workers");
+}
+
+void test_decompress_search(void)
+{
+    printf("\n=== Compressed Search Tests ===\n");
+    const char *files[] = {DZ_TEST_GZIP, DZ_TEST_BGZF};
+    const char *names[] = {"gzip", "BGZF"};
+
+    for (int i = 0; i < 2; i++)
+    {
+        char message[128];
+
+        search_params_t params = create_literal_params("Needle", true, false, false);
+        snprintf(message, sizeof(message), "%s search prints the same lines as the plain file", names[i]);
+        TEST_ASSERT(compressed_matches_plain(&params, files[i]), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("needle", false, true, false);
+        snprintf(message, sizeof(message), "%s -i -c gives the same count", names[i]);
+        TEST_ASSERT(compressed_matches_plain(&params, files[i]), message);
+        cleanup_params(&params);
+
+        params = create_regex_params("line [0-9]+0 has", true, false, true);
+        snprintf(message, sizeof(message), "%s regex -o prints the same matches", names[i]);
+        TEST_ASSERT(compressed_matches_plain(&params, files[i]), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("Needle", true, false, false);
+        params.max_count = 5;
+        snprintf(message, sizeof(message), "%s search honours -m", names[i]);
+        TEST_ASSERT(compressed_matches_plain(&params, files[i]), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("haystack", true, true, false);
+        snprintf(message, sizeof(message), "%s search without a match returns 1", names[i]);
+        TEST_ASSERT(compressed_matches_plain(&params, files[i]), message);
+        cleanup_params(&params);
+    }
+
+    search_params_t params = create_literal_params("Needle", true, true, false);
+    char *out = NULL;
+    int rc = run_dz_capture(&params, DZ_TEST_TRUNCATED, &out);
+    TEST_ASSERT(rc == 2, "Truncated gzip input is reported as an error");
+    free(out);
+
+    // Without the library (or with bad data) the raw bytes are never searched
+    rc = run_dz_capture(&params, DZ_TEST_ZSTD, &out);
+    TEST_ASSERT(rc == 2 && out && out[0] == '\0', "A .zst file that cannot be decoded is an error, not raw text");
+    free(out);
+    rc = run_dz_capture(&params, DZ_TEST_LZ4, &out);
+    TEST_ASSERT(rc == 2 && out && out[0] == '\0', "A .lz4 file that cannot be decoded is an error, not raw text");
+    free(out);
+    cleanup_params(&params);
+}
+
+#endif // KREP_HAVE_ZLIB
+
+void run_decompress_tests(void)
+{
+    printf("\n--- Running Decompression Tests ---\n");
+
+#if KREP_HAVE_ZLIB
+    if (!build_dz_input() || !write_plain_and_gzip() || !write_bgzf() || !write_truncated())
+    {
+        printf("✗ FAIL: Could not create decompression test input\n");
+        tests_failed++;
+    }
+    else
+    {
+        test_decompress_api();
+        test_decompress_search();
+    }
+
+    free(dz_input);
+    dz_input = NULL;
+    unlink(DZ_TEST_PLAIN);
+    unlink(DZ_TEST_GZIP);
+    unlink(DZ_TEST_BGZF);
+    unlink(DZ_TEST_TRUNCATED);
+    unlink(DZ_TEST_ZSTD);
+    unlink(DZ_TEST_LZ4);
+#else
+    printf("Built without zlib; skipping\n");
+#endif
+
+    printf("\n--- Completed Decompression Tests ---\n");
+}
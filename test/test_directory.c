@@ -19,6 +19,7 @@
 #endif
 
 #include "../krep.h"
+#include "../ignore.h"
 
 // Constants definitions
 #define TEST_DIR_BASE "/tmp/krep_test_dir"
@@ -30,6 +31,9 @@ static void cleanup_test_directory_structure(void);
 static void create_binary_file(const char *path);
 static void create_text_file(const char *path, const char *content);
 static void create_nested_directory(const char *base_path, int depth, int max_depth);
+static size_t count_lines_in_file(const char *path);
+static size_t list_files_in_walk_order(const char *dir, char *out, size_t out_size, size_t used);
+static size_t capture_counted_paths(const search_params_t *params, char *out, size_t out_size, int *errors);
 
 /**
  * Nested directory search test
@@ -57,6 +61,8 @@ void test_recursive_directory_search(void)
     params.patterns[0] = (char *)test_pattern;
     params.pattern_lens[0] = strlen(test_pattern);
     params.num_patterns = 1;
+    params.pattern = params.patterns[0];
+    params.pattern_len = params.pattern_lens[0];
     params.case_sensitive = true;
     params.use_regex = false;
     params.count_lines_mode = false;
@@ -96,6 +102,230 @@ void test_recursive_directory_search(void)
     cleanup_test_directory_structure();
 }
 
+/**
+ * Parallel file-level search test: output must be complete and one line per match
+ */
+void test_parallel_recursive_search(void)
+{
+    printf("\n=== Testing Parallel Recursive Search ===\n");
+
+    create_test_directory_structure();
+
+    search_params_t params = {0};
+    const char *patterns[] = {"FINDME"};
+    size_t pattern_lens[] = {6};
+    params.patterns = patterns;
+    params.pattern_lens = pattern_lens;
+    params.num_patterns = 1;
+    params.pattern = patterns[0];
+    params.pattern_len = pattern_lens[0];
+    params.case_sensitive = true;
+    params.track_positions = true;
+    params.max_count = SIZE_MAX;
+
+    // Capture stdout so the emitted lines can be counted
+    const char *capture_path = "/tmp/krep_test_parallel_output.txt";
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (saved_stdout == -1 || capture_fd == -1)
+    {
+        printf("FAIL: Could not redirect stdout for parallel search test\n");
+        cleanup_test_directory_structure();
+        return;
+    }
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    int errors = search_directory_recursive(TEST_DIR_BASE, &params, 4);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // file1.txt, minified.min.js, 2 files at nesting level 0 and 8 files at level 2
+    size_t lines = count_lines_in_file(capture_path);
+    if (errors > 0)
+        printf("FAIL: Parallel recursive search reported %d errors\n", errors);
+    else if (lines != 12)
+        printf("FAIL: Parallel recursive search printed %zu lines (expected 12)\n", lines);
+    else
+        printf("PASS: Parallel recursive search printed every matching line once\n");
+
+    unlink(capture_path);
+    cleanup_test_directory_structure();
+}
+
+/**
+ * Directory walk order test: with directories listed ahead on the pool (more of them
+ * than the read-ahead budget), files are still visited in serial depth-first order
+ */
+void test_walk_order(void)
+{
+    printf("\n=== Testing Directory Walk Order ===\n");
+
+    cleanup_test_directory_structure();
+    mkdir(TEST_DIR_BASE, 0755);
+    char path[PATH_MAX];
+    for (int a = 0; a < 12; a++)
+    {
+        snprintf(path, sizeof(path), "%s/a%d", TEST_DIR_BASE, a);
+        mkdir(path, 0755);
+        for (int b = 0; b < 15; b++)
+        {
+            snprintf(path, sizeof(path), "%s/a%d/b%d", TEST_DIR_BASE, a, b);
+            mkdir(path, 0755);
+            snprintf(path, sizeof(path), "%s/a%d/b%d/f.txt", TEST_DIR_BASE, a, b);
+            create_text_file(path, "FINDME\n");
+            // Skipped extensions are matched without regard to case
+            snprintf(path, sizeof(path), "%s/a%d/b%d/f.JPG", TEST_DIR_BASE, a, b);
+            create_text_file(path, "FINDME\n");
+        }
+        snprintf(path, sizeof(path), "%s/a%d/top.txt", TEST_DIR_BASE, a);
+        create_text_file(path, "FINDME\n");
+    }
+
+    static char expected[64 * 1024];
+    size_t expected_len = list_files_in_walk_order(TEST_DIR_BASE, expected, sizeof(expected), 0);
+
+    search_params_t params = {0};
+    const char *patterns[] = {"FINDME"};
+    size_t pattern_lens[] = {6};
+    params.patterns = patterns;
+    params.pattern_lens = pattern_lens;
+    params.num_patterns = 1;
+    params.pattern = patterns[0];
+    params.pattern_len = pattern_lens[0];
+    params.case_sensitive = true;
+    params.count_lines_mode = true;
+    params.max_count = SIZE_MAX;
+
+    const char *capture_path = "/tmp/krep_test_walk_output.txt";
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (saved_stdout == -1 || capture_fd == -1)
+    {
+        printf("FAIL: Could not redirect stdout for walk order test\n");
+        cleanup_test_directory_structure();
+        return;
+    }
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    int errors = search_directory_recursive(TEST_DIR_BASE, &params, 4);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // -c prints "path:count" per file; keep the paths
+    static char actual[64 * 1024];
+    size_t actual_len = 0;
+    FILE *f = fopen(capture_path, "r");
+    char line[PATH_MAX + 32];
+    while (f && fgets(line, sizeof(line), f))
+    {
+        char *colon = strrchr(line, ':');
+        if (colon)
+            *colon = '\0';
+        actual_len += snprintf(actual + actual_len, sizeof(actual) - actual_len, "%s\n", line);
+    }
+    if (f)
+        fclose(f);
+
+    if (errors > 0)
+        printf("FAIL: Walk order search reported %d errors\n", errors);
+    else if (expected_len == 0 || actual_len != expected_len || memcmp(actual, expected, expected_len) != 0)
+        printf("FAIL: Files were not visited in serial depth-first order\n");
+    else
+        printf("PASS: %zu files visited in serial depth-first order\n", count_lines_in_file(capture_path));
+
+    unlink(capture_path);
+    cleanup_test_directory_structure();
+}
+
+/**
+ * .gitignore / .ignore / --glob filtering test
+ */
+void test_ignore_files(void)
+{
+    printf("\n=== Testing Ignore Files and Globs ===\n");
+
+    cleanup_test_directory_structure();
+    mkdir(TEST_DIR_BASE, 0755);
+    char path[PATH_MAX];
+    const char *dirs[] = {"out", "out/deep", "src", "src/gen", "src/lib"};
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", TEST_DIR_BASE, dirs[i]);
+        mkdir(path, 0755);
+    }
+    const char *files[] = {"keep.txt",        "app.trace",   "out/a.txt",   "out/deep/b.txt", "src/main.c",
+                           "src/debug.trace", "src/gen/g.c", "src/lib/gen", "src/lib/util.c", "src/secret.txt"};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", TEST_DIR_BASE, files[i]);
+        create_text_file(path, "FINDME\n");
+    }
+    snprintf(path, sizeof(path), "%s/.gitignore", TEST_DIR_BASE);
+    create_text_file(path, "# build output\nout/\n*.trace\n");
+    // .ignore wins over .gitignore in its directory; both add to the inherited rules
+    snprintf(path, sizeof(path), "%s/src/.gitignore", TEST_DIR_BASE);
+    create_text_file(path, "!debug.trace\n/gen/\nsecret.txt\n");
+    snprintf(path, sizeof(path), "%s/src/.ignore", TEST_DIR_BASE);
+    create_text_file(path, "!secret.txt\n");
+
+    search_params_t params = {0};
+    const char *patterns[] = {"FINDME"};
+    size_t pattern_lens[] = {6};
+    params.patterns = patterns;
+    params.pattern_lens = pattern_lens;
+    params.num_patterns = 1;
+    params.pattern = patterns[0];
+    params.pattern_len = pattern_lens[0];
+    params.case_sensitive = true;
+    params.count_lines_mode = true;
+    params.max_count = SIZE_MAX;
+
+    static char out[16 * 1024];
+    int errors = 0;
+    size_t searched = capture_counted_paths(&params, out, sizeof(out), &errors);
+    bool pruned = !strstr(out, "/out/") && !strstr(out, "app.trace") && !strstr(out, "/src/gen/");
+    bool kept = strstr(out, "/keep.txt\n") && strstr(out, "/src/debug.trace\n") && strstr(out, "/src/lib/gen\n") &&
+                strstr(out, "/src/secret.txt\n") && strstr(out, "/src/main.c\n");
+    if (errors == 0 && searched == 9 && pruned && kept) // 6 files and the 3 ignore files
+        printf("PASS: Ignore files prune subtrees and are inherited with deeper rules first\n");
+    else
+        printf("FAIL: Ignore files: %zu files searched, %d errors:\n%s", searched, errors, out);
+
+    params.no_ignore = true;
+    searched = capture_counted_paths(&params, out, sizeof(out), &errors);
+    if (errors == 0 && searched == 13) // The ignore files themselves are searched too
+        printf("PASS: --no-ignore searches every file\n");
+    else
+        printf("FAIL: --no-ignore: %zu files searched, %d errors\n", searched, errors);
+    params.no_ignore = false;
+
+    ignore_rules_t *globs = ignore_rules_new(NULL, 0);
+    if (globs && ignore_rules_add_glob(globs, "*.c") && ignore_rules_add_glob(globs, "!src/lib/**") &&
+        ignore_rules_compile(globs))
+    {
+        params.glob_rules = globs;
+        searched = capture_counted_paths(&params, out, sizeof(out), &errors);
+        if (errors == 0 && searched == 1 && strstr(out, "/src/main.c\n"))
+            printf("PASS: --glob includes and excludes on top of the ignore files\n");
+        else
+            printf("FAIL: --glob: %zu files searched, %d errors:\n%s", searched, errors, out);
+    }
+    else
+    {
+        printf("FAIL: Could not compile --glob rules\n");
+    }
+    ignore_rules_release(globs);
+    cleanup_test_directory_structure();
+}
+
 /**
  * Binary file handling test
  */
@@ -157,7 +387,10 @@ int main(void)
         return 1;
     }
 
-    // Run tests
+    // Run tests (parallel first: the global thread pool is sized by the first search)
+    test_parallel_recursive_search();
+    test_walk_order();
+    test_ignore_files();
     test_recursive_directory_search();
     test_binary_file_handling();
 
@@ -302,3 +535,97 @@ static void create_nested_directory(const char *base_path, int depth, int max_de
         create_nested_directory(subdir_path, depth + 1, max_depth);
     }
 }
+
+/**
+ * Counts newline-terminated lines in a file
+ */
+static size_t count_lines_in_file(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+
+    size_t lines = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF)
+    {
+        if (c == '\n')
+            lines++;
+    }
+    fclose(f);
+    return lines;
+}
+
+/**
+ * Appends the .txt files under dir to out, one path per line, in the order a serial
+ * depth-first readdir walk reaches them. Returns the new length of out.
+ */
+static size_t list_files_in_walk_order(const char *dir, char *out, size_t out_size, size_t used)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return used;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (lstat(path, &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            used = list_files_in_walk_order(path, out, out_size, used);
+        else if (strstr(entry->d_name, ".txt") && used < out_size)
+            used += snprintf(out + used, out_size - used, "%s\n", path);
+    }
+    closedir(d);
+    return used;
+}
+
+/**
+ * Runs a recursive -c search of TEST_DIR_BASE and collects the searched paths, one per
+ * line. Returns the number of paths.
+ */
+static size_t capture_counted_paths(const search_params_t *params, char *out, size_t out_size, int *errors)
+{
+    const char *capture_path = "/tmp/krep_test_ignore_output.txt";
+    out[0] = '\0';
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (saved_stdout == -1 || capture_fd == -1)
+    {
+        *errors = 1;
+        return 0;
+    }
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    *errors = search_directory_recursive(TEST_DIR_BASE, params, 4);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // -c prints "path:count" per file; keep the paths
+    size_t lines = 0;
+    size_t used = 0;
+    FILE *f = fopen(capture_path, "r");
+    char line[PATH_MAX + 32];
+    while (f && fgets(line, sizeof(line), f))
+    {
+        char *colon = strrchr(line, ':');
+        if (colon)
+            *colon = '\0';
+        int n = snprintf(out + used, out_size - used, "%s\n", line);
+        if (n > 0 && (size_t)n < out_size - used)
+            used += (size_t)n;
+        lines++;
+    }
+    if (f)
+        fclose(f);
+    unlink(capture_path);
+    return lines;
+}
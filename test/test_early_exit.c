@@ -0,0 +1,223 @@
+/**
+ * Test suite for early termination (-m, -q, -l)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../stats.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+// Chunk worker used by search_file (krep.c)
+void *search_chunk_thread(void *arg);
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define EARLY_TEST_FILE "/tmp/krep_test_early_exit.txt"
+#define EARLY_TEST_LINES 600000 // 20-byte lines: 12 MB, three chunks with 4 threads
+
+// Every tenth line of the first 1000 holds "early"; the last line holds "late"
+static bool write_early_file(void)
+{
+    FILE *f = fopen(EARLY_TEST_FILE, "w");
+    if (!f)
+        return false;
+    for (size_t i = 0; i < EARLY_TEST_LINES; i++)
+    {
+        const char *word = (i < 1000 && i % 10 == 0) ? "early" : (i == EARLY_TEST_LINES - 1) ? "late!" : "plain";
+        fprintf(f, "%07zu %s text\n", i, word);
+    }
+    return fclose(f) == 0;
+}
+
+// Parameters as main sets them up for -l (or -q when quiet)
+static search_params_t match_only_params(const char *pattern, bool quiet)
+{
+    search_params_t params = create_literal_params(pattern, true, true, false);
+    params.files_with_matches = !quiet;
+    params.quiet = quiet;
+    params.max_count = 1;
+    return params;
+}
+
+void test_files_with_matches(void)
+{
+    printf("\n=== -l / -q Output Tests ===\n");
+    int rc = -1;
+    search_params_t params = match_only_params("late!", false);
+    char *out = NULL;
+    rc = capture_search_output(&params, EARLY_TEST_FILE, 4, &out);
+    TEST_ASSERT(rc == 0 && out && strcmp(out, EARLY_TEST_FILE "\n") == 0, "-l prints the name of a matching file once");
+    free(out);
+    rc = capture_search_output(&params, EARLY_TEST_FILE, 0, &out);
+    TEST_ASSERT(rc == 0 && out && strcmp(out, "(standard input)\n") == 0, "-l names standard input");
+    free(out);
+    cleanup_params(&params);
+
+    params = match_only_params("absent", false);
+    rc = capture_search_output(&params, EARLY_TEST_FILE, 4, &out);
+    TEST_ASSERT(rc == 1 && out && out[0] == '\0', "-l prints nothing for a file without matches");
+    free(out);
+    cleanup_params(&params);
+
+    params = match_only_params("early", true);
+    rc = capture_search_output(&params, EARLY_TEST_FILE, 4, &out);
+    TEST_ASSERT(rc == 0 && out && out[0] == '\0', "-q prints nothing and reports the match");
+    free(out);
+    cleanup_params(&params);
+}
+
+void test_max_count_chunks(void)
+{
+    printf("\n=== -m Across Chunks Tests ===\n");
+    int rc_chunked = -1;
+    search_params_t params = create_literal_params("early", true, false, false);
+    params.max_count = 7;
+    char *single = NULL;
+    capture_search_output(&params, EARLY_TEST_FILE, 1, &single);
+    char *chunked = NULL;
+    rc_chunked = capture_search_output(&params, EARLY_TEST_FILE, 4, &chunked);
+    size_t lines = 0;
+    for (const char *p = chunked; p && *p; p++)
+        lines += (*p == '\n');
+    TEST_ASSERT(rc_chunked == 0 && lines == 7 && single && chunked && strcmp(single, chunked) == 0,
+                "Chunks stopped by -m print the same lines as one chunk");
+    cleanup_params(&params);
+
+    // The count still comes from the first chunks when later ones stop early
+    params = create_literal_params("text", true, true, false);
+    params.max_count = 250000;
+    char *counted = NULL;
+    rc_chunked = capture_search_output(&params, EARLY_TEST_FILE, 4, &counted);
+    TEST_ASSERT(counted && strcmp(counted, EARLY_TEST_FILE ":250000\n") == 0, "-c -m caps the count across chunks");
+    cleanup_params(&params);
+
+    free(single);
+    free(chunked);
+    free(counted);
+}
+
+// Run one chunk worker over text and return its count
+static uint64_t run_budget_chunk(search_params_t *params, const char *text, size_t len, int id,
+                                 search_budget_t *budget)
+{
+    thread_data_t data;
+    memset(&data, 0, sizeof(data));
+    data.thread_id = id;
+    data.params = params;
+    data.chunk_start = text;
+    data.chunk_len = len;
+    data.file_fd = -1;
+    data.budget = budget;
+    search_chunk_thread(&data);
+    match_result_free(data.local_result);
+    return data.count_result;
+}
+
+void test_search_budget(void)
+{
+    printf("\n=== Search Budget Tests ===\n");
+    // Three blocks of lines that all match
+    size_t len = 3 * SEARCH_BUDGET_BLOCK_SIZE;
+    char *text = malloc(len);
+    if (!text)
+    {
+        TEST_ASSERT(false, "Budget test text allocated");
+        return;
+    }
+    for (size_t i = 0; i < len; i++)
+        text[i] = (i % 16 == 15) ? '\n' : "match line xxxx"[i % 16];
+
+    atomic_uint_fast64_t found[2];
+    search_budget_t budget;
+    atomic_init(&found[0], 0);
+    atomic_init(&found[1], 0);
+    atomic_init(&budget.done, false);
+    budget.counts_only = false;
+    budget.max_count = 5;
+    budget.num_chunks = 2;
+    budget.found = found;
+
+    // -m: the chunk after one holding max_count lines is not searched
+    search_params_t params = create_literal_params("match", true, false, false);
+    params.max_count = 5;
+    atomic_store(&found[0], 5);
+    TEST_ASSERT(run_budget_chunk(&params, text, len, 1, &budget) == 0 && atomic_load(&found[1]) == 0,
+                "A chunk after max_count lines is skipped");
+    atomic_store(&found[0], 4);
+    TEST_ASSERT(run_budget_chunk(&params, text, len, 1, &budget) == 5, "A chunk still needed is searched up to -m");
+    TEST_ASSERT(run_budget_chunk(&params, text, len, 0, &budget) == 5,
+                "Later chunks' counts do not stop an earlier chunk that prints lines");
+    cleanup_params(&params);
+
+    // -q / -l: a match anywhere ends every chunk
+    params = create_literal_params("match", true, true, false);
+    params.max_count = 1;
+    atomic_store(&found[0], 0);
+    atomic_store(&found[1], 0);
+    budget.counts_only = true;
+    budget.max_count = 1;
+#ifndef KREP_NO_STATS
+    stats_reset();
+    stats_start();
+#endif
+    TEST_ASSERT(run_budget_chunk(&params, text, len, 1, &budget) == 1 && atomic_load(&budget.done),
+                "A count-mode match marks the file decided");
+    TEST_ASSERT(run_budget_chunk(&params, text, len, 0, &budget) == 0, "An earlier chunk is skipped once decided");
+#ifndef KREP_NO_STATS
+    TEST_ASSERT(stats_counter_total(STATS_BYTES_SCANNED) == SEARCH_BUDGET_BLOCK_SIZE,
+                "Only the first block of the matching chunk is scanned");
+    stats_reset();
+#endif
+    cleanup_params(&params);
+    free(text);
+}
+
+void run_early_exit_tests(void)
+{
+    printf("\n--- Running Early Termination Tests ---\n");
+
+    if (write_early_file())
+    {
+        test_files_with_matches();
+        test_max_count_chunks();
+    }
+    else
+    {
+        TEST_ASSERT(false, "Early termination test file written");
+    }
+    test_search_budget();
+
+    unlink(EARLY_TEST_FILE);
+    printf("\n--- Completed Early Termination Tests ---\n");
+}
@@ -0,0 +1,152 @@
+/**
+ * Test suite for ignore rules (.gitignore / .ignore and --glob)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../ignore.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+// Rules for one level compiled from text in gitignore syntax
+static ignore_rules_t *compile_file(ignore_rules_t *parent, size_t base_len, const char *text)
+{
+    ignore_rules_t *rules = ignore_rules_new(parent, base_len);
+    if (rules && (!ignore_rules_add_file(rules, text, strlen(text)) || !ignore_rules_compile(rules)))
+    {
+        ignore_rules_release(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+static ignore_match_t match(const ignore_rules_t *rules, const char *path, bool is_dir)
+{
+    return ignore_rules_match(rules, path, strlen(path), is_dir);
+}
+
+void test_ignore_patterns(void)
+{
+    printf("\n=== Ignore Pattern Tests ===\n");
+    ignore_rules_t *rules = compile_file(NULL, 0,
+                                         "# build output\n"
+                                         "\n"
+                                         "*.o\n"
+                                         "node_modules\n"
+                                         "build/\n"
+                                         "/TODO\n"
+                                         "doc/*.txt\n"
+                                         "logs/**\n"
+                                         "a/**/z\n"
+                                         "**/tmp\n"
+                                         "data[0-9].csv\n"
+                                         "trailing \r\n");
+    TEST_ASSERT(rules && ignore_rules_count(rules) == 10, "Comments and blank lines add no rules");
+    if (!rules)
+        return;
+
+    TEST_ASSERT(match(rules, "main.o", false) == IGNORE_EXCLUDE && match(rules, "src/deep/x.o", false) == IGNORE_EXCLUDE,
+                "Extension rules match at any depth");
+    TEST_ASSERT(match(rules, "main.c", false) == IGNORE_NONE && match(rules, "main.od", false) == IGNORE_NONE,
+                "Other extensions are not matched");
+    TEST_ASSERT(match(rules, "node_modules", true) == IGNORE_EXCLUDE && match(rules, "x/node_modules", false) == IGNORE_EXCLUDE,
+                "Name rules match files and directories anywhere");
+    TEST_ASSERT(match(rules, "build", true) == IGNORE_EXCLUDE && match(rules, "build", false) == IGNORE_NONE,
+                "A trailing '/' matches directories only");
+    TEST_ASSERT(match(rules, "TODO", false) == IGNORE_EXCLUDE && match(rules, "src/TODO", false) == IGNORE_NONE,
+                "A leading '/' anchors to the ignore file's directory");
+    TEST_ASSERT(match(rules, "doc/a.txt", false) == IGNORE_EXCLUDE && match(rules, "doc/sub/a.txt", false) == IGNORE_NONE,
+                "'*' does not match '/'");
+    TEST_ASSERT(match(rules, "logs/x", false) == IGNORE_EXCLUDE && match(rules, "logs/y/z.log", false) == IGNORE_EXCLUDE &&
+                    match(rules, "logs", true) == IGNORE_NONE,
+                "A trailing \"/**\" matches everything inside");
+    TEST_ASSERT(match(rules, "a/z", false) == IGNORE_EXCLUDE && match(rules, "a/b/c/z", false) == IGNORE_EXCLUDE &&
+                    match(rules, "b/a/z", false) == IGNORE_NONE,
+                "\"/**/\" matches any number of directories");
+    TEST_ASSERT(match(rules, "tmp", true) == IGNORE_EXCLUDE && match(rules, "q/r/tmp", true) == IGNORE_EXCLUDE,
+                "A leading \"**/\" matches in every directory");
+    TEST_ASSERT(match(rules, "data7.csv", false) == IGNORE_EXCLUDE && match(rules, "datax.csv", false) == IGNORE_NONE,
+                "Character classes");
+    TEST_ASSERT(match(rules, "trailing", false) == IGNORE_EXCLUDE, "Trailing spaces and CR are trimmed");
+    ignore_rules_release(rules);
+}
+
+void test_ignore_precedence(void)
+{
+    printf("\n=== Ignore Precedence Tests ===\n");
+    // Last match wins within a level, whichever table or list holds the rule
+    ignore_rules_t *root = compile_file(NULL, 0, "*.log\n!keep.log\nout*\n!out2\n*.tmp\n!*.tmp\n");
+    TEST_ASSERT(root && match(root, "a.log", false) == IGNORE_EXCLUDE && match(root, "keep.log", false) == IGNORE_INCLUDE,
+                "A later '!' rule re-includes");
+    TEST_ASSERT(root && match(root, "out1", false) == IGNORE_EXCLUDE && match(root, "out2", false) == IGNORE_INCLUDE,
+                "A later name rule overrides an earlier wildcard rule");
+    TEST_ASSERT(root && match(root, "x.tmp", false) == IGNORE_INCLUDE, "A later extension rule overrides an earlier one");
+
+    // A subdirectory's rules come first and are anchored to it
+    ignore_rules_t *sub = compile_file(root, strlen("src"), "!debug.log\n/gen\n");
+    TEST_ASSERT(sub && match(sub, "src/debug.log", false) == IGNORE_INCLUDE && match(sub, "src/other.log", false) == IGNORE_EXCLUDE,
+                "Deeper levels override their parents and defer to them otherwise");
+    TEST_ASSERT(sub && match(sub, "src/gen", true) == IGNORE_EXCLUDE && match(sub, "src/x/gen", true) == IGNORE_NONE,
+                "Anchored rules are relative to their own directory");
+    ignore_rules_release(root); // The subdirectory level keeps its parent alive
+    TEST_ASSERT(sub && match(sub, "src/a.log", false) == IGNORE_EXCLUDE, "Levels retain their parents");
+    ignore_rules_release(sub);
+}
+
+void test_ignore_globs(void)
+{
+    printf("\n=== Glob Override Tests ===\n");
+    ignore_rules_t *globs = ignore_rules_new(NULL, 0);
+    TEST_ASSERT(globs && !ignore_rules_add_glob(globs, "") && !ignore_rules_add_glob(globs, "!"), "Empty globs are rejected");
+    TEST_ASSERT(globs && ignore_rules_add_glob(globs, "*.c") && ignore_rules_add_glob(globs, "!test_*.c") &&
+                    ignore_rules_compile(globs),
+                "Globs compile");
+    if (!globs)
+        return;
+    TEST_ASSERT(ignore_rules_has_includes(globs), "A plain glob is an include");
+    TEST_ASSERT(match(globs, "src/main.c", false) == IGNORE_INCLUDE && match(globs, "src/test_x.c", false) == IGNORE_EXCLUDE,
+                "'!' globs exclude, and the last match wins");
+    TEST_ASSERT(match(globs, "README", false) == IGNORE_NONE, "Unmatched paths get no verdict");
+    ignore_rules_release(globs);
+}
+
+void run_ignore_tests(void)
+{
+    printf("\n--- Running Ignore Rule Tests ---\n");
+
+    test_ignore_patterns();
+    test_ignore_precedence();
+    test_ignore_globs();
+
+    printf("\n--- Completed Ignore Rule Tests ---\n");
+}
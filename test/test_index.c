@@ -0,0 +1,248 @@
+/**
+ * Test suite for the persistent trigram index (--index-build / --index)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../trigram_index.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define INDEX_TEST_DIR "/tmp/krep_test_index"
+#define INDEX_TEST_FILE INDEX_TEST_DIR "/archive.txt"
+
+/* Lines in the generated archive; about 40 index blocks */
+#define INDEX_TEST_LINES 80000
+
+/**
+ * Write the archive: filler lines, with "needle N" on lines 1000 and 70000 only.
+ */
+static bool write_index_input(void)
+{
+    mkdir(INDEX_TEST_DIR, 0755);
+    FILE *f = fopen(INDEX_TEST_FILE, "w");
+    if (!f)
+        return false;
+    for (int i = 1; i <= INDEX_TEST_LINES; i++)
+    {
+        if (i == 1000 || i == 70000)
+            fprintf(f, "line %d: Needle %d found\n", i, i);
+        else
+            fprintf(f, "line %d: ordinary log filler\n", i);
+    }
+    return fclose(f) == 0;
+}
+
+/**
+ * True when searching with the index prints exactly what a full search prints
+ */
+static bool indexed_matches_full(search_params_t *params, const trigram_index_t *index)
+{
+    char *full = NULL, *indexed = NULL;
+    params->trigram_index = NULL;
+    int rc_full = capture_search_output(params, INDEX_TEST_FILE, 1, &full);
+    params->trigram_index = index;
+    int rc_indexed = capture_search_output(params, INDEX_TEST_FILE, 1, &indexed);
+    params->trigram_index = NULL;
+
+    bool same = rc_full == rc_indexed && full && indexed && strcmp(full, indexed) == 0;
+    free(full);
+    free(indexed);
+    return same;
+}
+
+void test_index_candidates(const trigram_index_t *index)
+{
+    printf("\n=== Trigram Index Candidate Tests ===\n");
+
+    char path[PATH_MAX];
+    struct stat st;
+    bool have_path = realpath(INDEX_TEST_FILE, path) != NULL && stat(path, &st) == 0;
+    TEST_ASSERT(have_path, "Indexed test file can be resolved");
+    if (!have_path)
+        return;
+
+    trigram_candidates_t cand;
+    const char *lits[] = {"Needle"};
+    size_t lens[] = {6};
+    bool ok = trigram_index_candidates(index, path, &st, lits, lens, 1, &cand);
+    TEST_ASSERT(ok && cand.num_blocks > 20, "Index covers the file in 64KB blocks");
+    TEST_ASSERT(ok && cand.num_candidates >= 2 && cand.num_candidates <= 4,
+                "Only the blocks holding the literal (and their predecessors) are candidates");
+    uint64_t newlines = 0;
+    for (uint32_t b = 0; ok && b < cand.num_blocks; b++)
+        newlines += cand.block_newlines[b];
+    TEST_ASSERT(ok && newlines == INDEX_TEST_LINES, "Per-block newline counts add up to the line count");
+
+    trigram_candidates_t upper;
+    const char *upper_lits[] = {"NEEDLE"};
+    bool upper_ok = trigram_index_candidates(index, path, &st, upper_lits, lens, 1, &upper);
+    size_t words = ((size_t)cand.num_blocks + 63) / 64;
+    TEST_ASSERT(ok && upper_ok && upper.num_candidates == cand.num_candidates &&
+                    memcmp(upper.candidates, cand.candidates, words * sizeof(uint64_t)) == 0,
+                "Trigrams are case-folded");
+    trigram_candidates_free(&upper);
+    trigram_candidates_free(&cand);
+
+    const char *absent[] = {"haystack"};
+    size_t absent_lens[] = {8};
+    ok = trigram_index_candidates(index, path, &st, absent, absent_lens, 1, &cand);
+    TEST_ASSERT(ok && cand.num_candidates == 0, "A literal with an unindexed trigram has no candidates");
+    trigram_candidates_free(&cand);
+
+    const char *short_lit[] = {"Ne"};
+    size_t short_lens[] = {2};
+    TEST_ASSERT(!trigram_index_candidates(index, path, &st, short_lit, short_lens, 1, &cand),
+                "Literals shorter than a trigram are not filtered");
+
+    struct stat changed = st;
+    changed.st_size++;
+    TEST_ASSERT(!trigram_index_candidates(index, path, &changed, lits, lens, 1, &cand),
+                "A changed fingerprint makes the index decline");
+    TEST_ASSERT(!trigram_index_candidates(index, "/nonexistent/file.txt", &st, lits, lens, 1, &cand),
+                "Files missing from the index are declined");
+}
+
+void test_index_search(const trigram_index_t *index)
+{
+    printf("\n=== Indexed Search Tests ===\n");
+
+    search_params_t params = create_literal_params("Needle", true, false, false);
+    TEST_ASSERT(indexed_matches_full(&params, index), "Indexed search prints the same lines and numbers");
+    cleanup_params(&params);
+
+    params = create_literal_params("needle", false, true, false);
+    TEST_ASSERT(indexed_matches_full(&params, index), "Indexed -i -c gives the same count");
+    cleanup_params(&params);
+
+    params = create_literal_params("haystack", true, true, false);
+    char *out = NULL;
+    params.trigram_index = index;
+    int rc = capture_search_output(&params, INDEX_TEST_FILE, 1, &out);
+    TEST_ASSERT(rc == 1 && out && strstr(out, ":0\n") != NULL, "Indexed search skips files without candidates");
+    free(out);
+    cleanup_params(&params);
+
+    params = create_regex_params("Needle [0-9]+ found$", true, false, false);
+    TEST_ASSERT(indexed_matches_full(&params, index), "Indexed regex search uses the required literal");
+    cleanup_params(&params);
+
+    const char *patterns[] = {"Needle 1000", "Needle 70000"};
+    size_t pattern_lens[] = {11, 12};
+    search_params_t multi = {0};
+    multi.patterns = patterns;
+    multi.pattern_lens = pattern_lens;
+    multi.num_patterns = 2;
+    multi.case_sensitive = true;
+    multi.track_positions = true;
+    multi.max_count = SIZE_MAX;
+    TEST_ASSERT(indexed_matches_full(&multi, index), "Indexed multi-pattern search unions the candidates");
+
+    params = create_literal_params("Needle", true, false, false);
+    params.max_count = 1;
+    TEST_ASSERT(indexed_matches_full(&params, index), "Indexed search honours -m across regions");
+    cleanup_params(&params);
+}
+
+void test_index_stale_file(const trigram_index_t *index)
+{
+    printf("\n=== Index Fallback Tests ===\n");
+
+    // Bump the mtime: the fingerprint no longer matches and the file is read in full
+    struct timeval times[2];
+    gettimeofday(&times[0], NULL);
+    times[0].tv_sec += 10;
+    times[1] = times[0];
+    utimes(INDEX_TEST_FILE, times);
+
+    FILE *f = fopen(INDEX_TEST_FILE, "a");
+    if (f)
+    {
+        fputs("appended haystack line\n", f);
+        fclose(f);
+    }
+    utimes(INDEX_TEST_FILE, times);
+
+    search_params_t params = create_literal_params("haystack", true, true, false);
+    char *out = NULL;
+    params.trigram_index = index;
+    int rc = capture_search_output(&params, INDEX_TEST_FILE, 1, &out);
+    TEST_ASSERT(rc == 0 && out && strstr(out, ":1\n") != NULL, "Changed files fall back to a full search");
+    free(out);
+    cleanup_params(&params);
+}
+
+void run_index_tests(void)
+{
+    printf("\n--- Running Trigram Index Tests ---\n");
+
+    if (!write_index_input())
+    {
+        printf("✗ FAIL: Could not create index test input\n");
+        tests_failed++;
+        return;
+    }
+
+    // build_trigram_index reports the file count on stdout; keep it out of the log
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+    int build_rc = build_trigram_index(INDEX_TEST_DIR);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    TEST_ASSERT(build_rc == 0, "Index build over a directory succeeds");
+
+    trigram_index_t *index = trigram_index_open(INDEX_TEST_DIR "/" TRIGRAM_INDEX_FILENAME);
+    TEST_ASSERT(index != NULL, "Built index can be mapped");
+    if (index)
+    {
+        test_index_candidates(index);
+        test_index_search(index);
+        test_index_stale_file(index);
+        trigram_index_close(index);
+    }
+
+    unlink(INDEX_TEST_DIR "/" TRIGRAM_INDEX_FILENAME);
+    unlink(INDEX_TEST_FILE);
+    rmdir(INDEX_TEST_DIR);
+
+    printf("\n--- Completed Trigram Index Tests ---\n");
+}
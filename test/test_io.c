@@ -0,0 +1,312 @@
+/**
+ * Test suite for the read-ahead I/O backends (--io) and mapped-file prefetch policies (--prefetch)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../io_reader.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define IO_TEST_INPUT "/tmp/krep_test_io_input.txt"
+#define IO_TEST_BINARY "/tmp/krep_test_io_binary.bin"
+
+/* Lines in the generated input; enough for several reader blocks and a short last one */
+#define IO_TEST_LINES 120000
+
+/* Block size for the reader tests; small so the queue wraps many times */
+#define IO_TEST_BLOCK (64 * 1024)
+
+static char *io_input = NULL;
+static size_t io_input_len = 0;
+
+static bool write_io_input(void)
+{
+    size_t cap = (size_t)IO_TEST_LINES * 40;
+    io_input = malloc(cap);
+    if (!io_input)
+        return false;
+    io_input_len = 0;
+    for (int i = 1; i <= IO_TEST_LINES; i++)
+    {
+        const char *fmt = (i % 700 == 0) ? "line %d holds a Needle\n" : "line %d is plain filler\n";
+        io_input_len += snprintf(io_input + io_input_len, cap - io_input_len, fmt, i);
+    }
+
+    FILE *f = fopen(IO_TEST_INPUT, "w");
+    if (!f)
+        return false;
+    bool ok = fwrite(io_input, 1, io_input_len, f) == io_input_len;
+    return fclose(f) == 0 && ok;
+}
+
+/**
+ * Read the whole input through a reader with an odd read size; true if it matches
+ */
+static bool reader_returns_input(io_backend_t backend, bool *used_uring)
+{
+    int fd = open(IO_TEST_INPUT, O_RDONLY);
+    if (fd == -1)
+        return false;
+    io_reader_t *reader = io_reader_open(fd, backend, IO_TEST_BLOCK);
+    close(fd); // The reader keeps its own descriptor
+    if (!reader)
+        return false;
+    if (used_uring)
+        *used_uring = io_reader_uses_uring(reader);
+
+    char *out = malloc(io_input_len + 1);
+    size_t n = 0;
+    ssize_t got = 0;
+    while (out && n <= io_input_len)
+    {
+        size_t want = io_input_len + 1 - n < 10007 ? io_input_len + 1 - n : 10007;
+        got = io_reader_read(reader, out + n, want);
+        if (got <= 0)
+            break;
+        n += (size_t)got;
+    }
+    bool same = out && got == 0 && n == io_input_len && memcmp(out, io_input, n) == 0;
+    // Reads after the end keep returning 0
+    same = same && io_reader_read(reader, out, 16) == 0;
+    free(out);
+    io_reader_close(reader);
+    return same;
+}
+
+/**
+ * True when reading with backend prints exactly what the mmap path prints
+ */
+static bool backend_matches_mmap(search_params_t *params, io_backend_t backend)
+{
+    char *mapped = NULL, *read_out = NULL;
+    params->io_backend = IO_BACKEND_MMAP;
+    int rc_mapped = capture_search_output(params, IO_TEST_INPUT, 1, &mapped);
+    params->io_backend = backend;
+    int rc_read = capture_search_output(params, IO_TEST_INPUT, 1, &read_out);
+    params->io_backend = IO_BACKEND_AUTO;
+
+    bool same = rc_mapped == rc_read && mapped && read_out && strcmp(mapped, read_out) == 0;
+    free(mapped);
+    free(read_out);
+    return same;
+}
+
+void test_io_backend_selection(void)
+{
+    printf("\n=== I/O Backend Selection Tests ===\n");
+
+    io_backend_t backend = IO_BACKEND_AUTO;
+    TEST_ASSERT(io_backend_parse("uring", &backend) && backend == IO_BACKEND_URING, "--io=uring is parsed");
+    TEST_ASSERT(io_backend_parse("direct", &backend) && backend == IO_BACKEND_DIRECT, "--io=direct is parsed");
+    TEST_ASSERT(!io_backend_parse("mmap2", &backend), "Unknown --io values are rejected");
+    TEST_ASSERT(strcmp(io_backend_name(IO_BACKEND_READ), "read") == 0, "Backend names round-trip");
+
+    int fd = open(IO_TEST_INPUT, O_RDONLY);
+    struct stat st;
+    bool have_file = fd != -1 && fstat(fd, &st) == 0;
+    TEST_ASSERT(have_file && io_backend_select(fd, &st, IO_BACKEND_AUTO) == IO_BACKEND_MMAP,
+                "Small local files are mapped");
+    TEST_ASSERT(have_file && io_backend_select(fd, &st, IO_BACKEND_READ) == IO_BACKEND_READ,
+                "An explicit backend is kept");
+    if (fd != -1)
+        close(fd);
+}
+
+void test_io_reader(void)
+{
+    printf("\n=== I/O Reader Tests ===\n");
+
+    TEST_ASSERT(reader_returns_input(IO_BACKEND_READ, NULL), "pread reader returns the file in order");
+
+    bool used_uring = false;
+    TEST_ASSERT(reader_returns_input(IO_BACKEND_URING, &used_uring), "io_uring reader returns the file in order");
+    printf("  (io_uring %s)\n", used_uring ? "available" : "unavailable, pread fallback used");
+
+    TEST_ASSERT(reader_returns_input(IO_BACKEND_DIRECT, NULL), "O_DIRECT reader returns the file in order");
+
+    int fd = open(IO_TEST_INPUT, O_RDONLY);
+    TEST_ASSERT(fd != -1 && io_reader_open(fd, IO_BACKEND_READ, 1000) == NULL,
+                "Block sizes that are not 4096-aligned are rejected");
+    if (fd != -1)
+        close(fd);
+}
+
+void test_io_search(void)
+{
+    printf("\n=== I/O Backend Search Tests ===\n");
+
+    const io_backend_t backends[] = {IO_BACKEND_READ, IO_BACKEND_URING, IO_BACKEND_DIRECT};
+    for (int i = 0; i < 3; i++)
+    {
+        char message[128];
+
+        search_params_t params = create_literal_params("Needle", true, false, false);
+        snprintf(message, sizeof(message), "--io=%s prints the same lines as mmap", io_backend_name(backends[i]));
+        TEST_ASSERT(backend_matches_mmap(&params, backends[i]), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("needle", false, true, false);
+        snprintf(message, sizeof(message), "--io=%s -i -c gives the same count", io_backend_name(backends[i]));
+        TEST_ASSERT(backend_matches_mmap(&params, backends[i]), message);
+        cleanup_params(&params);
+
+        params = create_regex_params("line [0-9]+00 is", true, false, true);
+        snprintf(message, sizeof(message), "--io=%s regex -o gives the same matches", io_backend_name(backends[i]));
+        TEST_ASSERT(backend_matches_mmap(&params, backends[i]), message);
+        cleanup_params(&params);
+    }
+
+    search_params_t params = create_literal_params("Needle", true, false, false);
+    params.max_count = 4;
+    TEST_ASSERT(backend_matches_mmap(&params, IO_BACKEND_URING), "--io=uring honours -m");
+    cleanup_params(&params);
+}
+
+/**
+ * True when searching with the window prefetch policy (small windows, so the file is
+ * searched in many pieces) prints exactly what a populated mapping prints
+ */
+static bool window_matches_populate(search_params_t *params)
+{
+    char *populated = NULL, *windowed = NULL;
+    params->io_backend = IO_BACKEND_MMAP;
+    params->prefetch = PREFETCH_POPULATE;
+    int rc_populated = capture_search_output(params, IO_TEST_INPUT, 1, &populated);
+    params->prefetch = PREFETCH_WINDOW;
+    params->prefetch_window = 48 * 1024;
+    int rc_windowed = capture_search_output(params, IO_TEST_INPUT, 1, &windowed);
+    params->prefetch = PREFETCH_AUTO;
+    params->prefetch_window = 0;
+    params->io_backend = IO_BACKEND_AUTO;
+
+    bool same = rc_populated == rc_windowed && populated && windowed && strcmp(populated, windowed) == 0;
+    free(populated);
+    free(windowed);
+    return same;
+}
+
+void test_prefetch_window(void)
+{
+    printf("\n=== Prefetch Window Tests ===\n");
+
+    search_params_t params = create_literal_params("Needle", true, false, false);
+    TEST_ASSERT(window_matches_populate(&params), "Windowed search prints the same lines");
+    cleanup_params(&params);
+
+    params = create_literal_params("filler", true, true, false);
+    TEST_ASSERT(window_matches_populate(&params), "Windowed -c counts every line once");
+    cleanup_params(&params);
+
+    params = create_regex_params("^line [0-9]+00 ", true, false, true);
+    TEST_ASSERT(window_matches_populate(&params), "Windowed regex -o keeps ^ anchors and offsets");
+    cleanup_params(&params);
+
+    params = create_literal_params("Needle", true, false, false);
+    params.max_count = 100;
+    TEST_ASSERT(window_matches_populate(&params), "Windowed search stops at -m across windows");
+    cleanup_params(&params);
+
+    const char *patterns[] = {"Needle", "line 99"};
+    size_t pattern_lens[] = {6, 7};
+    search_params_t multi = {0};
+    multi.patterns = patterns;
+    multi.pattern_lens = pattern_lens;
+    multi.num_patterns = 2;
+    multi.case_sensitive = true;
+    multi.track_positions = true;
+    multi.max_count = SIZE_MAX;
+    TEST_ASSERT(window_matches_populate(&multi), "Windowed multi-pattern search matches");
+}
+
+static bool write_binary_input(size_t nul_offset)
+{
+    FILE *f = fopen(IO_TEST_BINARY, "wb");
+    if (!f)
+        return false;
+    for (size_t i = 0; i < 3 * BINARY_CHECK_BUFFER_SIZE; i++)
+        fputc(i == nul_offset ? '\0' : (i % 50 == 49 ? '\n' : 'a' + (int)(i % 26)), f);
+    fputs("Needle\n", f);
+    return fclose(f) == 0;
+}
+
+void test_binary_detection(void)
+{
+    printf("\n=== Binary Detection Tests ===\n");
+    search_params_t params = create_literal_params("Needle", true, false, false);
+
+    TEST_ASSERT(write_binary_input(100), "Binary test file written");
+    params.binary_files = BINARY_FILES_TEXT;
+    TEST_ASSERT(capture_search_output(&params, IO_TEST_BINARY, 1, NULL) == 0, "Binary files are searched as text by default");
+    params.binary_files = BINARY_FILES_SKIP;
+    TEST_ASSERT(capture_search_output(&params, IO_TEST_BINARY, 1, NULL) == 1, "-I skips a mapped binary file");
+    params.io_backend = IO_BACKEND_READ;
+    TEST_ASSERT(capture_search_output(&params, IO_TEST_BINARY, 1, NULL) == 1, "-I skips a binary file read ahead");
+    params.io_backend = IO_BACKEND_AUTO;
+
+    // Only the first block decides
+    TEST_ASSERT(write_binary_input(BINARY_CHECK_BUFFER_SIZE + 10), "Late-NUL test file written");
+    TEST_ASSERT(capture_search_output(&params, IO_TEST_BINARY, 1, NULL) == 0, "A NUL past the first block is not binary");
+    TEST_ASSERT(capture_search_output(&params, IO_TEST_INPUT, 1, NULL) == 0, "-I leaves text files alone");
+
+    cleanup_params(&params);
+    unlink(IO_TEST_BINARY);
+}
+
+void run_io_tests(void)
+{
+    printf("\n--- Running I/O Backend Tests ---\n");
+
+    if (!write_io_input())
+    {
+        printf("✗ FAIL: Could not create I/O test input\n");
+        tests_failed++;
+    }
+    else
+    {
+        test_io_backend_selection();
+        test_io_reader();
+        test_io_search();
+        test_prefetch_window();
+        test_binary_detection();
+    }
+
+    free(io_input);
+    io_input = NULL;
+    unlink(IO_TEST_INPUT);
+
+    printf("\n--- Completed I/O Backend Tests ---\n");
+}
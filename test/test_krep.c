@@ -12,6 +12,7 @@
 #include <inttypes.h> // For PRIu64 format specifier
 #include <limits.h>   // For SIZE_MAX
 #include <unistd.h>   // For sleep (used in placeholder)
+#include <fcntl.h>    // For open (output capture)
 
 /* Define TESTING before including headers if not done by Makefile */
 #ifndef TESTING
@@ -22,6 +23,7 @@
 /* Assumes krep.h and aho_corasick.h are in the parent directory */
 #include "../krep.h"
 #include "../aho_corasick.h" // Include Aho-Corasick header
+#include "../regex_dfa.h"    // Lazy DFA attached to regex params
 #include "test_krep.h"       // Include test header for consistency (if needed)
 #include "test_compat.h"     // Include compatibility wrappers
 
@@ -29,6 +31,18 @@
 void run_regex_tests(void);
 // Forward declaration for multiple pattern tests (defined in test_multiple_patterns.c)
 void run_multiple_patterns_tests(void);
+// Forward declaration for stream tests (defined in test_stream.c)
+void run_stream_tests(void);
+void run_index_tests(void);
+void run_decompress_tests(void);
+void run_io_tests(void);
+void run_matcher_tests(void);
+void run_profile_tests(void);
+void run_stats_tests(void);
+void run_arena_tests(void);
+void run_ignore_tests(void);
+void run_context_tests(void);
+void run_early_exit_tests(void);
 
 /* Test flags and counters */
 int tests_passed = 0;
@@ -125,6 +139,7 @@ search_params_t create_regex_params(const char *pattern,
         exit(EXIT_FAILURE);
     }
     params.compiled_regex = compiled;
+    params.regex_dfa = regex_dfa_compile(pattern, case_sensitive); // NULL keeps regexec
     return params;
 }
 
@@ -137,6 +152,8 @@ void cleanup_params(search_params_t *params)
         free((void *)params->compiled_regex);       // Free the allocated regex_t struct itself
         params->compiled_regex = NULL;
     }
+    regex_dfa_free(params->regex_dfa);
+    params->regex_dfa = NULL;
     // Free pattern arrays allocated by helpers
     if (params->patterns)
     {
@@ -157,6 +174,59 @@ void cleanup_params(search_params_t *params)
     // Note: Does not free ac_trie, handled separately
 }
 
+/* Run a search with stdout redirected into a temporary file */
+int capture_search_output(const search_params_t *params, const char *path, int threads, char **output)
+{
+    if (output)
+        *output = NULL;
+    FILE *capture = tmpfile();
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (!capture || saved_stdout == -1)
+    {
+        if (capture)
+            fclose(capture);
+        if (saved_stdout != -1)
+            close(saved_stdout);
+        return -1;
+    }
+    dup2(fileno(capture), STDOUT_FILENO);
+
+    int rc = -1;
+    if (threads > 0)
+    {
+        rc = search_file(params, path, threads);
+    }
+    else
+    {
+        int in_fd = open(path, O_RDONLY);
+        if (in_fd != -1)
+        {
+            rc = search_stream(params, in_fd, NULL);
+            close(in_fd);
+        }
+    }
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    if (output)
+    {
+        fseek(capture, 0, SEEK_END);
+        long size = ftell(capture);
+        fseek(capture, 0, SEEK_SET);
+        *output = malloc(size + 1);
+        if (*output)
+        {
+            size_t n = fread(*output, 1, size, capture);
+            (*output)[n] = '\0';
+        }
+    }
+    fclose(capture);
+    return rc;
+}
+
 /* ========================================================================= */
 /* Test Functions using search_params_t             */
 /* ========================================================================= */
@@ -493,6 +563,41 @@ void test_performance_new(void)
 }
 
 #if KREP_USE_SSE42 || KREP_USE_AVX2 || KREP_USE_NEON
+// A periodic "abab..." pattern of pattern_len bytes over runs of 300 and 160 bytes of
+// "abab...": -o and -co must both report floor(300 / len) + floor(160 / len)
+// non-overlapping matches, like grep and the scalar searchers
+static bool kernel_skips_past_matches(search_func_t kernel, size_t pattern_len, bool case_sensitive)
+{
+    char pattern[65];
+    char text[512];
+    for (size_t i = 0; i < pattern_len; i++)
+        pattern[i] = (case_sensitive ? "ab" : "AB")[i % 2];
+    pattern[pattern_len] = '\0';
+    size_t text_len = 0;
+    text[text_len++] = 'x';
+    for (size_t i = 0; i < 300; i++)
+        text[text_len++] = "ab"[i % 2];
+    text[text_len++] = '\n';
+    for (size_t i = 0; i < 160; i++)
+        text[text_len++] = "ab"[i % 2];
+    uint64_t expected = 300 / pattern_len + 160 / pattern_len;
+
+    krep_set_only_matching(true);
+    match_result_t *result = match_result_init(16);
+    search_params_t params = create_literal_params(pattern, case_sensitive, false, true);
+    bool ok = result && kernel(&params, text, text_len, result) == expected && result->count == expected;
+    for (uint64_t i = 1; ok && i < result->count; i++)
+        ok = result->positions[i].start_offset >= result->positions[i - 1].end_offset;
+    cleanup_params(&params);
+    match_result_free(result);
+
+    params = create_literal_params(pattern, case_sensitive, true, true);
+    ok = ok && kernel(&params, text, text_len, NULL) == expected;
+    cleanup_params(&params);
+    krep_set_only_matching(false);
+    return ok;
+}
+
 /**
  * Test SIMD specific behaviors using the new structure
  */
@@ -556,15 +661,30 @@ void test_simd_specific_new(void)
     TEST_ASSERT(matches_simd == 1, "SSE4.2 fallback finds 'consectetur adipi' once");
     cleanup_params(&params17);
 
-    // Test case-insensitive SIMD fallback
+    // Test case-insensitive SIMD search (case-folded compare)
     const char *pattern_upper = "DOLOR"; // Should match "dolor" and "dolore"
     search_params_t params_ci = create_literal_params(pattern_upper, false, false, false);
-    matches_simd = simd_sse42_search(&params_ci, haystack, haystack_len, result); // Will call BM
+    matches_simd = simd_sse42_search(&params_ci, haystack, haystack_len, result);
     matches_bmh = test_bridge_boyer_moore(&params_ci, haystack, haystack_len, result);
     TEST_ASSERT(matches_simd == matches_bmh,
-                "Case-insensitive search consistent between SSE4.2 fallback and Boyer-Moore");
-    TEST_ASSERT(matches_simd == 2, "Case-insensitive SSE4.2 fallback finds 'DOLOR' twice");
+                "Case-insensitive search consistent between SSE4.2 and Boyer-Moore");
+    TEST_ASSERT(matches_simd == 2, "Case-insensitive SSE4.2 finds 'DOLOR' twice");
     cleanup_params(&params_ci);
+
+    // Mixed case on both sides; '@' and '[' sit just outside the folded 'A'-'Z' range
+    const char *mixed_text = "xx LoReM @[ lorem LOREM `{ Lorem";
+    search_params_t params_ci_mixed = create_literal_params("lOrEm", false, false, false);
+    matches_simd = simd_sse42_search(&params_ci_mixed, mixed_text, strlen(mixed_text), result);
+    TEST_ASSERT(matches_simd == 4, "Case-insensitive SSE4.2 matches every case mix");
+    cleanup_params(&params_ci_mixed);
+
+    search_params_t params_ci_punct = create_literal_params("@[", false, false, false);
+    matches_simd = simd_sse42_search(&params_ci_punct, mixed_text, strlen(mixed_text), result);
+    TEST_ASSERT(matches_simd == 1, "Case-insensitive SSE4.2 does not fold '@[' onto '`{'");
+    cleanup_params(&params_ci_punct);
+
+    TEST_ASSERT(kernel_skips_past_matches(simd_sse42_search, 16, true), "SSE4.2 -o matches do not overlap");
+    TEST_ASSERT(kernel_skips_past_matches(simd_sse42_search, 8, false), "SSE4.2 -o -i matches do not overlap");
 #else
     printf("INFO: SSE4.2 not available, skipping SSE4.2 specific tests.\n");
 #endif // KREP_USE_SSE42
@@ -598,8 +718,118 @@ void test_simd_specific_new(void)
     TEST_ASSERT(matches_simd == 2, "AVX2 finds 'DOLOR' twice (CI)");
     cleanup_params(&params_short_ci);
 
+    // Long pattern with mixed case; the text is long enough for the 32-byte vector loop
+    const char *mixed_long = "Ut Enim Ad Minim Veniam, Quis Nostrud. ut enim ad minim veniam, quis nostrud. "
+                             "UT ENIM AD MINIM VENIAM, QUIS NOSTRUD.";
+    search_params_t params_long_mixed = create_literal_params("ut enim AD MINIM veniam, quis", false, false, false);
+    matches_simd = simd_avx2_search(&params_long_mixed, mixed_long, strlen(mixed_long), result);
+    TEST_ASSERT(matches_simd == 3, "AVX2 matches a 29-byte pattern in every case mix (CI)");
+    cleanup_params(&params_long_mixed);
+
+    TEST_ASSERT(kernel_skips_past_matches(simd_avx2_search, 24, true), "AVX2 -o matches do not overlap");
+    TEST_ASSERT(kernel_skips_past_matches(simd_avx2_search, 24, false), "AVX2 -o -i matches do not overlap");
+
 #endif // KREP_USE_AVX2
 
+#if KREP_USE_AVX512
+    printf("--- Testing AVX-512BW ---\n");
+    // 57 bytes: longer than the AVX2 kernel handles
+    const char *pattern57 = "consectetur adipiscing elit, sed do eiusmod tempor incidi";
+    search_params_t params_512_long = create_literal_params(pattern57, true, false, false);
+    matches_simd = simd_avx512_search(&params_512_long, haystack, haystack_len, result);
+    matches_bmh = test_bridge_boyer_moore(&params_512_long, haystack, haystack_len, result);
+    TEST_ASSERT(matches_simd == matches_bmh, "AVX-512BW and Boyer-Moore match for 57-byte pattern");
+    TEST_ASSERT(matches_simd == 1, "AVX-512BW finds the 57-byte pattern once");
+    cleanup_params(&params_512_long);
+
+    // Match ending on the very last byte exercises the masked tail load
+    search_params_t params_512_end = create_literal_params("magna aliqua.", true, false, false);
+    matches_simd = simd_avx512_search(&params_512_end, haystack, haystack_len, result);
+    TEST_ASSERT(matches_simd == 1, "AVX-512BW finds a match at the end of the text");
+    cleanup_params(&params_512_end);
+
+    search_params_t params_512_short = create_literal_params(pattern1, true, false, false);
+    matches_simd = simd_avx512_search(&params_512_short, haystack, haystack_len, result);
+    TEST_ASSERT(matches_simd == 2, "AVX-512BW finds 'dolor' twice");
+    cleanup_params(&params_512_short);
+
+    search_params_t params_512_ci = create_literal_params("CONSECTETUR ADIPISCING ELIT, SED DO EIUSMOD TEMPOR INCIDI",
+                                                          false, false, false);
+    matches_simd = simd_avx512_search(&params_512_ci, haystack, haystack_len, result);
+    TEST_ASSERT(matches_simd == 1, "AVX-512BW finds the 57-byte pattern case-insensitively");
+    cleanup_params(&params_512_ci);
+
+    TEST_ASSERT(kernel_skips_past_matches(simd_avx512_search, 36, true), "AVX-512BW -o matches do not overlap");
+    TEST_ASSERT(kernel_skips_past_matches(simd_avx512_search, 16, false), "AVX-512BW -o -i matches do not overlap");
+#endif // KREP_USE_AVX512
+
+#if KREP_USE_AVX2 || KREP_USE_NEON
+    printf("--- Testing rare-byte anchor kernel ---\n");
+    {
+        // Long text with a 70-byte pattern near the start, in the middle and flush with the end
+        const char *needle = "java.lang.IllegalStateException: Connection pool exhausted (id=42)!";
+        size_t needle_len = strlen(needle);
+        size_t long_len = 4096;
+        char *long_text = malloc(long_len + 1);
+        memset(long_text, 'e', long_len);
+        for (size_t i = 80; i < long_len; i += 81)
+            long_text[i] = '\n';
+        memcpy(long_text + 3, needle, needle_len);
+        memcpy(long_text + 2000, needle, needle_len);
+        memcpy(long_text + long_len - needle_len, needle, needle_len);
+        long_text[long_len] = '\0';
+
+        search_params_t params_anchor = create_literal_params(needle, true, false, false);
+        matches_simd = simd_anchor_search(&params_anchor, long_text, long_len, result);
+        matches_bmh = test_bridge_boyer_moore(&params_anchor, long_text, long_len, result);
+        TEST_ASSERT(matches_simd == matches_bmh, "Anchor kernel and Boyer-Moore match for a 70-byte pattern");
+        TEST_ASSERT(matches_simd == 3, "Anchor kernel finds matches at start, middle and end of text");
+        cleanup_params(&params_anchor);
+
+        search_params_t params_anchor_ci = create_literal_params("JAVA.LANG.illegalstateexception: CONNECTION POOL",
+                                                                 false, false, false);
+        matches_simd = simd_anchor_search(&params_anchor_ci, long_text, long_len, result);
+        TEST_ASSERT(matches_simd == 3, "Anchor kernel matches case-insensitively");
+        cleanup_params(&params_anchor_ci);
+
+        search_params_t params_anchor_lines = create_literal_params("Connection pool", true, true, false);
+        matches_simd = simd_anchor_search(&params_anchor_lines, long_text, long_len, result);
+        matches_bmh = test_bridge_boyer_moore(&params_anchor_lines, long_text, long_len, result);
+        TEST_ASSERT(matches_simd == matches_bmh, "Anchor kernel counts matching lines like Boyer-Moore");
+        cleanup_params(&params_anchor_lines);
+
+        // A periodic 70-byte pattern: -o and -co count non-overlapping matches (150 and 80
+        // repetitions of "ab" hold 4 and 2 of them), like grep and the scalar searchers
+        char periodic[71];
+        char periodic_text[512];
+        for (size_t i = 0; i < 70; i++)
+            periodic[i] = "ab"[i % 2];
+        periodic[70] = '\0';
+        size_t periodic_len = 0;
+        periodic_text[periodic_len++] = 'x';
+        for (size_t i = 0; i < 300; i++)
+            periodic_text[periodic_len++] = "ab"[i % 2];
+        periodic_text[periodic_len++] = '\n';
+        for (size_t i = 0; i < 160; i++)
+            periodic_text[periodic_len++] = "ab"[i % 2];
+        match_result_t *periodic_result = match_result_init(16);
+        search_params_t params_periodic = create_literal_params(periodic, true, false, true);
+        matches_simd = simd_anchor_search(&params_periodic, periodic_text, periodic_len, periodic_result);
+        bool disjoint = periodic_result && periodic_result->count == 6;
+        for (uint64_t i = 1; disjoint && i < periodic_result->count; i++)
+            disjoint = periodic_result->positions[i].start_offset >= periodic_result->positions[i - 1].end_offset;
+        TEST_ASSERT(matches_simd == 6 && disjoint, "Anchor kernel reports non-overlapping -o matches");
+        cleanup_params(&params_periodic);
+        params_periodic = create_literal_params(periodic, true, true, true);
+        TEST_ASSERT(simd_anchor_search(&params_periodic, periodic_text, periodic_len, NULL) == 6,
+                    "Anchor kernel -co counts non-overlapping matches");
+        cleanup_params(&params_periodic);
+        match_result_free(periodic_result);
+
+        free(long_text);
+    }
+#endif // Anchor kernel
+
 #if KREP_USE_NEON
     printf("--- Testing NEON ---\n");
     search_params_t params_neon1 = create_literal_params(pattern1, true, false, false);
@@ -624,12 +854,15 @@ void test_simd_specific_new(void)
     cleanup_params(&params_neon17);
 
     search_params_t params_neon_ci = create_literal_params("DOLOR", false, false, false);
-    matches_simd = neon_search(&params_neon_ci, haystack, haystack_len, result); // Falls back to BM
+    matches_simd = neon_search(&params_neon_ci, haystack, haystack_len, result);
     matches_bmh = test_bridge_boyer_moore(&params_neon_ci, haystack, haystack_len, result);
-    TEST_ASSERT(matches_simd == matches_bmh, "NEON fallback for case-insensitive matches BM");
-    TEST_ASSERT(matches_simd == 2, "NEON fallback finds 'DOLOR' twice");
+    TEST_ASSERT(matches_simd == matches_bmh, "NEON case-insensitive search matches BM");
+    TEST_ASSERT(matches_simd == 2, "NEON finds 'DOLOR' twice");
     cleanup_params(&params_neon_ci);
 
+    TEST_ASSERT(kernel_skips_past_matches(neon_search, 16, true), "NEON -o matches do not overlap");
+    TEST_ASSERT(kernel_skips_past_matches(neon_search, 16, false), "NEON -o -i matches do not overlap");
+
 #endif // KREP_USE_NEON
 }
 #endif // Any SIMD defined
@@ -877,21 +1110,422 @@ void test_max_count_new(void)
     ac_trie_free(params_ac.ac_trie);
 }
 
+#define CHUNK_TEST_PATH "/tmp/krep_test_chunks.txt"
+#define CHUNK_TEST_OUTPUT "/tmp/krep_test_chunks_out.txt"
+#define CHUNK_TEST_LINES 30000
+
+/**
+ * Run search_file with stdout captured and return the number of output lines,
+ * or the count printed in -c mode. Returns -1 on failure.
+ */
+static long search_file_capture(const search_params_t *params, int threads)
+{
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(CHUNK_TEST_OUTPUT, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (saved_stdout == -1 || capture_fd == -1)
+        return -1;
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    int rc = search_file(params, CHUNK_TEST_PATH, threads);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    if (rc == 2)
+        return -1;
+
+    long lines = 0, count = -1;
+    FILE *f = fopen(CHUNK_TEST_OUTPUT, "r");
+    if (!f)
+        return -1;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), f))
+    {
+        const char *colon = strrchr(buf, ':');
+        if (colon && (params->count_lines_mode || params->count_matches_mode))
+            count = strtol(colon + 1, NULL, 10);
+        if (strchr(buf, '\n'))
+            lines++;
+    }
+    fclose(f);
+    return (params->count_lines_mode || params->count_matches_mode) ? count : lines;
+}
+
+// Read the last captured search output into a malloc'd buffer
+static char *read_capture(size_t *len)
+{
+    FILE *f = fopen(CHUNK_TEST_OUTPUT, "r");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(size + 1);
+    if (buf)
+        *len = fread(buf, 1, size, f);
+    fclose(f);
+    return buf;
+}
+
+// True when printing with 1 and with 4 threads produces byte-identical output
+static bool threaded_output_matches_single(const search_params_t *params)
+{
+    size_t single_len = 0, multi_len = 0;
+    bool same = false;
+    if (search_file_capture(params, 1) <= 0)
+        return false;
+    char *single = read_capture(&single_len);
+    if (search_file_capture(params, 4) > 0)
+    {
+        char *multi = read_capture(&multi_len);
+        same = single && multi && single_len == multi_len && memcmp(single, multi, single_len) == 0;
+        free(multi);
+    }
+    free(single);
+    return same;
+}
+
 /**
- * Placeholder test for multithreading.
- * Actual testing requires file I/O and calling search_file.
+ * Test that multithreaded file search splits chunks on line boundaries.
+ * Lines of varying length (400-496 bytes) make chunk splits land mid-line;
+ * each line must still be matched and counted exactly once.
  */
-void test_multithreading_placeholder_new(void)
+void test_multithreading_new(void)
 {
     printf("\n=== Testing Parallel Processing ===\n");
-    printf("  Parallel processing tests would validate:\n");
-    printf("  1. Correct match counting across thread boundaries\n");
-    printf("  2. Proper handling of overlapping chunks\n");
-    printf("  3. Thread scaling efficiency\n");
-    printf("  4. Memory mapping and resource cleanup\n");
-    // In a real test, we'd create a temp file, call search_file() with different thread counts,
-    // capture output or check return codes, and verify results.
-    TEST_ASSERT(true, "Placeholder for multi-threaded tests");
+
+    FILE *f = fopen(CHUNK_TEST_PATH, "w");
+    if (!f)
+    {
+        TEST_ASSERT(false, "Create chunking test file");
+        return;
+    }
+    char line[512];
+    memset(line, 'x', sizeof(line));
+    for (int i = 0; i < CHUNK_TEST_LINES; i++)
+    {
+        fwrite(line, 1, 400 + i % 97, f);
+        fputc('\n', f);
+    }
+    fclose(f);
+
+    search_params_t params = create_literal_params("x", true, true, false);
+    TEST_ASSERT(search_file_capture(&params, 1) == CHUNK_TEST_LINES, "Single-threaded -c counts every line");
+    TEST_ASSERT(search_file_capture(&params, 4) == CHUNK_TEST_LINES,
+                "Multithreaded -c counts lines spanning chunk splits once");
+    cleanup_params(&params);
+
+    params = create_regex_params("^x+$", true, true, false);
+    TEST_ASSERT(search_file_capture(&params, 4) == CHUNK_TEST_LINES,
+                "Multithreaded regex anchors see whole lines");
+    cleanup_params(&params);
+
+    // The empty match after a chunk's last newline is the next chunk's, not counted twice
+    params = create_regex_params("^$", true, true, false);
+    TEST_ASSERT(search_file_capture(&params, 4) == search_file_capture(&params, 1),
+                "Multithreaded empty-line count matches single-threaded count");
+    cleanup_params(&params);
+
+    params = create_regex_params("x{400}", true, true, true);
+    TEST_ASSERT(search_file_capture(&params, 4) == CHUNK_TEST_LINES,
+                "Multithreaded regex finds matches near chunk splits");
+    cleanup_params(&params);
+
+    // Printed output is formatted per chunk and written in chunk order
+    params = create_literal_params("x", true, false, false);
+    TEST_ASSERT(search_file_capture(&params, 4) == CHUNK_TEST_LINES, "Multithreaded search prints every line once");
+    TEST_ASSERT(threaded_output_matches_single(&params), "Multithreaded line output matches single-threaded output");
+    cleanup_params(&params);
+
+    params = create_regex_params("x{400}", true, false, true);
+    TEST_ASSERT(threaded_output_matches_single(&params),
+                "Multithreaded regex output matches single-threaded output");
+    cleanup_params(&params);
+
+    // -o numbers lines across chunks without matches: only the second and last lines match
+    f = fopen(CHUNK_TEST_PATH, "w");
+    if (!f)
+    {
+        TEST_ASSERT(false, "Create sparse chunking test file");
+        return;
+    }
+    for (int i = 0; i < CHUNK_TEST_LINES; i++)
+    {
+        if (i == 1 || i == CHUNK_TEST_LINES - 1)
+            fputs("needle\n", f);
+        fwrite(line, 1, 400 + i % 97, f);
+        fputc('\n', f);
+    }
+    fclose(f);
+    krep_set_only_matching(true);
+    params = create_literal_params("needle", true, false, true);
+    char *single = NULL, *chunked = NULL;
+    capture_search_output(&params, CHUNK_TEST_PATH, 1, &single);
+    capture_search_output(&params, CHUNK_TEST_PATH, 4, &chunked);
+    char last_line[32];
+    snprintf(last_line, sizeof(last_line), ":%d:needle", CHUNK_TEST_LINES + 1);
+    TEST_ASSERT(single && chunked && strcmp(single, chunked) == 0 && strstr(chunked, ":2:needle") &&
+                    strstr(chunked, last_line),
+                "Multithreaded -o line numbers count the lines of chunks without matches");
+    free(single);
+    free(chunked);
+    cleanup_params(&params);
+    krep_set_only_matching(false);
+
+    unlink(CHUNK_TEST_PATH);
+    unlink(CHUNK_TEST_OUTPUT);
+}
+
+/**
+ * Test the -c count kernels: each matching line counts once however many hits
+ * it holds, -i sees both cases, and -m and -w still apply.
+ */
+void test_count_kernels(void)
+{
+    printf("\n=== Testing Count Kernels ===\n");
+
+    const char *text = "eEe abc abc\nnothing here\nAbC\nzzz abc\nE";
+    size_t len = strlen(text);
+
+    search_params_t params = create_literal_params("e", true, true, false);
+    TEST_ASSERT(memchr_count_lines(&params, text, len, NULL) == 2, "memchr count kernel counts lines once");
+    params.case_sensitive = false;
+    TEST_ASSERT(memchr_count_lines(&params, text, len, NULL) == 3, "memchr count kernel matches either case");
+    params.max_count = 1;
+    TEST_ASSERT(memchr_count_lines(&params, text, len, NULL) == 1, "memchr count kernel stops at -m");
+    cleanup_params(&params);
+
+    params = create_literal_params("abc", true, true, false);
+    TEST_ASSERT(boyer_moore_count_lines(&params, text, len, NULL) == 2, "Horspool count kernel counts lines once");
+    params.case_sensitive = false;
+    TEST_ASSERT(boyer_moore_count_lines(&params, text, len, NULL) == 3, "Horspool count kernel matches either case");
+    params.whole_word = true;
+    TEST_ASSERT(boyer_moore_count_lines(&params, "xabc abc\nxabc\n", 14, NULL) == 1,
+                "Horspool count kernel applies -w");
+    cleanup_params(&params);
+
+    // Aho-Corasick resumes on the next line after the first hit
+    const char *ac_patterns[] = {"abc", "zzz", "here"};
+    size_t ac_lens[] = {3, 3, 4};
+    search_params_t ac_params = {
+        .patterns = ac_patterns,
+        .pattern_lens = ac_lens,
+        .num_patterns = 3,
+        .case_sensitive = true,
+        .count_lines_mode = true,
+        .max_count = SIZE_MAX};
+    ac_params.ac_trie = ac_trie_build(&ac_params);
+    TEST_ASSERT(ac_params.ac_trie && aho_corasick_search(&ac_params, text, len, NULL) == 3,
+                "Aho-Corasick -c counts each line with any pattern once");
+    ac_trie_free(ac_params.ac_trie);
+
+    // Regexes that match on every line count lines with the newline counter
+    params = create_regex_params("^", true, true, false);
+    TEST_ASSERT(regex_search(&params, text, len, NULL) == 5, "Regex ^ counts every line");
+    cleanup_params(&params);
+    params = create_regex_params("q*$", true, true, false);
+    TEST_ASSERT(regex_search(&params, "a\nb\n", 4, NULL) == 2, "Regex q*$ counts lines of newline-terminated text");
+    cleanup_params(&params);
+    params = create_regex_params("^$", true, true, false);
+    TEST_ASSERT(regex_search(&params, "a\n\nb", 4, NULL) == 1, "Regex ^$ counts only empty lines");
+    cleanup_params(&params);
+}
+
+/**
+ * Test the newline counter and the block newline index against a naive scan,
+ * with lines long and short enough to cross index blocks and SIMD widths.
+ */
+void test_newline_index(void)
+{
+    printf("\n=== Testing Newline Index ===\n");
+
+    size_t text_len = 3 * NEWLINE_INDEX_BLOCK_SIZE + 123;
+    char *text = malloc(text_len);
+    if (!text)
+    {
+        TEST_ASSERT(false, "Allocate newline index test text");
+        return;
+    }
+    // Line lengths cycle through 1..199 except for one line spanning a whole block
+    size_t next_newline = 0;
+    for (size_t i = 0, n = 1; i < text_len; i++)
+    {
+        if (i == next_newline)
+        {
+            text[i] = '\n';
+            n = (n % 199) + 1;
+            next_newline = i + ((i > NEWLINE_INDEX_BLOCK_SIZE && i < 2 * NEWLINE_INDEX_BLOCK_SIZE) ? NEWLINE_INDEX_BLOCK_SIZE + 7 : n);
+        }
+        else
+            text[i] = 'a' + (char)(i % 26);
+    }
+
+    bool counts_ok = true;
+    for (size_t len = 0; len < 300; len++)
+    {
+        size_t naive = 0;
+        for (size_t i = 0; i < len; i++)
+            naive += text[i] == '\n';
+        counts_ok &= count_newlines(text, len) == naive;
+    }
+    TEST_ASSERT(counts_ok, "count_newlines matches a byte loop for every tail length");
+
+    newline_index_t index = {0};
+    TEST_ASSERT(newline_index_build(&index, text, text_len), "Newline index builds");
+
+    bool line_of_ok = true, line_start_ok = true;
+    uint64_t line = 0;
+    size_t line_start = 0;
+    for (size_t pos = 0; pos <= text_len; pos++)
+    {
+        line_of_ok &= newline_index_line_of(&index, pos) == line;
+        if (pos == line_start)
+            line_start_ok &= newline_index_line_start(&index, line) == line_start;
+        if (pos < text_len && text[pos] == '\n')
+        {
+            line++;
+            line_start = pos + 1;
+        }
+    }
+    TEST_ASSERT(line_of_ok, "Newline index gives the line of every offset");
+    TEST_ASSERT(line_start_ok, "Newline index finds the start of every line");
+    TEST_ASSERT(newline_index_total(&index) == line, "Newline index total matches the line count");
+    TEST_ASSERT(newline_index_line_start(&index, line + 1) == text_len, "Line past the end starts at the text length");
+
+    newline_index_free(&index);
+    free(text);
+}
+
+/**
+ * Test compact match results: 32-bit starts with an implied end, converting to the
+ * full form when a match does not fit, and agreeing with the full form in kernels.
+ */
+void test_compact_match_results(void)
+{
+    printf("\n=== Testing Compact Match Results ===\n");
+
+    match_result_t *compact = match_result_init_compact(NULL, 2, 5);
+    TEST_ASSERT(compact && compact->starts && !compact->positions, "Compact result holds starts only");
+    TEST_ASSERT(match_result_init_compact(NULL, 2, 0) == NULL, "Compact results need a match length");
+    if (!compact)
+        return;
+    bool ok = true;
+    for (size_t i = 0; i < 1000; i++)
+        ok &= match_result_add(compact, i * 7, i * 7 + 5);
+    TEST_ASSERT(ok && compact->starts && compact->count == 1000, "Compact result grows");
+    TEST_ASSERT(match_result_start(compact, 999) == 6993 && match_result_end(compact, 999) == 6998,
+                "Accessors imply the end from the match length");
+
+    // Compact into compact, then past 32 bits
+    match_result_t *src = match_result_init_compact(NULL, 4, 5);
+    match_result_add(src, 3, 8);
+    match_result_add(src, 10, 15);
+    TEST_ASSERT(match_result_merge(compact, src, 100000) && compact->starts && compact->count == 1002 &&
+                    match_result_start(compact, 1001) == 100010,
+                "Compact merge stays compact");
+    TEST_ASSERT(match_result_merge(compact, src, (size_t)UINT32_MAX - 5) && !compact->starts &&
+                    compact->count == 1004 && compact->positions[1003].start_offset == (size_t)UINT32_MAX + 5 &&
+                    compact->positions[1003].end_offset == (size_t)UINT32_MAX + 10 &&
+                    compact->positions[999].start_offset == 6993 && compact->positions[999].end_offset == 6998,
+                "Merge past 32 bits converts to the full form");
+    match_result_free(compact);
+
+    // A match of another length converts too
+    compact = match_result_init_compact(NULL, 4, 3);
+    match_result_add(src, 20, 21);
+    match_result_add(compact, 1, 4);
+    TEST_ASSERT(match_result_merge(compact, src, 0) && !compact->starts && compact->count == 4 &&
+                    match_result_end(compact, 0) == 4 && match_result_end(compact, 3) == 21,
+                "A match of another length converts to the full form");
+    match_result_free(compact);
+    match_result_free(src);
+
+    // Kernels fill compact results with the same positions as full ones
+    size_t text_len = 100000;
+    char *text = malloc(text_len);
+    if (!text)
+    {
+        TEST_ASSERT(false, "Allocate compact result test text");
+        return;
+    }
+    for (size_t i = 0; i < text_len; i++)
+        text[i] = (i % 97 == 0) ? '\n' : 'a' + (char)(i % 23);
+    memcpy(text + text_len - 40, "needle", 6); // In the tail past the last full SIMD block
+    for (size_t i = 500; i < text_len - 100; i += 1001)
+        memcpy(text + i, "needle", 6);
+
+    const char *patterns[] = {"needle", "NEEDLE"};
+    for (int p = 0; p < 2; p++)
+    {
+        search_params_t params = create_literal_params(patterns[p], p == 0, false, true);
+        krep_matcher_t *matcher = krep_compile(&params);
+        match_result_t *full = match_result_init(16);
+        compact = match_result_init_compact(NULL, 16, 6);
+        uint64_t full_count = matcher ? krep_match(matcher, text, text_len, full) : 0;
+        uint64_t compact_count = matcher ? krep_match(matcher, text, text_len, compact) : 0;
+        bool same = full && compact && full_count == compact_count && full->count == compact->count &&
+                    full_count > 90 && compact->starts;
+        for (uint64_t i = 0; same && i < full->count; i++)
+            same = match_result_start(full, i) == match_result_start(compact, i) &&
+                   match_result_end(full, i) == match_result_end(compact, i);
+        TEST_ASSERT(same, p == 0 ? "Compact and full results agree" : "Compact and full results agree (-i)");
+        match_result_free(full);
+        match_result_free(compact);
+        krep_matcher_free(matcher);
+        cleanup_params(&params);
+    }
+    free(text);
+}
+
+static atomic_int pool_test_counter;
+static thread_pool_t *pool_test_pool;
+
+static void *pool_test_leaf(void *arg)
+{
+    (void)arg;
+    atomic_fetch_add(&pool_test_counter, 1);
+    return NULL;
+}
+
+static void *pool_test_parent(void *arg)
+{
+    // Submitted from a worker: lands on that worker's own deque
+    for (int i = 0; i < 8; i++)
+        thread_pool_submit(pool_test_pool, pool_test_leaf, arg);
+    return NULL;
+}
+
+/**
+ * Test the work-stealing thread pool: every submitted task runs exactly once,
+ * including tasks submitted from inside tasks, and wait_all returns after all of them.
+ */
+void test_thread_pool_new(void)
+{
+    printf("\n=== Testing Thread Pool ===\n");
+
+    pool_test_pool = thread_pool_init(4);
+    TEST_ASSERT(pool_test_pool != NULL, "Thread pool initializes");
+    if (!pool_test_pool)
+        return;
+
+    // More tasks than preallocated nodes and initial deque slots
+    atomic_store(&pool_test_counter, 0);
+    bool submitted = true;
+    for (int i = 0; i < 5000; i++)
+        submitted &= thread_pool_submit(pool_test_pool, pool_test_leaf, NULL);
+    thread_pool_wait_all(pool_test_pool);
+    TEST_ASSERT(submitted && atomic_load(&pool_test_counter) == 5000, "Thread pool runs every submitted task once");
+
+    atomic_store(&pool_test_counter, 0);
+    for (int i = 0; i < 500; i++)
+        thread_pool_submit(pool_test_pool, pool_test_parent, NULL);
+    thread_pool_wait_all(pool_test_pool);
+    TEST_ASSERT(atomic_load(&pool_test_counter) == 4000, "Thread pool waits for tasks submitted by tasks");
+
+    thread_pool_destroy(pool_test_pool);
+    pool_test_pool = NULL;
 }
 
 /**
@@ -1286,7 +1920,11 @@ int main(void)
 #endif
     test_report_limit_new();
     test_max_count_new(); // Add call to the new test function
-    test_multithreading_placeholder_new();
+    test_multithreading_new();
+    test_count_kernels();
+    test_newline_index();
+    test_compact_match_results();
+    test_thread_pool_new();
 
     // Add additional edge case tests
     test_additional_cases();
@@ -1294,6 +1932,37 @@ int main(void)
     // Run tests from other files
     run_regex_tests();
     run_multiple_patterns_tests();
+    run_stream_tests();
+
+    // Run trigram index tests
+    run_index_tests();
+
+    // Run compressed input tests
+    run_decompress_tests();
+
+    // Run I/O backend tests
+    run_io_tests();
+
+    // Run compiled matcher tests
+    run_matcher_tests();
+
+    // Run calibrated algorithm selection tests
+    run_profile_tests();
+
+    // Run --stats instrumentation tests
+    run_stats_tests();
+
+    // Run arena allocator tests
+    run_arena_tests();
+
+    // Run .gitignore / --glob rule tests
+    run_ignore_tests();
+
+    // Run -A/-B/-C context line tests
+    run_context_tests();
+
+    // Run -m / -q / -l early termination tests
+    run_early_exit_tests();
 
     // Run advanced edge cases
     test_edge_cases_advanced();
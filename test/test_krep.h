@@ -44,6 +44,7 @@ void test_regex_overlapping(void);
 void test_regex_report_limit(void);
 void test_regex_vs_literal_performance(void);
 void test_regex_line_extraction(void);
+void test_regex_dfa(void);
 void run_regex_tests(void);
 
 /* Helper function declarations */
@@ -83,4 +84,19 @@ search_params_t create_regex_params(const char *pattern, bool case_sensitive, bo
  */
 void cleanup_params(search_params_t *params);
 
+/**
+ * @brief Runs a search with stdout captured.
+ *
+ * Searches path with search_file on threads threads, or with search_stream over the
+ * opened file when threads is 0.
+ *
+ * @param params Search parameters.
+ * @param path File to search.
+ * @param threads Thread count for search_file, or 0 for search_stream.
+ * @param output Receives a malloc'd, NUL-terminated copy of what was printed; NULL
+ *               discards the output.
+ * @return The search result code, or -1 when the search could not be run.
+ */
+int capture_search_output(const search_params_t *params, const char *path, int threads, char **output);
+
 #endif /* TEST_KREP_H */
\ No newline at end of file
@@ -0,0 +1,442 @@
+/**
+ * Test suite for the compiled matcher API (krep_compile / krep_match)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../aho_corasick.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+/* Log lines the matcher is run over one at a time, as a highlighter would */
+static const char *matcher_lines[] = {
+    "2024-01-01 INFO service started",
+    "2024-01-01 ERROR disk full on /dev/sda1",
+    "2024-01-02 warn error rate rising: 3 errors, 1 ERROR",
+    "no timestamp here",
+    "",
+    "ErrorError error",
+    "2024-01-03 INFO ERRORS are not whole-word ERROR matches"};
+#define NUM_MATCHER_LINES (sizeof(matcher_lines) / sizeof(matcher_lines[0]))
+
+/**
+ * True when krep_match over every line gives the same counts and positions as
+ * calling the selected search algorithm directly with params
+ */
+static bool matcher_agrees(const search_params_t *params)
+{
+    krep_matcher_t *matcher = krep_compile(params);
+    if (!matcher)
+        return false;
+
+    search_func_t direct = select_search_algorithm(params);
+    bool same = true;
+    for (size_t i = 0; i < NUM_MATCHER_LINES && same; i++)
+    {
+        const char *line = matcher_lines[i];
+        size_t len = strlen(line);
+        match_result_t *expected = params->track_positions ? match_result_init(16) : NULL;
+        match_result_t *actual = params->track_positions ? match_result_init(16) : NULL;
+
+        uint64_t expected_count = direct(params, line, len, expected);
+        if (params->max_count != SIZE_MAX && expected_count > params->max_count)
+            expected_count = params->max_count;
+        if (expected && params->max_count != SIZE_MAX && expected->count > params->max_count)
+            expected->count = params->max_count;
+        uint64_t actual_count = krep_match(matcher, line, len, actual);
+
+        same = expected_count == actual_count;
+        if (same && expected)
+        {
+            same = actual && expected->count == actual->count;
+            for (uint64_t j = 0; same && j < expected->count; j++)
+                same = expected->positions[j].start_offset == actual->positions[j].start_offset &&
+                       expected->positions[j].end_offset == actual->positions[j].end_offset;
+        }
+        match_result_free(expected);
+        match_result_free(actual);
+    }
+    krep_matcher_free(matcher);
+    return same;
+}
+
+void test_matcher_literal(void)
+{
+    printf("\n=== Compiled Matcher Literal Tests ===\n");
+
+    search_params_t params = create_literal_params("ERROR", true, false, true);
+    TEST_ASSERT(matcher_agrees(&params), "Literal matcher finds the same positions");
+    cleanup_params(&params);
+
+    params = create_literal_params("error", false, false, true);
+    TEST_ASSERT(matcher_agrees(&params), "Case-insensitive matcher finds the same positions");
+    cleanup_params(&params);
+
+    params = create_literal_params("ERROR", true, true, false);
+    TEST_ASSERT(matcher_agrees(&params), "Line-counting matcher gives the same counts");
+    cleanup_params(&params);
+
+    params = create_literal_params("ERROR", true, false, true);
+    params.whole_word = true;
+    TEST_ASSERT(matcher_agrees(&params), "Whole-word matcher skips ERRORS");
+    cleanup_params(&params);
+
+    params = create_literal_params("Error", false, false, true);
+    params.max_count = 2;
+    TEST_ASSERT(matcher_agrees(&params), "Matcher caps results at max_count");
+    cleanup_params(&params);
+
+    // A pattern long enough for the table-driven scanners
+    params = create_literal_params("disk full on /dev/sda1", true, false, true);
+    TEST_ASSERT(matcher_agrees(&params), "Long literal matcher finds the same positions");
+    cleanup_params(&params);
+
+    // The caller's pattern may go away once the matcher is built
+    char *pattern = strdup("INFO");
+    const char *patterns[] = {pattern};
+    size_t pattern_lens[] = {4};
+    search_params_t owned = {0};
+    owned.patterns = patterns;
+    owned.pattern_lens = pattern_lens;
+    owned.num_patterns = 1;
+    owned.case_sensitive = true;
+    owned.track_positions = true;
+    owned.max_count = SIZE_MAX;
+    krep_matcher_t *matcher = krep_compile(&owned);
+    free(pattern);
+    match_result_t *result = match_result_init(4);
+    const char *line = matcher_lines[6];
+    uint64_t found = matcher ? krep_match(matcher, line, strlen(line), result) : 0;
+    TEST_ASSERT(found == 1 && result && result->positions[0].start_offset == 11,
+                "Matcher keeps its own copy of the pattern");
+    TEST_ASSERT(matcher && krep_match(matcher, line, strlen(line), NULL) == 1,
+                "A NULL result only counts");
+    match_result_free(result);
+    krep_matcher_free(matcher);
+}
+
+void test_matcher_multi_and_regex(void)
+{
+    printf("\n=== Compiled Matcher Multi-pattern and Regex Tests ===\n");
+
+    const char *patterns[] = {"ERROR", "INFO", "warn"};
+    size_t pattern_lens[] = {5, 4, 4};
+    search_params_t multi = {0};
+    multi.patterns = patterns;
+    multi.pattern_lens = pattern_lens;
+    multi.num_patterns = 3;
+    multi.case_sensitive = true;
+    multi.track_positions = true;
+    multi.max_count = SIZE_MAX;
+    ac_trie_t *trie = ac_trie_build(&multi);
+    multi.ac_trie = trie;
+    TEST_ASSERT(trie && matcher_agrees(&multi), "Multi-pattern matcher finds the same positions");
+    if (trie)
+        ac_trie_free(trie);
+
+    search_params_t params = create_regex_params("[0-9]+ errors?", true, false, true);
+    TEST_ASSERT(matcher_agrees(&params), "Regex matcher finds the same positions");
+    cleanup_params(&params);
+
+    params = create_regex_params("^2024-01-0[12]", true, true, false);
+    TEST_ASSERT(matcher_agrees(&params), "Anchored regex matcher gives the same counts");
+    cleanup_params(&params);
+
+    const char *bad_patterns[] = {"("};
+    size_t bad_lens[] = {1};
+    search_params_t bad = {0};
+    bad.patterns = bad_patterns;
+    bad.pattern_lens = bad_lens;
+    bad.num_patterns = 1;
+    bad.use_regex = true;
+    bad.max_count = SIZE_MAX;
+    TEST_ASSERT(krep_compile(&bad) == NULL, "An invalid regex is rejected");
+
+    search_params_t none = {0};
+    TEST_ASSERT(krep_compile(&none) == NULL, "Params without patterns are rejected");
+}
+
+/* Each thread matches every line many times and checks the totals */
+typedef struct
+{
+    const krep_matcher_t *matcher;
+    uint64_t expected;
+    bool ok;
+} matcher_thread_arg_t;
+
+static void *matcher_thread(void *arg)
+{
+    matcher_thread_arg_t *t = arg;
+    t->ok = true;
+    match_result_t *result = match_result_init(16);
+    for (int round = 0; round < 2000 && t->ok; round++)
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < NUM_MATCHER_LINES; i++)
+        {
+            result->count = 0;
+            total += krep_match(t->matcher, matcher_lines[i], strlen(matcher_lines[i]), result);
+        }
+        t->ok = total == t->expected;
+    }
+    match_result_free(result);
+    return NULL;
+}
+
+static bool matcher_is_thread_safe(const search_params_t *params)
+{
+    krep_matcher_t *matcher = krep_compile(params);
+    if (!matcher)
+        return false;
+    uint64_t expected = 0;
+    for (size_t i = 0; i < NUM_MATCHER_LINES; i++)
+        expected += krep_match(matcher, matcher_lines[i], strlen(matcher_lines[i]), NULL);
+
+    pthread_t threads[4];
+    matcher_thread_arg_t args[4];
+    bool ok = expected > 0;
+    for (int i = 0; i < 4; i++)
+    {
+        args[i] = (matcher_thread_arg_t){matcher, expected, false};
+        pthread_create(&threads[i], NULL, matcher_thread, &args[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(threads[i], NULL);
+        ok = ok && args[i].ok;
+    }
+    krep_matcher_free(matcher);
+    return ok;
+}
+
+void test_matcher_threads(void)
+{
+    printf("\n=== Compiled Matcher Concurrency Tests ===\n");
+
+    search_params_t params = create_literal_params("error", false, false, true);
+    TEST_ASSERT(matcher_is_thread_safe(&params), "One literal matcher is shared by four threads");
+    cleanup_params(&params);
+
+    params = create_regex_params("[0-9]+ errors?|ERROR", true, false, true);
+    TEST_ASSERT(matcher_is_thread_safe(&params), "One regex matcher is shared by four threads");
+    cleanup_params(&params);
+}
+
+/* Generated log lines for the batch tests; enough bytes for several pool groups */
+#define BATCH_TEST_LINES 20000
+
+static char *batch_buf = NULL;
+static size_t batch_offsets[BATCH_TEST_LINES + 1];
+static krep_span_t batch_spans[BATCH_TEST_LINES];
+
+static bool make_batch_input(void)
+{
+    size_t cap = (size_t)BATCH_TEST_LINES * 64;
+    batch_buf = malloc(cap);
+    if (!batch_buf)
+        return false;
+    size_t len = 0;
+    for (int i = 0; i < BATCH_TEST_LINES; i++)
+    {
+        batch_offsets[i] = len;
+        const char *line = matcher_lines[i % NUM_MATCHER_LINES];
+        len += snprintf(batch_buf + len, cap - len, "%d %s\n", i, line);
+    }
+    batch_offsets[BATCH_TEST_LINES] = len;
+    for (int i = 0; i < BATCH_TEST_LINES; i++)
+        batch_spans[i] = (krep_span_t){batch_buf + batch_offsets[i], batch_offsets[i + 1] - batch_offsets[i]};
+    return true;
+}
+
+/**
+ * True when both batch entry points, with and without positions, agree with
+ * krep_match run line by line
+ */
+static bool batch_agrees(const search_params_t *params, int threads)
+{
+    krep_matcher_t *matcher = krep_compile(params);
+    uint64_t *expected = calloc(BATCH_TEST_LINES, sizeof(uint64_t));
+    uint64_t *counts = calloc(BATCH_TEST_LINES, sizeof(uint64_t));
+    size_t *first = calloc(BATCH_TEST_LINES + 1, sizeof(size_t));
+    match_result_t *line_result = match_result_init(16);
+    match_result_t *all = match_result_init(16);
+    match_result_t *spans_all = match_result_init(16);
+    bool ok = matcher && expected && counts && first && line_result && all && spans_all;
+
+    // Expected: every line on its own, positions concatenated
+    for (size_t i = 0; ok && i < BATCH_TEST_LINES; i++)
+        expected[i] = krep_match(matcher, batch_spans[i].ptr, batch_spans[i].len, line_result);
+
+    ok = ok && krep_match_offsets(matcher, batch_buf, batch_offsets, BATCH_TEST_LINES, counts, first, all, threads);
+    for (size_t i = 0; ok && i < BATCH_TEST_LINES; i++)
+        ok = counts[i] == expected[i];
+    ok = ok && all->count == line_result->count && first[BATCH_TEST_LINES] == all->count;
+
+    // Positions are span-relative, so they match the line-by-line positions exactly
+    for (uint64_t k = 0; ok && k < all->count; k++)
+        ok = all->positions[k].start_offset == line_result->positions[k].start_offset &&
+             all->positions[k].end_offset == line_result->positions[k].end_offset;
+
+    ok = ok && krep_match_spans(matcher, batch_spans, BATCH_TEST_LINES, counts, first, spans_all, threads);
+    for (size_t i = 0; ok && i < BATCH_TEST_LINES; i++)
+        ok = counts[i] == expected[i] && first[i + 1] - first[i] == (params->track_positions ? expected[i] : 0);
+    ok = ok && spans_all->count == all->count;
+
+    // Counting only
+    ok = ok && krep_match_offsets(matcher, batch_buf, batch_offsets, BATCH_TEST_LINES, counts, NULL, NULL, threads);
+    for (size_t i = 0; ok && i < BATCH_TEST_LINES; i++)
+        ok = counts[i] == expected[i];
+
+    krep_matcher_free(matcher);
+    free(expected);
+    free(counts);
+    free(first);
+    match_result_free(line_result);
+    match_result_free(all);
+    match_result_free(spans_all);
+    return ok;
+}
+
+/* Each thread runs its own batches on the shared pool */
+static void *batch_thread(void *arg)
+{
+    bool *ok = arg;
+    search_params_t params = create_literal_params("ERROR", true, false, true);
+    *ok = true;
+    for (int round = 0; round < 20 && *ok; round++)
+        *ok = batch_agrees(&params, 4);
+    cleanup_params(&params);
+    return NULL;
+}
+
+void test_matcher_batch(void)
+{
+    printf("\n=== Compiled Matcher Batch Tests ===\n");
+
+    if (!make_batch_input())
+    {
+        printf("✗ FAIL: Could not create batch input\n");
+        tests_failed++;
+        return;
+    }
+
+    for (int threads = 1; threads <= 4; threads += 3)
+    {
+        char message[128];
+
+        search_params_t params = create_literal_params("ERROR", true, false, true);
+        snprintf(message, sizeof(message), "Batch literal search matches line by line (%d threads)", threads);
+        TEST_ASSERT(batch_agrees(&params, threads), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("error", false, true, false);
+        snprintf(message, sizeof(message), "Batch -i -c counts match line by line (%d threads)", threads);
+        TEST_ASSERT(batch_agrees(&params, threads), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("ERROR", true, false, true);
+        params.whole_word = true;
+        snprintf(message, sizeof(message), "Batch -w search matches line by line (%d threads)", threads);
+        TEST_ASSERT(batch_agrees(&params, threads), message);
+        cleanup_params(&params);
+
+        params = create_regex_params("[0-9]+ errors?", true, false, true);
+        snprintf(message, sizeof(message), "Batch regex search matches line by line (%d threads)", threads);
+        TEST_ASSERT(batch_agrees(&params, threads), message);
+        cleanup_params(&params);
+
+        params = create_literal_params("Error", false, false, true);
+        params.max_count = 1;
+        snprintf(message, sizeof(message), "Batch max_count applies per span (%d threads)", threads);
+        TEST_ASSERT(batch_agrees(&params, threads), message);
+        cleanup_params(&params);
+    }
+
+    const char *patterns[] = {"ERROR", "INFO", "warn"};
+    size_t pattern_lens[] = {5, 4, 4};
+    search_params_t multi = {0};
+    multi.patterns = patterns;
+    multi.pattern_lens = pattern_lens;
+    multi.num_patterns = 3;
+    multi.case_sensitive = true;
+    multi.track_positions = true;
+    multi.max_count = SIZE_MAX;
+    TEST_ASSERT(batch_agrees(&multi, 4), "Batch multi-pattern search matches line by line");
+
+    // Concurrent callers each wait for their own groups only
+    pthread_t batch_threads[4];
+    bool batch_ok[4];
+    for (int i = 0; i < 4; i++)
+        pthread_create(&batch_threads[i], NULL, batch_thread, &batch_ok[i]);
+    bool all_ok = true;
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(batch_threads[i], NULL);
+        all_ok = all_ok && batch_ok[i];
+    }
+    TEST_ASSERT(all_ok, "Batches from four threads at once match line by line");
+
+    // Spans cut mid-line are searched one by one: a match must not run across them
+    search_params_t params = create_literal_params("ERROR", true, false, true);
+    krep_matcher_t *matcher = krep_compile(&params);
+    const char text[] = "xxERR|OR ERROR\n";
+    size_t offsets[] = {0, 5, sizeof(text) - 1};
+    uint64_t counts[2] = {0, 0};
+    size_t first[3];
+    match_result_t *result = match_result_init(4);
+    bool ok = matcher && krep_match_offsets(matcher, text, offsets, 2, counts, first, result, 1);
+    TEST_ASSERT(ok && counts[0] == 0 && counts[1] == 1 && first[1] == 0 && first[2] == 1 &&
+                    result->positions[0].start_offset == 4,
+                "Spans that do not end at a newline are searched separately");
+    TEST_ASSERT(matcher && krep_match_spans(matcher, NULL, 0, counts, NULL, NULL, 1),
+                "An empty batch succeeds");
+    match_result_free(result);
+    krep_matcher_free(matcher);
+    cleanup_params(&params);
+
+    free(batch_buf);
+    batch_buf = NULL;
+}
+
+void run_matcher_tests(void)
+{
+    printf("\n--- Running Compiled Matcher Tests ---\n");
+
+    test_matcher_literal();
+    test_matcher_multi_and_regex();
+    test_matcher_threads();
+    test_matcher_batch();
+
+    printf("\n--- Completed Compiled Matcher Tests ---\n");
+}
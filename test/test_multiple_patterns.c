@@ -50,6 +50,8 @@ void test_aho_corasick_edge_cases(void);
 void test_position_tracking_multipattern(void);
 void test_multipattern_performance(void);
 void test_multiple_patterns_performance(void);
+void test_aho_corasick_large_pattern_set(void);
+void test_aho_corasick_prefilter(void);
 
 /**
  * Test basic Aho-Corasick functionality
@@ -593,6 +595,163 @@ void test_multiple_patterns_performance(void)
 /**
  * Run all multiple pattern tests
  */
+/**
+ * Test a large keyword list: a compact automaton (sparse deep states) must stay small
+ * and report exactly the same overlapping matches as a naive scan.
+ */
+void test_aho_corasick_large_pattern_set(void)
+{
+    printf("\n=== Aho-Corasick Large Pattern Set Test ===\n");
+
+    const size_t num_patterns = 5000;
+    char (*storage)[12] = malloc(num_patterns * sizeof(*storage));
+    const char **patterns = malloc(num_patterns * sizeof(char *));
+    size_t *pattern_lens = malloc(num_patterns * sizeof(size_t));
+    size_t text_len = 64 * 1024;
+    char *text = malloc(text_len + 1);
+    if (!storage || !patterns || !pattern_lens || !text)
+    {
+        printf("✗ FAIL: Memory allocation failed for large pattern set test\n");
+        tests_failed++;
+        free(storage);
+        free(patterns);
+        free(pattern_lens);
+        free(text);
+        return;
+    }
+
+    // Small alphabet so patterns share prefixes and suffixes (deep failure chains)
+    uint32_t seed = 12345;
+    for (size_t p = 0; p < num_patterns; p++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t len = 3 + (seed >> 16) % 8;
+        for (size_t i = 0; i < len; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            storage[p][i] = (char)('a' + (seed >> 16) % 6);
+        }
+        storage[p][len] = '\0';
+        patterns[p] = storage[p];
+        pattern_lens[p] = len;
+    }
+    for (size_t i = 0; i < text_len; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        text[i] = (char)('a' + (seed >> 16) % 7); // 'g' never occurs in a pattern
+    }
+    text[text_len] = '\0';
+
+    // Duplicate patterns are reported once per copy, as with the naive count below
+    uint64_t expected = 0;
+    for (size_t p = 0; p < num_patterns; p++)
+    {
+        for (const char *hit = strstr(text, patterns[p]); hit; hit = strstr(hit + 1, patterns[p]))
+            expected++;
+    }
+
+    search_params_t params = {
+        .patterns = patterns,
+        .pattern_lens = pattern_lens,
+        .num_patterns = num_patterns,
+        .case_sensitive = true,
+        .use_regex = false,
+        .track_positions = false,
+        .count_lines_mode = false,
+        .count_matches_mode = true,
+        .compiled_regex = NULL,
+        .max_count = SIZE_MAX,
+        .ac_trie = NULL};
+
+    params.ac_trie = ac_trie_build(&params);
+    TEST_ASSERT(params.ac_trie != NULL, "Aho-Corasick builds with 5000 patterns");
+    if (params.ac_trie)
+    {
+        size_t bytes = ac_trie_memory_usage(params.ac_trie);
+        printf("Automaton size for %zu patterns: %zu KB\n", num_patterns, bytes / 1024);
+        TEST_ASSERT(bytes < 8 * 1024 * 1024, "Aho-Corasick automaton for 5000 patterns stays under 8 MB");
+
+        uint64_t matches = aho_corasick_search(&params, text, text_len, NULL);
+        TEST_ASSERT(matches == expected, "Aho-Corasick match count equals naive scan for 5000 patterns");
+        ac_trie_free(params.ac_trie);
+    }
+
+    free(storage);
+    free(patterns);
+    free(pattern_lens);
+    free(text);
+}
+
+/**
+ * Test the start-byte prefilter: matches separated by long non-matching runs, at SIMD
+ * block boundaries and in the scalar tail, for small and large start-byte sets.
+ */
+void test_aho_corasick_prefilter(void)
+{
+    printf("\n=== Aho-Corasick Prefilter Tests ===\n");
+
+    size_t text_len = 10000;
+    char *text = malloc(text_len + 1);
+    if (!text)
+    {
+        printf("✗ FAIL: Memory allocation failed for prefilter test\n");
+        tests_failed++;
+        return;
+    }
+    memset(text, '.', text_len);
+    text[text_len] = '\0';
+    const size_t offsets[] = {0, 27, 32, 59, 4096, 9990, 9995};
+    const size_t num_offsets = sizeof(offsets) / sizeof(offsets[0]);
+    for (size_t i = 0; i < num_offsets; i++)
+        memcpy(text + offsets[i], (i % 2) ? "fatal" : "ERROR", 5);
+
+    // Two start bytes, case-sensitive (packed compares), and eleven start bytes,
+    // case-insensitive (nibble masks)
+    const char *small_set[] = {"ERROR", "fatal"};
+    size_t small_lens[] = {5, 5};
+    const char *large_set[] = {"ERROR", "FATAL", "#x", "~y", "{z", "@w", "0q", "|p", "\x7fv"};
+    size_t large_lens[] = {5, 5, 2, 2, 2, 2, 2, 2, 2};
+
+    for (int variant = 0; variant < 2; variant++)
+    {
+        search_params_t params = {
+            .patterns = variant ? large_set : small_set,
+            .pattern_lens = variant ? large_lens : small_lens,
+            .num_patterns = variant ? 9 : 2,
+            .case_sensitive = variant == 0,
+            .use_regex = false,
+            .track_positions = true,
+            .count_lines_mode = false,
+            .count_matches_mode = false,
+            .compiled_regex = NULL,
+            .max_count = SIZE_MAX,
+            .ac_trie = NULL};
+        params.ac_trie = ac_trie_build(&params);
+        match_result_t *result = match_result_init(16);
+        if (!params.ac_trie || !result)
+        {
+            printf("✗ FAIL: Setup failed for prefilter test\n");
+            tests_failed++;
+            ac_trie_free(params.ac_trie);
+            match_result_free(result);
+            continue;
+        }
+
+        uint64_t matches = aho_corasick_search(&params, text, text_len, result);
+        bool positions_ok = (matches == num_offsets && result->count == num_offsets);
+        for (size_t i = 0; positions_ok && i < num_offsets; i++)
+            positions_ok = (result->positions[i].start_offset == offsets[i] &&
+                            result->positions[i].end_offset == offsets[i] + 5);
+        TEST_ASSERT(positions_ok, variant ? "Prefilter with eleven start bytes finds every match"
+                                          : "Prefilter with two start bytes finds every match");
+
+        ac_trie_free(params.ac_trie);
+        match_result_free(result);
+    }
+
+    free(text);
+}
+
 void run_multiple_patterns_tests(void)
 {
     printf("\n--- Running Multiple Pattern Tests ---\n");
@@ -603,6 +762,8 @@ void run_multiple_patterns_tests(void)
     test_position_tracking_multipattern();
     test_multipattern_performance();
     test_multiple_patterns_performance();
+    test_aho_corasick_large_pattern_set();
+    test_aho_corasick_prefilter();
 
     printf("\n--- Completed Multiple Pattern Tests ---\n");
 }
@@ -0,0 +1,206 @@
+/**
+ * Test suite for calibrated algorithm selection (--calibrate / --profile)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../algo_profile.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define PROFILE_TEST_DIR "/tmp/krep_test_profile"
+#define PROFILE_TEST_PATH PROFILE_TEST_DIR "/cache/algorithms"
+
+static char *make_sample(size_t *len)
+{
+    size_t cap = 256 * 1024;
+    char *sample = malloc(cap);
+    size_t n = 0;
+    for (int i = 0; sample && n + 64 < cap; i++)
+        n += snprintf(sample + n, cap - n, i % 97 ? "%d plain filler text line\n" : "%d has a Needle in it\n", i);
+    *len = n;
+    return sample;
+}
+
+// Count of func over text with params (positions discarded)
+static uint64_t run_count(const search_params_t *params, search_func_t func, const char *text, size_t len)
+{
+    match_result_t *result = params->track_positions ? match_result_init(64) : NULL;
+    uint64_t count = func(params, text, len, result);
+    match_result_free(result);
+    return count;
+}
+
+void test_profile_classes(void)
+{
+    printf("\n=== Algorithm Profile Class Tests ===\n");
+    char cls[ALGO_PROFILE_CLASS_MAX];
+
+    search_params_t params = create_literal_params("x", true, false, false);
+    TEST_ASSERT(algo_profile_class(&params, cls, sizeof(cls)) && strcmp(cls, "literal:1:case:matches") == 0,
+                "One-byte patterns have their own class");
+    cleanup_params(&params);
+
+    params = create_literal_params("tenletters", false, true, false);
+    TEST_ASSERT(algo_profile_class(&params, cls, sizeof(cls)) && strcmp(cls, "literal:8-15:icase:lines") == 0,
+                "Classes record length bucket, -i and -c");
+    cleanup_params(&params);
+
+    params = create_regex_params("a+b", true, false, false);
+    TEST_ASSERT(!algo_profile_class(&params, cls, sizeof(cls)), "Regex searches are not profiled");
+    cleanup_params(&params);
+
+    TEST_ASSERT(strlen(algo_profile_cpu_model()) > 0 && !strchr(algo_profile_cpu_model(), '\t'),
+                "A CPU model is detected");
+}
+
+void test_profile_calibration(void)
+{
+    printf("\n=== Algorithm Profile Calibration Tests ===\n");
+    algo_profile_reset();
+
+    size_t len = 0;
+    char *sample = make_sample(&len);
+    if (!sample)
+    {
+        printf("✗ FAIL: Could not create calibration sample\n");
+        tests_failed++;
+        return;
+    }
+
+    search_params_t params = create_literal_params("Needle", true, false, false);
+    search_func_t heuristic = select_search_algorithm(&params);
+    TEST_ASSERT(algo_profile_lookup(&params) == NULL, "Without a profile the built-in choice is used");
+
+    double gbps = 0, heuristic_gbps = 0;
+    search_func_t best = algo_profile_calibrate(&params, heuristic, sample, len, &gbps, &heuristic_gbps);
+    TEST_ASSERT(best != NULL && gbps >= heuristic_gbps && heuristic_gbps > 0,
+                "Calibration picks a kernel at least as fast as the built-in choice");
+    TEST_ASSERT(best && select_search_algorithm(&params) == best, "The calibrated kernel is selected afterwards");
+    TEST_ASSERT(best && run_count(&params, best, sample, len) == run_count(&params, heuristic, sample, len),
+                "The calibrated kernel finds the same matches");
+
+    // Same class, different pattern
+    search_params_t other = create_literal_params("filler", true, false, false);
+    TEST_ASSERT(best && select_search_algorithm(&other) == best, "The choice applies to the whole class");
+    cleanup_params(&other);
+
+    // Round trip through the profile file
+    unlink(PROFILE_TEST_PATH);
+    TEST_ASSERT(algo_profile_save(PROFILE_TEST_PATH), "The profile is written, creating its directory");
+    algo_profile_reset();
+    TEST_ASSERT(algo_profile_lookup(&params) == NULL, "Resetting forgets the profile");
+    TEST_ASSERT(algo_profile_load(PROFILE_TEST_PATH) && algo_profile_lookup(&params) == best,
+                "A saved profile is read back");
+
+    search_params_t count = create_literal_params("Needle", true, true, false);
+    TEST_ASSERT(algo_profile_lookup(&count) == NULL, "Other classes keep the built-in choice");
+    cleanup_params(&count);
+
+    cleanup_params(&params);
+    free(sample);
+}
+
+void test_profile_file(void)
+{
+    printf("\n=== Algorithm Profile File Tests ===\n");
+    algo_profile_reset();
+
+    TEST_ASSERT(algo_profile_load(PROFILE_TEST_DIR "/missing"), "A missing profile is not an error");
+
+    // An entry for another CPU, one naming a kernel that cannot take 10-byte patterns,
+    // an unknown kernel and a malformed line
+    FILE *f = fopen(PROFILE_TEST_PATH, "w");
+    if (f)
+    {
+        fprintf(f, "# comment\n");
+        fprintf(f, "Some Other CPU\tliteral:4-7:case:matches\tKnuth-Morris-Pratt\t1.0\n");
+        fprintf(f, "%s\tliteral:8-15:case:matches\tmemchr\t9.0\n", algo_profile_cpu_model());
+        fprintf(f, "%s\tliteral:16-31:case:matches\tno such kernel\t9.0\n", algo_profile_cpu_model());
+        fprintf(f, "%s\tliteral:1:case:matches\tmemchr\t9.0\n", algo_profile_cpu_model());
+        fprintf(f, "garbage without tabs\n");
+        fclose(f);
+    }
+    TEST_ASSERT(f && algo_profile_load(PROFILE_TEST_PATH), "A hand-written profile is read");
+
+    search_params_t params = create_literal_params("abcd", true, false, false);
+    TEST_ASSERT(algo_profile_lookup(&params) == NULL, "Entries for other CPU models are ignored");
+    cleanup_params(&params);
+
+    params = create_literal_params("tenletters", true, false, false);
+    TEST_ASSERT(algo_profile_lookup(&params) == NULL, "A kernel that cannot handle the pattern is not used");
+    cleanup_params(&params);
+
+    params = create_literal_params("sixteen bytes ok!", true, false, false);
+    TEST_ASSERT(algo_profile_lookup(&params) == NULL, "Unknown kernel names are ignored");
+    cleanup_params(&params);
+
+    params = create_literal_params("x", true, false, false);
+    TEST_ASSERT(algo_profile_lookup(&params) == memchr_search, "A usable entry is selected");
+    cleanup_params(&params);
+
+    // Saving keeps the other CPU's entry
+    TEST_ASSERT(algo_profile_save(PROFILE_TEST_PATH), "The profile is rewritten");
+    f = fopen(PROFILE_TEST_PATH, "r");
+    char text[2048] = "";
+    size_t n = f ? fread(text, 1, sizeof(text) - 1, f) : 0;
+    text[n] = '\0';
+    if (f)
+        fclose(f);
+    TEST_ASSERT(strstr(text, "Some Other CPU\tliteral:4-7:case:matches\tKnuth-Morris-Pratt") != NULL,
+                "Entries for other CPU models are preserved");
+
+    setenv("KREP_PROFILE", "/tmp/krep_env_profile", 1);
+    char path[256];
+    TEST_ASSERT(algo_profile_default_path(path, sizeof(path)) && strcmp(path, "/tmp/krep_env_profile") == 0,
+                "KREP_PROFILE overrides the default profile path");
+    unsetenv("KREP_PROFILE");
+
+    algo_profile_reset();
+}
+
+void run_profile_tests(void)
+{
+    printf("\n--- Running Algorithm Profile Tests ---\n");
+
+    test_profile_classes();
+    test_profile_calibration();
+    test_profile_file();
+
+    unlink(PROFILE_TEST_PATH);
+    rmdir(PROFILE_TEST_DIR "/cache");
+    rmdir(PROFILE_TEST_DIR);
+
+    printf("\n--- Completed Algorithm Profile Tests ---\n");
+}
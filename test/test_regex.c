@@ -19,6 +19,7 @@
 
 /* Include main krep functions for testing */
 #include "../krep.h"     // Main krep header
+#include "../regex_dfa.h" // Lazy DFA engine
 #include "test_krep.h"   // Test header
 #include "test_compat.h" // Compatibility wrappers
 
@@ -448,6 +449,135 @@ void test_regex_line_extraction(void)
     regfree(&regex_obj);
 }
 
+/**
+ * Run one pattern through the lazy DFA and through regexec and compare the results.
+ * Count-lines mode compares line counts, otherwise every match position must agree.
+ */
+static bool dfa_agrees_with_posix(const char *pattern, bool case_sensitive, bool count_lines, const char *text)
+{
+    size_t text_len = strlen(text);
+    search_params_t params = create_regex_params(pattern, case_sensitive, count_lines, false);
+    if (!params.regex_dfa)
+    {
+        printf("  DFA did not compile '%s'\n", pattern);
+        cleanup_params(&params);
+        return false;
+    }
+
+    match_result_t *dfa_result = match_result_init(16);
+    match_result_t *posix_result = match_result_init(16);
+    uint64_t dfa_count = regex_search(&params, text, text_len, dfa_result);
+
+    regex_dfa_t *dfa = params.regex_dfa;
+    params.regex_dfa = NULL; // Plain regexec path
+    uint64_t posix_count = regex_search(&params, text, text_len, posix_result);
+    params.regex_dfa = dfa;
+
+    bool same = dfa_count == posix_count;
+    if (same && !count_lines)
+    {
+        same = dfa_result->count == posix_result->count;
+        for (uint64_t i = 0; same && i < dfa_result->count; i++)
+        {
+            same = dfa_result->positions[i].start_offset == posix_result->positions[i].start_offset &&
+                   dfa_result->positions[i].end_offset == posix_result->positions[i].end_offset;
+        }
+    }
+    if (!same)
+        printf("  '%s' (%s): DFA %" PRIu64 " vs regexec %" PRIu64 "\n", pattern,
+               case_sensitive ? "cs" : "ci", dfa_count, posix_count);
+
+    match_result_free(dfa_result);
+    match_result_free(posix_result);
+    cleanup_params(&params);
+    return same;
+}
+
+/**
+ * Test the lazy DFA engine against POSIX regexec
+ */
+void test_regex_dfa(void)
+{
+    printf("\n=== Lazy DFA Regex Tests ===\n");
+
+    const char *text = "ERROR 2024-01-15 disk full at /var/log (code 507)\n"
+                       "warn: retry 3 of 5, took 120ms\n"
+                       "\n"
+                       "INFO user=alice id=42 ok\n"
+                       "info user=Bob id=7 ok\n"
+                       "aaa bbb aaaa ab ba abab\n"
+                       "Error: timeout after 3000ms";
+
+    static const char *patterns[] = {
+        "ERROR|warn",
+        "[0-9]{4}-[0-9]{2}-[0-9]{2}",
+        "[0-9]+ms",
+        "user=[[:alpha:]]+",
+        "^info",
+        "ok$",
+        "^$",
+        "a+b?",
+        "(ab)+",
+        "a{2,3}",
+        "b*",
+        "id=[^ ]+",
+        "[^a-z]+",
+        "(code|took) [0-9]+",
+        "e.r",
+        "x?",
+        "t.*ms",
+        "[[:upper:]][[:lower:]]+",
+        "ok|^info",
+        "Error|ERROR",
+    };
+    size_t num_patterns = sizeof(patterns) / sizeof(patterns[0]);
+
+    bool all_cs = true, all_ci = true, all_lines = true;
+    for (size_t i = 0; i < num_patterns; i++)
+    {
+        all_cs &= dfa_agrees_with_posix(patterns[i], true, false, text);
+        all_ci &= dfa_agrees_with_posix(patterns[i], false, false, text);
+        all_lines &= dfa_agrees_with_posix(patterns[i], true, true, text);
+    }
+    TEST_ASSERT(all_cs, "DFA matches regexec positions for case-sensitive patterns");
+    TEST_ASSERT(all_ci, "DFA matches regexec positions for case-insensitive patterns");
+    TEST_ASSERT(all_lines, "DFA matches regexec line counts");
+
+    // -o steps over literal matches; the required-literal prefilter still finds a candidate
+    // that starts right after a failed one (short literals, "e error")
+    krep_set_only_matching(true);
+    const char *prefilter_text = "e error\nffoo bar\nf foo\nxbbar\n";
+    bool prefilter_ok = dfa_agrees_with_posix("err(or|and)", false, false, prefilter_text) &&
+                        dfa_agrees_with_posix("^foo", true, false, "ffoo\nfoo x\n") &&
+                        dfa_agrees_with_posix("bar$", true, false, prefilter_text) &&
+                        dfa_agrees_with_posix("(^| )foo( |$)", true, false, prefilter_text);
+    search_params_t o_params = create_regex_params("err(or|and)", false, false, false);
+    match_result_t *o_result = match_result_init(4);
+    bool found = o_params.regex_dfa && regex_search(&o_params, "e error", 7, o_result) == 1 &&
+                 o_result->positions[0].start_offset == 2 && o_result->positions[0].end_offset == 7;
+    match_result_free(o_result);
+    cleanup_params(&o_params);
+    krep_set_only_matching(false);
+    TEST_ASSERT(prefilter_ok && found, "-E -o -i finds matches right after a failed literal candidate");
+
+    size_t lit_len = 0;
+    regex_dfa_t *dfa = regex_dfa_compile("(code|took) [0-9]+ms", true);
+    const char *lit = dfa ? regex_dfa_required_literal(dfa, &lit_len) : NULL;
+    TEST_ASSERT(lit && lit_len == 2 && memcmp(lit, "ms", 2) == 0, "DFA extracts the required literal");
+    regex_dfa_free(dfa);
+
+    dfa = regex_dfa_compile("Disk FULL", false);
+    lit = dfa ? regex_dfa_required_literal(dfa, &lit_len) : NULL;
+    TEST_ASSERT(lit && lit_len == 9 && memcmp(lit, "disk full", 9) == 0,
+                "DFA required literal is lower-cased when case-insensitive");
+    regex_dfa_free(dfa);
+
+    // Constructs outside the DFA subset fall back to regexec
+    TEST_ASSERT(regex_dfa_compile("\\bword\\b", true) == NULL, "DFA declines \\b word boundaries");
+    TEST_ASSERT(regex_dfa_compile("(a)\\1", true) == NULL, "DFA declines backreferences");
+    TEST_ASSERT(regex_dfa_compile("\\w+", true) == NULL, "DFA declines GNU \\w");
+}
+
 /**
  * Run all regex tests
  */
@@ -463,6 +593,7 @@ void run_regex_tests(void)
     test_regex_report_limit();
     test_regex_vs_literal_performance();
     test_regex_line_extraction();
+    test_regex_dfa();
 
     printf("\n--- Completed Regex Tests ---\n");
 }
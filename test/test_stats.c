@@ -0,0 +1,189 @@
+/**
+ * Test suite for run statistics (--stats)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "../stats.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#ifndef KREP_NO_STATS
+
+#define STATS_TEST_FILE "/tmp/krep_test_stats.txt"
+#define STATS_TEST_LINES 2000
+
+// Lines with one real match in every 10, and near misses sharing its first and last bytes
+static char *make_text(size_t *len)
+{
+    size_t cap = STATS_TEST_LINES * 40;
+    char *text = malloc(cap);
+    size_t n = 0;
+    for (int i = 0; text && i < STATS_TEST_LINES; i++)
+        n += snprintf(text + n, cap - n, i % 10 ? "%d Exxxxxxxxxxxxxxxxxxxxxxxxxr\n" : "%d Error in this line\n", i);
+    *len = n;
+    return text;
+}
+
+#if KREP_USE_AVX2 || KREP_USE_NEON
+void test_stats_disabled(void)
+{
+    printf("\n=== Stats Disabled Tests ===\n");
+    size_t len = 0;
+    char *text = make_text(&len);
+
+    stats_reset();
+    search_params_t params = create_literal_params("Error", true, false, false);
+    match_result_t *result = match_result_init(64);
+    uint64_t count = simd_anchor_search(&params, text, len, result);
+    TEST_ASSERT(count == STATS_TEST_LINES / 10, "Search runs normally without --stats");
+    TEST_ASSERT(stats_counter_total(STATS_FILTER_CANDIDATES) == 0 && stats_counter_total(STATS_FILTER_VERIFIED) == 0,
+                "Hooks record nothing until stats_start");
+    match_result_free(result);
+    cleanup_params(&params);
+    free(text);
+}
+
+void test_stats_filter_counters(void)
+{
+    printf("\n=== Stats Filter Counter Tests ===\n");
+    size_t len = 0;
+    char *text = make_text(&len);
+
+    // "Error" anchors on rare bytes; the near misses share 'E' and 'r' with it
+    stats_reset();
+    stats_start();
+    search_params_t params = create_literal_params("Error", true, false, false);
+    match_result_t *result = match_result_init(64);
+    uint64_t count = simd_anchor_search(&params, text, len, result);
+    uint64_t candidates = stats_counter_total(STATS_FILTER_CANDIDATES);
+    uint64_t verified = stats_counter_total(STATS_FILTER_VERIFIED);
+    TEST_ASSERT(verified == count, "Every verified candidate is a reported match");
+    TEST_ASSERT(candidates >= verified && candidates > 0, "Candidates include every verified match");
+    match_result_free(result);
+    cleanup_params(&params);
+
+    stats_reset();
+    TEST_ASSERT(!stats_enabled && stats_counter_total(STATS_FILTER_CANDIDATES) == 0, "stats_reset clears and disables");
+    free(text);
+}
+#endif
+
+void test_stats_search_file(void)
+{
+    printf("\n=== Stats Search File Tests ===\n");
+    size_t len = 0;
+    char *text = make_text(&len);
+    FILE *f = fopen(STATS_TEST_FILE, "w");
+    bool written = f && fwrite(text, 1, len, f) == len;
+    if (f)
+        written = (fclose(f) == 0) && written;
+    TEST_ASSERT(written, "Stats test file written");
+
+    stats_reset();
+    stats_start();
+    search_params_t params = create_literal_params("Error", true, false, false);
+    int rc = capture_search_output(&params, STATS_TEST_FILE, 1, NULL);
+    TEST_ASSERT(rc == 0, "Search with stats enabled finds matches");
+    TEST_ASSERT(stats_counter_total(STATS_FILES) == 1, "One file counted");
+    TEST_ASSERT(stats_counter_total(STATS_BYTES_SCANNED) == len, "Bytes scanned equal the file size");
+    TEST_ASSERT(stats_counter_total(STATS_MATCHES) == STATS_TEST_LINES / 10, "Kernel matches counted");
+    TEST_ASSERT(stats_counter_total(STATS_ITEMS_PRINTED) == STATS_TEST_LINES / 10, "Printed lines counted");
+    TEST_ASSERT(stats_phase_total(STATS_PHASE_SEARCH) > 0 && stats_phase_total(STATS_PHASE_PRINT) > 0,
+                "Search and print phases timed");
+    cleanup_params(&params);
+
+    // -c prints no lines
+    params = create_literal_params("Error", true, true, false);
+    capture_search_output(&params, STATS_TEST_FILE, 1, NULL);
+    TEST_ASSERT(stats_counter_total(STATS_FILES) == 2 && stats_counter_total(STATS_BYTES_SCANNED) == 2 * len,
+                "Counters accumulate over searches");
+    TEST_ASSERT(stats_counter_total(STATS_ITEMS_PRINTED) == STATS_TEST_LINES / 10, "-c adds no printed lines");
+    cleanup_params(&params);
+
+    // JSON report carries the merged counters
+    char expected[64];
+    snprintf(expected, sizeof(expected), "\"bytes_scanned\": %zu", 2 * len);
+    FILE *report = tmpfile();
+    char buf[2048] = {0};
+    if (report)
+    {
+        stats_report(report, STATS_FORMAT_JSON);
+        rewind(report);
+        size_t n = fread(buf, 1, sizeof(buf) - 1, report);
+        buf[n] = '\0';
+        fclose(report);
+    }
+    TEST_ASSERT(buf[0] == '{' && strstr(buf, expected) && strstr(buf, "\"search_threads\": {\"count\": 1"),
+                "JSON report lists the merged counters and search threads");
+
+    report = tmpfile();
+    memset(buf, 0, sizeof(buf));
+    if (report)
+    {
+        stats_report(report, STATS_FORMAT_TEXT);
+        rewind(report);
+        size_t n = fread(buf, 1, sizeof(buf) - 1, report);
+        buf[n] = '\0';
+        fclose(report);
+    }
+    TEST_ASSERT(strstr(buf, "bytes scanned") && strstr(buf, "imbalance"), "Text report lists scanned bytes and balance");
+
+    stats_reset();
+    unlink(STATS_TEST_FILE);
+    free(text);
+}
+
+void run_stats_tests(void)
+{
+    printf("\n--- Running Stats Tests ---\n");
+
+#if KREP_USE_AVX2 || KREP_USE_NEON
+    test_stats_disabled();
+    test_stats_filter_counters();
+#endif
+    test_stats_search_file();
+
+    printf("\n--- Completed Stats Tests ---\n");
+}
+
+#else // KREP_NO_STATS
+
+void run_stats_tests(void)
+{
+    printf("\n--- Stats Tests skipped (built with KREP_NO_STATS) ---\n");
+}
+
+#endif // KREP_NO_STATS
@@ -0,0 +1,274 @@
+/**
+ * Test suite for streaming (block-wise) input search
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Define TESTING for test builds */
+#ifndef TESTING
+#define TESTING
+#endif
+
+#include "../krep.h"
+#include "test_krep.h"
+
+/* Test flags and counters */
+extern int tests_passed;
+extern int tests_failed;
+
+/**
+ * Basic test assertion with reporting
+ */
+#define TEST_ASSERT(condition, message)      \
+    do                                       \
+    {                                        \
+        if (condition)                       \
+        {                                    \
+            printf("✓ PASS: %s\n", message); \
+            tests_passed++;                  \
+        }                                    \
+        else                                 \
+        {                                    \
+            printf("✗ FAIL: %s\n", message); \
+            tests_failed++;                  \
+        }                                    \
+    } while (0)
+
+#define STREAM_INPUT_PATH "/tmp/krep_test_stream_input.txt"
+#define STREAM_OUTPUT_PATH "/tmp/krep_test_stream_output.txt"
+#define STREAM_FOLLOW_PATH "/tmp/krep_test_stream_follow.txt"
+
+/* Number of lines in the generated input; large enough to span several stream blocks */
+#define STREAM_TEST_LINES 200000
+
+/**
+ * Write the test input: every 1000th line holds "needle", the rest is filler.
+ * The final line has no trailing newline.
+ */
+static bool write_stream_input(void)
+{
+    FILE *f = fopen(STREAM_INPUT_PATH, "w");
+    if (!f)
+        return false;
+    for (int i = 1; i <= STREAM_TEST_LINES; i++)
+    {
+        if (i % 1000 == 0)
+            fprintf(f, "line %d has a needle in it", i);
+        else
+            fprintf(f, "line %d is just some filler text", i);
+        if (i < STREAM_TEST_LINES)
+            fputc('\n', f);
+    }
+    return fclose(f) == 0;
+}
+
+static size_t count_output_lines(const char *s)
+{
+    size_t n = 0;
+    for (; s && *s; s++)
+        if (*s == '\n')
+            n++;
+    return n;
+}
+
+void test_stream_counts(void)
+{
+    printf("\n=== Stream Count Tests ===\n");
+    char *out = NULL;
+
+    search_params_t params = create_literal_params("needle", true, true, false);
+    int rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 0 && out && strcmp(out, "200\n") == 0, "Stream -c counts matching lines across blocks");
+    free(out);
+    cleanup_params(&params);
+
+    params = create_literal_params("filler", true, true, false);
+    rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 0 && out && strcmp(out, "199800\n") == 0, "Stream -c counts lines split at block boundaries once");
+    free(out);
+    cleanup_params(&params);
+
+    params = create_literal_params("haystack", true, true, false);
+    rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 1 && out && strcmp(out, "0\n") == 0, "Stream reports no match with count 0");
+    free(out);
+    cleanup_params(&params);
+}
+
+void test_stream_output(void)
+{
+    printf("\n=== Stream Output Tests ===\n");
+    char *out = NULL;
+
+    search_params_t params = create_literal_params("needle", true, false, false);
+    int rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 0 && count_output_lines(out) == 200, "Stream prints every matching line");
+    TEST_ASSERT(out && strstr(out, "line 200000 has a needle in it\n") != NULL,
+                "Stream searches the final unterminated line");
+    free(out);
+    cleanup_params(&params);
+
+    params = create_regex_params("ne+dle in it$", true, false, false);
+    rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 0 && count_output_lines(out) == 200, "Stream regex search matches per line");
+    free(out);
+    cleanup_params(&params);
+
+    params = create_literal_params("needle", true, false, false);
+    params.max_count = 3;
+    rc = capture_search_output(&params, STREAM_INPUT_PATH, 0, &out);
+    TEST_ASSERT(rc == 0 && count_output_lines(out) == 3, "Stream stops after -m matching lines");
+    free(out);
+    cleanup_params(&params);
+}
+
+void test_follow_mode(void)
+{
+    printf("\n=== Follow Mode Tests ===\n");
+
+    // Once -m is satisfied follow mode returns instead of waiting for more data
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(STREAM_OUTPUT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    search_params_t params = create_literal_params("needle", true, false, false);
+    params.max_count = 150;
+    int rc = search_file_follow(&params, STREAM_INPUT_PATH);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    cleanup_params(&params);
+
+    size_t lines = 0;
+    FILE *f = fopen(STREAM_OUTPUT_PATH, "r");
+    if (f)
+    {
+        int c;
+        while ((c = fgetc(f)) != EOF)
+            if (c == '\n')
+                lines++;
+        fclose(f);
+    }
+    TEST_ASSERT(rc == 0 && lines == 150, "Follow mode searches existing content and stops at -m");
+
+    params = create_literal_params("needle", true, true, false);
+    rc = search_file_follow(&params, STREAM_INPUT_PATH);
+    TEST_ASSERT(rc == 2, "Follow mode rejects -c");
+    cleanup_params(&params);
+}
+
+static void follow_test_sleep(long ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+// Write count lines "<word> needle NNNN" into fd at offset (or appended when offset < 0)
+static void write_follow_lines(int fd, off_t offset, const char *word, int count)
+{
+    char buf[8192];
+    size_t len = 0;
+    for (int i = 0; i < count; i++)
+        len += snprintf(buf + len, sizeof(buf) - len, "%s needle %04d\n", word, i);
+    ssize_t written = offset < 0 ? write(fd, buf, len) : pwrite(fd, buf, len, offset);
+    (void)written;
+}
+
+// Rewrite the followed file in place with longer content, so its size never drops
+// below the read offset; later append more lines so a search that missed the rewrite
+// still reaches -m and returns
+static void *follow_rewrite_thread(void *arg)
+{
+    (void)arg;
+    follow_test_sleep(300);
+    int fd = open(STREAM_FOLLOW_PATH, O_WRONLY);
+    if (fd == -1)
+        return NULL;
+    write_follow_lines(fd, 0, "new", 300);
+    close(fd);
+
+    follow_test_sleep(1500);
+    fd = open(STREAM_FOLLOW_PATH, O_WRONLY | O_APPEND);
+    if (fd == -1)
+        return NULL;
+    write_follow_lines(fd, -1, "late", 300);
+    close(fd);
+    return NULL;
+}
+
+void test_follow_rewrite(void)
+{
+    printf("\n=== Follow Mode Rewrite Tests ===\n");
+    int fd = open(STREAM_FOLLOW_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        TEST_ASSERT(false, "Follow test file written");
+        return;
+    }
+    write_follow_lines(fd, 0, "old", 100);
+    close(fd);
+
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int capture_fd = open(STREAM_OUTPUT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    pthread_t writer;
+    pthread_create(&writer, NULL, follow_rewrite_thread, NULL);
+    search_params_t params = create_literal_params("needle", true, false, false);
+    params.max_count = 400; // 100 old lines, then the 300 rewritten ones
+    int rc = search_file_follow(&params, STREAM_FOLLOW_PATH);
+    pthread_join(writer, NULL);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    cleanup_params(&params);
+
+    char line[64];
+    bool new_head = false, late = false;
+    FILE *f = fopen(STREAM_OUTPUT_PATH, "r");
+    while (f && fgets(line, sizeof(line), f))
+    {
+        new_head = new_head || strstr(line, "new needle 0000\n");
+        late = late || strstr(line, "late needle");
+    }
+    if (f)
+        fclose(f);
+    TEST_ASSERT(rc == 0 && new_head && !late,
+                "Follow mode rescans a file rewritten in place that grew past the read offset");
+    unlink(STREAM_FOLLOW_PATH);
+}
+
+void run_stream_tests(void)
+{
+    printf("\n--- Running Stream Tests ---\n");
+
+    if (!write_stream_input())
+    {
+        printf("✗ FAIL: Could not create stream test input\n");
+        tests_failed++;
+        return;
+    }
+
+    test_stream_counts();
+    test_stream_output();
+    test_follow_mode();
+    test_follow_rewrite();
+
+    unlink(STREAM_INPUT_PATH);
+    unlink(STREAM_OUTPUT_PATH);
+
+    printf("\n--- Completed Stream Tests ---\n");
+}
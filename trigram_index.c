@@ -0,0 +1,770 @@
+/* trigram_index.c - Persistent trigram index for repeated searches of unchanging files
+ *
+ * Every indexed file is cut into TRIGRAM_INDEX_BLOCK_SIZE blocks. For each trigram (three
+ * consecutive bytes, ASCII case-folded, never containing a newline) the index stores the
+ * list of blocks in which the trigram starts. A literal can only start in block b if each
+ * of its trigrams starts in block b or b + 1, so intersecting a few posting lists leaves
+ * the handful of blocks worth reading.
+ *
+ * Layout of the index file (native byte order, all offsets from the start of the file):
+ *
+ *   ti_header_t
+ *   per file:  ti_trigram_entry_t[num_trigrams]   sorted by trigram
+ *              uint32_t newlines[num_blocks]      for line numbers without reading the file
+ *              posting lists                      varint(count << 1 | is_bitmap), then
+ *                                                 either a block bitmap or count varint
+ *                                                 block deltas (the first is absolute)
+ *   string table                                  NUL-terminated paths
+ *   ti_file_entry_t[num_files]                    sorted by path for binary search
+ *
+ * The file is written to a temporary name and renamed into place, so readers only ever
+ * map a complete index. Each file entry carries the size and mtime seen at build time;
+ * a file that no longer matches is simply searched in full.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trigram_index.h"
+
+#define TI_MAGIC "KREPTRI1"
+#define TI_VERSION 1
+#define TI_TRIGRAM_SPACE (1u << 24) // Trigrams are packed into 24 bits
+#define TI_MIN_SLOT_BITS 12
+
+#if defined(__APPLE__)
+#define TI_MTIME_NSEC(st) ((int64_t)(st)->st_mtimespec.tv_nsec)
+#else
+#define TI_MTIME_NSEC(st) ((int64_t)(st)->st_mtim.tv_nsec)
+#endif
+
+// --- On-disk structures ---
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t num_files;
+    uint64_t file_table_offset;
+    uint64_t string_table_offset;
+    uint64_t string_table_size;
+} ti_header_t;
+
+typedef struct
+{
+    uint64_t path_offset; // Into the string table
+    uint64_t size;        // Fingerprint: file size ...
+    int64_t mtime_sec;    // ... and modification time
+    int64_t mtime_nsec;
+    uint64_t data_offset; // Trigram table, newline counts and postings
+    uint64_t data_size;
+    uint32_t num_trigrams;
+    uint32_t num_blocks;
+    uint32_t path_len;
+    uint32_t reserved;
+} ti_file_entry_t;
+
+typedef struct
+{
+    uint32_t trigram;
+    uint32_t postings_offset; // From the start of this file's posting lists
+} ti_trigram_entry_t;
+
+// --- Writer ---
+
+typedef struct
+{
+    uint32_t trigram;
+    uint32_t count;         // Blocks in the list
+    uint32_t last_block;    // Last block appended, for delta coding
+    uint32_t len, cap;      // Encoded deltas
+    unsigned char *deltas;
+} ti_posting_t;
+
+struct trigram_index_writer
+{
+    char *index_path;
+    char *tmp_path;
+    FILE *out;
+    uint64_t offset; // Bytes written to out so far
+
+    ti_file_entry_t *files;
+    size_t num_files, cap_files;
+    char *strings;
+    size_t strings_len, strings_cap;
+
+    // Scratch reused for every file
+    uint64_t *seen;            // Trigrams already recorded for the current block
+    uint32_t *block_trigrams;  // Distinct trigrams of the current block
+    size_t num_block_trigrams;
+    ti_posting_t *postings;    // One per distinct trigram of the current file
+    size_t num_postings, cap_postings;
+    uint32_t *slots;           // Open addressing over postings: index + 1, 0 = empty
+    unsigned slot_bits;
+};
+
+static inline unsigned char ti_fold(unsigned char c)
+{
+    return (unsigned char)(c | (((unsigned)(c - 'A') < 26u) << 5));
+}
+
+static inline uint32_t ti_slot(uint32_t trigram, unsigned bits)
+{
+    return (uint32_t)(trigram * 0x9E3779B1u) >> (32 - bits);
+}
+
+static size_t ti_varint_put(unsigned char *out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static size_t ti_varint_len(uint64_t v)
+{
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// Read a varint from [*p, end); false if it is truncated
+static bool ti_varint_get(const unsigned char **p, const unsigned char *end, uint64_t *v)
+{
+    uint64_t result = 0;
+    for (unsigned shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        unsigned char b = *(*p)++;
+        result |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ti_write(trigram_index_writer_t *w, const void *data, size_t len)
+{
+    if (len > 0 && fwrite(data, 1, len, w->out) != len)
+        return false;
+    w->offset += len;
+    return true;
+}
+
+static bool ti_grow_slots(trigram_index_writer_t *w)
+{
+    unsigned bits = w->slot_bits ? w->slot_bits + 1 : TI_MIN_SLOT_BITS;
+    uint32_t *slots = calloc((size_t)1 << bits, sizeof(uint32_t));
+    if (!slots)
+        return false;
+    uint32_t mask = (1u << bits) - 1;
+    for (size_t i = 0; i < w->num_postings; i++)
+    {
+        uint32_t s = ti_slot(w->postings[i].trigram, bits);
+        while (slots[s])
+            s = (s + 1) & mask;
+        slots[s] = (uint32_t)i + 1;
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->slot_bits = bits;
+    return true;
+}
+
+// Posting list of trigram in the current file, created on first use
+static ti_posting_t *ti_posting_get(trigram_index_writer_t *w, uint32_t trigram)
+{
+    uint32_t mask = (1u << w->slot_bits) - 1;
+    uint32_t s = ti_slot(trigram, w->slot_bits);
+    while (w->slots[s])
+    {
+        ti_posting_t *p = &w->postings[w->slots[s] - 1];
+        if (p->trigram == trigram)
+            return p;
+        s = (s + 1) & mask;
+    }
+
+    if (w->num_postings == w->cap_postings)
+    {
+        size_t cap = w->cap_postings ? w->cap_postings * 2 : 4096;
+        ti_posting_t *postings = realloc(w->postings, cap * sizeof(ti_posting_t));
+        if (!postings)
+            return NULL;
+        w->postings = postings;
+        w->cap_postings = cap;
+    }
+    ti_posting_t *p = &w->postings[w->num_postings++];
+    memset(p, 0, sizeof(*p));
+    p->trigram = trigram;
+    w->slots[s] = (uint32_t)w->num_postings;
+
+    // Keep the table at most half full
+    if (w->num_postings * 2 > ((size_t)1 << w->slot_bits) && !ti_grow_slots(w))
+        return NULL;
+    return p;
+}
+
+// Append block to the posting list of every trigram seen in it
+static bool ti_flush_block(trigram_index_writer_t *w, uint32_t block)
+{
+    bool ok = true;
+    for (size_t i = 0; i < w->num_block_trigrams; i++)
+    {
+        uint32_t t = w->block_trigrams[i];
+        w->seen[t >> 6] &= ~(1ULL << (t & 63));
+        if (!ok)
+            continue; // Still clear the remaining bits
+
+        ti_posting_t *p = ti_posting_get(w, t);
+        if (!p || (p->cap - p->len < 5 && p->cap > UINT32_MAX / 2))
+        {
+            ok = false;
+            continue;
+        }
+        if (p->cap - p->len < 5)
+        {
+            uint32_t cap = p->cap ? p->cap * 2 : 8;
+            unsigned char *deltas = realloc(p->deltas, cap);
+            if (!deltas)
+            {
+                ok = false;
+                continue;
+            }
+            p->deltas = deltas;
+            p->cap = cap;
+        }
+        p->len += (uint32_t)ti_varint_put(p->deltas + p->len, p->count ? block - p->last_block : block);
+        p->last_block = block;
+        p->count++;
+    }
+    w->num_block_trigrams = 0;
+    return ok;
+}
+
+static void ti_reset_postings(trigram_index_writer_t *w)
+{
+    for (size_t i = 0; i < w->num_postings; i++)
+        free(w->postings[i].deltas);
+    w->num_postings = 0;
+    if (w->slots)
+        memset(w->slots, 0, ((size_t)1 << w->slot_bits) * sizeof(uint32_t));
+}
+
+static int ti_compare_postings(const void *a, const void *b)
+{
+    uint32_t ta = ((const ti_posting_t *)a)->trigram;
+    uint32_t tb = ((const ti_posting_t *)b)->trigram;
+    return (ta > tb) - (ta < tb);
+}
+
+trigram_index_writer_t *trigram_index_writer_open(const char *index_path)
+{
+    trigram_index_writer_t *w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+
+    size_t path_len = strlen(index_path);
+    w->index_path = strdup(index_path);
+    w->tmp_path = malloc(path_len + 5);
+    w->seen = calloc(TI_TRIGRAM_SPACE / 64, sizeof(uint64_t));
+    w->block_trigrams = malloc(TRIGRAM_INDEX_BLOCK_SIZE * sizeof(uint32_t));
+    if (!w->index_path || !w->tmp_path || !w->seen || !w->block_trigrams || !ti_grow_slots(w))
+        goto fail;
+    memcpy(w->tmp_path, index_path, path_len);
+    memcpy(w->tmp_path + path_len, ".tmp", 5);
+
+    w->out = fopen(w->tmp_path, "wb");
+    if (!w->out)
+        goto fail;
+
+    // The header is rewritten with the final offsets on close
+    ti_header_t header = {0};
+    if (!ti_write(w, &header, sizeof(header)))
+    {
+        fclose(w->out);
+        unlink(w->tmp_path);
+        goto fail;
+    }
+    return w;
+
+fail:
+    free(w->index_path);
+    free(w->tmp_path);
+    free(w->seen);
+    free(w->block_trigrams);
+    free(w->slots);
+    free(w);
+    return NULL;
+}
+
+size_t trigram_index_writer_count(const trigram_index_writer_t *writer)
+{
+    return writer ? writer->num_files : 0;
+}
+
+bool trigram_index_writer_add(trigram_index_writer_t *w, const char *path,
+                              const char *data, size_t size, const struct stat *st)
+{
+    const size_t block_size = TRIGRAM_INDEX_BLOCK_SIZE;
+    size_t path_len = strlen(path);
+    if (!w || size / block_size >= UINT32_MAX || path_len >= UINT32_MAX)
+        return false;
+
+    uint32_t num_blocks = (uint32_t)((size + block_size - 1) / block_size);
+    uint32_t *newlines = calloc(num_blocks ? num_blocks : 1, sizeof(uint32_t));
+    if (!newlines)
+        return false;
+
+    // --- Collect the distinct trigrams of every block ---
+    bool ok = true;
+    uint32_t trigram = 0;
+    size_t run = 0; // Bytes since the last newline
+    uint32_t block = 0;
+    size_t block_end = block_size;
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size && ok; i++)
+    {
+        unsigned char c = bytes[i];
+        if (c == '\n')
+        {
+            newlines[i / block_size]++;
+            run = 0;
+            continue;
+        }
+        trigram = ((trigram << 8) | ti_fold(c)) & (TI_TRIGRAM_SPACE - 1);
+        if (++run < 3)
+            continue;
+
+        size_t start = i - 2; // Trigrams belong to the block they start in
+        if (start >= block_end)
+        {
+            ok = ti_flush_block(w, block);
+            block = (uint32_t)(start / block_size);
+            block_end = ((size_t)block + 1) * block_size;
+        }
+        uint64_t bit = 1ULL << (trigram & 63);
+        if (!(w->seen[trigram >> 6] & bit))
+        {
+            w->seen[trigram >> 6] |= bit;
+            w->block_trigrams[w->num_block_trigrams++] = trigram;
+        }
+    }
+    ok = ti_flush_block(w, block) && ok;
+
+    // --- Lay out the posting lists ---
+    if (ok && w->num_postings > 1)
+        qsort(w->postings, w->num_postings, sizeof(ti_posting_t), ti_compare_postings);
+
+    const size_t bitmap_bytes = ((size_t)num_blocks + 7) / 8;
+    uint64_t postings_size = 0;
+    for (size_t i = 0; ok && i < w->num_postings; i++)
+    {
+        const ti_posting_t *p = &w->postings[i];
+        bool bitmap = bitmap_bytes < p->len;
+        postings_size += ti_varint_len((uint64_t)p->count << 1 | bitmap) + (bitmap ? bitmap_bytes : p->len);
+    }
+    if (postings_size > UINT32_MAX)
+        ok = false; // Offsets are 32-bit; such a file is left out of the index
+
+    // --- Write this file's section: trigram table, newline counts, postings ---
+    static const unsigned char padding[8] = {0};
+    ok = ok && ti_write(w, padding, (8 - w->offset % 8) % 8);
+    uint64_t data_offset = w->offset;
+
+    uint32_t postings_offset = 0;
+    for (size_t i = 0; ok && i < w->num_postings; i++)
+    {
+        const ti_posting_t *p = &w->postings[i];
+        ti_trigram_entry_t entry = {p->trigram, postings_offset};
+        bool bitmap = bitmap_bytes < p->len;
+        postings_offset += (uint32_t)(ti_varint_len((uint64_t)p->count << 1 | bitmap) + (bitmap ? bitmap_bytes : p->len));
+        ok = ti_write(w, &entry, sizeof(entry));
+    }
+    ok = ok && ti_write(w, newlines, (size_t)num_blocks * sizeof(uint32_t));
+
+    unsigned char *bitmap_buf = bitmap_bytes ? malloc(bitmap_bytes) : NULL;
+    if (bitmap_bytes && !bitmap_buf)
+        ok = false;
+    for (size_t i = 0; ok && i < w->num_postings; i++)
+    {
+        const ti_posting_t *p = &w->postings[i];
+        bool bitmap = bitmap_bytes < p->len;
+        unsigned char header[10];
+        ok = ti_write(w, header, ti_varint_put(header, (uint64_t)p->count << 1 | bitmap));
+        if (!ok || !bitmap)
+        {
+            ok = ok && ti_write(w, p->deltas, p->len);
+            continue;
+        }
+
+        memset(bitmap_buf, 0, bitmap_bytes);
+        const unsigned char *q = p->deltas;
+        uint64_t b = 0;
+        for (uint32_t n = 0; n < p->count; n++)
+        {
+            uint64_t delta = 0;
+            ti_varint_get(&q, p->deltas + p->len, &delta);
+            b += delta;
+            bitmap_buf[b >> 3] |= (unsigned char)(1u << (b & 7));
+        }
+        ok = ti_write(w, bitmap_buf, bitmap_bytes);
+    }
+    free(bitmap_buf);
+    free(newlines);
+
+    uint32_t num_trigrams = (uint32_t)w->num_postings;
+    ti_reset_postings(w);
+    if (!ok)
+        return false;
+
+    // --- Record the file entry ---
+    if (w->num_files == w->cap_files)
+    {
+        size_t cap = w->cap_files ? w->cap_files * 2 : 64;
+        ti_file_entry_t *files = realloc(w->files, cap * sizeof(ti_file_entry_t));
+        if (!files)
+            return false;
+        w->files = files;
+        w->cap_files = cap;
+    }
+    if (w->strings_cap - w->strings_len < path_len + 1)
+    {
+        size_t cap = w->strings_cap ? w->strings_cap * 2 : 4096;
+        while (cap - w->strings_len < path_len + 1)
+            cap *= 2;
+        char *strings = realloc(w->strings, cap);
+        if (!strings)
+            return false;
+        w->strings = strings;
+        w->strings_cap = cap;
+    }
+
+    ti_file_entry_t *entry = &w->files[w->num_files++];
+    memset(entry, 0, sizeof(*entry));
+    entry->path_offset = w->strings_len;
+    entry->path_len = (uint32_t)path_len;
+    entry->size = size;
+    entry->mtime_sec = (int64_t)st->st_mtime;
+    entry->mtime_nsec = TI_MTIME_NSEC(st);
+    entry->data_offset = data_offset;
+    entry->data_size = w->offset - data_offset;
+    entry->num_trigrams = num_trigrams;
+    entry->num_blocks = num_blocks;
+    memcpy(w->strings + w->strings_len, path, path_len + 1);
+    w->strings_len += path_len + 1;
+    return true;
+}
+
+static int ti_compare_paths(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (c != 0)
+        return c;
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+// Path strings for ti_compare_entries; only used while the writer sorts its file table
+static const char *ti_sort_strings;
+
+static int ti_compare_entries(const void *a, const void *b)
+{
+    const ti_file_entry_t *fa = a, *fb = b;
+    return ti_compare_paths(ti_sort_strings + fa->path_offset, fa->path_len,
+                            ti_sort_strings + fb->path_offset, fb->path_len);
+}
+
+bool trigram_index_writer_close(trigram_index_writer_t *w, bool commit)
+{
+    if (!w)
+        return false;
+
+    bool ok = commit;
+    ti_header_t header = {0};
+    memcpy(header.magic, TI_MAGIC, sizeof(header.magic));
+    header.version = TI_VERSION;
+    header.block_size = TRIGRAM_INDEX_BLOCK_SIZE;
+    header.num_files = w->num_files;
+
+    if (ok)
+    {
+        header.string_table_offset = w->offset;
+        header.string_table_size = w->strings_len;
+        ok = ti_write(w, w->strings, w->strings_len);
+    }
+    if (ok)
+    {
+        static const unsigned char padding[8] = {0};
+        ok = ti_write(w, padding, (8 - w->offset % 8) % 8);
+        header.file_table_offset = w->offset;
+    }
+    if (ok && w->num_files > 1)
+    {
+        ti_sort_strings = w->strings;
+        qsort(w->files, w->num_files, sizeof(ti_file_entry_t), ti_compare_entries);
+        ti_sort_strings = NULL;
+    }
+    ok = ok && ti_write(w, w->files, w->num_files * sizeof(ti_file_entry_t));
+    ok = ok && fseek(w->out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, w->out) == 1;
+    ok = (fclose(w->out) == 0) && ok;
+    ok = ok && rename(w->tmp_path, w->index_path) == 0;
+    if (!ok)
+        unlink(w->tmp_path);
+
+    ti_reset_postings(w);
+    free(w->postings);
+    free(w->slots);
+    free(w->seen);
+    free(w->block_trigrams);
+    free(w->files);
+    free(w->strings);
+    free(w->index_path);
+    free(w->tmp_path);
+    free(w);
+    return ok;
+}
+
+// --- Reader ---
+
+struct trigram_index
+{
+    const unsigned char *base; // Mapped index file
+    size_t size;
+    const ti_header_t *header;
+    const ti_file_entry_t *files;
+    const char *strings;
+};
+
+trigram_index_t *trigram_index_open(const char *index_path)
+{
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(ti_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    const ti_header_t *header = base;
+    bool valid = memcmp(header->magic, TI_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->version == TI_VERSION && header->block_size > 0 &&
+                 header->string_table_offset <= size &&
+                 header->string_table_size <= size - header->string_table_offset &&
+                 header->file_table_offset <= size && header->file_table_offset % 8 == 0 &&
+                 header->num_files <= (size - header->file_table_offset) / sizeof(ti_file_entry_t);
+    trigram_index_t *index = valid ? malloc(sizeof(*index)) : NULL;
+    if (!index)
+    {
+        munmap(base, size);
+        return NULL;
+    }
+    // Lookups are random; the posting lists touched are a tiny part of the file
+    (void)madvise(base, size, MADV_RANDOM);
+
+    index->base = base;
+    index->size = size;
+    index->header = header;
+    index->files = (const ti_file_entry_t *)(index->base + header->file_table_offset);
+    index->strings = (const char *)(index->base + header->string_table_offset);
+    return index;
+}
+
+void trigram_index_close(trigram_index_t *index)
+{
+    if (!index)
+        return;
+    munmap((void *)index->base, index->size);
+    free(index);
+}
+
+static const ti_file_entry_t *ti_find_file(const trigram_index_t *index, const char *path)
+{
+    size_t path_len = strlen(path);
+    size_t lo = 0, hi = index->header->num_files;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        const ti_file_entry_t *f = &index->files[mid];
+        if (f->path_offset > index->header->string_table_size ||
+            f->path_len > index->header->string_table_size - f->path_offset)
+            return NULL; // Corrupt entry
+        int c = ti_compare_paths(index->strings + f->path_offset, f->path_len, path, path_len);
+        if (c == 0)
+            return f;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+// Decode the posting list of trigram into the bitset blocks (num_words words).
+// Returns false if the trigram never occurs in the file.
+static bool ti_load_postings(const trigram_index_t *index, const ti_file_entry_t *f, uint32_t trigram,
+                             uint64_t *blocks, size_t num_words)
+{
+    const unsigned char *data = index->base + f->data_offset;
+    const ti_trigram_entry_t *table = (const ti_trigram_entry_t *)data;
+    const unsigned char *postings = data + (size_t)f->num_trigrams * sizeof(ti_trigram_entry_t) +
+                                    (size_t)f->num_blocks * sizeof(uint32_t);
+    const unsigned char *end = data + f->data_size;
+
+    size_t lo = 0, hi = f->num_trigrams;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (table[mid].trigram < trigram)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == f->num_trigrams || table[lo].trigram != trigram)
+        return false;
+
+    memset(blocks, 0, num_words * sizeof(uint64_t));
+    const unsigned char *p = postings + table[lo].postings_offset;
+    uint64_t header = 0;
+    if (p >= end || !ti_varint_get(&p, end, &header))
+        return false;
+
+    uint64_t count = header >> 1;
+    if (header & 1)
+    {
+        size_t bitmap_bytes = ((size_t)f->num_blocks + 7) / 8;
+        if ((size_t)(end - p) < bitmap_bytes)
+            return false;
+        for (size_t j = 0; j < bitmap_bytes; j++)
+            blocks[j >> 3] |= (uint64_t)p[j] << (8 * (j & 7));
+        return true;
+    }
+
+    uint64_t b = 0;
+    for (uint64_t n = 0; n < count; n++)
+    {
+        uint64_t delta = 0;
+        if (!ti_varint_get(&p, end, &delta))
+            break;
+        b += delta;
+        if (b >= f->num_blocks)
+            break;
+        blocks[b >> 6] |= 1ULL << (b & 63);
+    }
+    return true;
+}
+
+bool trigram_index_candidates(const trigram_index_t *index, const char *path, const struct stat *st,
+                              const char *const *literals, const size_t *literal_lens, size_t num_literals,
+                              trigram_candidates_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!index || num_literals == 0)
+        return false;
+    for (size_t i = 0; i < num_literals; i++)
+    {
+        if (literal_lens[i] < 3)
+            return false; // No trigram to look up: any block can match
+    }
+
+    const ti_file_entry_t *f = ti_find_file(index, path);
+    if (!f || f->size != (uint64_t)st->st_size || f->mtime_sec != (int64_t)st->st_mtime ||
+        f->mtime_nsec != TI_MTIME_NSEC(st))
+        return false; // Not indexed, or changed since the index was built
+    if (f->data_offset > index->size || f->data_size > index->size - f->data_offset ||
+        f->data_offset % 8 != 0 ||
+        (uint64_t)f->num_trigrams * sizeof(ti_trigram_entry_t) + (uint64_t)f->num_blocks * sizeof(uint32_t) > f->data_size)
+        return false;
+
+    const size_t block_size = index->header->block_size;
+    size_t num_words = ((size_t)f->num_blocks + 63) / 64;
+    uint64_t *candidates = calloc(num_words ? num_words : 1, sizeof(uint64_t));
+    uint64_t *acc = malloc((num_words ? num_words : 1) * sizeof(uint64_t));
+    uint64_t *blocks = malloc((num_words ? num_words : 1) * sizeof(uint64_t));
+    if (!candidates || !acc || !blocks)
+    {
+        free(candidates);
+        free(acc);
+        free(blocks);
+        return false;
+    }
+    uint64_t last_mask = (f->num_blocks % 64) ? (1ULL << (f->num_blocks % 64)) - 1 : ~0ULL;
+
+    for (size_t i = 0; i < num_literals && num_words > 0; i++)
+    {
+        const unsigned char *lit = (const unsigned char *)literals[i];
+        memset(acc, 0xFF, num_words * sizeof(uint64_t));
+        acc[num_words - 1] &= last_mask;
+
+        bool any = true;
+        // Only trigrams within a block of the match start: those start in block b or b + 1
+        for (size_t k = 0; k + 3 <= literal_lens[i] && k < block_size && any; k++)
+        {
+            if (lit[k] == '\n' || lit[k + 1] == '\n' || lit[k + 2] == '\n')
+                continue; // Never indexed
+            uint32_t trigram = (uint32_t)ti_fold(lit[k]) << 16 | (uint32_t)ti_fold(lit[k + 1]) << 8 | ti_fold(lit[k + 2]);
+            if (!ti_load_postings(index, f, trigram, blocks, num_words))
+            {
+                any = false;
+                break;
+            }
+            // Block b qualifies if the trigram starts in b or b + 1
+            any = false;
+            for (size_t w = 0; w < num_words; w++)
+            {
+                uint64_t next = (w + 1 < num_words) ? blocks[w + 1] << 63 : 0;
+                acc[w] &= blocks[w] | (blocks[w] >> 1) | next;
+                any |= acc[w] != 0;
+            }
+        }
+        if (!any)
+            continue;
+        for (size_t w = 0; w < num_words; w++)
+            candidates[w] |= acc[w];
+    }
+    free(acc);
+    free(blocks);
+
+    uint32_t num_candidates = 0;
+    for (size_t w = 0; w < num_words; w++)
+        num_candidates += (uint32_t)__builtin_popcountll(candidates[w]);
+
+    out->block_size = block_size;
+    out->num_blocks = f->num_blocks;
+    out->num_candidates = num_candidates;
+    out->candidates = candidates;
+    out->block_newlines = (const uint32_t *)(index->base + f->data_offset +
+                                             (size_t)f->num_trigrams * sizeof(ti_trigram_entry_t));
+    return true;
+}
+
+void trigram_candidates_free(trigram_candidates_t *candidates)
+{
+    if (!candidates)
+        return;
+    free(candidates->candidates);
+    candidates->candidates = NULL;
+}
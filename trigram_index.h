@@ -0,0 +1,70 @@
+/**
+ * Persistent trigram index over a directory of files.
+ * This header declares the index writer, the mmapped reader and the block candidate query.
+ */
+
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Name of the index file that --index-build writes into the indexed directory
+#define TRIGRAM_INDEX_FILENAME ".krep-index"
+
+// Files are indexed in blocks of this many bytes; a query selects whole blocks
+#define TRIGRAM_INDEX_BLOCK_SIZE (64 * 1024)
+
+// Forward declarations for the opaque writer and reader
+struct trigram_index_writer;
+typedef struct trigram_index_writer trigram_index_writer_t;
+struct trigram_index;
+typedef struct trigram_index trigram_index_t;
+
+// Blocks of one indexed file that may hold a match, from trigram_index_candidates
+typedef struct
+{
+   size_t block_size;              // Bytes per block (the last block may be shorter)
+   uint32_t num_blocks;            // Blocks in the file
+   uint32_t num_candidates;        // Set bits in candidates
+   uint64_t *candidates;           // Bitset: block b may hold the start of a match
+   const uint32_t *block_newlines; // Newlines in each block (points into the index)
+} trigram_candidates_t;
+
+// Start a new index at index_path. Data goes to a temporary file that replaces
+// index_path only when trigram_index_writer_close succeeds. Returns NULL on error.
+trigram_index_writer_t *trigram_index_writer_open(const char *index_path);
+
+// Index one file. path is stored as given (callers pass a realpath) together with the
+// size and mtime of st, which later lookups compare against the file on disk.
+bool trigram_index_writer_add(trigram_index_writer_t *writer, const char *path,
+                              const char *data, size_t size, const struct stat *st);
+
+// Write the file table and move the index into place. Frees the writer; with
+// commit false (or on any error) the temporary file is removed instead.
+bool trigram_index_writer_close(trigram_index_writer_t *writer, bool commit);
+
+// Number of files added so far
+size_t trigram_index_writer_count(const trigram_index_writer_t *writer);
+
+// Map an index built by the writer. Returns NULL if it is missing or malformed.
+trigram_index_t *trigram_index_open(const char *index_path);
+
+// Unmap the index
+void trigram_index_close(trigram_index_t *index);
+
+// Blocks of the file at path (a realpath) that can contain one of the literals.
+// A match of literal i starting in block b has every trigram of that literal start in
+// block b or b + 1. Trigrams are ASCII case-folded, so the answer holds for -i too.
+// Returns false when the file is not in the index, its size or mtime no longer match
+// st, or a literal is shorter than a trigram; the caller then searches the whole file.
+// On success out->candidates is malloc'd and released with trigram_candidates_free.
+bool trigram_index_candidates(const trigram_index_t *index, const char *path, const struct stat *st,
+                              const char *const *literals, const size_t *literal_lens, size_t num_literals,
+                              trigram_candidates_t *out);
+
+void trigram_candidates_free(trigram_candidates_t *candidates);
+
+#endif // TRIGRAM_INDEX_H